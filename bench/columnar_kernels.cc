@@ -0,0 +1,99 @@
+// Benchmarks the columnar aggregation kernels against the per-entry callback loop they replace.
+//
+// Usage: make && ./build/columnar_kernels [number_of_values] [repetitions]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "src/columnar_kernels.h"
+
+using ::TailProduce::Span;
+using ::TailProduce::ColumnarKernels::InstructionSet;
+
+namespace K = ::TailProduce::ColumnarKernels;
+
+static const char* InstructionSetName(InstructionSet set) {
+    return set == InstructionSet::AVX2 ? "AVX2" : (set == InstructionSet::SSE ? "SSE4.1" : "Reference");
+}
+
+// Runs `f` `repetitions` times and prints the throughput. The checksum keeps the computation observable.
+template <typename F> void Measure(const char* name, size_t values, size_t repetitions, F f) {
+    uint64_t checksum = 0;
+    const auto begin = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < repetitions; ++i) {
+        checksum += f();
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - begin).count();
+    const double total = static_cast<double>(values) * repetitions;
+    printf("%-32s %8.3f ns/value %10.1f Mvalues/s %8.2f GB/s  [checksum %llu]\n",
+           name,
+           seconds * 1e9 / total,
+           total / seconds * 1e-6,
+           total * sizeof(uint32_t) / seconds * 1e-9,
+           static_cast<unsigned long long>(checksum));
+}
+
+int main(int argc, char** argv) {
+    const size_t values = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (1 << 24);
+    const size_t repetitions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10;
+
+    std::mt19937 random(42);
+    std::vector<uint32_t> data(values);
+    for (auto& x : data) {
+        x = random();
+    }
+    const Span<uint32_t> column(data);
+
+    printf("%zu values, %zu repetitions, best supported instruction set: %s.\n",
+           values,
+           repetitions,
+           InstructionSetName(K::BestSupportedInstructionSet()));
+
+    // The baseline: what a per-entry processor does, one callback per value.
+    uint64_t callback_sum = 0;
+    std::function<void(uint32_t)> callback = [&callback_sum](uint32_t x) { callback_sum += x; };
+    Measure("sum, per-entry callback", values, repetitions, [&]() {
+        callback_sum = 0;
+        for (uint32_t x : data) {
+            callback(x);
+        }
+        return callback_sum;
+    });
+
+    std::vector<InstructionSet> sets{InstructionSet::Reference};
+    if (K::BestSupportedInstructionSet() != InstructionSet::Reference) {
+        sets.push_back(InstructionSet::SSE);
+    }
+    if (K::BestSupportedInstructionSet() == InstructionSet::AVX2) {
+        sets.push_back(InstructionSet::AVX2);
+    }
+
+    char name[64];
+    for (InstructionSet set : sets) {
+        snprintf(name, sizeof(name), "sum, %s", InstructionSetName(set));
+        Measure(name, values, repetitions, [&]() { return K::Sum(column, set); });
+    }
+    for (InstructionSet set : sets) {
+        snprintf(name, sizeof(name), "min/max, %s", InstructionSetName(set));
+        Measure(name, values, repetitions, [&]() {
+            const K::MinMax result = K::MinMaxOf(column, set);
+            return static_cast<uint64_t>(result.min) + result.max;
+        });
+    }
+    std::vector<uint64_t> histogram(256);
+    for (InstructionSet set : sets) {
+        snprintf(name, sizeof(name), "histogram/256, %s", InstructionSetName(set));
+        Measure(name, values, repetitions, [&]() {
+            std::fill(histogram.begin(), histogram.end(), 0);
+            K::Histogram(column, 24, histogram, set);
+            return histogram[0];
+        });
+    }
+
+    return 0;
+}
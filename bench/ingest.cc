@@ -0,0 +1,194 @@
+// Benchmarks the bulk HTTP ingestion over loopback, see src/stream_ingester.h, against publishing in-process.
+// Each run publishes into a fresh LevelDB storage under /tmp.
+//
+// Usage: make && ./build/ingest [entries] [entries_per_request] [payload_bytes] [port]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "src/tailproduce.h"
+#include "src/storage_leveldb.h"
+
+struct BenchEntry : ::TailProduce::CerealJSONSerializable<BenchEntry> {
+    BenchEntry() = default;
+    BenchEntry(uint32_t key, const std::string& data) : key(key), data(data) {
+    }
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+    uint32_t key;
+    std::string data;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(data));
+    }
+};
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(IngestFramework, ::TailProduce::StreamManager<::TailProduce::StorageLevelDB>);
+TAILPRODUCE_STREAM(bench, BenchEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(bench);
+TAILPRODUCE_INGEST_STREAM(bench);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+struct Options {
+    size_t entries;
+    size_t entries_per_request;
+    size_t payload_bytes;
+    size_t port;
+};
+
+static std::string FreshStoragePath() {
+    static int index = 0;
+    return "/tmp/tailproduce-bench-ingest-" +
+           std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + '-' +
+           std::to_string(++index) + '/';
+}
+
+static void Report(const char* name, const Options& options, double seconds, size_t request_bytes) {
+    printf("%-32s %10.0f entries/s %8.1f ns/entry",
+           name,
+           options.entries / seconds,
+           seconds * 1e9 / options.entries);
+    if (request_bytes) {
+        printf(" %8.1f MB/s %8.3f ms/request",
+               request_bytes / seconds * 1e-6,
+               seconds * 1e3 * options.entries_per_request / options.entries);
+    }
+    printf("\n");
+}
+
+// Runs `f(framework)` against a fresh framework and returns how long it took, in seconds.
+template <typename F> double Run(const Options& options, F f) {
+    ::TailProduce::StorageLevelDB storage(FreshStoragePath());
+    IngestFramework framework(storage,
+                              ::TailProduce::StreamManagerParams()
+                                  .CreateStream("bench", uint32_t(0), uint32_t(0))
+                                  .SetHTTPPort(options.port));
+    framework.bench_ingester.SetMaxBatchEntries(options.entries_per_request);
+    const auto begin = std::chrono::steady_clock::now();
+    f(framework);
+    const auto end = std::chrono::steady_clock::now();
+    if (framework.bench_publisher.GetHead() != options.entries) {
+        fprintf(stderr, "Expected the HEAD at %zu, got %u.\n", options.entries, framework.bench_publisher.GetHead());
+        exit(1);
+    }
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Builds the request bodies of `entries_per_request` entries each, in the format of the ingester.
+static std::vector<std::string> RequestBodies(const Options& options, bool binary) {
+    std::vector<std::string> bodies;
+    const std::string payload(options.payload_bytes, 'x');
+    std::ostringstream os;
+    for (size_t i = 1; i <= options.entries; ++i) {
+        if (bodies.empty() || (i - 1) % options.entries_per_request == 0) {
+            bodies.emplace_back();
+        }
+        std::string& body = bodies.back();
+        if (binary) {
+            const std::string key = ::TailProduce::FixedSizeSerialization::PackToString(uint32_t(i)) +
+                                    ::TailProduce::FixedSizeSerialization::PackToString(uint32_t(0));
+            os.str("");
+            BenchEntry::SerializeEntry(os, BenchEntry(i, payload));
+            const std::string value = os.str();
+            ::TailProduce::StreamExporterInternal::AppendBigEndianUInt32(body, key.length());
+            body += key;
+            ::TailProduce::StreamExporterInternal::AppendBigEndianUInt32(body, value.length());
+            body += value;
+        } else {
+            body += "{\"key\":" + std::to_string(i) + ",\"entry\":{\"data\":\"" + payload + "\"}}\n";
+        }
+    }
+    return bodies;
+}
+
+// POST-s the bodies one after another over a single keep-alive connection.
+static void PostAll(const Options& options, const std::vector<std::string>& bodies, const std::string& target) {
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket socket(io_service);
+    socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"),
+                                                  options.port));
+    boost::asio::streambuf buffer;
+    for (const std::string& body : bodies) {
+        const std::string head = "POST " + target + " HTTP/1.1\r\nContent-Length: " + std::to_string(body.length()) +
+                                 "\r\nConnection: keep-alive\r\n\r\n";
+        boost::asio::write(socket, boost::asio::buffer(head), boost::asio::transfer_all());
+        boost::asio::write(socket, boost::asio::buffer(body), boost::asio::transfer_all());
+        const size_t head_size = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+        const std::string response(boost::asio::buffer_cast<const char*>(buffer.data()), head_size);
+        buffer.consume(head_size);
+        if (response.find("HTTP/1.1 200 ") != 0) {
+            fprintf(stderr, "Unexpected response:\n%s\n", response.c_str());
+            exit(1);
+        }
+        const size_t length = std::stoul(response.substr(response.find("Content-Length: ") + 16));
+        if (buffer.size() < length) {
+            boost::asio::read(socket, buffer, boost::asio::transfer_exactly(length - buffer.size()));
+        }
+        buffer.consume(length);
+    }
+}
+
+static size_t TotalSize(const std::vector<std::string>& bodies) {
+    size_t total = 0;
+    for (const std::string& body : bodies) {
+        total += body.length();
+    }
+    return total;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    options.entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    options.entries_per_request = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+    options.payload_bytes = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100;
+    options.port = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 8080;
+    if (!options.entries || !options.entries_per_request) {
+        fprintf(stderr, "Usage: %s [entries] [entries_per_request] [payload_bytes] [port]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%zu entries of %zu bytes, %zu entries per request or batch, port %zu.\n",
+           options.entries,
+           options.payload_bytes,
+           options.entries_per_request,
+           options.port);
+
+    const std::string payload(options.payload_bytes, 'x');
+    Report("Publisher::Push, in-process", options, Run(options, [&](IngestFramework& framework) {
+        for (size_t i = 1; i <= options.entries; ++i) {
+            framework.bench_publisher.Push(BenchEntry(i, payload));
+        }
+    }), 0);
+
+    std::vector<BenchEntry> batch;
+    Report("Publisher::PushMany, in-process", options, Run(options, [&](IngestFramework& framework) {
+        for (size_t i = 1; i <= options.entries; ++i) {
+            batch.emplace_back(i, payload);
+            if (batch.size() == options.entries_per_request || i == options.entries) {
+                framework.bench_publisher.PushMany(batch.begin(), batch.end());
+                batch.clear();
+            }
+        }
+    }), 0);
+
+    const std::vector<std::string> json = RequestBodies(options, false);
+    Report("HTTP POST, json", options, Run(options, [&](IngestFramework&) {
+        PostAll(options, json, "/bench/ingest");
+    }), TotalSize(json));
+
+    const std::vector<std::string> binary = RequestBodies(options, true);
+    Report("HTTP POST, binary", options, Run(options, [&](IngestFramework&) {
+        PostAll(options, binary, "/bench/ingest?format=binary");
+    }), TotalSize(binary));
+
+    return 0;
+}
@@ -0,0 +1,483 @@
+// Generates synthetic load on a framework, to size the hardware for the production one.
+//
+// Publishes into the chosen streams, at a target rate or flat out, for a number of seconds, with listeners and
+// exporters attached to each stream. Reports the sustained publishing throughput, how far the listeners fall behind
+// the publishers, the publish-to-process latency percentiles of each listener, see src/latency.h, and the bytes
+// received by the exporters. The streams:
+//   flat   Entries with a payload of --payload_bytes, give or take up to --payload_jitter_bytes.
+//   mixed  A polymorphic stream: --large_fraction of its entries are LargeEntry-s with a payload of
+//          --large_payload_bytes, the others are SmallEntry-s of a few numbers.
+//
+// Runs fully offline. The exporters are HTTP clients following the streams, as served by TAILPRODUCE_EXPORT_STREAM,
+// over a Unix domain socket in the abstract namespace; no TCP port is opened. The storage is either the in-memory
+// one of the tests, for one stream at a time since it takes no locks of its own, or LevelDB, in a fresh directory
+// under /tmp unless --leveldb_path is given. The stats of the framework are on, see src/stats.h, as they are
+// where the bytes published are counted.
+//
+// Usage: make build/load_generator &&
+//        ./build/load_generator --storage=leveldb --streams=flat,mixed --rate=50000 --listeners=2 --exporters=1
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/iterator/indirect_iterator.hpp>
+
+#include <gflags/gflags.h>
+
+#include "src/tailproduce.h"
+#include "src/storage_leveldb.h"
+
+#include "cereal/archives/binary.hpp"
+#include "cereal/types/polymorphic.hpp"
+#include "cereal/types/string.hpp"
+
+#include "test/cpp/helpers/storage_inmemory.h"
+
+DEFINE_string(storage, "memory", "The storage: `memory`, the in-memory one of the tests, or `leveldb`.");
+DEFINE_string(leveldb_path, "", "The LevelDB directory. Defaults to a fresh one under /tmp.");
+DEFINE_string(streams, "flat", "The streams to publish into, comma-separated: `flat` and/or `mixed`.");
+DEFINE_uint64(payload_bytes, 100, "The payload of the entries of the `flat` stream.");
+DEFINE_uint64(payload_jitter_bytes, 0, "How much the payload of the `flat` entries varies, either way.");
+DEFINE_double(large_fraction, 0.1, "The fraction of the entries of the `mixed` stream that are LargeEntry-s.");
+DEFINE_uint64(large_payload_bytes, 4096, "The payload of the LargeEntry-s of the `mixed` stream.");
+DEFINE_uint64(rate, 0, "The entries per second to publish into each stream. Zero for as fast as possible.");
+DEFINE_uint64(batch, 1, "The entries to publish at once. Greater than one publishes them with PushMany().");
+DEFINE_double(seconds, 10, "For how long to publish.");
+DEFINE_int32(listeners, 1, "The AsyncListener-s on each stream.");
+DEFINE_int32(exporters, 0, "The HTTP clients following each stream.");
+DEFINE_string(export_format, "json", "The format the exporters request: `json`, `tsv` or `binary`.");
+DEFINE_double(report_every_seconds, 1, "How often to report the progress. Zero for the summary only.");
+
+struct FlatEntry : ::TailProduce::CerealBinarySerializable<FlatEntry> {
+    FlatEntry() = default;
+    FlatEntry(uint64_t key, std::string payload) : key(key), payload(std::move(payload)) {
+    }
+    void SetOrderKey(uint64_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint64_t& output) const {
+        output = key;
+    }
+    uint64_t key;
+    std::string payload;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(payload));
+    }
+};
+
+struct SmallEntry;
+struct LargeEntry;
+struct MixedEntry : ::TailProduce::PolymorphicCerealBinarySerializable<MixedEntry, SmallEntry, LargeEntry> {
+    MixedEntry() = default;
+    virtual ~MixedEntry() {
+    }
+    explicit MixedEntry(uint64_t key) : key(key) {
+    }
+    void SetOrderKey(uint64_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint64_t& output) const {
+        output = key;
+    }
+    uint64_t key;
+
+  protected:
+    friend class cereal::access;
+    template <class A> void serialize(A&) {
+    }
+};
+
+struct SmallEntry : MixedEntry {
+    SmallEntry() = default;
+    SmallEntry(uint64_t key, uint32_t user, uint32_t item, double value)
+        : MixedEntry(key), user(user), item(item), value(value) {
+    }
+    uint32_t user;
+    uint32_t item;
+    double value;
+
+  private:
+    friend class cereal::access;
+    template <class A> void serialize(A& ar) {
+        MixedEntry::serialize(ar);
+        ar(CEREAL_NVP(user), CEREAL_NVP(item), CEREAL_NVP(value));
+    }
+};
+
+struct LargeEntry : MixedEntry {
+    LargeEntry() = default;
+    LargeEntry(uint64_t key, std::string payload) : MixedEntry(key), payload(std::move(payload)) {
+    }
+    std::string payload;
+
+  private:
+    friend class cereal::access;
+    template <class A> void serialize(A& ar) {
+        MixedEntry::serialize(ar);
+        ar(CEREAL_NVP(payload));
+    }
+};
+
+CEREAL_REGISTER_TYPE(MixedEntry);
+CEREAL_REGISTER_TYPE(SmallEntry);
+CEREAL_REGISTER_TYPE(LargeEntry);
+
+template <typename STORAGE> struct Load {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(Framework, ::TailProduce::StreamManager<STORAGE>);
+    TAILPRODUCE_STREAM(flat, FlatEntry, uint64_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(flat);
+    TAILPRODUCE_EXPORT_STREAM(flat);
+    TAILPRODUCE_STREAM(mixed, MixedEntry, uint64_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(mixed);
+    TAILPRODUCE_EXPORT_STREAM(mixed);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+};
+
+// The entries of the streams, by their primary keys.
+struct FlatEntries {
+    std::mt19937_64 random;
+    std::unique_ptr<FlatEntry> operator()(uint64_t key) {
+        size_t length = FLAGS_payload_bytes;
+        if (FLAGS_payload_jitter_bytes) {
+            length += random() % (2 * FLAGS_payload_jitter_bytes + 1);
+            length = length > FLAGS_payload_jitter_bytes ? length - FLAGS_payload_jitter_bytes : 0;
+        }
+        return std::unique_ptr<FlatEntry>(new FlatEntry(key, std::string(length, 'x')));
+    }
+};
+
+struct MixedEntries {
+    std::mt19937_64 random;
+    std::unique_ptr<MixedEntry> operator()(uint64_t key) {
+        if (std::uniform_real_distribution<double>()(random) < FLAGS_large_fraction) {
+            return std::unique_ptr<MixedEntry>(new LargeEntry(key, std::string(FLAGS_large_payload_bytes, 'x')));
+        } else {
+            return std::unique_ptr<MixedEntry>(new SmallEntry(key, random() % 1000000, random() % 1000, 0.5));
+        }
+    }
+};
+
+// Counts the entries for the main thread to see how far behind the publisher the listener is.
+struct CountingProcessor {
+    std::atomic<uint64_t> entries{0};
+    template <typename ENTRY> void operator()(const ENTRY&) {
+        entries.store(entries.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// Follows the export of a stream over the Unix domain socket of the framework, counting the bytes received,
+// until the framework, and its exporters, are gone.
+struct ExporterClient {
+    ExporterClient(const std::string& socket_path, const std::string& target)
+        : thread(&ExporterClient::Run, this, socket_path, target) {
+    }
+    void Run(const std::string& socket_path, const std::string& target) {
+        boost::asio::io_service io_service;
+        boost::asio::local::stream_protocol::socket socket(io_service);
+        boost::system::error_code ec;
+        socket.connect(boost::asio::local::stream_protocol::endpoint('\0' + socket_path.substr(1)), ec);
+        if (!ec) {
+            const std::string request = "GET " + target + " HTTP/1.1\r\n\r\n";
+            boost::asio::write(socket, boost::asio::buffer(request), boost::asio::transfer_all(), ec);
+        }
+        std::array<char, 64 * 1024> buffer;
+        while (!ec) {
+            bytes += socket.read_some(boost::asio::buffer(buffer), ec);
+        }
+    }
+    std::atomic<uint64_t> bytes{0};
+    std::thread thread;
+};
+
+// The load on one stream, and what is measured of it.
+struct StreamLoad {
+    explicit StreamLoad(const std::string& name) : name(name) {
+    }
+    const std::string name;
+    std::thread publisher;
+    std::atomic<uint64_t> published{0};
+    std::function<uint64_t()> bytes_published;
+    std::vector<std::unique_ptr<CountingProcessor>> processors;
+    // The listeners, type-erased, and their latency histograms, owned by the listeners.
+    std::vector<std::shared_ptr<void>> listeners;
+    std::vector<std::pair<std::string, const ::TailProduce::LatencyHistogram*>> latencies;
+    std::vector<std::unique_ptr<ExporterClient>> exporters;
+    uint64_t max_lag = 0;
+
+    uint64_t Lag() const {
+        uint64_t lag = 0;
+        const uint64_t head = published.load(std::memory_order_acquire);
+        for (const auto& processor : processors) {
+            lag = std::max(lag, head - std::min(head, processor->entries.load(std::memory_order_acquire)));
+        }
+        return lag;
+    }
+    uint64_t ExportedBytes() const {
+        uint64_t total = 0;
+        for (const auto& exporter : exporters) {
+            total += exporter->bytes;
+        }
+        return total;
+    }
+};
+
+// Publishes the entries made by `make_entry` from keys 1, 2, ... until `deadline`, pacing them to --rate if set.
+template <typename PUBLISHER, typename MAKE_ENTRY>
+void Publish(StreamLoad& load,
+             PUBLISHER& publisher,
+             MAKE_ENTRY make_entry,
+             std::chrono::steady_clock::time_point deadline) {
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<decltype(make_entry(0))> batch;
+    uint64_t key = 0;
+    while (true) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return;
+        }
+        uint64_t entries = FLAGS_batch;
+        if (FLAGS_rate) {
+            const uint64_t due = FLAGS_rate * std::chrono::duration<double>(now - begin).count();
+            if (due <= key) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            entries = std::min(entries, due - key);
+        }
+        batch.clear();
+        for (uint64_t i = 0; i < entries; ++i) {
+            batch.push_back(make_entry(++key));
+        }
+        if (batch.size() == 1) {
+            publisher.Push(*batch.front());
+        } else {
+            publisher.PushMany(boost::make_indirect_iterator(batch.begin()),
+                               boost::make_indirect_iterator(batch.end()));
+        }
+        load.published.store(key, std::memory_order_release);
+    }
+}
+
+// Attaches the listeners and the exporters to the stream and starts publishing into it.
+template <typename STREAM, typename PUBLISHER, typename MAKE_ENTRY>
+void StartLoad(StreamLoad& load,
+               STREAM& stream,
+               PUBLISHER& publisher,
+               ::TailProduce::AsyncListenersFactory<STREAM>& new_listener,
+               MAKE_ENTRY make_entry,
+               const std::string& socket_path,
+               std::chrono::steady_clock::time_point deadline) {
+    for (int i = 0; i < FLAGS_listeners; ++i) {
+        load.processors.emplace_back(new CountingProcessor());
+        auto listener = new_listener(*load.processors.back());
+        load.latencies.emplace_back(listener->LatencyHistogramName(), listener->Latency());
+        load.listeners.emplace_back(std::move(listener));
+    }
+    for (int i = 0; i < FLAGS_exporters; ++i) {
+        const std::string target = "/" + load.name + "?format=" + FLAGS_export_format;
+        load.exporters.emplace_back(new ExporterClient(socket_path, target));
+    }
+    load.bytes_published = [&stream]() { return stream.publish_stats_.BytesPublished(); };
+    load.publisher = std::thread([&load, &publisher, make_entry, deadline]() {
+        Publish(load, publisher, make_entry, deadline);
+    });
+}
+
+static std::vector<std::string> SplitByComma(const std::string& s) {
+    std::vector<std::string> result;
+    std::istringstream is(s);
+    std::string item;
+    while (std::getline(is, item, ',')) {
+        if (!item.empty()) {
+            result.push_back(item);
+        }
+    }
+    return result;
+}
+
+static std::string Microseconds(uint64_t nanoseconds) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.1fus", nanoseconds * 1e-3);
+    return buffer;
+}
+
+template <typename STORAGE> int Run(STORAGE& storage, const std::vector<std::string>& streams) {
+    typedef typename Load<STORAGE>::Framework T_FRAMEWORK;
+    const std::string socket_path = "@tailproduce-load-generator-" + std::to_string(getpid());
+    std::vector<std::unique_ptr<StreamLoad>> loads;
+    {
+        T_FRAMEWORK framework(storage,
+                              ::TailProduce::StreamManagerParams()
+                                  .CreateStream("flat", uint64_t(0), uint32_t(0))
+                                  .CreateStream("mixed", uint64_t(0), uint32_t(0))
+                                  .SetHTTPPort(0)
+                                  .SetHTTPUnixSocket(socket_path)
+                                  .SetLatencyTracking()
+                                  .SetStats());
+        const auto begin = std::chrono::steady_clock::now();
+        const auto deadline =
+            begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(FLAGS_seconds));
+        for (const std::string& name : streams) {
+            loads.emplace_back(new StreamLoad(name));
+            if (name == "flat") {
+                StartLoad(*loads.back(),
+                          framework.flat,
+                          framework.flat_publisher,
+                          framework.new_scoped_flat_listener,
+                          FlatEntries(),
+                          socket_path,
+                          deadline);
+            } else {
+                StartLoad(*loads.back(),
+                          framework.mixed,
+                          framework.mixed_publisher,
+                          framework.new_scoped_mixed_listener,
+                          MixedEntries(),
+                          socket_path,
+                          deadline);
+            }
+        }
+
+        // Samples the lag every millisecond, and reports the progress every --report_every_seconds.
+        const auto report_every = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(FLAGS_report_every_seconds));
+        auto next_report = begin + report_every;
+        std::vector<uint64_t> published_at_last_report(loads.size());
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            for (auto& load : loads) {
+                load->max_lag = std::max(load->max_lag, load->Lag());
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (FLAGS_report_every_seconds > 0 && now >= next_report) {
+                const double seconds = std::chrono::duration<double>(now - begin).count();
+                for (size_t i = 0; i < loads.size(); ++i) {
+                    const uint64_t published = loads[i]->published;
+                    printf("%6.1fs %-6s %10llu entries published, %10.0f entries/s, listeners %llu entries behind\n",
+                           seconds,
+                           loads[i]->name.c_str(),
+                           static_cast<unsigned long long>(published),
+                           (published - published_at_last_report[i]) / FLAGS_report_every_seconds,
+                           static_cast<unsigned long long>(loads[i]->Lag()));
+                    published_at_last_report[i] = published;
+                }
+                next_report += report_every;
+            }
+        }
+        for (auto& load : loads) {
+            load->publisher.join();
+        }
+        const double publish_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        // Lets the listeners catch up, for the latency percentiles to cover all the entries.
+        const auto drain_begin = std::chrono::steady_clock::now();
+        while (std::any_of(loads.begin(), loads.end(), [](const std::unique_ptr<StreamLoad>& load) {
+            return load->Lag() > 0;
+        })) {
+            if (std::chrono::steady_clock::now() - drain_begin > std::chrono::seconds(60)) {
+                fprintf(stderr, "The listeners have not caught up in 60 seconds.\n");
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const double drain_seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - drain_begin).count();
+
+        printf("\nStorage %s, %.1f seconds, %s, batches of %llu, %d listener(s) and %d exporter(s) per stream.\n",
+               FLAGS_storage.c_str(),
+               publish_seconds,
+               FLAGS_rate ? ("at most " + std::to_string(FLAGS_rate) + " entries/s").c_str() : "flat out",
+               static_cast<unsigned long long>(FLAGS_batch),
+               FLAGS_listeners,
+               FLAGS_exporters);
+        for (const auto& load : loads) {
+            const uint64_t published = load->published;
+            const uint64_t bytes = load->bytes_published();
+            printf("%-6s %10llu entries, %10.0f entries/s, %8.1f MB/s, %6.0f bytes/entry; "
+                   "listeners up to %llu entries behind, caught up %.3fs after the publisher stopped\n",
+                   load->name.c_str(),
+                   static_cast<unsigned long long>(published),
+                   published / publish_seconds,
+                   bytes / publish_seconds * 1e-6,
+                   published ? static_cast<double>(bytes) / published : 0.0,
+                   static_cast<unsigned long long>(load->max_lag),
+                   drain_seconds);
+            for (const auto& latency : load->latencies) {
+                const ::TailProduce::LatencyHistogram& h = *latency.second;
+                printf("  %-12s latency p50 %10s  p99 %10s  p99.9 %10s  max %10s  (%llu entries unmatched)\n",
+                       latency.first.c_str(),
+                       Microseconds(h.Percentile(0.5)).c_str(),
+                       Microseconds(h.Percentile(0.99)).c_str(),
+                       Microseconds(h.Percentile(0.999)).c_str(),
+                       Microseconds(h.Max()).c_str(),
+                       static_cast<unsigned long long>(h.Unmatched()));
+            }
+            if (!load->exporters.empty()) {
+                printf("  exporters    %.1f MB/s received in total\n",
+                       load->ExportedBytes() / (publish_seconds + drain_seconds) * 1e-6);
+            }
+            load->listeners.clear();
+        }
+    }
+    // The exporters end their responses as the framework goes away.
+    for (auto& load : loads) {
+        for (auto& exporter : load->exporters) {
+            exporter->thread.join();
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    const std::vector<std::string> streams = SplitByComma(FLAGS_streams);
+    for (const std::string& name : streams) {
+        if (name != "flat" && name != "mixed") {
+            fprintf(stderr, "Unknown stream `%s`, the streams are `flat` and `mixed`.\n", name.c_str());
+            return 1;
+        }
+        if (std::count(streams.begin(), streams.end(), name) > 1) {
+            fprintf(stderr, "The stream `%s` is given more than once.\n", name.c_str());
+            return 1;
+        }
+    }
+    if (streams.empty() || FLAGS_seconds <= 0 || !FLAGS_batch || FLAGS_listeners < 0 || FLAGS_exporters < 0) {
+        fprintf(stderr, "Nothing to do, see --help.\n");
+        return 1;
+    }
+    if (FLAGS_storage == "memory") {
+        if (streams.size() > 1) {
+            fprintf(stderr, "The in-memory storage takes one stream at a time, use --storage=leveldb.\n");
+            return 1;
+        }
+        InMemoryTestStorage storage;
+        return Run(storage, streams);
+    } else if (FLAGS_storage == "leveldb") {
+        const std::string path =
+            !FLAGS_leveldb_path.empty()
+                ? FLAGS_leveldb_path
+                : "/tmp/tailproduce-load-generator-" +
+                      std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + '/';
+        ::TailProduce::StorageLevelDB storage(path);
+        printf("LevelDB at %s\n", path.c_str());
+        return Run(storage, streams);
+    } else {
+        fprintf(stderr, "Unknown storage `%s`, the storages are `memory` and `leveldb`.\n", FLAGS_storage.c_str());
+        return 1;
+    }
+}
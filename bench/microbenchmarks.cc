@@ -0,0 +1,341 @@
+// Microbenchmarks of the hot paths: publishing, replaying through INTERNAL_UnsafeListener, composing and parsing the
+// storage keys, FixedSizeSerializer and the Cereal serialization policies. The publishing and replaying ones are run
+// on both the in-memory storage of the tests and StorageLevelDB, the latter in a fresh directory under /tmp.
+//
+// Reports ops/s, ns/op and allocations/op for each, and writes the same numbers as JSON, for the runs to be diffed.
+// The allocations are the ones made by the benchmarking thread, the background threads of LevelDB are not counted.
+//
+// Usage: make bench, or make && ./build/microbenchmarks [iterations] [json_output_file]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/tailproduce.h"
+#include "src/storage_leveldb.h"
+
+#include "cereal/types/string.hpp"
+
+#include "test/cpp/helpers/storage_inmemory.h"
+
+// Per-thread, for the numbers not to depend on what the background threads are up to.
+static thread_local size_t allocations_made_by_this_thread = 0;
+
+void* operator new(size_t size) {
+    ++allocations_made_by_this_thread;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// The same entry serialized with either of the Cereal policies.
+template <template <typename> class POLICY> struct BenchEntry : POLICY<BenchEntry<POLICY>> {
+    BenchEntry() = default;
+    BenchEntry(uint32_t key, const std::string& data) : key(key), data(data) {
+    }
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+    uint32_t key;
+    std::string data;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(data));
+    }
+};
+
+typedef BenchEntry<::TailProduce::CerealJSONSerializable> JSONEntry;
+typedef BenchEntry<::TailProduce::CerealBinarySerializable> BinaryEntry;
+
+template <typename STREAM_MANAGER_TYPE> struct BenchSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(Framework, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(json, JSONEntry, uint32_t, uint32_t);
+    TAILPRODUCE_STREAM(binary, BinaryEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(json);
+    TAILPRODUCE_PUBLISHER(binary);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    static ::TailProduce::StreamManagerParams Params() {
+        return ::TailProduce::StreamManagerParams()
+            .CreateStream("json", uint32_t(0), uint32_t(0))
+            .CreateStream("binary", uint32_t(0), uint32_t(0));
+    }
+};
+
+struct FreshLevelDB : ::TailProduce::StorageLevelDB {
+    FreshLevelDB() : ::TailProduce::StorageLevelDB(Path()) {
+    }
+    static std::string Path() {
+        static int index = 0;
+        return "/tmp/tailproduce-bench-microbenchmarks-" +
+               std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + '-' +
+               std::to_string(++index) + '/';
+    }
+};
+
+// Sums up what it sees, for the deserialization not to be optimized away.
+struct Checksum {
+    uint64_t value = 0;
+    template <typename ENTRY> void operator()(const ENTRY& entry) {
+        value += entry.key + entry.data.length();
+    }
+};
+
+struct Result {
+    std::string name;
+    std::string storage;
+    size_t ops;
+    double seconds;
+    size_t allocations;
+};
+
+static std::vector<Result> results;
+
+// Runs `f()`, which performs `ops` operations and returns a checksum, and records how long it took.
+template <typename F> void Measure(const std::string& name, const std::string& storage, size_t ops, F f) {
+    const size_t allocations_before = allocations_made_by_this_thread;
+    const auto begin = std::chrono::steady_clock::now();
+    const uint64_t checksum = f();
+    const auto end = std::chrono::steady_clock::now();
+    Result result{name, storage, ops, std::chrono::duration<double>(end - begin).count(), 0};
+    result.allocations = allocations_made_by_this_thread - allocations_before;
+    printf("%-64s %-10s %12.0f ops/s %10.1f ns/op %8.2f allocs/op  [checksum %llu]\n",
+           name.c_str(),
+           storage.c_str(),
+           ops / result.seconds,
+           result.seconds * 1e9 / ops,
+           static_cast<double>(result.allocations) / ops,
+           static_cast<unsigned long long>(checksum));
+    results.push_back(result);
+}
+
+static void WriteJSON(const std::string& filename, size_t iterations) {
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Can not write '%s'.\n", filename.c_str());
+        exit(1);
+    }
+    fprintf(f, "{\n  \"iterations\": %zu,\n  \"benchmarks\": [\n", iterations);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(f,
+                "    {\"name\": \"%s\", \"storage\": \"%s\", \"ops\": %zu, \"ops_per_second\": %.1f, "
+                "\"ns_per_op\": %.2f, \"allocations_per_op\": %.3f}%s\n",
+                r.name.c_str(),
+                r.storage.c_str(),
+                r.ops,
+                r.ops / r.seconds,
+                r.seconds * 1e9 / r.ops,
+                static_cast<double>(r.allocations) / r.ops,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static const std::string kPayload = "a payload of some sixty-four bytes, about the size of a log line";
+
+template <typename STREAM>
+static void Replay(const std::string& name,
+                   const std::string& storage,
+                   const STREAM& stream,
+                   size_t ops,
+                   ::TailProduce::EntryAllocation entry_allocation) {
+    Measure(name, storage, ops, [&]() {
+        ::TailProduce::INTERNAL_UnsafeListener<STREAM> listener(stream);
+        listener.SetEntryAllocation(entry_allocation);
+        Checksum checksum;
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(checksum);
+            listener.AdvanceToNextEntry();
+        }
+        return checksum.value;
+    });
+}
+
+// Publishes into, then replays, a fresh framework on top of STORAGE.
+template <typename STORAGE> static void StorageBenchmarks(const std::string& storage_name, size_t iterations) {
+    typedef BenchSetup<::TailProduce::StreamManager<STORAGE>> Setup;
+    STORAGE storage;
+    typename Setup::Framework framework(storage, Setup::Params());
+
+    Measure("Publisher::Push, JSON", storage_name, iterations, [&]() {
+        for (size_t i = 1; i <= iterations; ++i) {
+            framework.json_publisher.Push(JSONEntry(i, kPayload));
+        }
+        return framework.json_publisher.GetHead();
+    });
+    Measure("Publisher::Push, binary", storage_name, iterations, [&]() {
+        for (size_t i = 1; i <= iterations; ++i) {
+            framework.binary_publisher.Push(BinaryEntry(i, kPayload));
+        }
+        return framework.binary_publisher.GetHead();
+    });
+    std::vector<JSONEntry> batch;
+    for (size_t i = 0; i < 1000; ++i) {
+        batch.emplace_back(0, kPayload);
+    }
+    const size_t batched = (iterations + batch.size() - 1) / batch.size() * batch.size();
+    Measure("Publisher::PushMany, JSON, 1000 per batch", storage_name, batched, [&]() {
+        for (size_t i = 0; i < batched; i += batch.size()) {
+            for (size_t j = 0; j < batch.size(); ++j) {
+                batch[j].key = iterations + 1 + i + j;
+            }
+            framework.json_publisher.PushMany(batch.begin(), batch.end());
+        }
+        return framework.json_publisher.GetHead();
+    });
+
+    const size_t json_entries = iterations + batched;
+    Replay("INTERNAL_UnsafeListener replay, JSON",
+           storage_name,
+           framework.json,
+           json_entries,
+           ::TailProduce::EntryAllocation::FreshEntry);
+    Replay("INTERNAL_UnsafeListener replay, JSON, ReuseEntry",
+           storage_name,
+           framework.json,
+           json_entries,
+           ::TailProduce::EntryAllocation::ReuseEntry);
+    Replay("INTERNAL_UnsafeListener replay, binary",
+           storage_name,
+           framework.binary,
+           iterations,
+           ::TailProduce::EntryAllocation::FreshEntry);
+    Replay("INTERNAL_UnsafeListener replay, binary, ReuseEntry",
+           storage_name,
+           framework.binary,
+           iterations,
+           ::TailProduce::EntryAllocation::ReuseEntry);
+}
+
+template <typename ENTRY> static void SerializationBenchmarks(const std::string& policy, size_t iterations) {
+    const ENTRY entry(42, kPayload);
+    std::ostringstream os;
+    Measure(policy + "::SerializeEntry", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            os.str("");
+            ENTRY::SerializeEntry(os, entry);
+            checksum += os.tellp();
+        }
+        return checksum;
+    });
+    const std::string serialized = os.str();
+    Measure(policy + "::DeSerializeAndProcessEntry", "none", iterations, [&]() {
+        Checksum checksum;
+        for (size_t i = 0; i < iterations; ++i) {
+            ::TailProduce::MemoryInputStream is(serialized.data(), serialized.data() + serialized.size());
+            ENTRY::DeSerializeAndProcessEntry(is, uint32_t(i), checksum);
+        }
+        return checksum.value;
+    });
+    Measure(policy + "::DeSerializeAndProcessEntry, reused entry", "none", iterations, [&]() {
+        Checksum checksum;
+        ENTRY reused;
+        for (size_t i = 0; i < iterations; ++i) {
+            ::TailProduce::MemoryInputStream is(serialized.data(), serialized.data() + serialized.size());
+            ENTRY::DeSerializeAndProcessEntry(is, uint32_t(i), checksum, reused);
+        }
+        return checksum.value;
+    });
+}
+
+// The storage keys and the serialization do not depend on the storage. The stream is for its key prefix only.
+static void KeyAndSerializationBenchmarks(size_t iterations) {
+    typedef BenchSetup<::TailProduce::StreamManager<InMemoryTestStorage>> Setup;
+    InMemoryTestStorage storage;
+    Setup::Framework framework(storage, Setup::Params());
+    const auto& stream = framework.json;
+    typedef decltype(framework.json.head) T_ORDER_KEY;
+
+    Measure("OrderKey::ComposeStorageKey", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += T_ORDER_KEY(i, i & 7).ComposeStorageKey(stream, stream.config_values()).length();
+        }
+        return checksum;
+    });
+    const auto storage_key = T_ORDER_KEY(123456789, 7).ComposeStorageKey(stream, stream.config_values());
+    Measure("OrderKey::DecomposeStorageKey", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        T_ORDER_KEY key;
+        for (size_t i = 0; i < iterations; ++i) {
+            key.DecomposeStorageKey(storage_key, stream, stream.config_values());
+            checksum += key.primary + key.secondary;
+        }
+        return checksum;
+    });
+
+    typedef ::TailProduce::FixedSizeSerializer<uint32_t> U32;
+    typedef ::TailProduce::FixedSizeSerializer<uint64_t> U64;
+    Measure("FixedSizeSerializer<uint32_t>::PackToString", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += U32::PackToString(i)[U32::size_in_bytes - 1];
+        }
+        return checksum;
+    });
+    Measure("FixedSizeSerializer<uint64_t>::PackToString", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += U64::PackToString(i)[U64::size_in_bytes - 1];
+        }
+        return checksum;
+    });
+    // Different inputs, for the parsing not to be hoisted out of the loop.
+    std::vector<std::string> packed;
+    for (uint32_t i = 0; i < 64; ++i) {
+        packed.push_back(U32::PackToString(i * 123456789u));
+    }
+    Measure("FixedSizeSerializer<uint32_t>::UnpackFromString", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += U32::UnpackFromString(packed[i % packed.size()]);
+        }
+        return checksum;
+    });
+    Measure("FixedSizeSerializer<uint32_t>::UnpackFromChars", "none", iterations, [&]() {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            checksum += U32::UnpackFromChars(packed[i % packed.size()].data());
+        }
+        return checksum;
+    });
+
+    SerializationBenchmarks<JSONEntry>("CerealJSONSerializable", iterations);
+    SerializationBenchmarks<BinaryEntry>("CerealBinarySerializable", iterations);
+}
+
+int main(int argc, char** argv) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    const std::string json_output_file = argc > 2 ? argv[2] : "build/microbenchmarks.json";
+    if (!iterations) {
+        fprintf(stderr, "Usage: %s [iterations] [json_output_file]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%zu iterations.\n", iterations);
+    KeyAndSerializationBenchmarks(iterations);
+    StorageBenchmarks<InMemoryTestStorage>("in-memory", iterations);
+    StorageBenchmarks<FreshLevelDB>("leveldb", iterations);
+
+    WriteJSON(json_output_file, iterations);
+    printf("Written '%s'.\n", json_output_file.c_str());
+    return 0;
+}
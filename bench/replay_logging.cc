@@ -0,0 +1,119 @@
+// Benchmarks the per-entry cost of the logging on the replay path, see src/tp_logging.h.
+//
+// Replays the stream through INTERNAL_UnsafeListener, on the in-memory storage of the tests, with the logging off
+// at run time. The Makefile builds it twice: build/replay_logging with the per-entry logging compiled out, and
+// build/replay_logging_at_level_3 with it compiled in, as the debug builds have it. The difference between the two
+// is the cost of the disabled logging. Reports the best of several rounds, in ns and allocations per entry.
+//
+// Usage: make build/replay_logging build/replay_logging_at_level_3 &&
+//        ./build/replay_logging [entries] [rounds] && ./build/replay_logging_at_level_3 [entries] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "src/tailproduce.h"
+
+#include "cereal/types/string.hpp"
+
+#include "test/cpp/helpers/storage_inmemory.h"
+
+static thread_local size_t allocations_made_by_this_thread = 0;
+
+void* operator new(size_t size) {
+    ++allocations_made_by_this_thread;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+struct BenchEntry : ::TailProduce::CerealBinarySerializable<BenchEntry> {
+    BenchEntry() = default;
+    BenchEntry(uint32_t key, const std::string& data) : key(key), data(data) {
+    }
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+    uint32_t key;
+    std::string data;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(data));
+    }
+};
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(BenchFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(bench, BenchEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(bench);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+struct Checksum {
+    uint64_t value = 0;
+    void operator()(const BenchEntry& entry) {
+        value += entry.key + entry.data.length();
+    }
+};
+
+int main(int argc, char** argv) {
+    const size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5;
+    if (!entries || !rounds) {
+        fprintf(stderr, "Usage: %s [entries] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    InMemoryTestStorage storage;
+    BenchFramework framework(storage,
+                             ::TailProduce::StreamManagerParams().CreateStream("bench", uint32_t(0), uint32_t(0)));
+    std::vector<BenchEntry> batch;
+    for (size_t i = 1; i <= entries; ++i) {
+        batch.emplace_back(i, "entry " + std::to_string(i));
+        if (batch.size() == 10000 || i == entries) {
+            framework.bench_publisher.PushMany(batch.begin(), batch.end());
+            batch.clear();
+        }
+    }
+
+    double best_seconds = 1e9;
+    size_t allocations = 0;
+    uint64_t checksum = 0;
+    for (size_t round = 0; round < rounds; ++round) {
+        const size_t allocations_before = allocations_made_by_this_thread;
+        const auto begin = std::chrono::steady_clock::now();
+        ::TailProduce::INTERNAL_UnsafeListener<BenchFramework::bench_type> listener(framework.bench);
+        listener.SetEntryAllocation(::TailProduce::EntryAllocation::ReuseEntry);
+        Checksum processor;
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(processor);
+            listener.AdvanceToNextEntry();
+        }
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+        best_seconds = std::min(best_seconds, seconds.count());
+        allocations = allocations_made_by_this_thread - allocations_before;
+        checksum = processor.value;
+    }
+
+    printf("TAILPRODUCE_TRACING_LEVEL=%d: %zu entries, best of %zu rounds, %.1f ns/entry, %.2f allocs/entry"
+           "  [checksum %llu]\n",
+           TAILPRODUCE_TRACING_LEVEL,
+           entries,
+           rounds,
+           best_seconds * 1e9 / entries,
+           static_cast<double>(allocations) / entries,
+           static_cast<unsigned long long>(checksum));
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Benchmarks the throughput of the HTTP stream export over a Unix domain socket against loopback TCP,
+// see TCPServerEndpoint and StreamManagerParams::SetHTTPUnixSocket().
+//
+// The framework serves the same exporter on both. The client reads the complete export, `follow=0`, as fast as it
+// can and discards it, so that the time is the exporter's plus the transport's. The best of several rounds counts.
+//
+// Usage: make && ./build/unix_socket_export [entries] [port] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "src/tailproduce.h"
+#include "src/storage_leveldb.h"
+
+struct BenchEntry : ::TailProduce::CerealJSONSerializable<BenchEntry> {
+    BenchEntry() = default;
+    BenchEntry(uint32_t ikey, const std::string& data) : ikey(ikey), data(data) {
+    }
+    void SetOrderKey(uint32_t input) {
+        ikey = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = ikey;
+    }
+    uint32_t ikey;
+    std::string data;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(data));
+    }
+};
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(BenchFramework, ::TailProduce::StreamManager<::TailProduce::StorageLevelDB>);
+TAILPRODUCE_STREAM(bench, BenchEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(bench);
+TAILPRODUCE_EXPORT_STREAM(bench);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+// Sends the request and reads the response until the server closes the connection. Returns the number of bytes.
+template <typename SOCKET> static size_t Fetch(SOCKET& socket, const std::string& request) {
+    boost::asio::write(socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    std::vector<char> buffer(256 * 1024);
+    size_t bytes = 0;
+    boost::system::error_code ec;
+    while (!ec) {
+        bytes += socket.read_some(boost::asio::buffer(buffer), ec);
+    }
+    return bytes;
+}
+
+// Returns the best time of `rounds` complete exports, and sets `bytes` to the size of the response.
+template <typename CONNECT>
+static double BestSeconds(CONNECT connect, const std::string& request, size_t rounds, size_t& bytes) {
+    double best = 1e9;
+    for (size_t round = 0; round < rounds; ++round) {
+        const auto begin = std::chrono::steady_clock::now();
+        bytes = connect(request);
+        const std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+        best = std::min(best, seconds.count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    const size_t port = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8080;
+    const size_t rounds = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 5;
+    if (!entries || !rounds) {
+        fprintf(stderr, "Usage: %s [entries] [port] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string suffix = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    const std::string path = "/tmp/tailproduce-bench-unix-socket-export-" + suffix + '/';
+    const std::string socket_path = "/tmp/tailproduce-bench-" + suffix + ".socket";
+    ::TailProduce::StorageLevelDB storage(path);
+    BenchFramework framework(storage,
+                             ::TailProduce::StreamManagerParams()
+                                 .CreateStream("bench", uint32_t(0), uint32_t(0))
+                                 .SetHTTPPort(port)
+                                 .SetHTTPUnixSocket(socket_path));
+    std::vector<BenchEntry> batch;
+    for (size_t i = 1; i <= entries; ++i) {
+        batch.emplace_back(i, "entry number " + std::to_string(i) + ", padded to look like a log line of sorts");
+        if (batch.size() == 10000 || i == entries) {
+            framework.bench_publisher.PushMany(batch.begin(), batch.end());
+            batch.clear();
+        }
+    }
+
+    boost::asio::io_service io_service;
+    const auto over_tcp = [&io_service, port](const std::string& request) {
+        boost::asio::ip::tcp::socket socket(io_service);
+        socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port));
+        return Fetch(socket, request);
+    };
+    const auto over_unix_socket = [&io_service, &socket_path](const std::string& request) {
+        boost::asio::local::stream_protocol::socket socket(io_service);
+        socket.connect(boost::asio::local::stream_protocol::endpoint(socket_path));
+        return Fetch(socket, request);
+    };
+
+    printf("%zu entries, best of %zu rounds.\n", entries, rounds);
+    for (const char* format : {"binary", "tsv", "json"}) {
+        const std::string request = std::string("GET /bench?follow=0&format=") + format + " HTTP/1.1\r\n\r\n";
+        size_t bytes;
+        const double tcp_seconds = BestSeconds(over_tcp, request, rounds, bytes);
+        const double unix_socket_seconds = BestSeconds(over_unix_socket, request, rounds, bytes);
+        printf("%-8s %8.1f MB, TCP %8.1f MB/s %10.0f entries/s, Unix socket %8.1f MB/s %10.0f entries/s, %+.1f%%\n",
+               format,
+               bytes * 1e-6,
+               bytes * 1e-6 / tcp_seconds,
+               entries / tcp_seconds,
+               bytes * 1e-6 / unix_socket_seconds,
+               entries / unix_socket_seconds,
+               100.0 * (tcp_seconds / unix_socket_seconds - 1.0));
+    }
+    return 0;
+}
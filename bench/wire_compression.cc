@@ -0,0 +1,185 @@
+// Benchmarks the wire compression of the exported and replicated streams, see src/wire_compression.h:
+// the bytes saved against the CPU time spent per GB of the data as it would be sent uncompressed.
+//
+// The entries are shaped as `SimpleEntry` of the tests, an order key and a string, with the strings made of
+// log-like fields. The chunks are the actual coalesced batches the exporter and the replication leader send,
+// fetched over loopback from a fresh LevelDB storage under /tmp.
+//
+// Usage: make && ./build/wire_compression [entries] [port]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "src/tailproduce.h"
+#include "src/storage_leveldb.h"
+
+using ::TailProduce::WireCompression;
+
+struct BenchEntry : ::TailProduce::CerealJSONSerializable<BenchEntry> {
+    BenchEntry() = default;
+    BenchEntry(uint32_t ikey, const std::string& data) : ikey(ikey), data(data) {
+    }
+    void SetOrderKey(uint32_t input) {
+        ikey = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = ikey;
+    }
+    uint32_t ikey;
+    std::string data;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(data));
+    }
+};
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(BenchFramework, ::TailProduce::StreamManager<::TailProduce::StorageLevelDB>);
+TAILPRODUCE_STREAM(bench, BenchEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(bench);
+TAILPRODUCE_EXPORT_STREAM(bench);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static std::string RandomData(std::mt19937& random) {
+    static const char* actions[] = {"view", "click", "scroll", "purchase", "share"};
+    static const char* sections[] = {"home", "search", "product", "cart", "account", "help"};
+    char data[256];
+    snprintf(data,
+             sizeof(data),
+             "user=u%06u action=%s page=/%s/%u latency_ms=%u agent=Mozilla/5.0",
+             static_cast<unsigned>(random() % 100000),
+             actions[random() % 5],
+             sections[random() % 6],
+             static_cast<unsigned>(random() % 10000),
+             static_cast<unsigned>(random() % 2000));
+    return data;
+}
+
+// Sends the request and returns the chunks of the response, until `done(the last chunk)` is true or the response
+// is over.
+template <typename F>
+static std::vector<std::string> FetchChunks(size_t port, const std::string& request, F done) {
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket socket(io_service);
+    socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port));
+    boost::asio::write(socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    boost::asio::streambuf buffer;
+    buffer.consume(boost::asio::read_until(socket, buffer, "\r\n\r\n"));
+    std::vector<std::string> chunks;
+    while (chunks.empty() || !done(chunks.back())) {
+        boost::system::error_code ec;
+        const size_t line = boost::asio::read_until(socket, buffer, "\r\n", ec);
+        if (ec) {
+            break;
+        }
+        const size_t size =
+            std::stoul(std::string(boost::asio::buffer_cast<const char*>(buffer.data()), line), nullptr, 16);
+        buffer.consume(line);
+        if (!size) {
+            break;
+        }
+        if (buffer.size() < size + 2) {
+            boost::asio::read(socket, buffer, boost::asio::transfer_exactly(size + 2 - buffer.size()));
+        }
+        chunks.emplace_back(boost::asio::buffer_cast<const char*>(buffer.data()), size);
+        buffer.consume(size + 2);
+    }
+    return chunks;
+}
+
+// Compresses and uncompresses the chunks, repeatedly for at least a second of CPU time each.
+static void Measure(const char* name, const std::vector<std::string>& chunks) {
+    size_t bytes = 0;
+    size_t compressed_bytes = 0;
+    std::vector<std::string> compressed(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        ::TailProduce::CompressWireChunk(WireCompression::Snappy, chunks[i], compressed[i]);
+        bytes += chunks[i].size();
+        compressed_bytes += compressed[i].size();
+    }
+
+    std::string output;
+    size_t rounds = 0;
+    const std::clock_t compress_begin = std::clock();
+    while (std::clock() - compress_begin < CLOCKS_PER_SEC) {
+        for (const std::string& chunk : chunks) {
+            ::TailProduce::CompressWireChunk(WireCompression::Snappy, chunk, output);
+        }
+        ++rounds;
+    }
+    const double compress_seconds = double(std::clock() - compress_begin) / CLOCKS_PER_SEC / rounds;
+
+    rounds = 0;
+    const std::clock_t uncompress_begin = std::clock();
+    while (std::clock() - uncompress_begin < CLOCKS_PER_SEC) {
+        for (const std::string& chunk : compressed) {
+            if (!::TailProduce::UncompressWireChunk(WireCompression::Snappy, chunk, output)) {
+                fprintf(stderr, "Malformed compressed chunk.\n");
+                exit(1);
+            }
+        }
+        ++rounds;
+    }
+    const double uncompress_seconds = double(std::clock() - uncompress_begin) / CLOCKS_PER_SEC / rounds;
+
+    const double gigabytes = bytes * 1e-9;
+    printf("%-20s %6zu chunks %9.1f MB -> %8.1f MB, %5.1f%% saved, "
+           "%6.2f CPU s/GB to compress, %6.2f to uncompress\n",
+           name,
+           chunks.size(),
+           bytes * 1e-6,
+           compressed_bytes * 1e-6,
+           100.0 - 100.0 * compressed_bytes / bytes,
+           compress_seconds / gigabytes,
+           uncompress_seconds / gigabytes);
+}
+
+int main(int argc, char** argv) {
+    const size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    const size_t port = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8080;
+    if (!entries) {
+        fprintf(stderr, "Usage: %s [entries] [port]\n", argv[0]);
+        return 1;
+    }
+
+    const std::string path = "/tmp/tailproduce-bench-wire-compression-" +
+                             std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + '/';
+    ::TailProduce::StorageLevelDB storage(path);
+    BenchFramework framework(
+        storage,
+        ::TailProduce::StreamManagerParams().CreateStream("bench", uint32_t(0), uint32_t(0)).SetHTTPPort(port));
+    ::TailProduce::ReplicationLeader<BenchFramework> leader(framework);
+    std::mt19937 random(42);
+    std::vector<BenchEntry> batch;
+    for (size_t i = 1; i <= entries; ++i) {
+        batch.emplace_back(i, RandomData(random));
+        if (batch.size() == 10000 || i == entries) {
+            framework.bench_publisher.PushMany(batch.begin(), batch.end());
+            batch.clear();
+        }
+    }
+    printf("%zu entries, e.g. `%s`.\n", entries, RandomData(random).c_str());
+
+    const auto whole_response = [](const std::string&) { return false; };
+    for (const char* format : {"json", "tsv", "binary"}) {
+        const std::string request = std::string("GET /bench?follow=0&format=") + format + " HTTP/1.1\r\n\r\n";
+        Measure((std::string("export, ") + format).c_str(), FetchChunks(port, request, whole_response));
+    }
+
+    // The replication never ends the response: read it up to the HEAD record of the last entry.
+    const std::string last_key = framework.bench_publisher.GetHeadPrimaryAndSecondary().ComposeStorageKey(
+        framework.bench, framework.bench.config_values());
+    std::string head_record = "s:bench";
+    ::TailProduce::StreamExporterInternal::AppendBigEndianUInt32(head_record, last_key.length());
+    head_record += last_key;
+    const std::string request = "GET /replicate?bench=" + std::string(20, '0') + " HTTP/1.1\r\n\r\n";
+    Measure("replication", FetchChunks(port, request, [&head_record](const std::string& chunk) {
+        return chunk.find(head_record) != std::string::npos;
+    }));
+    return 0;
+}
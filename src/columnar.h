@@ -0,0 +1,154 @@
+// Columnar batch decoding.
+//
+// Instead of receiving one `const T_ENTRY&` at a time, a batch processor receives a run of entries decoded into
+// structure-of-arrays column buffers, so that aggregations over them can be written as tight (SIMD) loops.
+//
+// A batch processor exposes:
+//
+// struct MyBatchProcessor {
+//     typedef ::TailProduce::ColumnarBatch<uint32_t, uint32_t, double> T_BATCH;
+//     // Appends the columns of one entry to the batch. Overload it for each type of a polymorphic stream.
+//     void ExtractColumns(const MyEntry& entry, T_BATCH& batch) {
+//         batch.Append(entry.key, entry.count, entry.weight);
+//     }
+//     // Processes a run of entries, at most `T_BATCH::default_max_size` of them when run by AsyncListener.
+//     void operator()(const T_BATCH& batch) {
+//         uint64_t total = ::TailProduce::ColumnarKernels::Sum(batch.Column<0>());
+//     }
+// };
+
+#ifndef TAILPRODUCE_COLUMNAR_H
+#define TAILPRODUCE_COLUMNAR_H
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "projection.h"
+
+namespace TailProduce {
+    // Read-only view over a contiguous array. A C++11 stand-in for `std::span<const T>`.
+    template <typename T> struct Span {
+        typedef T T_VALUE;
+        const T* data;
+        size_t size;
+
+        Span() : data(nullptr), size(0) {
+        }
+        Span(const T* data, size_t size) : data(data), size(size) {
+        }
+        explicit Span(const std::vector<T>& v) : data(v.data()), size(v.size()) {
+        }
+
+        const T* begin() const {
+            return data;
+        }
+        const T* end() const {
+            return data + size;
+        }
+        const T& operator[](size_t i) const {
+            return data[i];
+        }
+        bool empty() const {
+            return !size;
+        }
+    };
+
+    namespace ColumnarInternal {
+        template <size_t I, size_t N> struct ForEachColumn {
+            template <typename TUPLE, typename F> static void Run(TUPLE& columns, F f) {
+                f(std::get<I>(columns));
+                ForEachColumn<I + 1, N>::Run(columns, f);
+            }
+        };
+        template <size_t N> struct ForEachColumn<N, N> {
+            template <typename TUPLE, typename F> static void Run(TUPLE&, F) {
+            }
+        };
+        struct ClearColumn {
+            template <typename V> void operator()(V& v) const {
+                v.clear();
+            }
+        };
+        struct ReserveColumn {
+            size_t n;
+            template <typename V> void operator()(V& v) const {
+                v.reserve(n);
+            }
+        };
+    };
+
+    // Structure-of-arrays buffer for a run of entries: the primary order keys and the numeric columns.
+    // Clear() keeps the capacity, so a batch reused across runs does not reallocate.
+    template <typename PRIMARY_KEY, typename... COLUMNS> struct ColumnarBatch {
+        typedef PRIMARY_KEY T_PRIMARY_KEY;
+        typedef std::tuple<COLUMNS...> T_ROW;
+        typedef std::tuple<std::vector<COLUMNS>...> T_COLUMNS;
+        enum { default_max_size = 1024 };
+
+        void Append(const T_PRIMARY_KEY& order_key, const COLUMNS&... values) {
+            order_keys.push_back(order_key);
+            AppendToColumns<0>(values...);
+        }
+
+        void Clear() {
+            order_keys.clear();
+            ColumnarInternal::ForEachColumn<0, sizeof...(COLUMNS)>::Run(columns, ColumnarInternal::ClearColumn());
+        }
+
+        void Reserve(size_t n) {
+            order_keys.reserve(n);
+            ColumnarInternal::ForEachColumn<0, sizeof...(COLUMNS)>::Run(columns,
+                                                                         ColumnarInternal::ReserveColumn{n});
+        }
+
+        size_t Size() const {
+            return order_keys.size();
+        }
+
+        Span<T_PRIMARY_KEY> OrderKeys() const {
+            return Span<T_PRIMARY_KEY>(order_keys);
+        }
+
+        template <size_t I> Span<typename std::tuple_element<I, T_ROW>::type> Column() const {
+            return Span<typename std::tuple_element<I, T_ROW>::type>(std::get<I>(columns));
+        }
+
+      private:
+        template <size_t I> void AppendToColumns() {
+        }
+        template <size_t I, typename HEAD, typename... TAIL>
+        void AppendToColumns(const HEAD& head, const TAIL&... tail) {
+            std::get<I>(columns).push_back(head);
+            AppendToColumns<I + 1>(tail...);
+        }
+
+        std::vector<T_PRIMARY_KEY> order_keys;
+        T_COLUMNS columns;
+    };
+
+    // IsBatchProcessor<T>::value is true if T declares `T_BATCH`, and thus should be fed via ProcessBatchSync().
+    template <typename T> struct IsBatchProcessor {
+        template <typename U> static char Test(typename U::T_BATCH*);
+        template <typename U> static long Test(...);
+        enum { value = (sizeof(Test<T>(nullptr)) == sizeof(char)) };
+    };
+
+    // Adapts a batch processor to the per-entry processor interface used by the deserializers.
+    template <typename PROCESSOR> struct ColumnExtractor {
+        typedef PROCESSOR T_PROCESSOR;
+        typedef typename T_PROCESSOR::T_BATCH T_BATCH;
+        // Batch processors can declare a projection too, since ExtractColumns() usually needs only a few fields.
+        typedef typename ProjectionOf<T_PROCESSOR>::type T_PROJECTION;
+        ColumnExtractor(T_PROCESSOR& processor, T_BATCH& batch) : processor(processor), batch(batch) {
+        }
+        template <typename ENTRY> void operator()(const ENTRY& entry) {
+            processor.ExtractColumns(entry, batch);
+        }
+        T_PROCESSOR& processor;
+        T_BATCH& batch;
+    };
+};
+
+#endif  // TAILPRODUCE_COLUMNAR_H
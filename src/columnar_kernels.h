@@ -0,0 +1,241 @@
+// Aggregation kernels over uint32_t columns of a ColumnarBatch: sum, min/max and histogram.
+//
+// Each kernel has a portable scalar version in `Reference`, and, on x86, the `SSE` (SSE4.1) and `AVX2` versions.
+// The SIMD versions are compiled via function-level target attributes, so that the library and its users
+// do not need -msse4.1 / -mavx2. The top-level functions pick the best version the CPU supports at runtime.
+
+#ifndef TAILPRODUCE_COLUMNAR_KERNELS_H
+#define TAILPRODUCE_COLUMNAR_KERNELS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "columnar.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TAILPRODUCE_COLUMNAR_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace TailProduce {
+    namespace ColumnarKernels {
+        // For an empty column, `min` is the largest uint32_t and `max` is zero.
+        struct MinMax {
+            uint32_t min;
+            uint32_t max;
+        };
+
+        // The histogram kernels add to `counts`. The bucket of value `v` is `v >> bucket_shift`,
+        // with values beyond the last bucket counted in the last one. `bucket_shift` should be below 32.
+        namespace Reference {
+            inline uint64_t Sum(Span<uint32_t> column) {
+                uint64_t result = 0;
+                for (size_t i = 0; i < column.size; ++i) {
+                    result += column[i];
+                }
+                return result;
+            }
+
+            inline MinMax MinMaxOf(Span<uint32_t> column) {
+                MinMax result{std::numeric_limits<uint32_t>::max(), 0};
+                for (size_t i = 0; i < column.size; ++i) {
+                    result.min = std::min(result.min, column[i]);
+                    result.max = std::max(result.max, column[i]);
+                }
+                return result;
+            }
+
+            inline void Histogram(Span<uint32_t> column, uint32_t bucket_shift, std::vector<uint64_t>& counts) {
+                if (counts.empty()) {
+                    return;
+                }
+                const uint32_t last = static_cast<uint32_t>(counts.size() - 1);
+                for (size_t i = 0; i < column.size; ++i) {
+                    ++counts[std::min(column[i] >> bucket_shift, last)];
+                }
+            }
+        };
+
+#ifdef TAILPRODUCE_COLUMNAR_KERNELS_X86
+        namespace SSE {
+            __attribute__((target("sse4.1"))) inline uint64_t Sum(Span<uint32_t> column) {
+                const __m128i zero = _mm_setzero_si128();
+                __m128i acc = _mm_setzero_si128();
+                size_t i = 0;
+                for (; i + 4 <= column.size; i += 4) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column.data + i));
+                    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+                    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+                }
+                uint64_t lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+                return lanes[0] + lanes[1] + Reference::Sum(Span<uint32_t>(column.data + i, column.size - i));
+            }
+
+            __attribute__((target("sse4.1"))) inline MinMax MinMaxOf(Span<uint32_t> column) {
+                MinMax result{std::numeric_limits<uint32_t>::max(), 0};
+                size_t i = 0;
+                if (column.size >= 4) {
+                    __m128i lo = _mm_set1_epi32(-1);
+                    __m128i hi = _mm_setzero_si128();
+                    for (; i + 4 <= column.size; i += 4) {
+                        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column.data + i));
+                        lo = _mm_min_epu32(lo, v);
+                        hi = _mm_max_epu32(hi, v);
+                    }
+                    uint32_t lo_lanes[4];
+                    uint32_t hi_lanes[4];
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(lo_lanes), lo);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(hi_lanes), hi);
+                    result.min = *std::min_element(lo_lanes, lo_lanes + 4);
+                    result.max = *std::max_element(hi_lanes, hi_lanes + 4);
+                }
+                const MinMax tail = Reference::MinMaxOf(Span<uint32_t>(column.data + i, column.size - i));
+                result.min = std::min(result.min, tail.min);
+                result.max = std::max(result.max, tail.max);
+                return result;
+            }
+
+            __attribute__((target("sse4.1"))) inline void Histogram(Span<uint32_t> column,
+                                                                     uint32_t bucket_shift,
+                                                                     std::vector<uint64_t>& counts) {
+                if (counts.empty()) {
+                    return;
+                }
+                const __m128i last = _mm_set1_epi32(static_cast<int>(std::min<size_t>(
+                    counts.size() - 1, static_cast<size_t>(std::numeric_limits<int32_t>::max()))));
+                const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(bucket_shift));
+                uint32_t index[4];
+                size_t i = 0;
+                for (; i + 4 <= column.size; i += 4) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column.data + i));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(index),
+                                     _mm_min_epu32(_mm_srl_epi32(v, shift), last));
+                    ++counts[index[0]];
+                    ++counts[index[1]];
+                    ++counts[index[2]];
+                    ++counts[index[3]];
+                }
+                Reference::Histogram(Span<uint32_t>(column.data + i, column.size - i), bucket_shift, counts);
+            }
+        };
+
+        namespace AVX2 {
+            __attribute__((target("avx2"))) inline uint64_t Sum(Span<uint32_t> column) {
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                size_t i = 0;
+                for (; i + 8 <= column.size; i += 8) {
+                    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column.data + i));
+                    acc0 = _mm256_add_epi64(acc0, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+                    acc1 = _mm256_add_epi64(acc1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+                }
+                uint64_t lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc0, acc1));
+                return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                       Reference::Sum(Span<uint32_t>(column.data + i, column.size - i));
+            }
+
+            __attribute__((target("avx2"))) inline MinMax MinMaxOf(Span<uint32_t> column) {
+                MinMax result{std::numeric_limits<uint32_t>::max(), 0};
+                size_t i = 0;
+                if (column.size >= 8) {
+                    __m256i lo = _mm256_set1_epi32(-1);
+                    __m256i hi = _mm256_setzero_si256();
+                    for (; i + 8 <= column.size; i += 8) {
+                        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column.data + i));
+                        lo = _mm256_min_epu32(lo, v);
+                        hi = _mm256_max_epu32(hi, v);
+                    }
+                    uint32_t lo_lanes[8];
+                    uint32_t hi_lanes[8];
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lo_lanes), lo);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(hi_lanes), hi);
+                    result.min = *std::min_element(lo_lanes, lo_lanes + 8);
+                    result.max = *std::max_element(hi_lanes, hi_lanes + 8);
+                }
+                const MinMax tail = Reference::MinMaxOf(Span<uint32_t>(column.data + i, column.size - i));
+                result.min = std::min(result.min, tail.min);
+                result.max = std::max(result.max, tail.max);
+                return result;
+            }
+
+            __attribute__((target("avx2"))) inline void Histogram(Span<uint32_t> column,
+                                                                   uint32_t bucket_shift,
+                                                                   std::vector<uint64_t>& counts) {
+                if (counts.empty()) {
+                    return;
+                }
+                const __m256i last = _mm256_set1_epi32(static_cast<int>(std::min<size_t>(
+                    counts.size() - 1, static_cast<size_t>(std::numeric_limits<int32_t>::max()))));
+                const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(bucket_shift));
+                uint32_t index[8];
+                size_t i = 0;
+                for (; i + 8 <= column.size; i += 8) {
+                    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column.data + i));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(index),
+                                        _mm256_min_epu32(_mm256_srl_epi32(v, shift), last));
+                    for (size_t j = 0; j < 8; ++j) {
+                        ++counts[index[j]];
+                    }
+                }
+                Reference::Histogram(Span<uint32_t>(column.data + i, column.size - i), bucket_shift, counts);
+            }
+        };
+#endif  // TAILPRODUCE_COLUMNAR_KERNELS_X86
+
+        enum class InstructionSet { Reference, SSE, AVX2 };
+
+        inline InstructionSet BestSupportedInstructionSet() {
+#ifdef TAILPRODUCE_COLUMNAR_KERNELS_X86
+            static const InstructionSet best = __builtin_cpu_supports("avx2")
+                                                   ? InstructionSet::AVX2
+                                                   : (__builtin_cpu_supports("sse4.1") ? InstructionSet::SSE
+                                                                                       : InstructionSet::Reference);
+            return best;
+#else
+            return InstructionSet::Reference;
+#endif
+        }
+
+        inline uint64_t Sum(Span<uint32_t> column, InstructionSet set = BestSupportedInstructionSet()) {
+#ifdef TAILPRODUCE_COLUMNAR_KERNELS_X86
+            if (set == InstructionSet::AVX2) {
+                return AVX2::Sum(column);
+            } else if (set == InstructionSet::SSE) {
+                return SSE::Sum(column);
+            }
+#endif
+            return Reference::Sum(column);
+        }
+
+        inline MinMax MinMaxOf(Span<uint32_t> column, InstructionSet set = BestSupportedInstructionSet()) {
+#ifdef TAILPRODUCE_COLUMNAR_KERNELS_X86
+            if (set == InstructionSet::AVX2) {
+                return AVX2::MinMaxOf(column);
+            } else if (set == InstructionSet::SSE) {
+                return SSE::MinMaxOf(column);
+            }
+#endif
+            return Reference::MinMaxOf(column);
+        }
+
+        inline void Histogram(Span<uint32_t> column,
+                              uint32_t bucket_shift,
+                              std::vector<uint64_t>& counts,
+                              InstructionSet set = BestSupportedInstructionSet()) {
+#ifdef TAILPRODUCE_COLUMNAR_KERNELS_X86
+            if (set == InstructionSet::AVX2) {
+                return AVX2::Histogram(column, bucket_shift, counts);
+            } else if (set == InstructionSet::SSE) {
+                return SSE::Histogram(column, bucket_shift, counts);
+            }
+#endif
+            Reference::Histogram(column, bucket_shift, counts);
+        }
+    };
+};
+
+#endif  // TAILPRODUCE_COLUMNAR_KERNELS_H
@@ -39,6 +39,20 @@ namespace TailProduce {
             return stream_meta_prefix_ + delimiter_ + traits.name + delimiter_;
         }
 
+        // The input cursor of the job publishing into the stream, see OperatorStage in operators.h.
+        template <typename STREAM_TRAITS>
+        ::TailProduce::Storage::STORAGE_KEY_TYPE JobCursorStorageKey(const STREAM_TRAITS& traits,
+                                                                     const std::string& job_name) const {
+            return GetStreamMetaPrefix(traits) + "job" + delimiter_ + job_name;
+        }
+
+        // The committed cursor of the named consumer of the stream, see ConsumerCursor in listeners.h.
+        template <typename STREAM_TRAITS>
+        ::TailProduce::Storage::STORAGE_KEY_TYPE ConsumerCursorStorageKey(const STREAM_TRAITS& traits,
+                                                                          const std::string& consumer_name) const {
+            return GetStreamMetaPrefix(traits) + "consumer" + delimiter_ + consumer_name;
+        }
+
       private:
         const std::string stream_meta_prefix_;
         const std::string stream_data_prefix_;
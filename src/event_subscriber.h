@@ -2,6 +2,7 @@
 #define EVENT_SUBSCRIBER_H
 
 #include <cassert>
+#include <mutex>
 #include <set>
 
 namespace TailProduce {
@@ -11,19 +12,28 @@ namespace TailProduce {
         virtual void Poke() = 0;
     };
 
+    // Subscribers may come and go from other threads while the publisher pokes them,
+    // so Poke() is called under the mutex and should not block.
     struct SubscriptionsManager {
         std::set<Subscriber*> subscribers;
+        std::mutex mutex;
+        SubscriptionsManager() = default;
+        SubscriptionsManager(const SubscriptionsManager& rhs) : subscribers(rhs.subscribers) {
+        }
         void RegisterSubscriber(Subscriber* s) {
+            std::lock_guard<std::mutex> guard(mutex);
             // TODO(dkorolev): Throw an exception here.
             assert(!subscribers.count(s));
             subscribers.insert(s);
         }
         void UnregisterSubscriber(Subscriber* s) {
+            std::lock_guard<std::mutex> guard(mutex);
             // TODO(dkorolev): Throw an exception here.
             assert(subscribers.count(s));
             subscribers.erase(s);
         }
         void PokeAll() {
+            std::lock_guard<std::mutex> guard(mutex);
             for (auto it : subscribers) {
                 it->Poke();
             }
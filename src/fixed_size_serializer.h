@@ -29,6 +29,14 @@ namespace TailProduce {
             is >> x;
             return x;
         }
+        // Parses exactly `size_in_bytes` digits starting at `p`, without allocating.
+        static T UnpackFromChars(const char* p) {
+            T x = 0;
+            for (size_t i = 0; i < size_in_bytes; ++i) {
+                x = x * 10 + static_cast<T>(p[i] - '0');
+            }
+            return x;
+        }
     };
 
     // To save on type specializations wherever possible.
@@ -0,0 +1,395 @@
+// A minimal HTTP/1.1 request parser and response formatter for the TailProduce endpoints.
+//
+// Requests are read through a `boost::asio::streambuf`: the request line and the headers usually take a single
+// read, and whatever follows them stays in the buffer for the next request on the same keep-alive connection.
+//
+// boost::asio::streambuf buffer(::TailProduce::HTTPRequest::kMaxHeadSize);
+// ::TailProduce::HTTPRequest request;
+// while (::TailProduce::ReadHTTPRequest(socket, buffer, request)) {
+//     const std::string response = "Hello, " + request.GetParameter("name", "World") + "!\n";
+//     boost::asio::write(socket, boost::asio::buffer(::TailProduce::FormatHTTPResponse(request, 200, response)));
+//     if (!request.keep_alive) {
+//         break;
+//     }
+// }
+//
+// For compatibility with `echo /stream | nc`, a request line with no HTTP version is a complete request.
+
+#ifndef TAILPRODUCE_HTTP_H
+#define TAILPRODUCE_HTTP_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include <boost/asio.hpp>
+
+#include "tcp_server_singleton.h"
+#include "tp_exceptions.h"
+
+namespace TailProduce {
+    struct HTTPRequest {
+        enum { kMaxHeadSize = 64 * 1024, kMaxBodySize = 64 * 1024 * 1024 };
+
+        std::string method;
+        std::string target;  // As sent: "/path?query".
+        std::string path;    // URL-decoded.
+        std::string version;
+        std::map<std::string, std::string> headers;     // With lowercase names.
+        std::map<std::string, std::string> parameters;  // URL-decoded query string parameters.
+        std::string body;
+        bool keep_alive = false;
+
+        void Clear() {
+            method.clear();
+            target.clear();
+            path.clear();
+            version.clear();
+            headers.clear();
+            parameters.clear();
+            body.clear();
+            keep_alive = false;
+        }
+
+        bool HasParameter(const std::string& name) const {
+            return parameters.count(name) != 0;
+        }
+
+        const std::string& GetParameter(const std::string& name, const std::string& default_value = "") const {
+            const auto cit = parameters.find(name);
+            return cit != parameters.end() ? cit->second : default_value;
+        }
+
+        const std::string& GetHeader(const std::string& lowercase_name,
+                                     const std::string& default_value = "") const {
+            const auto cit = headers.find(lowercase_name);
+            return cit != headers.end() ? cit->second : default_value;
+        }
+    };
+
+    namespace HTTPInternal {
+        inline std::string ToLower(std::string s) {
+            std::transform(s.begin(), s.end(), s.begin(), [](char c) { return std::tolower(c); });
+            return s;
+        }
+
+        inline std::string Trim(const std::string& s) {
+            const size_t begin = s.find_first_not_of(" \t\r");
+            if (begin == std::string::npos) {
+                return "";
+            }
+            return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+        }
+
+        inline int HexDigit(char c) {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
+            } else {
+                return -1;
+            }
+        }
+
+        inline std::string URLDecode(const std::string& s, bool plus_is_space) {
+            std::string result;
+            result.reserve(s.length());
+            for (size_t i = 0; i < s.length(); ++i) {
+                if (s[i] == '%' && i + 2 < s.length() && HexDigit(s[i + 1]) >= 0 && HexDigit(s[i + 2]) >= 0) {
+                    result += static_cast<char>(HexDigit(s[i + 1]) * 16 + HexDigit(s[i + 2]));
+                    i += 2;
+                } else if (s[i] == '+' && plus_is_space) {
+                    result += ' ';
+                } else {
+                    result += s[i];
+                }
+            }
+            return result;
+        }
+
+        // The `read_until()` match condition for the end of the request head: an empty line,
+        // or the end of the first line if it carries no HTTP version.
+        struct EndOfRequestHead {
+            typedef boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type> T_ITERATOR;
+            std::pair<T_ITERATOR, bool> operator()(T_ITERATOR begin, T_ITERATOR end) const {
+                bool first_line = true;
+                bool has_version = false;
+                T_ITERATOR line_begin = begin;
+                for (T_ITERATOR it = begin; it != end; ++it) {
+                    if (*it == '\n') {
+                        const size_t line_length = std::distance(line_begin, it);
+                        if (first_line) {
+                            const std::string line(line_begin, it);
+                            has_version = line.find(" HTTP/") != std::string::npos;
+                            first_line = false;
+                            if (!has_version && !Trim(line).empty()) {
+                                return std::make_pair(it + 1, true);
+                            }
+                        } else if (line_length == 0 || (line_length == 1 && *line_begin == '\r')) {
+                            return std::make_pair(it + 1, true);
+                        }
+                        line_begin = it + 1;
+                    }
+                }
+                return std::make_pair(end, false);
+            }
+        };
+    };
+};
+
+namespace boost {
+    namespace asio {
+        template <>
+        struct is_match_condition<::TailProduce::HTTPInternal::EndOfRequestHead> : public boost::true_type {};
+    }
+}
+
+namespace TailProduce {
+    // Parses the query string, "a=1&b=two%20words&flag", into `parameters`.
+    inline void ParseHTTPQueryString(const std::string& query, std::map<std::string, std::string>& parameters) {
+        size_t begin = 0;
+        while (begin <= query.length()) {
+            size_t end = query.find('&', begin);
+            if (end == std::string::npos) {
+                end = query.length();
+            }
+            const std::string pair = query.substr(begin, end - begin);
+            if (!pair.empty()) {
+                const size_t eq = pair.find('=');
+                if (eq == std::string::npos) {
+                    parameters[HTTPInternal::URLDecode(pair, true)] = "";
+                } else {
+                    parameters[HTTPInternal::URLDecode(pair.substr(0, eq), true)] =
+                        HTTPInternal::URLDecode(pair.substr(eq + 1), true);
+                }
+            }
+            begin = end + 1;
+        }
+    }
+
+    // Parses the request line and the headers. Does not touch the body.
+    inline void ParseHTTPRequestHead(const std::string& head, HTTPRequest& request) {
+        request.Clear();
+        std::istringstream is(head);
+        std::string line;
+        if (!std::getline(is, line)) {
+            VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"Empty request.\");";
+            throw ::TailProduce::HTTPRequestParseException("Empty request.");
+        }
+        {
+            std::istringstream request_line(line);
+            request_line >> request.method >> request.target >> request.version;
+            if (request.target.empty()) {
+                // The legacy form: "/path", with no method.
+                if (!request.method.empty() && request.method[0] == '/') {
+                    request.target = request.method;
+                    request.method = "GET";
+                } else {
+                    VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"Malformed request line.\");";
+                    throw ::TailProduce::HTTPRequestParseException("Malformed request line.");
+                }
+            }
+        }
+        while (std::getline(is, line)) {
+            line = HTTPInternal::Trim(line);
+            if (line.empty()) {
+                break;
+            }
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"Malformed header.\");";
+                throw ::TailProduce::HTTPRequestParseException("Malformed header.");
+            }
+            request.headers[HTTPInternal::ToLower(HTTPInternal::Trim(line.substr(0, colon)))] =
+                HTTPInternal::Trim(line.substr(colon + 1));
+        }
+
+        const size_t question_mark = request.target.find('?');
+        request.path = HTTPInternal::URLDecode(request.target.substr(0, question_mark), false);
+        if (question_mark != std::string::npos) {
+            ParseHTTPQueryString(request.target.substr(question_mark + 1), request.parameters);
+        }
+
+        const std::string connection = HTTPInternal::ToLower(request.GetHeader("connection"));
+        if (request.version == "HTTP/1.1") {
+            request.keep_alive = (connection != "close");
+        } else {
+            request.keep_alive = (connection == "keep-alive");
+        }
+    }
+
+    namespace HTTPInternal {
+        // Parses the head of the request, the first `head_size` bytes of `buffer`, and moves the buffered part
+        // of the body into `request.body`. Returns the number of bytes of the body still to be read.
+        inline size_t TakeRequestHead(boost::asio::streambuf& buffer, size_t head_size, HTTPRequest& request) {
+            const char* data = boost::asio::buffer_cast<const char*>(buffer.data());
+            ParseHTTPRequestHead(std::string(data, data + head_size), request);
+            buffer.consume(head_size);
+
+            const std::string& content_length = request.GetHeader("content-length");
+            if (content_length.empty()) {
+                return 0;
+            }
+            size_t length;
+            std::istringstream is(content_length);
+            if (!(is >> length) || length > HTTPRequest::kMaxBodySize) {
+                VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"Bad Content-Length.\");";
+                throw ::TailProduce::HTTPRequestParseException("Bad Content-Length.");
+            }
+            request.body.resize(length);
+            const size_t buffered = std::min(length, buffer.size());
+            boost::asio::buffer_copy(boost::asio::buffer(&request.body[0], buffered), buffer.data());
+            buffer.consume(buffered);
+            return length - buffered;
+        }
+    };
+
+    // Reads the next request from the socket into `request`, the body included if there is `Content-Length`.
+    // Returns false if the connection was closed before the request began. Throws HTTPRequestParseException
+    // on malformed or oversized requests. The bytes after the request stay in `buffer` for the next call.
+    inline bool ReadHTTPRequest(boost::asio::ip::tcp::socket& socket,
+                                boost::asio::streambuf& buffer,
+                                HTTPRequest& request) {
+        boost::system::error_code ec;
+        const size_t head_size = boost::asio::read_until(socket, buffer, HTTPInternal::EndOfRequestHead(), ec);
+        if (ec) {
+            if ((ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset) && !buffer.size()) {
+                return false;
+            } else if (ec == boost::asio::error::not_found) {
+                VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"Request head too large.\");";
+                throw ::TailProduce::HTTPRequestParseException("Request head too large.");
+            } else {
+                VLOG(3) << "throw ::TailProduce::HTTPRequestParseException(\"" << ec.message() << "\");";
+                throw ::TailProduce::HTTPRequestParseException(ec.message());
+            }
+        }
+        const size_t remaining = HTTPInternal::TakeRequestHead(buffer, head_size, request);
+        if (remaining) {
+            boost::asio::read(socket,
+                              boost::asio::buffer(&request.body[request.body.size() - remaining], remaining),
+                              boost::asio::transfer_all());
+        }
+        return true;
+    }
+
+    enum class HTTPReadResult { Request, Closed, Malformed };
+
+    // The asynchronous counterpart of ReadHTTPRequest(), for the handlers of TCPServer::Connection-s.
+    // `buffer` and `request` should outlive the call, `callback` is run on the strand of the connection.
+    inline void AsyncReadHTTPRequest(std::shared_ptr<TCPServer::Connection> connection,
+                                     boost::asio::streambuf& buffer,
+                                     HTTPRequest& request,
+                                     std::function<void(HTTPReadResult)> callback) {
+        boost::asio::async_read_until(
+            connection->socket,
+            buffer,
+            HTTPInternal::EndOfRequestHead(),
+            connection->strand.wrap([connection, &buffer, &request, callback](const boost::system::error_code& ec,
+                                                                             size_t head_size) {
+                if (ec) {
+                    VLOG(3) << "AsyncReadHTTPRequest(): " << ec.message();
+                    callback((ec == boost::asio::error::not_found) ? HTTPReadResult::Malformed
+                                                                    : HTTPReadResult::Closed);
+                    return;
+                }
+                size_t remaining;
+                try {
+                    remaining = HTTPInternal::TakeRequestHead(buffer, head_size, request);
+                } catch (const ::TailProduce::HTTPRequestParseException& e) {
+                    VLOG(3) << "AsyncReadHTTPRequest(): " << e.what();
+                    callback(HTTPReadResult::Malformed);
+                    return;
+                }
+                if (!remaining) {
+                    callback(HTTPReadResult::Request);
+                    return;
+                }
+                boost::asio::async_read(
+                    connection->socket,
+                    boost::asio::buffer(&request.body[request.body.size() - remaining], remaining),
+                    connection->strand.wrap([connection, callback](const boost::system::error_code& ec, size_t) {
+                        callback(ec ? HTTPReadResult::Closed : HTTPReadResult::Request);
+                    }));
+            }));
+    }
+
+    inline const char* HTTPStatusText(int code) {
+        switch (code) {
+            case 200:
+                return "OK";
+            case 400:
+                return "Bad Request";
+            case 404:
+                return "Not Found";
+            case 405:
+                return "Method Not Allowed";
+            case 413:
+                return "Payload Too Large";
+            case 500:
+                return "Internal Server Error";
+            case 503:
+                return "Service Unavailable";
+            default:
+                return "Unknown";
+        }
+    }
+
+    inline std::string FormatHTTPResponseHead(int code,
+                                              const std::string& content_type,
+                                              size_t content_length,
+                                              bool keep_alive) {
+        std::ostringstream os;
+        os << "HTTP/1.1 " << code << ' ' << HTTPStatusText(code) << "\r\n";
+        os << "Content-Type: " << content_type << "\r\n";
+        os << "Content-Length: " << content_length << "\r\n";
+        os << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n";
+        os << "\r\n";
+        return os.str();
+    }
+
+    inline std::string FormatHTTPResponse(const HTTPRequest& request,
+                                          int code,
+                                          const std::string& body,
+                                          const std::string& content_type = "text/plain") {
+        return FormatHTTPResponseHead(code, content_type, body.length(), request.keep_alive) + body;
+    }
+
+    // The head of a response of unknown length, to be followed by AppendHTTPChunk()-s and kLastHTTPChunk.
+    inline std::string FormatHTTPChunkedResponseHead(int code,
+                                                     const std::string& content_type,
+                                                     const std::string& content_encoding = "") {
+        std::ostringstream os;
+        os << "HTTP/1.1 " << code << ' ' << HTTPStatusText(code) << "\r\n";
+        os << "Content-Type: " << content_type << "\r\n";
+        if (!content_encoding.empty()) {
+            os << "Content-Encoding: " << content_encoding << "\r\n";
+        }
+        os << "Transfer-Encoding: chunked\r\n";
+        os << "Connection: close\r\n";
+        os << "\r\n";
+        return os.str();
+    }
+
+    inline void AppendHTTPChunk(std::string& output, const char* data, size_t size) {
+        if (size) {
+            char length[20];
+            output.append(length, snprintf(length, sizeof(length), "%zx\r\n", size));
+            output.append(data, size);
+            output.append("\r\n", 2);
+        }
+    }
+
+    const char kLastHTTPChunk[] = "0\r\n\r\n";
+};
+
+#endif  // TAILPRODUCE_HTTP_H
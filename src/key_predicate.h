@@ -0,0 +1,122 @@
+// Key predicates: listener-side filters evaluated on the storage key of each entry before its value is read.
+//
+// A listener with a predicate only hands the processor the entries the predicate accepts. The rejected entries
+// are never read from the storage nor deserialized. Range-based predicates also move the storage iterator past
+// the gaps between the ranges, so a sparse query over a long history only touches the ranges it asks for.
+//
+// typename T_STREAM::INTERNAL_unsafe_listener_type listener(stream);
+// listener.SetKeyPredicate(std::unique_ptr<::TailProduce::KeyPredicate<T_STREAM>>(
+//     new ::TailProduce::PrimaryKeyRanges<T_STREAM>(stream, {{100, 200}, {1000, 1100}})));
+//
+// Predicates may keep state between the calls and assume the keys they see never go down,
+// so each listener needs its own instance. The same key can be evaluated more than once.
+
+#ifndef TAILPRODUCE_KEY_PREDICATE_H
+#define TAILPRODUCE_KEY_PREDICATE_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "storage.h"
+#include "tp_exceptions.h"
+
+namespace TailProduce {
+    enum class KeyPredicateDecision { Accept, Skip, SeekTo, End };
+
+    template <typename STREAM> struct KeyPredicate {
+        typedef STREAM T_STREAM;
+        virtual ~KeyPredicate() {
+        }
+        // Accept: the entry is processed. Skip: the entry is skipped.
+        // SeekTo: the entry is skipped, along with all the entries before `seek_to`, which should be greater
+        // than `storage_key`. End: no entry at or after `storage_key` will ever be accepted.
+        virtual KeyPredicateDecision Evaluate(const ::TailProduce::Storage::STORAGE_KEY_TYPE& storage_key,
+                                              ::TailProduce::Storage::STORAGE_KEY_TYPE& seek_to) = 0;
+    };
+
+    // Accepts the entries with the primary key within any of the [begin, end) ranges.
+    // Compares the raw storage keys, no decoding involved. The ranges may overlap and come in any order.
+    template <typename STREAM> struct PrimaryKeyRanges : KeyPredicate<STREAM> {
+        typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_ORDER_KEY T_ORDER_KEY;
+        typedef typename T_ORDER_KEY::T_PRIMARY_KEY T_PRIMARY_KEY;
+        typedef std::pair<T_PRIMARY_KEY, T_PRIMARY_KEY> T_RANGE;
+
+        PrimaryKeyRanges(const T_STREAM& stream, std::vector<T_RANGE> ranges) : current(0) {
+            std::sort(ranges.begin(), ranges.end());
+            for (const auto& range : ranges) {
+                if (!(range.first < range.second)) {
+                    continue;
+                }
+                if (!merged.empty() && !(merged.back().second < range.first)) {
+                    merged.back().second = std::max(merged.back().second, range.second);
+                } else {
+                    merged.push_back(range);
+                }
+            }
+            for (const auto& range : merged) {
+                bounds.emplace_back(T_ORDER_KEY(range.first).ComposeStorageKey(stream, stream.config_values()),
+                                    T_ORDER_KEY(range.second).ComposeStorageKey(stream, stream.config_values()));
+            }
+        }
+
+        virtual KeyPredicateDecision Evaluate(const ::TailProduce::Storage::STORAGE_KEY_TYPE& storage_key,
+                                              ::TailProduce::Storage::STORAGE_KEY_TYPE& seek_to) override {
+            // The keys only go up, the ranges that are behind will not be needed again.
+            while (current < bounds.size() && !(storage_key < bounds[current].second)) {
+                ++current;
+            }
+            if (current == bounds.size()) {
+                return KeyPredicateDecision::End;
+            } else if (!(storage_key < bounds[current].first)) {
+                return KeyPredicateDecision::Accept;
+            } else {
+                seek_to = bounds[current].first;
+                return KeyPredicateDecision::SeekTo;
+            }
+        }
+
+        const std::vector<T_RANGE>& Ranges() const {
+            return merged;
+        }
+
+      private:
+        std::vector<T_RANGE> merged;
+        std::vector<std::pair<::TailProduce::Storage::STORAGE_KEY_TYPE, ::TailProduce::Storage::STORAGE_KEY_TYPE>>
+            bounds;
+        size_t current;
+    };
+
+    // Samples the entries by their secondary key: accepts the ones with `secondary % modulo == remainder`.
+    template <typename STREAM> struct SecondaryKeySampling : KeyPredicate<STREAM> {
+        typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_ORDER_KEY T_ORDER_KEY;
+        typedef typename T_ORDER_KEY::T_SECONDARY_KEY T_SECONDARY_KEY;
+
+        SecondaryKeySampling(const T_STREAM& stream, const T_SECONDARY_KEY& modulo, const T_SECONDARY_KEY& remainder)
+            : stream(stream), modulo(modulo), remainder(remainder) {
+            if (!(remainder < modulo)) {
+                VLOG(3) << "throw ::TailProduce::InvalidKeyPredicateException();";
+                throw ::TailProduce::InvalidKeyPredicateException();
+            }
+        }
+
+        virtual KeyPredicateDecision Evaluate(const ::TailProduce::Storage::STORAGE_KEY_TYPE& storage_key,
+                                              ::TailProduce::Storage::STORAGE_KEY_TYPE&) override {
+            order_key.DecomposeStorageKey(storage_key, stream, stream.config_values());
+            return (order_key.secondary % modulo == remainder) ? KeyPredicateDecision::Accept
+                                                               : KeyPredicateDecision::Skip;
+        }
+
+      private:
+        const T_STREAM& stream;
+        const T_SECONDARY_KEY modulo;
+        const T_SECONDARY_KEY remainder;
+        T_ORDER_KEY order_key;
+    };
+};
+
+#endif  // TAILPRODUCE_KEY_PREDICATE_H
@@ -0,0 +1,226 @@
+// The publish-to-process latency of the listeners, enabled by StreamManagerParams::SetLatencyTracking().
+//
+// The publisher stamps each entry with the time it was pushed. The stamps are kept in memory, next to the stream,
+// and never get into the stored values. PublishTimestamps is a table of the latest stamps of the stream, indexed
+// by the hash of the order key. It is only ever touched under the stream mutex, which the publisher and the
+// listeners take anyway.
+//
+// Each AsyncListener records the delay from the entry being pushed to the entry being read for its processor
+// into a LatencyHistogram of its own, named `<stream>/<number>`. The entries with no stamp, published before the
+// framework started or too long ago for the table to still hold their stamps, are counted as unmatched.
+// The histograms of a framework are served as JSON at /latency.
+
+#ifndef TAILPRODUCE_LATENCY_H
+#define TAILPRODUCE_LATENCY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace TailProduce {
+    namespace LatencyInternal {
+        inline uint64_t NowInNanoseconds() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    };
+
+    // An HDR-style histogram of nanoseconds: exact below 128, then 128 buckets per power of two, which keeps
+    // every percentile within 1% of the true value. Recording is wait-free: one writer, the listener thread,
+    // stores into the atomic counters, and any thread may read them meanwhile.
+    class LatencyHistogram {
+      public:
+        enum { kSubBucketBits = 7, kSubBuckets = 1 << kSubBucketBits, kMaxMagnitude = 47 };
+        enum { kBuckets = (kMaxMagnitude - kSubBucketBits + 2) * kSubBuckets };
+
+        // From the one writing thread only.
+        void Record(uint64_t nanoseconds) {
+            std::atomic<uint64_t>& bucket = buckets[BucketIndex(nanoseconds)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (nanoseconds > max.load(std::memory_order_relaxed)) {
+                max.store(nanoseconds, std::memory_order_relaxed);
+            }
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        void RecordUnmatched() {
+            unmatched.store(unmatched.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        uint64_t Count() const {
+            return count.load(std::memory_order_acquire);
+        }
+        uint64_t Unmatched() const {
+            return unmatched.load(std::memory_order_relaxed);
+        }
+        uint64_t Max() const {
+            return max.load(std::memory_order_relaxed);
+        }
+
+        // The value at the given quantile, 0.5 for the median. Zero if nothing has been recorded.
+        uint64_t Percentile(double quantile) const {
+            const uint64_t total = Count();
+            if (!total) {
+                return 0;
+            }
+            const uint64_t rank = std::max(uint64_t(1), static_cast<uint64_t>(quantile * total + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                seen += buckets[i].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    // The last bucket takes all the values too large for the others.
+                    return i + 1 == kBuckets ? Max() : std::min(HighestValueInBucket(i), Max());
+                }
+            }
+            return Max();
+        }
+
+        static size_t BucketIndex(uint64_t value) {
+            if (value < kSubBuckets) {
+                return value;
+            }
+            const int magnitude = 63 - __builtin_clzll(value);
+            if (magnitude > kMaxMagnitude) {
+                return kBuckets - 1;
+            }
+            const int shift = magnitude - kSubBucketBits;
+            return (shift + 1) * kSubBuckets + (value >> shift) - kSubBuckets;
+        }
+
+        static uint64_t HighestValueInBucket(size_t index) {
+            if (index < 2 * kSubBuckets) {
+                return index;
+            }
+            const int shift = index / kSubBuckets - 1;
+            const uint64_t sub_bucket = index % kSubBuckets + kSubBuckets;
+            return ((sub_bucket + 1) << shift) - 1;
+        }
+
+      private:
+        std::atomic<uint64_t> buckets[kBuckets] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> unmatched{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    // The publish times of the latest entries of a stream, by their order keys. Used under the stream mutex only.
+    // A disabled one holds nothing and costs nothing.
+    class PublishTimestamps {
+      public:
+        enum { kSlotsBits = 14, kSlots = 1 << kSlotsBits };
+
+        explicit PublishTimestamps(bool enabled) : slots(enabled ? new Slot[kSlots]() : nullptr) {
+        }
+
+        bool Enabled() const {
+            return slots != nullptr;
+        }
+
+        void Stamp(uint64_t primary, uint64_t secondary, uint64_t nanoseconds) {
+            Slot& slot = slots[SlotIndex(primary, secondary)];
+            slot.primary = primary;
+            slot.secondary = secondary;
+            slot.nanoseconds = nanoseconds;
+        }
+
+        // Returns false if the stamp of this order key is not, or no longer, held.
+        bool Lookup(uint64_t primary, uint64_t secondary, uint64_t& nanoseconds) const {
+            const Slot& slot = slots[SlotIndex(primary, secondary)];
+            if (!slot.nanoseconds || slot.primary != primary || slot.secondary != secondary) {
+                return false;
+            }
+            nanoseconds = slot.nanoseconds;
+            return true;
+        }
+
+      private:
+        struct Slot {
+            uint64_t primary;
+            uint64_t secondary;
+            uint64_t nanoseconds;
+        };
+
+        static size_t SlotIndex(uint64_t primary, uint64_t secondary) {
+            return ((primary * 0x9e3779b97f4a7c15ull + secondary) * 0xc2b2ae3d27d4eb4full) >> (64 - kSlotsBits);
+        }
+
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    // The latency histograms of the listeners of a framework, by their names.
+    class LatencyHistograms {
+      public:
+        explicit LatencyHistograms(bool enabled) : enabled(enabled) {
+        }
+
+        bool Enabled() const {
+            return enabled;
+        }
+
+        // Keeps the histogram listed while in scope.
+        struct Registration {
+            Registration(LatencyHistograms& registry, const std::string& name)
+                : registry(registry), name(name), histogram(std::make_shared<LatencyHistogram>()) {
+            }
+            ~Registration() {
+                std::lock_guard<std::mutex> guard(registry.mutex);
+                registry.histograms.erase(name);
+            }
+
+            LatencyHistograms& registry;
+            const std::string name;
+            const std::shared_ptr<LatencyHistogram> histogram;
+
+            Registration() = delete;
+            Registration(const Registration&) = delete;
+            void operator=(const Registration&) = delete;
+        };
+
+        // Lists a new histogram for a listener of the stream. Returns null if the latency is not tracked.
+        std::unique_ptr<Registration> Register(const std::string& stream_name) {
+            if (!enabled) {
+                return nullptr;
+            }
+            std::lock_guard<std::mutex> guard(mutex);
+            std::unique_ptr<Registration> registration(
+                new Registration(*this, stream_name + '/' + std::to_string(++listeners_registered)));
+            histograms[registration->name] = registration->histogram;
+            return registration;
+        }
+
+        // {"<stream>/<number>": {"count": ..., "unmatched": ..., "p50_ns": ..., "p99_ns": ..., ...}, ...}
+        std::string FormatJSON() const {
+            std::lock_guard<std::mutex> guard(mutex);
+            std::ostringstream os;
+            os << '{';
+            bool first = true;
+            for (const auto& cit : histograms) {
+                const LatencyHistogram& h = *cit.second;
+                os << (first ? "" : ",") << "\n  \"" << cit.first << "\": {\"count\": " << h.Count()
+                   << ", \"unmatched\": " << h.Unmatched() << ", \"p50_ns\": " << h.Percentile(0.5)
+                   << ", \"p99_ns\": " << h.Percentile(0.99) << ", \"p999_ns\": " << h.Percentile(0.999)
+                   << ", \"max_ns\": " << h.Max() << '}';
+                first = false;
+            }
+            os << (first ? "}\n" : "\n}\n");
+            return os.str();
+        }
+
+      private:
+        const bool enabled;
+        mutable std::mutex mutex;
+        std::map<std::string, std::shared_ptr<const LatencyHistogram>> histograms;
+        size_t listeners_registered = 0;
+
+        LatencyHistograms() = delete;
+        LatencyHistograms(const LatencyHistograms&) = delete;
+        void operator=(const LatencyHistograms&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_LATENCY_H
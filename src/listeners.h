@@ -3,7 +3,10 @@
 #ifndef UNSAFELISTENERS_H
 #define UNSAFELISTENERS_H
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <string>
 #include <thread>
 #include <mutex>
 
@@ -11,15 +14,31 @@
 
 #include "stream.h"
 #include "storage.h"
+#include "columnar.h"
 #include "event_subscriber.h"
+#include "key_predicate.h"
+#include "latency.h"
+#include "memory_istream.h"
+#include "projection.h"
+#include "stats.h"
 #include "tp_exceptions.h"
+#include "tp_logging.h"
+#include "tracing.h"
 
 namespace TailProduce {
+    // Listener-side entry allocation policy.
+    // `FreshEntry` default-constructs a new entry for each record.
+    // `ReuseEntry` keeps one entry instance and one value buffer per listener and deserializes each record
+    // into them, so that the std::string / std::vector members keep their capacity across records.
+    // With `ReuseEntry`, the fields not covered by the entry's serialize() keep the values of the previous record.
+    enum class EntryAllocation { FreshEntry, ReuseEntry };
+
     // TODO(dkorolev): Rename this class.
     // INTERNAL_UnsafeListener contains the logic of creating and re-creating storage-level read iterators,
     // presenting data in serialized format and keeping track of HEAD order keys.
     template <typename STREAM> struct INTERNAL_UnsafeListener {
         typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_TRACER T_TRACER;
 
         // Unbounded.
         ~INTERNAL_UnsafeListener() {
@@ -82,32 +101,71 @@ namespace TailProduce {
         // Can change from false to true if/when new data is available.
         bool HasDataUnguarded() const {
             if (reached_end) {
-                VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = false, due to reached_end = true.";
+                TP_VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = false, due to reached_end = true.";
                 return false;
             } else {
-                if (!iterator) {
-                    iterator = std::move(storage.CreateStorageIterator(
-                        storage_cursor_key, stream.config_values().EndDataStorageKey(stream)));
-                    if (need_to_increment_cursor && !iterator->Done()) {
-                        iterator->Next();
+                while (true) {
+                    if (!iterator) {
+                        TraceScope<T_TRACER> trace(TraceEvent::StorageSeek);
+                        iterator = std::move(storage.CreateStorageIterator(
+                            storage_cursor_key, stream.config_values().EndDataStorageKey(stream)));
+                        stream.manager_->stats_.storage.CountIteratorCreated();
+                        if (need_to_increment_cursor && !iterator->Done()) {
+                            iterator->Next();
+                        }
+                    }
+                    if (iterator->Done()) {
+                        iterator.reset(nullptr);
+                        key_predicate_accepted = false;
+                        TP_VLOG(3) << this
+                                   << " INTERNAL_UnsafeListener::HasData() = false, due to no data in the iterator.";
+                        return false;
+                    }
+                    assert(iterator && !iterator->Done());
+                    if (has_end_key && iterator->Key() >= storage_end_key) {
+                        TP_VLOG(3) << this
+                                   << " INTERNAL_UnsafeListener::HasData() = false, due to reaching the end.";
+                        reached_end = true;
+                        iterator.reset(nullptr);
+                        return false;
                     }
-                }
-                if (iterator->Done()) {
-                    iterator.reset(nullptr);
-                    VLOG(3) << this
-                            << " INTERNAL_UnsafeListener::HasData() = false, due to no data in the iterator.";
-                    return false;
-                }
-                assert(iterator && !iterator->Done());
-                if (has_end_key && iterator->Key() >= storage_end_key) {
-                    VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = false, due to reaching the end.";
-                    reached_end = true;
-                    iterator.reset(nullptr);
-                    return false;
-                } else {
                     // TODO(dkorolev): Handle HEAD going beyond storage_end_key resulting in ReachedEnd().
-                    VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = true.";
-                    return true;
+                    if (!key_predicate || key_predicate_accepted) {
+                        TP_VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = true.";
+                        return true;
+                    }
+                    // The rejected entries are passed over the same way AdvanceToNextEntry() does it,
+                    // so that a re-created iterator does not have to go through them again.
+                    switch (key_predicate->Evaluate(iterator->Key(), key_predicate_seek_key)) {
+                        case KeyPredicateDecision::Accept:
+                            TP_VLOG(3) << this << " INTERNAL_UnsafeListener::HasData() = true.";
+                            key_predicate_accepted = true;
+                            return true;
+                        case KeyPredicateDecision::Skip:
+                            storage_cursor_key = iterator->Key();
+                            need_to_increment_cursor = true;
+                            UpdateStatsCursorUnguarded();
+                            iterator->Next();
+                            break;
+                        case KeyPredicateDecision::SeekTo:
+                            if (!(iterator->Key() < key_predicate_seek_key)) {
+                                VLOG(3) << "throw ::TailProduce::InvalidKeyPredicateException();";
+                                throw ::TailProduce::InvalidKeyPredicateException();
+                            }
+                            TP_VLOG(3) << this << " INTERNAL_UnsafeListener::HasData(): Seeking to '"
+                                       << key_predicate_seek_key << "'.";
+                            storage_cursor_key = key_predicate_seek_key;
+                            need_to_increment_cursor = false;
+                            UpdateStatsCursorUnguarded();
+                            iterator.reset(nullptr);
+                            break;
+                        case KeyPredicateDecision::End:
+                            TP_VLOG(3) << this
+                                       << " INTERNAL_UnsafeListener::HasData() = false, due to the predicate.";
+                            reached_end = true;
+                            iterator.reset(nullptr);
+                            return false;
+                    }
                 }
             }
         }
@@ -116,6 +174,35 @@ namespace TailProduce {
             return HasDataUnguarded();
         }
 
+        // PeekStorageKey() copies the storage key of the next available entry into `key`, without reading its value.
+        // Returns false if no data is available. Used to merge several streams, see merged_listener.h.
+        bool PeekStorageKey(::TailProduce::Storage::STORAGE_KEY_TYPE& key) const {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            if (!HasDataUnguarded()) {
+                return false;
+            }
+            key.assign(iterator->Key());
+            return true;
+        }
+
+        // PeekStorageEntry() copies the storage key and the serialized value of the next available entry,
+        // without deserializing it. Returns false if no data is available. Used to export raw entries.
+        bool PeekStorageEntry(::TailProduce::Storage::STORAGE_KEY_TYPE& key,
+                              ::TailProduce::Storage::STORAGE_VALUE_TYPE& value) const {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            if (!HasDataUnguarded()) {
+                return false;
+            }
+            key.assign(iterator->Key());
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::StorageGet);
+                const ::TailProduce::Storage::STORAGE_VALUE_TYPE& stored_value = iterator->Value();
+                value.assign(stored_value.begin(), stored_value.end());
+            }
+            stream.manager_->stats_.storage.CountRead(value.size());
+            return true;
+        }
+
         // ReachedEnd() returns true if the end has been reached and no data may even be read from this iterator.
         // Can only happen if the iterator has a fixed `end`, it has been reached and the HEAD of this stream
         // is beyond this end.
@@ -124,10 +211,110 @@ namespace TailProduce {
             return reached_end;
         }
 
+        void SetEntryAllocation(EntryAllocation mode) {
+            entry_allocation = mode;
+        }
+
+        // Records the delay from each entry being published to it being read for the processor, see latency.h.
+        // Does nothing unless the stream stamps its entries.
+        void SetLatencyHistogram(std::shared_ptr<LatencyHistogram> histogram) {
+            latency_histogram = histogram;
+        }
+
+        // Keeps the cursor, the entries processed and the time spent processing them in `stats`, see stats.h.
+        void SetStats(std::shared_ptr<ListenerStats> stats) {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            listener_stats = stats;
+            UpdateStatsCursorUnguarded();
+        }
+
+        // Only the entries accepted by the predicate will be seen by HasData() and processed. See key_predicate.h.
+        void SetKeyPredicate(std::unique_ptr<KeyPredicate<T_STREAM>> predicate) {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            key_predicate = std::move(predicate);
+        }
+
         // ProcessEntrySync() deserealizes the entry and calls the supplied method of the respective type.
         template <typename PROCESSOR> void ProcessEntrySync(PROCESSOR& processor, bool require_data = true) {
-            std::string key_as_string;  // For logging purposes, should be removed in non-debug builds.
-            std::string value_as_string;
+            ProcessEntrySyncImpl(processor, require_data, entry_allocation);
+        }
+
+        // ProcessBatchSync() decodes up to `max_entries` available entries into the column buffers of `batch`,
+        // advances the listener past them and hands the whole batch to the processor in one call.
+        // Returns the number of entries consumed. The batch is cleared first and keeps its capacity.
+        // Entries are always deserialized into the reused instance, since only their columns are retained.
+        template <typename PROCESSOR>
+        size_t ProcessBatchSync(PROCESSOR& processor, typename PROCESSOR::T_BATCH& batch, size_t max_entries) {
+            batch.Clear();
+            ColumnExtractor<PROCESSOR> extractor(processor, batch);
+            size_t consumed = 0;
+            while (consumed < max_entries && HasData()) {
+                ProcessEntrySyncImpl(extractor, true, EntryAllocation::ReuseEntry);
+                AdvanceToNextEntry();
+                ++consumed;
+            }
+            if (batch.Size()) {
+                const uint64_t begin = listener_stats ? LatencyInternal::NowInNanoseconds() : 0;
+                processor(static_cast<const typename PROCESSOR::T_BATCH&>(batch));
+                if (listener_stats) {
+                    listener_stats->CountProcessed(0, LatencyInternal::NowInNanoseconds() - begin);
+                }
+            }
+            TP_VLOG(3) << this << " INTERNAL_UnsafeListener::ProcessBatchSync(): " << consumed << " entries.";
+            return consumed;
+        }
+
+        // AdvanceToNextEntry() advances the listener to the next available entry.
+        // Will throw an exception if no further data is (yet) available.
+        void AdvanceToNextEntry() {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            if (!HasDataUnguarded()) {
+                VLOG(3) << "throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();";
+                throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();
+            }
+            if (!iterator) {
+                VLOG(3) << "throw ::TailProduce::InternalError();";
+                throw ::TailProduce::InternalError();
+            }
+            storage_cursor_key = iterator->Key();
+            need_to_increment_cursor = true;
+            UpdateStatsCursorUnguarded();
+            iterator->Next();
+            key_predicate_accepted = false;
+        }
+
+        // The storage key of the last entry the listener has advanced past, empty if there is none yet.
+        ::TailProduce::Storage::STORAGE_KEY_TYPE LastEntryStorageKey() const {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            return need_to_increment_cursor ? storage_cursor_key : ::TailProduce::Storage::STORAGE_KEY_TYPE();
+        }
+
+        // ResumeAfter() moves the listener to the entry following the one with the given storage key,
+        // as returned by LastEntryStorageKey(), for a restarted job to pick up where it has left off.
+        void ResumeAfter(const ::TailProduce::Storage::STORAGE_KEY_TYPE& key) {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            storage_cursor_key = key;
+            need_to_increment_cursor = true;
+            UpdateStatsCursorUnguarded();
+            iterator.reset(nullptr);
+            key_predicate_accepted = false;
+        }
+
+      private:
+        void UpdateStatsCursorUnguarded() const {
+            if (listener_stats) {
+                listener_stats->cursor = storage_cursor_key;
+                listener_stats->cursor_processed = need_to_increment_cursor;
+            }
+        }
+
+        template <typename PROCESSOR>
+        void ProcessEntrySyncImpl(PROCESSOR& processor, bool require_data, EntryAllocation mode) {
+            typedef typename ProjectionOf<PROCESSOR>::type T_PROJECTION;
+            std::string fresh_value;
+            std::string& value_as_string = (mode == EntryAllocation::ReuseEntry) ? reusable_value : fresh_value;
+            bool published_at_known = false;
+            uint64_t published_at;
             {
                 std::lock_guard<std::mutex> guard(stream.lock_mutex());
                 if (!HasDataUnguarded()) {
@@ -145,46 +332,104 @@ namespace TailProduce {
 
                 // TODO(dkorolev): Make this proof-of-concept code efficient.
                 order_key_instance.DecomposeStorageKey(iterator->Key(), stream, stream.config_values());
-                const ::TailProduce::Storage::STORAGE_VALUE_TYPE& value = iterator->Value();
-                value_as_string = std::string(value.begin(), value.end());
+                // Key-only processors do not need the value, so it is not read from the storage at all.
+                if (!T_PROJECTION::key_only) {
+                    TraceScope<T_TRACER> trace(TraceEvent::StorageGet);
+                    const ::TailProduce::Storage::STORAGE_VALUE_TYPE& value = iterator->Value();
+                    value_as_string.assign(value.begin(), value.end());
+                    stream.manager_->stats_.storage.CountRead(value_as_string.size());
+                }
+                TP_VLOG(3) << this << " INTERNAL_UnsafeListener::ProcessEntrySync(): ['" << iterator->Key()
+                           << "'] = '" << value_as_string << "'";
+
+                if (latency_histogram && stream.publish_timestamps_.Enabled()) {
+                    published_at_known = stream.publish_timestamps_.Lookup(
+                        order_key_instance.primary, order_key_instance.secondary, published_at);
+                    if (!published_at_known) {
+                        latency_histogram->RecordUnmatched();
+                    }
+                }
+            }
+            if (published_at_known) {
+                const uint64_t now = LatencyInternal::NowInNanoseconds();
+                latency_histogram->Record(now > published_at ? now - published_at : 0);
+            }
+            // The time spent processing includes deserializing the entry.
+            const uint64_t begin = listener_stats ? LatencyInternal::NowInNanoseconds() : 0;
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::DeserializeAndProcess);
+                DeSerializeAndProcess<T_PROJECTION>(
+                    processor, value_as_string, mode, std::integral_constant<bool, T_PROJECTION::key_only>());
+            }
+            if (listener_stats) {
+                listener_stats->CountProcessed(1, LatencyInternal::NowInNanoseconds() - begin);
+            }
+        }
 
-                // For logging purposes, should be removed in non-debug builds.
-                ::TailProduce::Storage::STORAGE_KEY_TYPE const key = iterator->Key();
-                key_as_string = std::string(key.begin(), key.end());
+        // Key-only projection: no deserialization, the processor gets an entry with just the order key set.
+        template <typename PROJECTION, typename PROCESSOR>
+        void DeSerializeAndProcess(PROCESSOR& processor, const std::string&, EntryAllocation mode, std::true_type) {
+            if (mode == EntryAllocation::ReuseEntry) {
+                reusable_entry.SetOrderKey(order_key_instance.primary);
+                processor(reusable_entry);
+            } else {
+                typename T_STREAM::T_ENTRY entry;
+                entry.SetOrderKey(order_key_instance.primary);
+                processor(entry);
             }
-            VLOG(3) << this << " INTERNAL_UnsafeListener::ProcessEntrySync(): ['" << key_as_string << "'] = '"
-                    << value_as_string << "'";
-            std::istringstream is(value_as_string);
-            T_STREAM::T_ENTRY::DeSerializeAndProcessEntry(is, order_key_instance.primary, processor);
         }
 
-        // AdvanceToNextEntry() advances the listener to the next available entry.
-        // Will throw an exception if no further data is (yet) available.
-        void AdvanceToNextEntry() {
-            std::lock_guard<std::mutex> guard(stream.lock_mutex());
-            if (!HasDataUnguarded()) {
-                VLOG(3) << "throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();";
-                throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();
+        template <typename PROJECTION, typename PROCESSOR>
+        void DeSerializeAndProcess(PROCESSOR& processor,
+                                   const std::string& value,
+                                   EntryAllocation mode,
+                                   std::false_type) {
+            DeSerializeFields(processor, value, mode, static_cast<PROJECTION*>(nullptr));
+        }
+
+        template <typename PROCESSOR>
+        void DeSerializeFields(PROCESSOR& processor, const std::string& value, EntryAllocation mode, AllFields*) {
+            if (mode == EntryAllocation::ReuseEntry) {
+                MemoryInputStream is(value.data(), value.data() + value.size());
+                T_STREAM::T_ENTRY::DeSerializeAndProcessEntry(
+                    is, order_key_instance.primary, processor, reusable_entry);
+            } else {
+                std::istringstream is(value);
+                T_STREAM::T_ENTRY::DeSerializeAndProcessEntry(is, order_key_instance.primary, processor);
             }
-            if (!iterator) {
-                VLOG(3) << "throw ::TailProduce::InternalError();";
-                throw ::TailProduce::InternalError();
+        }
+
+        template <typename PROCESSOR, typename PROJECTION>
+        void DeSerializeFields(PROCESSOR& processor, const std::string& value, EntryAllocation mode, PROJECTION*) {
+            MemoryInputStream is(value.data(), value.data() + value.size());
+            if (mode == EntryAllocation::ReuseEntry) {
+                T_STREAM::T_ENTRY::template DeSerializeProjectedAndProcessEntry<PROJECTION>(
+                    is, order_key_instance.primary, processor, reusable_entry);
+            } else {
+                typename T_STREAM::T_ENTRY entry;
+                T_STREAM::T_ENTRY::template DeSerializeProjectedAndProcessEntry<PROJECTION>(
+                    is, order_key_instance.primary, processor, entry);
             }
-            storage_cursor_key = iterator->Key();
-            need_to_increment_cursor = true;
-            iterator->Next();
         }
 
-      private:
         const T_STREAM& stream;
         typename T_STREAM::T_STORAGE& storage;
-        ::TailProduce::Storage::STORAGE_KEY_TYPE storage_cursor_key;
-        bool need_to_increment_cursor;
+        mutable ::TailProduce::Storage::STORAGE_KEY_TYPE storage_cursor_key;
+        mutable bool need_to_increment_cursor;
         const bool has_end_key;
         ::TailProduce::Storage::STORAGE_KEY_TYPE const storage_end_key;
         mutable bool reached_end;
         mutable typename T_STREAM::T_STORAGE::StorageIterator iterator;
         mutable typename T_STREAM::T_ORDER_KEY order_key_instance;
+        std::unique_ptr<KeyPredicate<T_STREAM>> key_predicate;
+        mutable ::TailProduce::Storage::STORAGE_KEY_TYPE key_predicate_seek_key;
+        // Whether the predicate has accepted the entry the iterator points to, to not evaluate it again.
+        mutable bool key_predicate_accepted = false;
+        EntryAllocation entry_allocation = EntryAllocation::FreshEntry;
+        typename T_STREAM::T_ENTRY reusable_entry;
+        std::string reusable_value;
+        std::shared_ptr<LatencyHistogram> latency_histogram;
+        std::shared_ptr<ListenerStats> listener_stats;
 
         INTERNAL_UnsafeListener() = delete;
         INTERNAL_UnsafeListener(const INTERNAL_UnsafeListener&) = delete;
@@ -192,6 +437,99 @@ namespace TailProduce {
         void operator=(const INTERNAL_UnsafeListener&) = delete;
     };
 
+    namespace ListenersInternal {
+        enum { kDefaultCommitEveryEntries = 1000 };
+    };
+
+    // ConsumerCursor keeps the cursor of a named consumer of the stream in the storage, under the
+    // `s:<stream>:consumer:<name>` meta key, for the listener to resume after it once restarted,
+    // instead of going through the stream from the beginning.
+    // The cursor is the storage key of the last entry processed. The listener thread commits it every
+    // `commit_every_entries` entries, on request, see CommitAndWait(), and once the listener is terminating.
+    // The entries processed since the last commit are processed again by the restarted listener.
+    template <typename STREAM> class ConsumerCursor {
+      public:
+        ConsumerCursor(const STREAM& stream, const std::string& name, size_t commit_every_entries)
+            : stream(stream),
+              storage_key(stream.config_values().ConsumerCursorStorageKey(stream, name)),
+              commit_every_entries(commit_every_entries ? commit_every_entries : 1) {
+        }
+
+        // Moves the listener to the entry following the committed cursor, if there is one.
+        void Resume(INTERNAL_UnsafeListener<STREAM>& listener) {
+            {
+                std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                if (stream.manager_->storage.Has(storage_key)) {
+                    committed = ::TailProduce::Storage::ValueToKey(stream.manager_->storage.Get(storage_key));
+                }
+            }
+            if (!committed.empty()) {
+                VLOG(2) << this << " ConsumerCursor('" << storage_key << "'): Resuming after '" << committed << "'.";
+                listener.ResumeAfter(committed);
+            }
+        }
+
+        // Called by the listener thread once it has processed and advanced past `entries` entries.
+        void Processed(INTERNAL_UnsafeListener<STREAM>& listener, size_t entries = 1) {
+            entries_since_commit += entries;
+            if (entries_since_commit >= commit_every_entries || commit_requested) {
+                Commit(listener);
+            }
+        }
+
+        // Called by the listener thread when it has no entries to process.
+        void Idle(INTERNAL_UnsafeListener<STREAM>& listener) {
+            if (commit_requested) {
+                Commit(listener);
+            }
+        }
+
+        // Called by the listener thread. Writes the cursor to the storage, unless it is already there.
+        void Commit(INTERNAL_UnsafeListener<STREAM>& listener) {
+            const ::TailProduce::Storage::STORAGE_KEY_TYPE cursor = listener.LastEntryStorageKey();
+            if (!cursor.empty() && cursor != committed) {
+                const ::TailProduce::Storage::STORAGE_VALUE_TYPE value = ::TailProduce::Storage::KeyToValue(cursor);
+                {
+                    std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                    TraceScope<typename STREAM::T_TRACER> trace(TraceEvent::StorageSet);
+                    stream.manager_->storage.SetAllowingOverwrite(storage_key, value);
+                }
+                stream.manager_->stats_.storage.CountWrite(value.size());
+                committed = cursor;
+            }
+            entries_since_commit = 0;
+            std::lock_guard<std::mutex> guard(mutex);
+            commit_requested = false;
+            ++commits;
+            condition.notify_all();
+        }
+
+        // Called by any other thread: has the listener thread commit the cursor and waits until it has.
+        void CommitAndWait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            const size_t next_commit = commits + 1;
+            commit_requested = true;
+            condition.wait(lock, [this, next_commit]() { return commits >= next_commit; });
+        }
+
+      private:
+        const STREAM& stream;
+        const ::TailProduce::Storage::STORAGE_KEY_TYPE storage_key;
+        const size_t commit_every_entries;
+        // Only used by the listener thread.
+        ::TailProduce::Storage::STORAGE_KEY_TYPE committed;
+        size_t entries_since_commit = 0;
+
+        std::atomic<bool> commit_requested{false};
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t commits = 0;
+
+        ConsumerCursor() = delete;
+        ConsumerCursor(const ConsumerCursor&) = delete;
+        void operator=(const ConsumerCursor&) = delete;
+    };
+
     // TODO(dkorolev): Add support for other listener types, not just "all" range.
     template <typename T_STREAM> struct AsyncListenersFactory {
         AsyncListenersFactory(const T_STREAM& stream) : stream(stream) {
@@ -199,10 +537,20 @@ namespace TailProduce {
 
         template <typename PROCESSOR> struct AsyncListener : ::TailProduce::Subscriber {
             typedef PROCESSOR T_PROCESSOR;
-            AsyncListener(const T_STREAM& stream, T_PROCESSOR& processor)
+            AsyncListener(const T_STREAM& stream,
+                          T_PROCESSOR& processor,
+                          EntryAllocation entry_allocation,
+                          const std::string& consumer_name = "",
+                          size_t commit_every_entries = ListenersInternal::kDefaultCommitEveryEntries)
                 : stream(stream),
                   processor(processor),
+                  entry_allocation(entry_allocation),
+                  cursor(consumer_name.empty()
+                             ? nullptr
+                             : new ConsumerCursor<T_STREAM>(stream, consumer_name, commit_every_entries)),
                   subscribe(this, stream.subscriptions_),
+                  latency(stream.manager_->latency_histograms_.Register(stream.name)),
+                  stats(stream.manager_->stats_.RegisterListener(stream.name)),
                   worker_thread(&AsyncListener::ThreadFunction, this) {
             }
             virtual ~AsyncListener() {
@@ -212,16 +560,94 @@ namespace TailProduce {
                 VLOG(2) << this << " AsyncListener::~AsyncListener(): Thread terminated.";
             }
 
+            // The publish-to-process latency of this listener, null unless tracked, see latency.h.
+            const LatencyHistogram* Latency() const {
+                return latency ? latency->histogram.get() : nullptr;
+            }
+            // The name of the latency histogram, as served at /latency.
+            std::string LatencyHistogramName() const {
+                return latency ? latency->name : std::string();
+            }
+
+            // The progress of this listener, null unless the stats are collected, see stats.h.
+            const ListenerStats* Stats() const {
+                return stats ? stats->listener.get() : nullptr;
+            }
+            // The name of the listener, as served at /stats.
+            std::string StatsName() const {
+                return stats ? stats->name : std::string();
+            }
+
+            // Commits the cursor of a named consumer now, and returns once it is committed.
+            // Does nothing for the listeners that are not named consumers.
+            void CommitCursor() {
+                if (cursor) {
+                    cursor->CommitAndWait();
+                }
+            }
+
             void ThreadFunction() {
                 INTERNAL_UnsafeListener<T_STREAM> impl(stream);
+                impl.SetEntryAllocation(entry_allocation);
+                if (latency) {
+                    impl.SetLatencyHistogram(latency->histogram);
+                }
+                if (stats) {
+                    impl.SetStats(stats->listener);
+                }
+                if (cursor) {
+                    cursor->Resume(impl);
+                }
+                RunLoop(impl, std::integral_constant<bool, IsBatchProcessor<T_PROCESSOR>::value>());
+                if (cursor) {
+                    cursor->Commit(impl);
+                }
+            }
+
+            // Per-entry processors.
+            void RunLoop(INTERNAL_UnsafeListener<T_STREAM>& impl, std::false_type) {
                 // TODO(dkorolev): This, of course, should not be based on this repeated check.
+                while (!terminating) {
+                    if (!impl.ReachedEnd() && impl.HasData()) {
+                        // The entries available since the listener has last run out of them make a batch.
+                        TraceScope<typename T_STREAM::T_TRACER> trace(TraceEvent::ListenerBatch);
+                        do {
+                            TP_VLOG(3) << this << " AsyncListener::ThreadFunction(): Has entry.";
+                            impl.ProcessEntrySync(processor);
+                            TP_VLOG(3) << this << " AsyncListener::ThreadFunction(): Processed entry.";
+                            impl.AdvanceToNextEntry();
+                            TP_VLOG(3) << this << " AsyncListener::ThreadFunction(): Advanced to next entry.";
+                            if (cursor) {
+                                cursor->Processed(impl);
+                            }
+                        } while (!terminating && !impl.ReachedEnd() && impl.HasData());
+                    }
+                    if (cursor) {
+                        cursor->Idle(impl);
+                    }
+                    {
+                        std::lock_guard<std::mutex> guard(mutex);
+                        ++cycles;
+                    }
+                }
+            }
+
+            // Batch processors, the ones that declare `T_BATCH`, see columnar.h.
+            template <typename BATCH_PROCESSOR = T_PROCESSOR>
+            void RunLoop(INTERNAL_UnsafeListener<T_STREAM>& impl, std::true_type) {
+                typename BATCH_PROCESSOR::T_BATCH batch;
                 while (!terminating) {
                     while (!terminating && !impl.ReachedEnd() && impl.HasData()) {
-                        VLOG(3) << this << " AsyncListener::ThreadFunction(): Has entry.";
-                        impl.ProcessEntrySync(processor);
-                        VLOG(3) << this << " AsyncListener::ThreadFunction(): Processed entry.";
-                        impl.AdvanceToNextEntry();
-                        VLOG(3) << this << " AsyncListener::ThreadFunction(): Advanced to next entry.";
+                        TraceScope<typename T_STREAM::T_TRACER> trace(TraceEvent::ListenerBatch);
+                        const size_t consumed =
+                            impl.ProcessBatchSync(processor, batch, BATCH_PROCESSOR::T_BATCH::default_max_size);
+                        TP_VLOG(3) << this << " AsyncListener::ThreadFunction(): Processed batch.";
+                        if (cursor) {
+                            cursor->Processed(impl, consumed);
+                        }
+                    }
+                    if (cursor) {
+                        cursor->Idle(impl);
                     }
                     {
                         std::lock_guard<std::mutex> guard(mutex);
@@ -258,7 +684,12 @@ namespace TailProduce {
             const T_STREAM& stream;
 
             T_PROCESSOR& processor;
+            const EntryAllocation entry_allocation;
+            // Null unless the listener is a named consumer.
+            const std::unique_ptr<ConsumerCursor<T_STREAM>> cursor;
             ::TailProduce::SubscribeWhileInScope<::TailProduce::SubscriptionsManager> subscribe;
+            const std::unique_ptr<LatencyHistograms::Registration> latency;
+            const std::unique_ptr<FrameworkStats::ListenerRegistration> stats;
 
             std::mutex mutex;
             bool terminating = false;
@@ -272,9 +703,29 @@ namespace TailProduce {
             void operator=(const AsyncListener&) = delete;
         };
 
-        template <typename PROCESSOR> std::unique_ptr<AsyncListener<PROCESSOR>> operator()(PROCESSOR& processor) {
+        template <typename PROCESSOR>
+        std::unique_ptr<AsyncListener<PROCESSOR>> operator()(
+            PROCESSOR& processor,
+            EntryAllocation entry_allocation = EntryAllocation::FreshEntry) {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            return std::unique_ptr<AsyncListener<PROCESSOR>>(
+                new AsyncListener<PROCESSOR>(stream, processor, entry_allocation));
+        }
+
+        // A named consumer: the listener resumes after the cursor committed under the same name, see ConsumerCursor.
+        template <typename PROCESSOR>
+        std::unique_ptr<AsyncListener<PROCESSOR>> Consumer(
+            const std::string& name,
+            PROCESSOR& processor,
+            EntryAllocation entry_allocation = EntryAllocation::FreshEntry,
+            size_t commit_every_entries = ListenersInternal::kDefaultCommitEveryEntries) {
+            if (name.empty()) {
+                VLOG(3) << "throw ::TailProduce::ConsumerNameEmptyException();";
+                throw ::TailProduce::ConsumerNameEmptyException();
+            }
             std::lock_guard<std::mutex> guard(stream.lock_mutex());
-            return std::unique_ptr<AsyncListener<PROCESSOR>>(new AsyncListener<PROCESSOR>(stream, processor));
+            return std::unique_ptr<AsyncListener<PROCESSOR>>(
+                new AsyncListener<PROCESSOR>(stream, processor, entry_allocation, name, commit_every_entries));
         }
 
       private:
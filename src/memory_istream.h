@@ -0,0 +1,30 @@
+// Non-owning, non-copying std::istream over a contiguous range of bytes.
+// Unlike std::istringstream, it does not copy the buffer, thus deserializing from it does not allocate.
+// The buffer should outlive the stream.
+
+#ifndef TAILPRODUCE_MEMORY_ISTREAM_H
+#define TAILPRODUCE_MEMORY_ISTREAM_H
+
+#include <istream>
+#include <streambuf>
+
+namespace TailProduce {
+    struct MemoryInputStreamBuffer : std::streambuf {
+        MemoryInputStreamBuffer(const char* begin, const char* end) {
+            char* b = const_cast<char*>(begin);
+            setg(b, b, const_cast<char*>(end));
+        }
+    };
+
+    struct MemoryInputStream : private MemoryInputStreamBuffer, public std::istream {
+        MemoryInputStream(const char* begin, const char* end)
+            : MemoryInputStreamBuffer(begin, end), std::istream(static_cast<std::streambuf*>(this)) {
+        }
+
+        MemoryInputStream() = delete;
+        MemoryInputStream(const MemoryInputStream&) = delete;
+        void operator=(const MemoryInputStream&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_MEMORY_ISTREAM_H
@@ -0,0 +1,254 @@
+// MergedListener reads several streams as one, in the order of their primary keys.
+//
+// The streams should share the type of the primary key. Their entry types may differ: the processor is called
+// with the entry of the respective stream, the same way the listener of that stream would call it.
+//
+// An entry is only handed out once no stream can get an entry with a smaller primary key. Each of the other
+// streams should either have its next entry available, or have its HEAD at or beyond the primary key of the
+// entry to hand out. A stream with no new entries thus holds the merge back until its publisher moves its HEAD
+// forward, with the next entry or with PushHead().
+//
+// Entries with equal primary keys from different streams are handed out in the order the streams are passed in,
+// as long as they are available at the same time.
+//
+// Single-threaded: all the calls should come from one thread. The merge does not allocate memory per entry:
+// the cursors and the heap over them are fixed-size, and the storage keys are compared without decoding them.
+// Use EntryAllocation::ReuseEntry to have the per-stream listeners reuse their entries as well.
+//
+// ::TailProduce::MergedListener<foo_type, bar_type> merged(streams_manager.foo, streams_manager.bar);
+// while (merged.HasData()) {
+//     merged.ProcessEntrySync(processor);  // Accepts both `foo_type::T_ENTRY` and `bar_type::T_ENTRY`.
+//     merged.AdvanceToNextEntry();
+// }
+
+#ifndef TAILPRODUCE_MERGED_LISTENER_H
+#define TAILPRODUCE_MERGED_LISTENER_H
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+
+#include <glog/logging.h>
+
+#include "fixed_size_serializer.h"
+#include "listeners.h"
+#include "storage.h"
+#include "tp_exceptions.h"
+#include "tp_logging.h"
+
+namespace TailProduce {
+    namespace MergedListenerInternal {
+        template <typename T, typename... TS> struct AllSame : std::true_type {};
+        template <typename T, typename U, typename... TS>
+        struct AllSame<T, U, TS...>
+            : std::integral_constant<bool, std::is_same<T, U>::value && AllSame<T, TS...>::value> {};
+
+        // Calls `f(*std::get<I>(listeners))` for the runtime index `i == I`.
+        template <size_t I, size_t N> struct Dispatch {
+            template <typename TUPLE, typename F> static void Run(TUPLE& listeners, size_t i, F& f) {
+                if (i == I) {
+                    f(*std::get<I>(listeners));
+                } else {
+                    Dispatch<I + 1, N>::Run(listeners, i, f);
+                }
+            }
+        };
+        template <size_t N> struct Dispatch<N, N> {
+            template <typename TUPLE, typename F> static void Run(TUPLE&, size_t, F&) {
+            }
+        };
+
+        struct SetEntryAllocation {
+            EntryAllocation mode;
+            template <typename LISTENER> void operator()(LISTENER& listener) const {
+                listener.SetEntryAllocation(mode);
+            }
+        };
+        struct PeekStorageKey {
+            ::TailProduce::Storage::STORAGE_KEY_TYPE& key;
+            bool found;
+            template <typename LISTENER> void operator()(LISTENER& listener) {
+                found = listener.PeekStorageKey(key);
+            }
+        };
+        template <typename PRIMARY_KEY> struct GetHeadAndReachedEnd {
+            PRIMARY_KEY head;
+            bool reached_end;
+            template <typename LISTENER> void operator()(LISTENER& listener) {
+                reached_end = listener.ReachedEnd();
+                head = listener.GetHead();
+            }
+        };
+        template <typename PROCESSOR> struct ProcessEntrySync {
+            PROCESSOR& processor;
+            template <typename LISTENER> void operator()(LISTENER& listener) {
+                listener.ProcessEntrySync(processor);
+            }
+        };
+        struct AdvanceToNextEntry {
+            template <typename LISTENER> void operator()(LISTENER& listener) const {
+                listener.AdvanceToNextEntry();
+            }
+        };
+    };
+
+    template <typename... STREAMS> struct MergedListener {
+        enum { N = sizeof...(STREAMS) };
+        static_assert(N > 0, "MergedListener needs at least one stream.");
+        typedef typename std::tuple_element<0, std::tuple<STREAMS...>>::type::T_ORDER_KEY::T_PRIMARY_KEY
+            T_PRIMARY_KEY;
+        static_assert(MergedListenerInternal::AllSame<T_PRIMARY_KEY,
+                                                      typename STREAMS::T_ORDER_KEY::T_PRIMARY_KEY...>::value,
+                      "The streams of MergedListener should have the same primary key type.");
+        typedef std::tuple<std::unique_ptr<INTERNAL_UnsafeListener<STREAMS>>...> T_LISTENERS;
+
+        // Unbounded.
+        explicit MergedListener(const STREAMS&... streams)
+            : listeners(std::unique_ptr<INTERNAL_UnsafeListener<STREAMS>>(
+                  new INTERNAL_UnsafeListener<STREAMS>(streams))...),
+              primary_key_offset{{streams.storage_key_data_prefix.length()...}} {
+            pending.fill(false);
+            VLOG(3) << this << ": MergedListener::MergedListener(), " << N << " streams.";
+        }
+
+        // Bounded, [begin, end) by the primary key, for each of the streams.
+        MergedListener(const T_PRIMARY_KEY& begin, const T_PRIMARY_KEY& end, const STREAMS&... streams)
+            : listeners(std::unique_ptr<INTERNAL_UnsafeListener<STREAMS>>(
+                  new INTERNAL_UnsafeListener<STREAMS>(streams, begin, end))...),
+              primary_key_offset{{streams.storage_key_data_prefix.length()...}} {
+            pending.fill(false);
+            VLOG(3) << this << ": MergedListener::MergedListener(" << begin << ", " << end << "), " << N
+                    << " streams.";
+        }
+
+        void SetEntryAllocation(EntryAllocation mode) {
+            MergedListenerInternal::SetEntryAllocation f{mode};
+            for (size_t i = 0; i < N; ++i) {
+                MergedListenerInternal::Dispatch<0, N>::Run(listeners, i, f);
+            }
+        }
+
+        // HasData() returns true if the next entry in the merged order is available and safe to hand out.
+        // Can change from false to true as new data arrives or the HEAD-s of the streams move forward.
+        bool HasData() {
+            for (size_t i = 0; i < N; ++i) {
+                Refresh(i);
+            }
+            while (heap_size) {
+                const size_t top = heap[0];
+                bool got_new_data = false;
+                for (size_t i = 0; i < N && !got_new_data; ++i) {
+                    if (!pending[i]) {
+                        // The HEAD goes first: if the stream still has no data after it has been read,
+                        // its further entries can not come before the HEAD.
+                        MergedListenerInternal::GetHeadAndReachedEnd<T_PRIMARY_KEY> f;
+                        MergedListenerInternal::Dispatch<0, N>::Run(listeners, i, f);
+                        Refresh(i);
+                        if (pending[i]) {
+                            got_new_data = true;
+                        } else if (!f.reached_end && f.head < primary_keys[top]) {
+                            TP_VLOG(3) << this << " MergedListener::HasData() = false, waiting for stream " << i
+                                       << ".";
+                            return false;
+                        }
+                    }
+                }
+                if (!got_new_data) {
+                    TP_VLOG(3) << this << " MergedListener::HasData() = true, stream " << top << ".";
+                    return true;
+                }
+            }
+            TP_VLOG(3) << this << " MergedListener::HasData() = false, no stream has data.";
+            return false;
+        }
+
+        // ReachedEnd() returns true if each of the listeners has reached its end.
+        bool ReachedEnd() {
+            for (size_t i = 0; i < N; ++i) {
+                Refresh(i);
+                if (pending[i]) {
+                    return false;
+                }
+                MergedListenerInternal::GetHeadAndReachedEnd<T_PRIMARY_KEY> f;
+                MergedListenerInternal::Dispatch<0, N>::Run(listeners, i, f);
+                if (!f.reached_end) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // The index of the stream, in the order they were passed in, the next entry comes from.
+        size_t CurrentStreamIndex() {
+            if (!HasData()) {
+                VLOG(3) << "throw ::TailProduce::ListenerHasNoDataToRead();";
+                throw ::TailProduce::ListenerHasNoDataToRead();
+            }
+            return heap[0];
+        }
+
+        template <typename PROCESSOR> void ProcessEntrySync(PROCESSOR& processor) {
+            MergedListenerInternal::ProcessEntrySync<PROCESSOR> f{processor};
+            MergedListenerInternal::Dispatch<0, N>::Run(listeners, CurrentStreamIndex(), f);
+        }
+
+        void AdvanceToNextEntry() {
+            if (!HasData()) {
+                VLOG(3) << "throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();";
+                throw ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable();
+            }
+            const size_t i = heap[0];
+            std::pop_heap(heap.begin(), heap.begin() + heap_size, Later{primary_keys});
+            --heap_size;
+            pending[i] = false;
+            MergedListenerInternal::AdvanceToNextEntry f;
+            MergedListenerInternal::Dispatch<0, N>::Run(listeners, i, f);
+            Refresh(i);
+        }
+
+      private:
+        // The heap order: the entry with the smaller primary key comes first, ties are broken by the stream index.
+        struct Later {
+            const std::array<T_PRIMARY_KEY, N>& keys;
+            bool operator()(size_t a, size_t b) const {
+                return keys[b] < keys[a] || (!(keys[a] < keys[b]) && b < a);
+            }
+        };
+
+        // Puts the next entry of stream `i` onto the heap, if it has one and it is not there yet.
+        void Refresh(size_t i) {
+            if (!pending[i]) {
+                MergedListenerInternal::PeekStorageKey f{storage_keys[i], false};
+                MergedListenerInternal::Dispatch<0, N>::Run(listeners, i, f);
+                if (f.found) {
+                    if (storage_keys[i].length() <
+                        primary_key_offset[i] + FixedSizeSerializer<T_PRIMARY_KEY>::size_in_bytes) {
+                        VLOG(3) << "throw ::TailProduce::MalformedStorageHeadException();";
+                        throw ::TailProduce::MalformedStorageHeadException();
+                    }
+                    primary_keys[i] = FixedSizeSerializer<T_PRIMARY_KEY>::UnpackFromChars(storage_keys[i].data() +
+                                                                                           primary_key_offset[i]);
+                    pending[i] = true;
+                    heap[heap_size++] = i;
+                    std::push_heap(heap.begin(), heap.begin() + heap_size, Later{primary_keys});
+                }
+            }
+        }
+
+        T_LISTENERS listeners;
+        const std::array<size_t, N> primary_key_offset;
+        std::array<::TailProduce::Storage::STORAGE_KEY_TYPE, N> storage_keys;
+        std::array<T_PRIMARY_KEY, N> primary_keys;
+        std::array<bool, N> pending;
+        std::array<size_t, N> heap;
+        size_t heap_size = 0;
+
+        MergedListener() = delete;
+        MergedListener(const MergedListener&) = delete;
+        void operator=(const MergedListener&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_MERGED_LISTENER_H
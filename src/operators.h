@@ -0,0 +1,406 @@
+// Stream processing operators, and the stage that runs them from one stream into another.
+//
+// An operator is called with each entry and passes on whatever it produces to the next one, via `next(output)`:
+//   Filter(predicate)     Passes on the entries for which `predicate(entry)` is true.
+//   Map(f)                Passes on `f(entry)`.
+//   FlatMap(f)            Calls `f(entry, emit)`, which passes on any number of entries via `emit(output)`.
+//                         As `emit` is of an internal type, `f` has a `template <typename EMIT>` operator().
+//   KeyedAggregate<KEY, STATE>(key_of, window_of, update, emit)
+//                         Folds the entries into a STATE per `key_of(entry)` with `update(state, entry)`, within
+//                         tumbling windows numbered by `window_of(entry)`, as a uint64_t. Once an entry of a later
+//                         window comes, passes on `emit(key, state, window)` for each key of the window ending,
+//                         in the order of the keys. The entries of earlier windows count towards the current one.
+// The functions may be overloaded functors, for the operators to work on polymorphic streams.
+//
+// Fuse(a, b, ...) chains the operators into one. The fused chain runs entry by entry, each operator calling
+// the next one directly: no intermediate streams, no intermediate buffers, one stage.
+//
+// OperatorStage runs an operator from an input stream into the publisher of an output stream as a pipeline of
+// two threads. The reader takes up to `max_batch_entries` entries at a time off the input stream, runs them through
+// the operator and collects the output entries into a batch. The writer publishes the batch with PushMany(), as one
+// storage write, while the reader goes on with the next one. The reader only waits for the writer if it has the next
+// batch ready before the previous one is written, and waits for the publisher of the input stream to poke it
+// once it runs out of entries.
+//
+// The stage starts from the beginning of the input stream and runs while in scope. As with any publisher,
+// the order keys of the output entries must not go backwards.
+//
+//   auto stage = ::TailProduce::RunOperatorStage(
+//       framework.numbers, framework.primes_publisher, ::TailProduce::Fuse(::TailProduce::Filter(IsPrime()),
+//                                                                          ::TailProduce::Map(ToPrimeEntry())));
+//
+// RunJob() runs a named stage that can be restarted. The job keeps its input cursor, the storage key of the last
+// input entry it has consumed, under the `s:<output stream>:job:<name>` meta key, and the writer commits it
+// along with the output entries and the output HEAD, as one storage write batch, see PushManyAlongWith().
+// The output and the cursor are therefore never out of sync: a job restarted with the same name resumes right
+// after the last input entry whose output has been published, with no entries lost or published twice.
+// The batches of input entries with no output are committed as well, to move the cursor forward.
+// The state of the operators is not persisted: the KeyedAggregate-s of a restarted job start afresh,
+// from the window of the first input entry they see.
+//
+//   auto job = ::TailProduce::RunJob("primes", framework.numbers, framework.primes_publisher, PrimesOperator());
+
+#ifndef TAILPRODUCE_OPERATORS_H
+#define TAILPRODUCE_OPERATORS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "event_subscriber.h"
+#include "listeners.h"
+#include "storage.h"
+#include "tp_exceptions.h"
+#include "tracing.h"
+
+namespace TailProduce {
+    namespace OperatorsInternal {
+        enum { kDefaultMaxBatchEntries = 1000 };
+    };
+
+    template <typename PREDICATE> struct FilterOperator {
+        explicit FilterOperator(PREDICATE predicate) : predicate(predicate) {
+        }
+        template <typename ENTRY, typename NEXT> void operator()(const ENTRY& entry, NEXT& next) {
+            if (predicate(entry)) {
+                next(entry);
+            }
+        }
+        PREDICATE predicate;
+    };
+
+    template <typename F> struct MapOperator {
+        explicit MapOperator(F f) : f(f) {
+        }
+        template <typename ENTRY, typename NEXT> void operator()(const ENTRY& entry, NEXT& next) {
+            next(f(entry));
+        }
+        F f;
+    };
+
+    template <typename F> struct FlatMapOperator {
+        explicit FlatMapOperator(F f) : f(f) {
+        }
+        template <typename ENTRY, typename NEXT> void operator()(const ENTRY& entry, NEXT& next) {
+            f(entry, next);
+        }
+        F f;
+    };
+
+    template <typename KEY, typename STATE, typename KEY_OF, typename WINDOW_OF, typename UPDATE, typename EMIT>
+    struct KeyedAggregateOperator {
+        KeyedAggregateOperator(KEY_OF key_of, WINDOW_OF window_of, UPDATE update, EMIT emit)
+            : key_of(key_of), window_of(window_of), update(update), emit(emit) {
+        }
+        template <typename ENTRY, typename NEXT> void operator()(const ENTRY& entry, NEXT& next) {
+            const uint64_t window = window_of(entry);
+            if (window > current_window) {
+                for (const auto& cit : states) {
+                    next(emit(cit.first, cit.second, current_window));
+                }
+                states.clear();
+                current_window = window;
+            }
+            update(states[key_of(entry)], entry);
+        }
+        KEY_OF key_of;
+        WINDOW_OF window_of;
+        UPDATE update;
+        EMIT emit;
+        uint64_t current_window = 0;
+        std::map<KEY, STATE> states;
+    };
+
+    // Calls the operator with each entry passed on to it, for it to pass its output on to `next`.
+    template <typename OPERATOR, typename NEXT> struct OperatorContinuation {
+        OperatorContinuation(OPERATOR& op, NEXT& next) : op(op), next(next) {
+        }
+        template <typename ENTRY> void operator()(const ENTRY& entry) {
+            op(entry, next);
+        }
+        OPERATOR& op;
+        NEXT& next;
+    };
+
+    template <typename FIRST, typename SECOND> struct FusedOperator {
+        FusedOperator(FIRST first, SECOND second) : first(first), second(second) {
+        }
+        template <typename ENTRY, typename NEXT> void operator()(const ENTRY& entry, NEXT& next) {
+            OperatorContinuation<SECOND, NEXT> then(second, next);
+            first(entry, then);
+        }
+        FIRST first;
+        SECOND second;
+    };
+
+    template <typename PREDICATE> FilterOperator<PREDICATE> Filter(PREDICATE predicate) {
+        return FilterOperator<PREDICATE>(predicate);
+    }
+
+    template <typename F> MapOperator<F> Map(F f) {
+        return MapOperator<F>(f);
+    }
+
+    template <typename F> FlatMapOperator<F> FlatMap(F f) {
+        return FlatMapOperator<F>(f);
+    }
+
+    template <typename KEY, typename STATE, typename KEY_OF, typename WINDOW_OF, typename UPDATE, typename EMIT>
+    KeyedAggregateOperator<KEY, STATE, KEY_OF, WINDOW_OF, UPDATE, EMIT> KeyedAggregate(KEY_OF key_of,
+                                                                                      WINDOW_OF window_of,
+                                                                                      UPDATE update,
+                                                                                      EMIT emit) {
+        return KeyedAggregateOperator<KEY, STATE, KEY_OF, WINDOW_OF, UPDATE, EMIT>(key_of, window_of, update, emit);
+    }
+
+    template <typename... OPERATORS> struct FusedOperatorType;
+    template <typename OPERATOR> struct FusedOperatorType<OPERATOR> {
+        typedef OPERATOR type;
+    };
+    template <typename FIRST, typename... REST> struct FusedOperatorType<FIRST, REST...> {
+        typedef FusedOperator<FIRST, typename FusedOperatorType<REST...>::type> type;
+    };
+
+    template <typename OPERATOR> OPERATOR Fuse(OPERATOR op) {
+        return op;
+    }
+
+    template <typename FIRST, typename SECOND, typename... REST>
+    typename FusedOperatorType<FIRST, SECOND, REST...>::type Fuse(FIRST first, SECOND second, REST... rest) {
+        return typename FusedOperatorType<FIRST, SECOND, REST...>::type(first, Fuse(second, rest...));
+    }
+
+    template <typename INPUT_STREAM, typename OUTPUT_PUBLISHER, typename OPERATOR>
+    class OperatorStage : public ::TailProduce::Subscriber {
+      public:
+        typedef INPUT_STREAM T_INPUT_STREAM;
+        typedef typename OUTPUT_PUBLISHER::T_STREAM::T_ENTRY T_OUTPUT_ENTRY;
+        // With a non-empty `job_name`, the stage is a restartable job, see RunJob().
+        OperatorStage(const T_INPUT_STREAM& input,
+                      OUTPUT_PUBLISHER& output,
+                      OPERATOR op,
+                      size_t max_batch_entries = OperatorsInternal::kDefaultMaxBatchEntries,
+                      const std::string& job_name = "")
+            : input(input),
+              output(output),
+              op(op),
+              max_batch_entries(max_batch_entries ? max_batch_entries : 1),
+              cursor_storage_key(job_name.empty() ? ""
+                                                  : output.impl.stream.config_values().JobCursorStorageKey(
+                                                        output.impl.stream, job_name)),
+              committed_cursor(CommittedCursor()),
+              subscribe(this, input.subscriptions_),
+              writer_thread(&OperatorStage::WriterThread, this),
+              reader_thread(&OperatorStage::ReaderThread, this) {
+        }
+
+        virtual ~OperatorStage() {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                stopping = true;
+                condition.notify_all();
+            }
+            reader_thread.join();
+            writer_thread.join();
+            VLOG(2) << this << " OperatorStage('" << input.name << "'): " << entries_read << " entries read, "
+                    << entries_written << " written in " << batches_written << " batches.";
+        }
+
+        virtual void Poke() override {
+            std::lock_guard<std::mutex> guard(mutex);
+            poked = true;
+            condition.notify_all();
+        }
+
+        uint64_t EntriesRead() const {
+            return entries_read;
+        }
+        uint64_t EntriesWritten() const {
+            return entries_written;
+        }
+        uint64_t BatchesWritten() const {
+            return batches_written;
+        }
+
+      private:
+        // Runs the operator on the entries read, collecting its output into the batch being read.
+        struct Sink {
+            Sink(OPERATOR& op, std::vector<T_OUTPUT_ENTRY>& batch) : op(op), collect(batch) {
+            }
+            struct Collect {
+                explicit Collect(std::vector<T_OUTPUT_ENTRY>& batch) : batch(batch) {
+                }
+                void operator()(const T_OUTPUT_ENTRY& entry) {
+                    batch.push_back(entry);
+                }
+                std::vector<T_OUTPUT_ENTRY>& batch;
+            };
+            template <typename ENTRY> void operator()(const ENTRY& entry) {
+                op(entry, collect);
+            }
+            OPERATOR& op;
+            Collect collect;
+        };
+
+        void ReaderThread() {
+            INTERNAL_UnsafeListener<T_INPUT_STREAM> listener(input);
+            listener.SetEntryAllocation(EntryAllocation::ReuseEntry);
+            if (!committed_cursor.empty()) {
+                listener.ResumeAfter(committed_cursor);
+            }
+            std::vector<T_OUTPUT_ENTRY> batch;
+            Sink sink(op, batch);
+            while (Continue()) {
+                size_t consumed = 0;
+                {
+                    TraceScope<typename T_INPUT_STREAM::T_TRACER> trace(TraceEvent::ListenerBatch);
+                    while (consumed < max_batch_entries && listener.HasData()) {
+                        listener.ProcessEntrySync(sink);
+                        listener.AdvanceToNextEntry();
+                        ++consumed;
+                    }
+                }
+                entries_read += consumed;
+                if (!batch.empty() || (consumed && !cursor_storage_key.empty())) {
+                    const ::TailProduce::Storage::STORAGE_KEY_TYPE cursor =
+                        cursor_storage_key.empty() ? "" : listener.LastEntryStorageKey();
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this]() { return !has_ready || stopping; });
+                    if (stopping) {
+                        return;
+                    }
+                    ready.swap(batch);
+                    ready_cursor = cursor;
+                    has_ready = true;
+                    condition.notify_all();
+                }
+                if (consumed < max_batch_entries) {
+                    WaitForPoke();
+                }
+            }
+        }
+
+        void WriterThread() {
+            std::vector<T_OUTPUT_ENTRY> batch;
+            ::TailProduce::Storage::STORAGE_KEY_TYPE cursor;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this]() { return has_ready || stopping; });
+                    if (!has_ready) {
+                        return;
+                    }
+                    // The emptied vector goes back to the reader, keeping its capacity.
+                    batch.swap(ready);
+                    cursor.swap(ready_cursor);
+                    has_ready = false;
+                    condition.notify_all();
+                }
+                if (cursor_storage_key.empty()) {
+                    output.PushMany(batch.begin(), batch.end());
+                } else {
+                    ::TailProduce::Storage::WriteBatch commit_cursor;
+                    commit_cursor.SetAllowingOverwrite(cursor_storage_key,
+                                                       ::TailProduce::Storage::KeyToValue(cursor));
+                    output.PushManyAlongWith(batch.begin(), batch.end(), commit_cursor);
+                }
+                entries_written += batch.size();
+                ++batches_written;
+                batch.clear();
+            }
+        }
+
+        // The input cursor committed by the previous run of the job, empty if there is none.
+        ::TailProduce::Storage::STORAGE_KEY_TYPE CommittedCursor() const {
+            if (cursor_storage_key.empty()) {
+                return "";
+            }
+            auto& stream = output.impl.stream;
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            if (!stream.manager_->storage.Has(cursor_storage_key)) {
+                return "";
+            }
+            return ::TailProduce::Storage::ValueToKey(stream.manager_->storage.Get(cursor_storage_key));
+        }
+
+        // Returns false once the stage is stopping. Otherwise, a poke from now on means there may be more data.
+        bool Continue() {
+            std::lock_guard<std::mutex> guard(mutex);
+            poked = false;
+            return !stopping;
+        }
+
+        void WaitForPoke() {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, std::chrono::seconds(1), [this]() { return poked || stopping; });
+        }
+
+        const T_INPUT_STREAM& input;
+        OUTPUT_PUBLISHER& output;
+        OPERATOR op;
+        const size_t max_batch_entries;
+        // Empty unless the stage is a job.
+        const ::TailProduce::Storage::STORAGE_KEY_TYPE cursor_storage_key;
+        const ::TailProduce::Storage::STORAGE_KEY_TYPE committed_cursor;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool poked = false;
+        bool stopping = false;
+        // The batch read and waiting to be written, along with the input cursor past it for a job.
+        bool has_ready = false;
+        std::vector<T_OUTPUT_ENTRY> ready;
+        ::TailProduce::Storage::STORAGE_KEY_TYPE ready_cursor;
+
+        std::atomic<uint64_t> entries_read{0};
+        std::atomic<uint64_t> entries_written{0};
+        std::atomic<uint64_t> batches_written{0};
+
+        ::TailProduce::SubscribeWhileInScope<::TailProduce::SubscriptionsManager> subscribe;
+        std::thread writer_thread;
+        std::thread reader_thread;
+
+        OperatorStage() = delete;
+        OperatorStage(const OperatorStage&) = delete;
+        void operator=(const OperatorStage&) = delete;
+    };
+
+    template <typename INPUT_STREAM, typename OUTPUT_PUBLISHER, typename OPERATOR>
+    std::unique_ptr<OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>> RunOperatorStage(
+        const INPUT_STREAM& input,
+        OUTPUT_PUBLISHER& output,
+        OPERATOR op,
+        size_t max_batch_entries = OperatorsInternal::kDefaultMaxBatchEntries) {
+        return std::unique_ptr<OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>>(
+            new OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>(input, output, op, max_batch_entries));
+    }
+
+    // Runs the operator as a restartable job, which resumes after the last input entry it has committed.
+    template <typename INPUT_STREAM, typename OUTPUT_PUBLISHER, typename OPERATOR>
+    std::unique_ptr<OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>> RunJob(
+        const std::string& job_name,
+        const INPUT_STREAM& input,
+        OUTPUT_PUBLISHER& output,
+        OPERATOR op,
+        size_t max_batch_entries = OperatorsInternal::kDefaultMaxBatchEntries) {
+        if (job_name.empty()) {
+            VLOG(3) << "throw ::TailProduce::JobNameEmptyException();";
+            throw ::TailProduce::JobNameEmptyException();
+        }
+        return std::unique_ptr<OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>>(
+            new OperatorStage<INPUT_STREAM, OUTPUT_PUBLISHER, OPERATOR>(
+                input, output, op, max_batch_entries, job_name));
+    }
+};
+
+#endif  // TAILPRODUCE_OPERATORS_H
@@ -0,0 +1,180 @@
+// Field projection: a processor that only needs some of the fields of an entry declares them at compile time,
+// and the listener skips decoding the rest.
+//
+// struct MyProcessor {
+//     // Field indexes are the positions of the fields in the entry's `serialize()`, starting from zero.
+//     typedef ::TailProduce::Projection<0, 2> T_PROJECTION;
+//     void operator()(const MyEntry& entry) {
+//         // Only the order key and fields 0 and 2 are populated.
+//     }
+// };
+//
+// `::TailProduce::KeyOnly`, the empty projection, makes the listener skip reading the value from the storage
+// altogether: the processor receives an entry with only its order key set, and the replay becomes a key scan.
+//
+// Notes:
+// * Projection requires the entry to have a member `serialize()`.
+//   The fields that are not projected keep their previous values: default ones for a fresh entry,
+//   whatever the previous record had for EntryAllocation::ReuseEntry.
+// * Binary archives skip the bytes of arithmetic fields, strings and vectors of arithmetic types without
+//   decoding them. Other skipped field types are decoded into a temporary.
+// * JSON archives still parse the whole document, but do not materialize the skipped named fields.
+// * Polymorphic streams support KeyOnly, other projections on them decode all fields.
+
+#ifndef TAILPRODUCE_PROJECTION_H
+#define TAILPRODUCE_PROJECTION_H
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cereal/cereal.hpp"
+#include "cereal/archives/binary.hpp"
+#include "cereal/archives/json.hpp"
+
+namespace TailProduce {
+    namespace ProjectionInternal {
+        template <size_t... FIELDS> struct Contains;
+        template <> struct Contains<> {
+            static bool Run(size_t) {
+                return false;
+            }
+        };
+        template <size_t HEAD, size_t... TAIL> struct Contains<HEAD, TAIL...> {
+            static bool Run(size_t index) {
+                return index == HEAD || Contains<TAIL...>::Run(index);
+            }
+        };
+    };
+
+    template <size_t... FIELDS> struct Projection {
+        enum { key_only = (sizeof...(FIELDS) == 0) };
+        static bool Has(size_t index) {
+            return ProjectionInternal::Contains<FIELDS...>::Run(index);
+        }
+    };
+
+    typedef Projection<> KeyOnly;
+
+    // The projection of the processors that do not declare one.
+    struct AllFields {
+        enum { key_only = false };
+        static bool Has(size_t) {
+            return true;
+        }
+    };
+
+    // ProjectionOf<T>::type is `T::T_PROJECTION` if T declares it, and AllFields otherwise.
+    template <typename T> struct ProjectionOf {
+        template <typename U> static typename U::T_PROJECTION Test(typename U::T_PROJECTION*);
+        template <typename U> static AllFields Test(...);
+        typedef decltype(Test<T>(nullptr)) type;
+    };
+
+    namespace ProjectionInternal {
+        // The generic way to skip a field is to decode it into a temporary.
+        template <typename ARCHIVE> struct Skipper {
+            template <typename T> static void Skip(ARCHIVE& ar, std::istream&, T& value) {
+                typename std::decay<T>::type unused;
+                ar(unused);
+            }
+            template <typename T> static void Skip(ARCHIVE& ar, std::istream&, cereal::NameValuePair<T>& nvp) {
+                typename std::decay<T>::type unused;
+                ar(cereal::make_nvp(nvp.name, unused));
+            }
+        };
+
+        // JSON archives look named fields up by their names, so the skipped ones can just be left alone.
+        template <> struct Skipper<cereal::JSONInputArchive> {
+            template <typename T> static void Skip(cereal::JSONInputArchive& ar, std::istream&, T& value) {
+                typename std::decay<T>::type unused;
+                ar(unused);
+            }
+            template <typename T>
+            static void Skip(cereal::JSONInputArchive&, std::istream&, cereal::NameValuePair<T>&) {
+            }
+        };
+
+        // Binary archives are positional, the skipped fields have to be consumed. Their bytes are not decoded
+        // where the size is known from the type and the size tag alone.
+        template <> struct Skipper<cereal::BinaryInputArchive> {
+            template <typename T>
+            static void Skip(cereal::BinaryInputArchive& ar, std::istream& is, cereal::NameValuePair<T>& nvp) {
+                Skip(ar, is, nvp.value);
+            }
+            template <typename T>
+            static typename std::enable_if<std::is_arithmetic<T>::value>::type Skip(cereal::BinaryInputArchive&,
+                                                                                     std::istream& is,
+                                                                                     T&) {
+                is.ignore(sizeof(T));
+            }
+            static void Skip(cereal::BinaryInputArchive& ar, std::istream& is, std::string&) {
+                cereal::size_type size;
+                ar(cereal::make_size_tag(size));
+                is.ignore(static_cast<std::streamsize>(size));
+            }
+            template <typename T, typename A>
+            static typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type Skip(
+                cereal::BinaryInputArchive& ar,
+                std::istream& is,
+                std::vector<T, A>&) {
+                cereal::size_type size;
+                ar(cereal::make_size_tag(size));
+                is.ignore(static_cast<std::streamsize>(size * sizeof(T)));
+            }
+            template <typename T>
+            static typename std::enable_if<!std::is_arithmetic<T>::value>::type Skip(cereal::BinaryInputArchive& ar,
+                                                                                      std::istream&,
+                                                                                      T& value) {
+                typename std::decay<T>::type unused;
+                ar(unused);
+            }
+        };
+    };
+
+    // Wraps a Cereal input archive for the entry's `serialize()`: the fields are counted in the order they are
+    // passed to the archive, the projected ones are loaded, the rest are skipped.
+    template <typename ARCHIVE, typename PROJECTION> struct ProjectingInputArchive {
+        typedef ARCHIVE T_ARCHIVE;
+        typedef PROJECTION T_PROJECTION;
+
+        ProjectingInputArchive(T_ARCHIVE& archive, std::istream& is) : archive(archive), is(is), index(0) {
+        }
+
+        template <typename ENTRY> void Load(ENTRY& entry) {
+            cereal::prologue(archive, entry);
+            cereal::access::member_serialize(*this, entry);
+            cereal::epilogue(archive, entry);
+        }
+
+        template <typename... ARGS> ProjectingInputArchive& operator()(ARGS&&... args) {
+            Process(std::forward<ARGS>(args)...);
+            return *this;
+        }
+
+      private:
+        void Process() {
+        }
+        template <typename HEAD, typename... TAIL> void Process(HEAD&& head, TAIL&&... tail) {
+            if (T_PROJECTION::Has(index++)) {
+                archive(std::forward<HEAD>(head));
+            } else {
+                ProjectionInternal::Skipper<T_ARCHIVE>::Skip(archive, is, head);
+            }
+            Process(std::forward<TAIL>(tail)...);
+        }
+
+        T_ARCHIVE& archive;
+        std::istream& is;
+        size_t index;
+
+        ProjectingInputArchive() = delete;
+        ProjectingInputArchive(const ProjectingInputArchive&) = delete;
+        void operator=(const ProjectingInputArchive&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_PROJECTION_H
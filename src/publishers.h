@@ -13,6 +13,9 @@
 
 #include "tp_exceptions.h"
 #include "bytes.h"
+#include "latency.h"
+#include "storage.h"
+#include "tracing.h"
 
 // TODO(dkorolev): Rename INTERNAL_UnsafePublisher once the transition is completed.
 
@@ -21,6 +24,7 @@ namespace TailProduce {
     // and updating their HEAD order keys.
     template <typename STREAM> struct INTERNAL_UnsafePublisher {
         typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_TRACER T_TRACER;
         explicit INTERNAL_UnsafePublisher(T_STREAM& stream) : stream(stream) {
         }
 
@@ -33,29 +37,114 @@ namespace TailProduce {
 
         void Push(const typename T_STREAM::T_ENTRY& entry) {
             std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            TraceScope<T_TRACER> commit_trace(TraceEvent::PublisherCommit);
             typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY primary_order_key;
             entry.GetOrderKey(primary_order_key);
             PushHeadUnguarded(primary_order_key);
             std::ostringstream value_output_stream;
-            T_STREAM::T_ENTRY::SerializeEntry(value_output_stream, entry);
-            stream.manager_->storage.Set(stream.head.ComposeStorageKey(stream, stream.config_values()),
-                                         bytes(value_output_stream.str()));
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::Serialize);
+                T_STREAM::T_ENTRY::SerializeEntry(value_output_stream, entry);
+            }
+            const std::string value = value_output_stream.str();
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::StorageSet);
+                stream.manager_->storage.Set(stream.head.ComposeStorageKey(stream, stream.config_values()),
+                                             bytes(value));
+            }
+            stream.manager_->stats_.storage.CountWrite(value.size());
+            stream.publish_stats_.CountPublished(1, value.size());
+            if (stream.publish_timestamps_.Enabled()) {
+                stream.publish_timestamps_.Stamp(
+                    stream.head.primary, stream.head.secondary, LatencyInternal::NowInNanoseconds());
+            }
         }
 
-        void PushHeadUnguarded(const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& primary_order_key) {
-            // TODO(dkorolev): Move this logic to the new keys as well.
+        // Appends the entries, in order, as a single storage write batch along with the new HEAD:
+        // either all of them are published, or, if any of them goes backwards, none of them are.
+        template <typename ITERATOR> void PushMany(ITERATOR begin, ITERATOR end) {
+            PushManyAlongWith(begin, end, ::TailProduce::Storage::WriteBatch());
+        }
+
+        // PushMany() with `writes` applied as part of the same storage write batch, for the metadata
+        // of whoever publishes the entries to be committed atomically with them. See OperatorStage in operators.h.
+        template <typename ITERATOR>
+        void PushManyAlongWith(ITERATOR begin, ITERATOR end, const ::TailProduce::Storage::WriteBatch& writes) {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            TraceScope<T_TRACER> commit_trace(TraceEvent::PublisherCommit);
+            typename T_STREAM::T_ORDER_KEY head = stream.head;
+            ::TailProduce::Storage::WriteBatch batch;
+            std::ostringstream value_output_stream;
+            size_t published_bytes = 0;
+            for (ITERATOR it = begin; it != end; ++it) {
+                typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY primary_order_key;
+                it->GetOrderKey(primary_order_key);
+                head = NextHead(head, primary_order_key);
+                value_output_stream.str("");
+                {
+                    TraceScope<T_TRACER> trace(TraceEvent::Serialize);
+                    T_STREAM::T_ENTRY::SerializeEntry(value_output_stream, *it);
+                }
+                batch.Set(head.ComposeStorageKey(stream, stream.config_values()), bytes(value_output_stream.str()));
+                published_bytes += batch.writes.back().value.size();
+            }
+            const size_t published_entries = batch.Size();
+            if (published_entries) {
+                batch.SetAllowingOverwrite(stream.config_values().HeadStorageKey(stream),
+                                           bytes(head.ComposeStorageKey(stream, stream.config_values())));
+            }
+            batch.writes.insert(batch.writes.end(), writes.writes.begin(), writes.writes.end());
+            if (batch.Empty()) {
+                return;
+            }
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::StorageSet);
+                stream.manager_->storage.ApplyBatch(batch);
+            }
+            stream.manager_->stats_.storage.CountWrites(batch);
+            stream.publish_stats_.CountPublished(published_entries, published_bytes);
+            if (stream.publish_timestamps_.Enabled()) {
+                // The entries of the batch are published at once.
+                const uint64_t now = LatencyInternal::NowInNanoseconds();
+                typename T_STREAM::T_ORDER_KEY stamped = stream.head;
+                for (ITERATOR it = begin; it != end; ++it) {
+                    typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY primary_order_key;
+                    it->GetOrderKey(primary_order_key);
+                    stamped = NextHead(stamped, primary_order_key);
+                    stream.publish_timestamps_.Stamp(stamped.primary, stamped.secondary, now);
+                }
+            }
+            stream.head = head;
+        }
+
+        // The HEAD after appending an entry with the given primary key: the secondary key grows
+        // for the entries with the same primary key.
+        static typename T_STREAM::T_ORDER_KEY NextHead(
+            const typename T_STREAM::T_ORDER_KEY& head,
+            const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& primary_order_key) {
             typename T_STREAM::T_ORDER_KEY new_head(primary_order_key, 0);
-            if (new_head.primary < stream.head.primary) {
+            if (new_head.primary < head.primary) {
                 // Order keys should only be increasing.
                 VLOG(3) << "throw ::TailProduce::OrderKeysGoBackwardsException();";
                 throw ::TailProduce::OrderKeysGoBackwardsException();
             }
-            if (!(stream.head.primary < new_head.primary)) {
-                new_head.secondary = stream.head.secondary + 1;
+            if (!(head.primary < new_head.primary)) {
+                new_head.secondary = head.secondary + 1;
             }
+            return new_head;
+        }
+
+        void PushHeadUnguarded(const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& primary_order_key) {
+            // TODO(dkorolev): Move this logic to the new keys as well.
+            const typename T_STREAM::T_ORDER_KEY new_head = NextHead(stream.head, primary_order_key);
             // TODO(dkorolev): Perhaps more checks here?
             auto v = new_head.ComposeStorageKey(stream, stream.config_values());
-            stream.manager_->storage.SetAllowingOverwrite(stream.config_values().HeadStorageKey(stream), bytes(v));
+            {
+                TraceScope<T_TRACER> trace(TraceEvent::StorageSet);
+                stream.manager_->storage.SetAllowingOverwrite(stream.config_values().HeadStorageKey(stream),
+                                                              bytes(v));
+            }
+            stream.manager_->stats_.storage.CountWrite(v.size());
             stream.head = new_head;
         }
         void PushHead(const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& primary_order_key) {
@@ -63,6 +152,7 @@ namespace TailProduce {
             PushHeadUnguarded(primary_order_key);
         }
 
+        // PushHead() without an entry lets the MergedListener-s over this stream proceed, see merged_listener.h.
         // TODO: PushSecondaryKey for merge usecases.
 
         const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& GetHead() const {
@@ -104,6 +194,18 @@ namespace TailProduce {
             impl.stream.subscriptions_.PokeAll();
         }
 
+        // Publishes the entries as one storage write batch, see INTERNAL_UnsafePublisher::PushMany().
+        template <typename ITERATOR> void PushMany(ITERATOR begin, ITERATOR end) {
+            impl.PushMany(begin, end);
+            impl.stream.subscriptions_.PokeAll();
+        }
+
+        template <typename ITERATOR>
+        void PushManyAlongWith(ITERATOR begin, ITERATOR end, const ::TailProduce::Storage::WriteBatch& writes) {
+            impl.PushManyAlongWith(begin, end, writes);
+            impl.stream.subscriptions_.PokeAll();
+        }
+
         void PushHead(const typename T_STREAM::T_ORDER_KEY& order_key) {
             impl.PushHead(order_key);
             impl.stream.subscriptions_.PokeAll();
@@ -114,6 +216,7 @@ namespace TailProduce {
             impl.stream.subscriptions_.PokeAll();
         }
 
+        // PushHead() without an entry lets the MergedListener-s over this stream proceed, see merged_listener.h.
         // TODO: PushSecondaryKey for merge usecases.
 
         const typename T_STREAM::T_ORDER_KEY::T_PRIMARY_KEY& GetHead() const {
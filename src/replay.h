@@ -0,0 +1,162 @@
+// Parallel replay of a historical range of a stream.
+//
+// ParallelReplay(stream, begin, end, partitions, make_processor, reduce) splits the entries of [begin, end) into
+// up to `partitions` sub-ranges of order keys with about as many entries each, and processes the sub-ranges
+// concurrently, each with its own processor, `make_processor(partition_index)`, on a pool of worker threads.
+// Once all of them are done, it calls `reduce(processor)` with the processors, in the order of the sub-ranges,
+// on the calling thread. Returns the number of entries replayed.
+//
+// The sub-ranges are found by sampling the storage keys of the range: a key-only pass over it, without reading
+// or deserializing the values, keeping an evenly spaced sample of at most kSamplesPerPartition keys per partition.
+// ReplayPartitions() returns the boundaries on their own.
+//
+// The replay only goes through the entries of the range already in the stream, it does not wait for more.
+// The processors must be movable; the first exception thrown by any of them is rethrown by ParallelReplay().
+//
+//   struct CountEvents {
+//       uint64_t events = 0;
+//       void operator()(const Event&) { ++events; }
+//   };
+//   uint64_t total = 0;
+//   ::TailProduce::ParallelReplay(framework.events, begin, end, 16,
+//                                 [](size_t) { return CountEvents(); },
+//                                 [&total](const CountEvents& partition) { total += partition.events; });
+
+#ifndef TAILPRODUCE_REPLAY_H
+#define TAILPRODUCE_REPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "listeners.h"
+#include "storage.h"
+
+namespace TailProduce {
+    namespace ReplayInternal {
+        enum { kSamplesPerPartition = 64 };
+    };
+
+    // Returns the boundaries of the sub-ranges of [begin, end) of about as many entries each: `begin`,
+    // the first order key of each sub-range but the first one, and `end`. At most `partitions` sub-ranges,
+    // fewer if the range has fewer entries, and at least one.
+    template <typename STREAM>
+    std::vector<typename STREAM::T_ORDER_KEY> ReplayPartitions(const STREAM& stream,
+                                                               const typename STREAM::T_ORDER_KEY& begin,
+                                                               const typename STREAM::T_ORDER_KEY& end,
+                                                               size_t partitions) {
+        partitions = std::max(partitions, size_t(1));
+        // Every `stride`-th key. Once twice as many as needed are kept, every other one is dropped.
+        const size_t max_samples = partitions * ReplayInternal::kSamplesPerPartition;
+        std::vector<::TailProduce::Storage::STORAGE_KEY_TYPE> samples;
+        size_t stride = 1;
+        size_t keys = 0;
+        {
+            INTERNAL_UnsafeListener<STREAM> listener(stream, begin, end);
+            ::TailProduce::Storage::STORAGE_KEY_TYPE key;
+            while (listener.PeekStorageKey(key)) {
+                if (keys % stride == 0) {
+                    samples.push_back(key);
+                    if (samples.size() == max_samples * 2) {
+                        for (size_t i = 0; i < max_samples; ++i) {
+                            samples[i].swap(samples[i * 2]);
+                        }
+                        samples.resize(max_samples);
+                        stride *= 2;
+                    }
+                }
+                ++keys;
+                listener.AdvanceToNextEntry();
+            }
+        }
+        VLOG(2) << "ReplayPartitions('" << stream.name << "'): " << keys << " entries, " << samples.size()
+                << " sampled.";
+
+        std::vector<typename STREAM::T_ORDER_KEY> boundaries(1, begin);
+        ::TailProduce::Storage::STORAGE_KEY_TYPE previous;
+        for (size_t i = 1; i < partitions; ++i) {
+            const size_t index = i * samples.size() / partitions;
+            // The sample is the first key of a sub-range, so the first one can not be a boundary.
+            if (index && index < samples.size() && samples[index] != previous) {
+                previous = samples[index];
+                boundaries.emplace_back();
+                boundaries.back().DecomposeStorageKey(previous, stream, stream.config_values());
+            }
+        }
+        boundaries.push_back(end);
+        return boundaries;
+    }
+
+    template <typename STREAM, typename MAKE_PROCESSOR, typename REDUCE>
+    uint64_t ParallelReplay(const STREAM& stream,
+                            const typename STREAM::T_ORDER_KEY& begin,
+                            const typename STREAM::T_ORDER_KEY& end,
+                            size_t partitions,
+                            MAKE_PROCESSOR make_processor,
+                            REDUCE reduce,
+                            size_t threads = std::thread::hardware_concurrency()) {
+        typedef decltype(make_processor(size_t(0))) T_PROCESSOR;
+        const std::vector<typename STREAM::T_ORDER_KEY> boundaries =
+            ReplayPartitions(stream, begin, end, partitions);
+        const size_t ranges = boundaries.size() - 1;
+        std::vector<std::unique_ptr<T_PROCESSOR>> processors(ranges);
+        std::atomic<size_t> next_range{0};
+        std::atomic<uint64_t> entries{0};
+        std::mutex mutex;
+        std::exception_ptr exception;
+
+        // Each worker takes the next sub-range not taken yet, until there are none left.
+        auto worker = [&]() {
+            try {
+                for (size_t i = next_range++; i < ranges; i = next_range++) {
+                    processors[i].reset(new T_PROCESSOR(make_processor(i)));
+                    INTERNAL_UnsafeListener<STREAM> listener(stream, boundaries[i], boundaries[i + 1]);
+                    listener.SetEntryAllocation(EntryAllocation::ReuseEntry);
+                    uint64_t processed = 0;
+                    while (listener.HasData()) {
+                        listener.ProcessEntrySync(*processors[i]);
+                        listener.AdvanceToNextEntry();
+                        ++processed;
+                    }
+                    entries += processed;
+                    VLOG(3) << "ParallelReplay('" << stream.name << "'): Sub-range " << i << ", " << processed
+                            << " entries.";
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+                // The other workers stop after their current sub-range.
+                next_range = ranges;
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < std::min(std::max(threads, size_t(1)), ranges); ++i) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+
+        for (const auto& processor : processors) {
+            reduce(*processor);
+        }
+        VLOG(2) << "ParallelReplay('" << stream.name << "'): " << entries << " entries in " << ranges
+                << " sub-ranges on " << (pool.size() + 1) << " threads.";
+        return entries;
+    }
+};
+
+#endif  // TAILPRODUCE_REPLAY_H
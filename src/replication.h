@@ -0,0 +1,617 @@
+// Replication of the streams of one StaticFramework, the leader, into another one, the follower.
+//
+// The leader serves `/replicate` next to its exporters. The follower requests it with its own HEAD for each
+// of its streams, `/replicate?foo=<order key>&bar=<order key>`, where the order key is the part of the storage
+// key after the data prefix of the stream. The response is a chunked stream of binary records, each being
+// the big-endian 32-bit length and the bytes of the storage key, followed by the same for the value:
+//
+// * Data records: the storage keys and the values of the entries the follower does not have yet, in order.
+// * HEAD records: the HEAD storage key of the stream and the storage key of its new HEAD, as stored.
+//   The data records of a stream are always followed by its HEAD record.
+// * Status records: an empty key and, as the value, the big-endian 64-bit number of the entries and bytes
+//   the leader has found to not yet be sent to the follower. This is the leader's part of the lag.
+//
+// The follower buffers the data records and, on each HEAD record, writes them and the HEAD in one
+// storage batch, moves the HEAD of its stream and pokes its listeners. It reconnects, starting from its HEAD-s,
+// if the connection is lost. The streams of the follower should not be published into by anything else.
+//
+// The follower may ask for the chunks to be compressed, see wire_compression.h. It pays off across racks:
+// the records of neighboring entries share most of their storage keys and, often, the field names of the values.
+//
+// // The leader.
+// LeaderFramework leader_framework(leader_storage, params);
+// ::TailProduce::ReplicationLeader<LeaderFramework> leader(leader_framework);
+//
+// // The follower, the same framework with no HTTP server of its own.
+// LeaderFramework follower_framework(follower_storage, ::TailProduce::StreamManagerParams().SetHTTPPort(0));
+// ::TailProduce::ReplicationFollower<LeaderFramework> follower(follower_framework, "localhost", 8080);
+// ...
+// follower.Lag().entries;  // The entries published on the leader and not yet applied on the follower.
+
+#ifndef TAILPRODUCE_REPLICATION_H
+#define TAILPRODUCE_REPLICATION_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <glog/logging.h>
+
+#include "event_subscriber.h"
+#include "http.h"
+#include "static_framework.h"
+#include "storage.h"
+#include "stream_exporter.h"
+#include "tcp_server_singleton.h"
+#include "tp_exceptions.h"
+#include "wire_compression.h"
+
+namespace TailProduce {
+    // The stream as seen by the replication, with the types erased. TAILPRODUCE_STREAM registers one for each
+    // stream of the framework, see `StaticFramework::replicated_streams_`.
+    struct ReplicatedStream {
+        virtual ~ReplicatedStream() {
+        }
+        virtual const std::string& Name() const = 0;
+        virtual const std::string& DataPrefix() const = 0;
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadStorageKey() const = 0;
+        // The mutex of the stream, to be locked to read its storage or its HEAD.
+        virtual std::mutex& Mutex() const = 0;
+        // The storage key the HEAD corresponds to. To be called with the mutex locked.
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadDataKeyUnguarded() const = 0;
+        virtual ::TailProduce::SubscriptionsManager& Subscriptions() const = 0;
+        // Writes the batch and the new HEAD in one go, then pokes the listeners of the stream.
+        virtual void ApplyBatch(::TailProduce::Storage::WriteBatch& batch,
+                                const ::TailProduce::Storage::STORAGE_KEY_TYPE& head) = 0;
+    };
+
+    template <typename STREAM> struct ReplicatedStreamImpl : ReplicatedStream {
+        typedef STREAM T_STREAM;
+
+        ReplicatedStreamImpl(ReplicatedStreams& registry, T_STREAM& stream) : registry(registry), stream(stream) {
+            registry[stream.name] = this;
+        }
+        virtual ~ReplicatedStreamImpl() {
+            registry.erase(stream.name);
+        }
+
+        virtual const std::string& Name() const override {
+            return stream.name;
+        }
+        virtual const std::string& DataPrefix() const override {
+            return stream.storage_key_data_prefix;
+        }
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadStorageKey() const override {
+            return stream.config_values().HeadStorageKey(stream);
+        }
+        virtual std::mutex& Mutex() const override {
+            return stream.lock_mutex();
+        }
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadDataKeyUnguarded() const override {
+            return stream.head.ComposeStorageKey(stream, stream.config_values());
+        }
+        virtual ::TailProduce::SubscriptionsManager& Subscriptions() const override {
+            return stream.subscriptions_;
+        }
+
+        virtual void ApplyBatch(::TailProduce::Storage::WriteBatch& batch,
+                                const ::TailProduce::Storage::STORAGE_KEY_TYPE& head) override {
+            {
+                std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                typename T_STREAM::T_ORDER_KEY new_head;
+                new_head.DecomposeStorageKey(head, stream, stream.config_values());
+                batch.SetAllowingOverwrite(HeadStorageKey(), ::TailProduce::Storage::KeyToValue(head));
+                stream.manager_->storage.ApplyBatch(batch);
+                stream.manager_->stats_.storage.CountWrites(batch);
+                stream.head = new_head;
+            }
+            stream.subscriptions_.PokeAll();
+        }
+
+      private:
+        ReplicatedStreams& registry;
+        T_STREAM& stream;
+
+        ReplicatedStreamImpl() = delete;
+        ReplicatedStreamImpl(const ReplicatedStreamImpl&) = delete;
+        void operator=(const ReplicatedStreamImpl&) = delete;
+    };
+
+    struct ReplicationLag {
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    namespace ReplicationInternal {
+        inline void AppendRecord(std::string& output, const std::string& key, const uint8_t* value, size_t size) {
+            StreamExporterInternal::AppendBigEndianUInt32(output, key.length());
+            output += key;
+            StreamExporterInternal::AppendBigEndianUInt32(output, size);
+            output.append(reinterpret_cast<const char*>(value), size);
+        }
+
+        inline size_t RecordSize(const std::string& key, size_t value_size) {
+            return 8 + key.length() + value_size;
+        }
+
+        inline void AppendBigEndianUInt64(std::string& output, uint64_t value) {
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                output += static_cast<char>((value >> shift) & 0xff);
+            }
+        }
+
+        inline uint64_t ParseBigEndian(const char* p, size_t size) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < size; ++i) {
+                value = (value << 8) | static_cast<uint8_t>(p[i]);
+            }
+            return value;
+        }
+
+        // Splits the incoming bytes into records. The bytes of an incomplete record are kept until the rest of it
+        // arrives.
+        struct RecordParser {
+            std::string pending;
+
+            template <typename F> void Feed(const std::string& data, F&& f) {
+                pending += data;
+                size_t offset = 0;
+                while (true) {
+                    if (pending.length() < offset + 4) {
+                        break;
+                    }
+                    const size_t key_size = ParseBigEndian(pending.data() + offset, 4);
+                    if (pending.length() < offset + 4 + key_size + 4) {
+                        break;
+                    }
+                    const size_t value_size = ParseBigEndian(pending.data() + offset + 4 + key_size, 4);
+                    const size_t record_size = 8 + key_size + value_size;
+                    if (pending.length() < offset + record_size) {
+                        break;
+                    }
+                    f(pending.substr(offset + 4, key_size), pending.data() + offset + 8 + key_size, value_size);
+                    offset += record_size;
+                }
+                pending.erase(0, offset);
+            }
+        };
+    };
+
+    template <typename FRAMEWORK> struct ReplicationLeader : StreamExporter {
+        typedef FRAMEWORK T_FRAMEWORK;
+        typedef typename T_FRAMEWORK::T_STORAGE T_STORAGE;
+        // The entries counted ahead of the ones sent, per stream and per chunk, to report the lag.
+        enum { kMaxEntriesCountedAhead = 10000 };
+
+        struct StreamState {
+            ReplicatedStream* stream;
+            // The storage key of the last entry the follower has, or of the HEAD it has started from.
+            ::TailProduce::Storage::STORAGE_KEY_TYPE cursor;
+            ::TailProduce::Storage::STORAGE_KEY_TYPE sent_head;
+            // The entries up to `counted_until` are counted in `counted`, the ones up to `cursor` in `sent`.
+            ::TailProduce::Storage::STORAGE_KEY_TYPE counted_until;
+            ReplicationLag counted;
+            ReplicationLag sent;
+        };
+
+        struct Session : ExportSession {
+            Session(T_STORAGE& storage,
+                    std::shared_ptr<TCPServer::Connection> connection,
+                    const std::vector<StreamState>& streams)
+                : ExportSession(connection), storage(storage), streams(streams) {
+            }
+
+            virtual void Run() override {
+                std::vector<std::unique_ptr<SubscribeWhileInScope<SubscriptionsManager>>> subscriptions;
+                for (auto& state : streams) {
+                    subscriptions.emplace_back(
+                        new SubscribeWhileInScope<SubscriptionsManager>(this, state.stream->Subscriptions()));
+                }
+                SendHead("application/octet-stream");
+                std::string buffer;
+                while (Continue()) {
+                    bool has_more = false;
+                    for (auto& state : streams) {
+                        has_more |= ReplicateAvailableEntries(state, buffer);
+                    }
+                    AppendStatusIfChanged(buffer);
+                    if (!SendChunk(buffer)) {
+                        break;
+                    }
+                    if (!has_more) {
+                        WaitForPoke();
+                    }
+                }
+                EndResponse();
+            }
+
+            // Appends the entries of the stream after the cursor and up to its HEAD, as long as the chunk has room,
+            // then its HEAD. Returns true if the HEAD has not been reached.
+            bool ReplicateAvailableEntries(StreamState& state, std::string& buffer) {
+                std::lock_guard<std::mutex> guard(state.stream->Mutex());
+                const ::TailProduce::Storage::STORAGE_KEY_TYPE head = state.stream->HeadDataKeyUnguarded();
+                bool reached_head = true;
+                bool sent_entries = false;
+                if (state.cursor < head) {
+                    // The storage keys of a stream are of the same length: none of them is between these two.
+                    auto iterator = storage.CreateStorageIterator(state.cursor, head + '\0');
+                    while (!iterator->Done()) {
+                        const ::TailProduce::Storage::STORAGE_KEY_TYPE key = iterator->Key();
+                        if (key != state.cursor) {
+                            if (buffer.size() >= kChunkSize) {
+                                reached_head = false;
+                                break;
+                            }
+                            const ::TailProduce::Storage::STORAGE_VALUE_TYPE& value = iterator->Value();
+                            ReplicationInternal::AppendRecord(buffer, key, value.data(), value.size());
+                            const size_t size = ReplicationInternal::RecordSize(key, value.size());
+                            state.cursor = key;
+                            ++state.sent.entries;
+                            state.sent.bytes += size;
+                            if (state.counted_until < key) {
+                                state.counted_until = key;
+                                ++state.counted.entries;
+                                state.counted.bytes += size;
+                            }
+                            sent_entries = true;
+                        }
+                        iterator->Next();
+                    }
+                }
+                // With the chunk full, the HEAD moves as far as the entries sent.
+                const ::TailProduce::Storage::STORAGE_KEY_TYPE& new_head = reached_head ? head : state.cursor;
+                if ((reached_head || sent_entries) && new_head != state.sent_head) {
+                    ReplicationInternal::AppendRecord(buffer,
+                                                      state.stream->HeadStorageKey(),
+                                                      reinterpret_cast<const uint8_t*>(new_head.data()),
+                                                      new_head.size());
+                    state.sent_head = new_head;
+                }
+                if (!reached_head) {
+                    CountEntriesAhead(state, head);
+                }
+                return !reached_head;
+            }
+
+            // Counts some of the entries not sent yet. Each entry is only counted once.
+            void CountEntriesAhead(StreamState& state, const ::TailProduce::Storage::STORAGE_KEY_TYPE& head) {
+                auto iterator = storage.CreateStorageIterator(state.counted_until, head + '\0');
+                size_t counted = 0;
+                while (!iterator->Done() && counted < kMaxEntriesCountedAhead) {
+                    const ::TailProduce::Storage::STORAGE_KEY_TYPE key = iterator->Key();
+                    if (key != state.counted_until) {
+                        state.counted_until = key;
+                        ++state.counted.entries;
+                        state.counted.bytes += ReplicationInternal::RecordSize(key, iterator->Value().size());
+                        ++counted;
+                    }
+                    iterator->Next();
+                }
+            }
+
+            void AppendStatusIfChanged(std::string& buffer) {
+                ReplicationLag lag;
+                for (const auto& state : streams) {
+                    lag.entries += state.counted.entries - state.sent.entries;
+                    lag.bytes += state.counted.bytes - state.sent.bytes;
+                }
+                if (!status_sent || lag.entries != last_status.entries || lag.bytes != last_status.bytes) {
+                    std::string value;
+                    ReplicationInternal::AppendBigEndianUInt64(value, lag.entries);
+                    ReplicationInternal::AppendBigEndianUInt64(value, lag.bytes);
+                    ReplicationInternal::AppendRecord(
+                        buffer, "", reinterpret_cast<const uint8_t*>(value.data()), value.size());
+                    last_status = lag;
+                    status_sent = true;
+                }
+            }
+
+            T_STORAGE& storage;
+            std::vector<StreamState> streams;
+            ReplicationLag last_status;
+            bool status_sent = false;
+        };
+
+        explicit ReplicationLeader(T_FRAMEWORK& framework, const std::string& path = "/replicate")
+            : framework(framework), path(path) {
+            framework.AddExporter(path, this);
+        }
+
+        virtual ~ReplicationLeader() {
+            framework.RemoveExporter(path, this);
+        }
+
+        virtual void ListenAndStreamData(std::shared_ptr<TCPServer::Connection> connection,
+                                         const HTTPRequest& request) override {
+            VLOG(2) << this << " ReplicationLeader: " << request.target;
+            std::vector<StreamState> streams;
+            for (const auto& parameter : request.parameters) {
+                const auto cit = framework.replicated_streams_.find(parameter.first);
+                if (cit == framework.replicated_streams_.end()) {
+                    RespondWithErrorAndClose(connection, request, 400, "Unknown stream `" + parameter.first + "`.");
+                    return;
+                }
+                ReplicatedStream* stream = cit->second;
+                std::string head;
+                {
+                    std::lock_guard<std::mutex> guard(stream->Mutex());
+                    head = stream->HeadDataKeyUnguarded();
+                }
+                const std::string follower_head = stream->DataPrefix() + parameter.second;
+                if (follower_head.length() != head.length() ||
+                    parameter.second.find_first_not_of("0123456789") != std::string::npos) {
+                    RespondWithErrorAndClose(
+                        connection, request, 400, "Malformed HEAD of `" + parameter.first + "`.");
+                    return;
+                }
+                if (head < follower_head) {
+                    RespondWithErrorAndClose(connection, request, 400, "`" + parameter.first + "` is ahead.");
+                    return;
+                }
+                StreamState state;
+                state.stream = stream;
+                state.cursor = follower_head;
+                state.sent_head = follower_head;
+                state.counted_until = follower_head;
+                streams.push_back(state);
+            }
+            auto session = std::make_shared<Session>(framework.storage, connection, streams);
+            session->SetCompression(NegotiateWireCompression(request));
+            sessions.Start(session);
+        }
+
+        size_t ActiveSessions() {
+            return sessions.Active();
+        }
+
+      private:
+        T_FRAMEWORK& framework;
+        const std::string path;
+        ExportSessions sessions;
+
+        ReplicationLeader() = delete;
+        ReplicationLeader(const ReplicationLeader&) = delete;
+        void operator=(const ReplicationLeader&) = delete;
+    };
+
+    template <typename FRAMEWORK> struct ReplicationFollower {
+        typedef FRAMEWORK T_FRAMEWORK;
+
+        ReplicationFollower(T_FRAMEWORK& framework,
+                            const std::string& host,
+                            size_t port,
+                            const std::string& path = "/replicate",
+                            WireCompression compression = WireCompression::None)
+            : streams(framework.replicated_streams_), host(host), port(port), path(path), compression(compression) {
+            thread = std::thread(&ReplicationFollower::Run, this);
+        }
+
+        ~ReplicationFollower() {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                stopping = true;
+                if (socket) {
+                    boost::system::error_code ec;
+                    socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+                }
+                condition.notify_all();
+            }
+            thread.join();
+        }
+
+        // The entries and bytes published on the leader and not yet applied here, as far as the leader has
+        // counted them. Zero once the follower has caught up.
+        ReplicationLag Lag() {
+            std::lock_guard<std::mutex> guard(mutex);
+            ReplicationLag lag = leader_lag;
+            lag.entries += buffered.entries;
+            lag.bytes += buffered.bytes;
+            return lag;
+        }
+
+        // The entries and bytes written into the storage of the follower.
+        ReplicationLag Applied() {
+            std::lock_guard<std::mutex> guard(mutex);
+            return applied;
+        }
+
+        bool Connected() {
+            std::lock_guard<std::mutex> guard(mutex);
+            return connected;
+        }
+
+      private:
+        enum { kReconnectDelayMS = 100 };
+
+        void Run() {
+            while (true) {
+                try {
+                    Replicate();
+                } catch (const std::exception& e) {
+                    VLOG(2) << this << " ReplicationFollower: " << e.what();
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                socket.reset();
+                connected = false;
+                buffered = ReplicationLag();
+                if (condition.wait_for(lock, std::chrono::milliseconds(kReconnectDelayMS), [this]() {
+                        return stopping;
+                    })) {
+                    return;
+                }
+            }
+        }
+
+        void Replicate() {
+            std::string target = path;
+            char separator = '?';
+            for (const auto& cit : streams) {
+                std::string head;
+                {
+                    std::lock_guard<std::mutex> guard(cit.second->Mutex());
+                    head = cit.second->HeadDataKeyUnguarded();
+                }
+                target += separator + cit.first + '=' + head.substr(cit.second->DataPrefix().length());
+                separator = '&';
+            }
+
+            boost::asio::ip::tcp::resolver resolver(io_service);
+            auto endpoints = resolver.resolve(boost::asio::ip::tcp::resolver::query(host, std::to_string(port)));
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (stopping) {
+                    return;
+                }
+                socket.reset(new boost::asio::ip::tcp::socket(io_service));
+            }
+            boost::asio::connect(*socket, endpoints);
+            {
+                // From now on, stopping shuts the connected socket down, and the reads below fail.
+                std::lock_guard<std::mutex> guard(mutex);
+                if (stopping) {
+                    return;
+                }
+            }
+            std::string request = "GET " + target + " HTTP/1.1\r\nHost: " + host + "\r\n";
+            if (compression != WireCompression::None) {
+                request += std::string("Accept-Encoding: ") + WireCompressionContentEncoding(compression) + "\r\n";
+            }
+            request += "\r\n";
+            boost::asio::write(*socket, boost::asio::buffer(request));
+
+            boost::asio::streambuf buffer;
+            const size_t head_size = boost::asio::read_until(*socket, buffer, "\r\n\r\n");
+            const std::string head = Take(buffer, head_size);
+            if (head.compare(0, 13, "HTTP/1.1 200 ")) {
+                VLOG(3) << "throw ::TailProduce::ReplicationProtocolException();";
+                throw ::TailProduce::ReplicationProtocolException(head.substr(0, head.find('\r')));
+            }
+            // The leader may not support the compression asked for.
+            const std::string encoding =
+                std::string("\r\ncontent-encoding: ") + WireCompressionContentEncoding(compression) + "\r\n";
+            const bool compressed = HTTPInternal::ToLower(head).find(encoding) != std::string::npos;
+            const WireCompression received = compressed ? compression : WireCompression::None;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                connected = true;
+            }
+
+            ReplicationInternal::RecordParser parser;
+            ReplicatedStream* current = nullptr;
+            ::TailProduce::Storage::WriteBatch batch;
+            std::string chunk;
+            std::string uncompressed;
+            while (ReadChunk(buffer, chunk)) {
+                if (!UncompressWireChunk(received, chunk, uncompressed)) {
+                    VLOG(3) << "throw ::TailProduce::ReplicationProtocolException();";
+                    throw ::TailProduce::ReplicationProtocolException("Malformed compressed chunk.");
+                }
+                parser.Feed(uncompressed,
+                            [this, &current, &batch](const std::string& key, const char* value, size_t size) {
+                                OnRecord(key, value, size, current, batch);
+                            });
+            }
+        }
+
+        void OnRecord(const std::string& key,
+                      const char* value,
+                      size_t size,
+                      ReplicatedStream*& current,
+                      ::TailProduce::Storage::WriteBatch& batch) {
+            if (key.empty()) {
+                if (size != 16) {
+                    VLOG(3) << "throw ::TailProduce::ReplicationProtocolException();";
+                    throw ::TailProduce::ReplicationProtocolException("Malformed status.");
+                }
+                std::lock_guard<std::mutex> guard(mutex);
+                leader_lag.entries = ReplicationInternal::ParseBigEndian(value, 8);
+                leader_lag.bytes = ReplicationInternal::ParseBigEndian(value + 8, 8);
+                return;
+            }
+            if (!current) {
+                for (const auto& cit : streams) {
+                    const std::string& prefix = cit.second->DataPrefix();
+                    if (!key.compare(0, prefix.length(), prefix) || key == cit.second->HeadStorageKey()) {
+                        current = cit.second;
+                        break;
+                    }
+                }
+                if (!current) {
+                    VLOG(3) << "throw ::TailProduce::ReplicationProtocolException();";
+                    throw ::TailProduce::ReplicationProtocolException("Unexpected key.");
+                }
+            }
+            if (key == current->HeadStorageKey()) {
+                const size_t entries = batch.Size();
+                current->ApplyBatch(batch, std::string(value, value + size));
+                batch.Clear();
+                current = nullptr;
+                std::lock_guard<std::mutex> guard(mutex);
+                applied.entries += entries;
+                applied.bytes += buffered.bytes;
+                buffered = ReplicationLag();
+            } else if (!key.compare(0, current->DataPrefix().length(), current->DataPrefix())) {
+                batch.Set(key, ::TailProduce::Storage::STORAGE_VALUE_TYPE(value, value + size));
+                std::lock_guard<std::mutex> guard(mutex);
+                ++buffered.entries;
+                buffered.bytes += ReplicationInternal::RecordSize(key, size);
+            } else {
+                VLOG(3) << "throw ::TailProduce::ReplicationProtocolException();";
+                throw ::TailProduce::ReplicationProtocolException("Entries of several streams in one batch.");
+            }
+        }
+
+        // Reads the next chunk of the response into `data`. Returns false once the response is over.
+        bool ReadChunk(boost::asio::streambuf& buffer, std::string& data) {
+            const size_t line = boost::asio::read_until(*socket, buffer, "\r\n");
+            const size_t size = std::stoul(Take(buffer, line), nullptr, 16);
+            if (!size) {
+                return false;
+            }
+            if (buffer.size() < size + 2) {
+                boost::asio::read(*socket, buffer, boost::asio::transfer_exactly(size + 2 - buffer.size()));
+            }
+            data = Take(buffer, size);
+            Take(buffer, 2);
+            return true;
+        }
+
+        static std::string Take(boost::asio::streambuf& buffer, size_t size) {
+            const char* begin = boost::asio::buffer_cast<const char*>(buffer.data());
+            std::string result(begin, begin + size);
+            buffer.consume(size);
+            return result;
+        }
+
+        const ReplicatedStreams& streams;
+        const std::string host;
+        const size_t port;
+        const std::string path;
+        const WireCompression compression;
+
+        boost::asio::io_service io_service;
+        std::unique_ptr<boost::asio::ip::tcp::socket> socket;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+        bool connected = false;
+        ReplicationLag leader_lag;
+        ReplicationLag buffered;
+        ReplicationLag applied;
+        std::thread thread;
+
+        ReplicationFollower() = delete;
+        ReplicationFollower(const ReplicationFollower&) = delete;
+        void operator=(const ReplicationFollower&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_REPLICATION_H
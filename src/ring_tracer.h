@@ -0,0 +1,129 @@
+// A sample tracer, see tracing.h: each thread records the events into a ring of its own, and Dump() writes them
+// out as a Chrome trace, to be opened in chrome://tracing or Perfetto.
+//
+// Recording takes no locks: a thread only ever writes into its own ring, and publishes the count of the events
+// recorded with a release store. The ring keeps the latest RING_SIZE events of its thread, and outlives the thread,
+// for its events to be dumped. Dump() is meant for when the threads are done or idle: the events being overwritten
+// while it reads them may come out garbled.
+//
+// Usage: StreamManager<STORAGE, RingTracer<>>, then RingTracer<>::Dump("trace.json").
+
+#ifndef TAILPRODUCE_RING_TRACER_H
+#define TAILPRODUCE_RING_TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tracing.h"
+
+namespace TailProduce {
+    template <size_t RING_SIZE = 1 << 16> class RingTracer {
+      public:
+        static void Begin(TraceEvent event) {
+            Record(event, 'B');
+        }
+        static void End(TraceEvent event) {
+            Record(event, 'E');
+        }
+
+        // {"traceEvents": [{"name": ..., "ph": "B" or "E", "ts": <microseconds>, "pid": 1, "tid": ...}, ...]}
+        static std::string FormatJSON() {
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> guard(registry.mutex);
+            std::string result = "{\"traceEvents\": [";
+            bool first = true;
+            char buffer[160];
+            for (const auto& ring : registry.rings) {
+                const uint64_t recorded = ring->recorded.load(std::memory_order_acquire);
+                for (uint64_t i = recorded > RING_SIZE ? recorded - RING_SIZE : 0; i < recorded; ++i) {
+                    const Event& event = ring->events[i % RING_SIZE];
+                    snprintf(buffer,
+                             sizeof(buffer),
+                             "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %zu}",
+                             first ? "" : ",",
+                             TraceEventName(event.event),
+                             event.phase,
+                             event.nanoseconds * 1e-3,
+                             ring->thread_index);
+                    result += buffer;
+                    first = false;
+                }
+            }
+            return result + "\n]}\n";
+        }
+
+        // Returns false if the file could not be written.
+        static bool Dump(const std::string& file_name) {
+            std::ofstream file(file_name);
+            file << FormatJSON();
+            return static_cast<bool>(file);
+        }
+
+        // The number of events recorded by all the threads so far, including the overwritten ones.
+        static uint64_t EventsRecorded() {
+            Registry& registry = GetRegistry();
+            std::lock_guard<std::mutex> guard(registry.mutex);
+            uint64_t total = 0;
+            for (const auto& ring : registry.rings) {
+                total += ring->recorded.load(std::memory_order_acquire);
+            }
+            return total;
+        }
+
+      private:
+        struct Event {
+            uint64_t nanoseconds;
+            TraceEvent event;
+            char phase;
+        };
+
+        struct Ring {
+            explicit Ring(size_t thread_index) : thread_index(thread_index), events(new Event[RING_SIZE]) {
+            }
+            const size_t thread_index;
+            std::atomic<uint64_t> recorded{0};
+            std::unique_ptr<Event[]> events;
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<Ring>> rings;
+        };
+
+        static Registry& GetRegistry() {
+            static Registry registry;
+            return registry;
+        }
+
+        // The first event of a thread registers its ring, the only time the mutex is taken on the recording side.
+        static Ring& ThisThreadRing() {
+            thread_local std::shared_ptr<Ring> ring = [] {
+                Registry& registry = GetRegistry();
+                std::lock_guard<std::mutex> guard(registry.mutex);
+                registry.rings.push_back(std::make_shared<Ring>(registry.rings.size() + 1));
+                return registry.rings.back();
+            }();
+            return *ring;
+        }
+
+        static void Record(TraceEvent event, char phase) {
+            Ring& ring = ThisThreadRing();
+            const uint64_t index = ring.recorded.load(std::memory_order_relaxed);
+            ring.events[index % RING_SIZE] =
+                Event{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                std::chrono::steady_clock::now().time_since_epoch()).count()),
+                      event,
+                      phase};
+            ring.recorded.store(index + 1, std::memory_order_release);
+        }
+    };
+};
+
+#endif  // TAILPRODUCE_RING_TRACER_H
@@ -2,6 +2,7 @@
 #define SERIALIZE_H
 
 #include "dispatcher.h"
+#include "projection.h"
 
 #include "cereal/archives/json.hpp"
 #include "cereal/archives/binary.hpp"
@@ -20,6 +21,16 @@ namespace TailProduce {
                                                const PRIMARY_KEY& order_key,
                                                PROCESSOR& processor) {
             T_ENTRY entry;
+            DeSerializeAndProcessEntry(is, order_key, processor, entry);
+        }
+
+        // Deserializes into the caller-provided `entry`, so that a listener can keep reusing one instance
+        // and its std::string / std::vector members retain their capacity across records.
+        template <typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeAndProcessEntry(std::istream& is,
+                                               const PRIMARY_KEY& order_key,
+                                               PROCESSOR& processor,
+                                               T_ENTRY& entry) {
             cereal::JSONInputArchive ar(is);
             try {
                 ar(entry);
@@ -29,6 +40,22 @@ namespace TailProduce {
             entry.SetOrderKey(order_key);
             processor(entry);
         }
+
+        // Deserializes only the fields listed in PROJECTION into `entry`, skipping the rest. See projection.h.
+        template <typename PROJECTION, typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeProjectedAndProcessEntry(std::istream& is,
+                                                        const PRIMARY_KEY& order_key,
+                                                        PROCESSOR& processor,
+                                                        T_ENTRY& entry) {
+            cereal::JSONInputArchive ar(is);
+            try {
+                ProjectingInputArchive<cereal::JSONInputArchive, PROJECTION>(ar, is).Load(entry);
+            } catch (cereal::Exception& e) {
+                throw CerealDeSerializeException();
+            }
+            entry.SetOrderKey(order_key);
+            processor(entry);
+        }
     };
     // TODO(dkorolev): This copy-pasted code for Binary vs. JSON is worth eliminating some day.
     template <typename ENTRY> struct CerealBinarySerializable {
@@ -42,6 +69,14 @@ namespace TailProduce {
                                                const PRIMARY_KEY& order_key,
                                                PROCESSOR& processor) {
             T_ENTRY entry;
+            DeSerializeAndProcessEntry(is, order_key, processor, entry);
+        }
+
+        template <typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeAndProcessEntry(std::istream& is,
+                                               const PRIMARY_KEY& order_key,
+                                               PROCESSOR& processor,
+                                               T_ENTRY& entry) {
             cereal::BinaryInputArchive ar(is);
             try {
                 ar(entry);
@@ -51,6 +86,22 @@ namespace TailProduce {
             entry.SetOrderKey(order_key);
             processor(entry);
         }
+
+        // Deserializes only the fields listed in PROJECTION into `entry`, skipping the rest. See projection.h.
+        template <typename PROJECTION, typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeProjectedAndProcessEntry(std::istream& is,
+                                                        const PRIMARY_KEY& order_key,
+                                                        PROCESSOR& processor,
+                                                        T_ENTRY& entry) {
+            cereal::BinaryInputArchive ar(is);
+            try {
+                ProjectingInputArchive<cereal::BinaryInputArchive, PROJECTION>(ar, is).Load(entry);
+            } catch (cereal::Exception& e) {
+                throw CerealDeSerializeException();
+            }
+            entry.SetOrderKey(order_key);
+            processor(entry);
+        }
     };
 
     // Cereal-based polymorphic type serialization.
@@ -104,6 +155,24 @@ namespace TailProduce {
                     *p_entry.get(), DeSerializerImplJSON<T_BASE_TYPE, PRIMARY_KEY, PROCESSOR>(order_key, processor));
             }
         }
+
+        // Polymorphic entries are allocated by Cereal for each record, there is no instance to reuse.
+        template <typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeAndProcessEntry(std::istream& is,
+                                               const PRIMARY_KEY& order_key,
+                                               PROCESSOR& processor,
+                                               T_BASE_TYPE&) {
+            DeSerializeAndProcessEntry(is, order_key, processor);
+        }
+
+        // Field projections are not supported for polymorphic entries, all fields are deserialized.
+        template <typename PROJECTION, typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeProjectedAndProcessEntry(std::istream& is,
+                                                        const PRIMARY_KEY& order_key,
+                                                        PROCESSOR& processor,
+                                                        T_BASE_TYPE&) {
+            DeSerializeAndProcessEntry(is, order_key, processor);
+        }
     };
     // TODO(dkorolev): This copy-pasted code for Binary vs. JSON is worth eliminating some day.
     template <typename BASE_TYPE> struct SerializerImplBinary {
@@ -157,6 +226,22 @@ namespace TailProduce {
                     DeSerializerImplBinary<T_BASE_TYPE, PRIMARY_KEY, PROCESSOR>(order_key, processor));
             }
         }
+
+        template <typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeAndProcessEntry(std::istream& is,
+                                               const PRIMARY_KEY& order_key,
+                                               PROCESSOR& processor,
+                                               T_BASE_TYPE&) {
+            DeSerializeAndProcessEntry(is, order_key, processor);
+        }
+
+        template <typename PROJECTION, typename PRIMARY_KEY, typename PROCESSOR>
+        static void DeSerializeProjectedAndProcessEntry(std::istream& is,
+                                                        const PRIMARY_KEY& order_key,
+                                                        PROCESSOR& processor,
+                                                        T_BASE_TYPE&) {
+            DeSerializeAndProcessEntry(is, order_key, processor);
+        }
     };
 };
 
@@ -0,0 +1,113 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared_memory_ring.h"
+#include "tp_exceptions.h"
+
+namespace {
+    std::string ErrorText(const std::string& what, const std::string& name) {
+        return what + " '" + name + "': " + strerror(errno);
+    }
+}
+
+// No FUTEX_PRIVATE_FLAG: the futex word is in a segment mapped by several processes.
+void TailProduce::SharedMemoryRingInternal::FutexWakeAll(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void TailProduce::SharedMemoryRingInternal::FutexWait(const std::atomic<uint32_t>* word,
+                                                       uint32_t value,
+                                                       std::chrono::milliseconds timeout) {
+    struct timespec ts;
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<const uint32_t*>(word), FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+TailProduce::SharedMemoryRingWriter::SharedMemoryRingWriter(const std::string& name, size_t capacity)
+    : name(name),
+      capacity((capacity + SharedMemoryRingInternal::kHeaderSize - 1) &
+               ~uint64_t(SharedMemoryRingInternal::kHeaderSize - 1)) {
+    using namespace SharedMemoryRingInternal;
+    if (!this->capacity) {
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException("Zero capacity for '" + name + "'.");
+    }
+    // A stale segment is unlinked rather than truncated, as its readers may still have it mapped.
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException(ErrorText("Can not create", name));
+    }
+    mapping = MAP_FAILED;
+    if (ftruncate(fd, kHeaderSize + this->capacity) == 0) {
+        mapping = mmap(nullptr, kHeaderSize + this->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const std::string error = ErrorText("Can not map", name);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException(error);
+    }
+    header = static_cast<Header*>(mapping);
+    data = static_cast<char*>(mapping) + kHeaderSize;
+    header->version = kVersion;
+    header->capacity = this->capacity;
+    // The readers check the magic first.
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = kMagic;
+    VLOG(2) << "SharedMemoryRingWriter('" << name << "'): " << this->capacity << " bytes.";
+}
+
+TailProduce::SharedMemoryRingWriter::~SharedMemoryRingWriter() {
+    munmap(mapping, SharedMemoryRingInternal::kHeaderSize + capacity);
+    // The readers that have the segment mapped keep it.
+    shm_unlink(name.c_str());
+}
+
+TailProduce::SharedMemoryRingReader::SharedMemoryRingReader(const std::string& name) {
+    using namespace SharedMemoryRingInternal;
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException(ErrorText("Can not open", name));
+    }
+    mapping = MAP_FAILED;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > kHeaderSize) {
+        mapping_size = st.st_size;
+        mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    const std::string error = ErrorText("Can not map", name);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException(error);
+    }
+    header = static_cast<const Header*>(mapping);
+    data = static_cast<const char*>(mapping) + kHeaderSize;
+    const bool valid =
+        header->magic == kMagic && header->version == kVersion && header->capacity == mapping_size - kHeaderSize;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid) {
+        munmap(mapping, mapping_size);
+        VLOG(3) << "throw SharedMemoryException();";
+        throw SharedMemoryException("Not a ring, or not initialized yet: '" + name + "'.");
+    }
+    capacity = header->capacity;
+}
+
+TailProduce::SharedMemoryRingReader::~SharedMemoryRingReader() {
+    munmap(mapping, mapping_size);
+}
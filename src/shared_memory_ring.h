@@ -0,0 +1,235 @@
+// A single-writer, many-readers ring of records in POSIX shared memory, for the processes on the same host to read
+// a stream without going through a socket. See shared_memory_stream.h for the stream side of it.
+//
+// The segment is a header page followed by `capacity` bytes of records. A record is the record header,
+// {key size, value size, sequence number}, then the key, then the value, padded to eight bytes. A record never
+// wraps: if it does not fit before the end of the buffer, the writer marks the rest of it as padding and goes on
+// from the start of the buffer.
+//
+// The positions in the header are absolute byte counts, the offset in the buffer is the position modulo capacity,
+// and the buffer holds the records in [begin, end). The writer makes room by moving `begin` past the oldest records
+// before it overwrites them, and commits by moving `end`. Then it bumps the `futex` word and wakes up whoever waits
+// on it. The readers map the segment read-only and never write to it: a reader copies a record out, then checks
+// `begin` again, and if the writer has lapped it meanwhile, drops the copy and resumes from the oldest record held.
+// The sequence numbers tell how many records it has missed.
+
+#ifndef TAILPRODUCE_SHARED_MEMORY_RING_H
+#define TAILPRODUCE_SHARED_MEMORY_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "tp_exceptions.h"
+
+namespace TailProduce {
+    namespace SharedMemoryRingInternal {
+        enum : uint64_t { kMagic = 0x31474e4952505400ull };
+        enum : uint32_t { kVersion = 1, kPaddingMarker = 0xffffffffu };
+        enum : size_t { kHeaderSize = 4096 };
+
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+                      "The atomics shared between the processes should be lock-free.");
+
+        struct Header {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t capacity;
+            // Written by the writer only, read by every reader: on a cache line of their own.
+            alignas(64) std::atomic<uint64_t> begin;
+            std::atomic<uint64_t> end;
+            std::atomic<uint64_t> sequence;
+            alignas(64) std::atomic<uint32_t> futex;
+        };
+        static_assert(sizeof(Header) <= kHeaderSize, "The header should fit into its page.");
+
+        struct RecordHeader {
+            uint32_t key_size;
+            uint32_t value_size;
+            uint64_t sequence;
+        };
+
+        inline uint64_t RecordSize(uint64_t key_size, uint64_t value_size) {
+            return (sizeof(RecordHeader) + key_size + value_size + 7) & ~uint64_t(7);
+        }
+
+        // The segments are shared between the processes, so are the futexes. See shared_memory_ring.cc.
+        void FutexWakeAll(std::atomic<uint32_t>* word);
+        void FutexWait(const std::atomic<uint32_t>* word, uint32_t value, std::chrono::milliseconds timeout);
+    };
+
+    // The writing side. Owns the segment: creates it, replacing a stale one of the same name, and removes it.
+    // Not thread-safe, the records are appended from one thread.
+    class SharedMemoryRingWriter {
+      public:
+        // The capacity is rounded up to whole pages.
+        SharedMemoryRingWriter(const std::string& name, size_t capacity);
+        ~SharedMemoryRingWriter();
+
+        // Returns false, and writes nothing, if the record takes more than half of the ring.
+        bool Append(const char* key, size_t key_size, const char* value, size_t value_size) {
+            using namespace SharedMemoryRingInternal;
+            const uint64_t size = RecordSize(key_size, value_size);
+            if (size > capacity / 2) {
+                return false;
+            }
+            const uint64_t room_before_the_end = capacity - end % capacity;
+            if (room_before_the_end < size) {
+                MakeRoom(room_before_the_end);
+                const uint32_t marker = kPaddingMarker;
+                memcpy(data + end % capacity, &marker, sizeof(marker));
+                end += room_before_the_end;
+            }
+            MakeRoom(size);
+            char* p = data + end % capacity;
+            const RecordHeader record{static_cast<uint32_t>(key_size), static_cast<uint32_t>(value_size), sequence};
+            memcpy(p, &record, sizeof(record));
+            memcpy(p + sizeof(record), key, key_size);
+            memcpy(p + sizeof(record) + key_size, value, value_size);
+            end += size;
+            ++sequence;
+            return true;
+        }
+
+        // Makes the records appended so far visible to the readers and wakes up the waiting ones.
+        void Commit() {
+            header->sequence.store(sequence, std::memory_order_relaxed);
+            header->end.store(end, std::memory_order_release);
+            header->futex.fetch_add(1, std::memory_order_release);
+            SharedMemoryRingInternal::FutexWakeAll(&header->futex);
+        }
+
+        uint64_t Capacity() const {
+            return capacity;
+        }
+
+      private:
+        // Moves `begin` past the oldest records until `size` more bytes fit. The readers are to see the new `begin`
+        // before any of the bytes it frees get overwritten.
+        void MakeRoom(uint64_t size) {
+            using namespace SharedMemoryRingInternal;
+            const uint64_t original_begin = begin;
+            while (end + size - begin > capacity) {
+                const uint64_t offset = begin % capacity;
+                RecordHeader record;
+                memcpy(&record.key_size, data + offset, sizeof(record.key_size));
+                if (record.key_size == kPaddingMarker) {
+                    begin += capacity - offset;
+                } else {
+                    memcpy(&record, data + offset, sizeof(record));
+                    begin += RecordSize(record.key_size, record.value_size);
+                }
+            }
+            if (begin != original_begin) {
+                header->begin.store(begin, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+        }
+
+        const std::string name;
+        const uint64_t capacity;
+        void* mapping;
+        SharedMemoryRingInternal::Header* header;
+        char* data;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        uint64_t sequence = 0;
+
+        SharedMemoryRingWriter() = delete;
+        SharedMemoryRingWriter(const SharedMemoryRingWriter&) = delete;
+        void operator=(const SharedMemoryRingWriter&) = delete;
+    };
+
+    // The reading side. Maps an existing segment read-only; thread-safe, each reader keeps its own position.
+    class SharedMemoryRingReader {
+      public:
+        explicit SharedMemoryRingReader(const std::string& name);
+        ~SharedMemoryRingReader();
+
+        // The position of the oldest record held.
+        uint64_t Begin() const {
+            return header->begin.load(std::memory_order_acquire);
+        }
+
+        // The position past the newest record committed.
+        uint64_t End() const {
+            return header->end.load(std::memory_order_acquire);
+        }
+
+        // Copies the record at `position` into `key` and `value`, sets `sequence` to its sequence number and moves
+        // `position` past it. Returns false if there is no record at `position` yet. If the writer has overwritten
+        // the record at `position`, reads the oldest record held instead.
+        bool Read(uint64_t& position, uint64_t& sequence, std::string& key, std::string& value) const {
+            using namespace SharedMemoryRingInternal;
+            while (position < End()) {
+                if (position < Begin()) {
+                    position = Begin();
+                    continue;
+                }
+                const uint64_t offset = position % capacity;
+                RecordHeader record;
+                memcpy(&record.key_size, data + offset, sizeof(record.key_size));
+                if (record.key_size == kPaddingMarker) {
+                    if (!Overwritten(position)) {
+                        position += capacity - offset;
+                    }
+                    continue;
+                }
+                memcpy(&record, data + offset, sizeof(record));
+                const uint64_t size = RecordSize(record.key_size, record.value_size);
+                if (size > capacity - offset) {
+                    if (Overwritten(position)) {
+                        continue;
+                    }
+                    VLOG(3) << "throw SharedMemoryException();";
+                    throw SharedMemoryException("Malformed record.");
+                }
+                key.assign(data + offset + sizeof(record), record.key_size);
+                value.assign(data + offset + sizeof(record) + record.key_size, record.value_size);
+                if (Overwritten(position)) {
+                    continue;
+                }
+                position += size;
+                sequence = record.sequence;
+                return true;
+            }
+            return false;
+        }
+
+        // Blocks until there is a record at `position`, or for up to `timeout`.
+        void Wait(uint64_t position, std::chrono::milliseconds timeout) const {
+            const uint32_t word = header->futex.load(std::memory_order_acquire);
+            if (End() <= position) {
+                SharedMemoryRingInternal::FutexWait(&header->futex, word, timeout);
+            }
+        }
+
+        uint64_t Capacity() const {
+            return capacity;
+        }
+
+      private:
+        // Whether the bytes at `position` read so far may have been overwritten while being read.
+        bool Overwritten(uint64_t position) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return header->begin.load(std::memory_order_relaxed) > position;
+        }
+
+        void* mapping;
+        size_t mapping_size;
+        const SharedMemoryRingInternal::Header* header;
+        const char* data;
+        uint64_t capacity;
+
+        SharedMemoryRingReader() = delete;
+        SharedMemoryRingReader(const SharedMemoryRingReader&) = delete;
+        void operator=(const SharedMemoryRingReader&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_SHARED_MEMORY_RING_H
@@ -0,0 +1,248 @@
+// Streams published into shared memory rings, for the processes on the same host to listen to them, see
+// shared_memory_ring.h.
+//
+// The framework side is SharedMemoryStreamWriter: a thread per stream that copies each new entry of the stream,
+// its order key and its serialized value, into the ring named `prefix + stream name`, and commits them in batches.
+// It is declared with TAILPRODUCE_SHARED_MEMORY_STREAM(NAME) and is enabled by
+// StreamManagerParams::SetSharedMemoryPrefix(). The ring holds the latest entries only, the ones published since
+// the writer started, as many as fit.
+//
+// The process side is SharedMemoryListenersFactory: the same interface as AsyncListenersFactory, with the listener
+// thread reading from the ring. A listener starts from the oldest entry the ring holds. If it falls behind by more
+// than the ring holds, it skips to the oldest entry held, and EntriesLost() counts the ones it has missed.
+
+#ifndef TAILPRODUCE_SHARED_MEMORY_STREAM_H
+#define TAILPRODUCE_SHARED_MEMORY_STREAM_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <glog/logging.h>
+
+#include "event_subscriber.h"
+#include "fixed_size_serializer.h"
+#include "listeners.h"
+#include "memory_istream.h"
+#include "shared_memory_ring.h"
+#include "tp_exceptions.h"
+
+namespace TailProduce {
+    template <typename STREAM> struct SharedMemoryStreamWriter : ::TailProduce::Subscriber {
+        typedef STREAM T_STREAM;
+        enum { kMaxEntriesPerCommit = 1000 };
+
+        // An empty name publishes nothing. Otherwise, publishes the entries that come after the current HEAD.
+        SharedMemoryStreamWriter(const T_STREAM& stream, const std::string& name, size_t capacity)
+            : stream(stream) {
+            if (!name.empty()) {
+                ring.reset(new SharedMemoryRingWriter(name, capacity));
+                stream.subscriptions_.RegisterSubscriber(this);
+                {
+                    std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                    listener.reset(new INTERNAL_UnsafeListener<T_STREAM>(stream, stream.head));
+                    head_key = stream.head.ComposeStorageKey(stream, stream.config_values());
+                }
+                thread = std::thread(&SharedMemoryStreamWriter::Run, this);
+            }
+        }
+
+        ~SharedMemoryStreamWriter() {
+            if (ring) {
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    stopping = true;
+                    condition.notify_all();
+                }
+                thread.join();
+                stream.subscriptions_.UnregisterSubscriber(this);
+            }
+        }
+
+        // The number of entries written to the ring, and of the ones skipped for taking more than half of it.
+        size_t EntriesWritten() const {
+            return entries_written;
+        }
+        size_t EntriesSkipped() const {
+            return entries_skipped;
+        }
+
+        virtual void Poke() override {
+            std::lock_guard<std::mutex> guard(mutex);
+            poked = true;
+            condition.notify_all();
+        }
+
+      private:
+        void Run() {
+            // The entry at the HEAD, if any, is not a new one.
+            ::TailProduce::Storage::STORAGE_KEY_TYPE key;
+            if (listener->PeekStorageKey(key) && key == head_key) {
+                listener->AdvanceToNextEntry();
+            }
+            const size_t prefix_length = stream.storage_key_data_prefix.length();
+            ::TailProduce::Storage::STORAGE_VALUE_TYPE value;
+            while (Continue()) {
+                size_t entries = 0;
+                while (entries < kMaxEntriesPerCommit && listener->PeekStorageEntry(key, value)) {
+                    listener->AdvanceToNextEntry();
+                    if (ring->Append(key.data() + prefix_length,
+                                     key.length() - prefix_length,
+                                     reinterpret_cast<const char*>(value.data()),
+                                     value.size())) {
+                        ++entries;
+                    } else {
+                        VLOG(2) << this << " SharedMemoryStreamWriter: skipped '" << key << "', " << value.size()
+                                << " bytes.";
+                        ++entries_skipped;
+                    }
+                }
+                if (entries) {
+                    ring->Commit();
+                    entries_written += entries;
+                } else {
+                    WaitForPoke();
+                }
+            }
+        }
+
+        // Returns false once the writer is being destroyed. Otherwise, a poke from now on means there is more data.
+        bool Continue() {
+            std::lock_guard<std::mutex> guard(mutex);
+            poked = false;
+            return !stopping;
+        }
+
+        void WaitForPoke() {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, std::chrono::seconds(1), [this]() { return poked || stopping; });
+        }
+
+        const T_STREAM& stream;
+        std::unique_ptr<SharedMemoryRingWriter> ring;
+        std::unique_ptr<INTERNAL_UnsafeListener<T_STREAM>> listener;
+        ::TailProduce::Storage::STORAGE_KEY_TYPE head_key;
+        std::atomic<size_t> entries_written{0};
+        std::atomic<size_t> entries_skipped{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool poked = false;
+        bool stopping = false;
+        std::thread thread;
+
+        SharedMemoryStreamWriter() = delete;
+        SharedMemoryStreamWriter(const SharedMemoryStreamWriter&) = delete;
+        void operator=(const SharedMemoryStreamWriter&) = delete;
+    };
+
+    // Listens to the stream published into the ring `name`, its entries being of type ENTRY,
+    // ordered by PRIMARY_KEY and SECONDARY_KEY. Only the per-entry processors are supported.
+    template <typename ENTRY, typename PRIMARY_KEY, typename SECONDARY_KEY> struct SharedMemoryListenersFactory {
+        typedef ENTRY T_ENTRY;
+        typedef PRIMARY_KEY T_PRIMARY_KEY;
+        enum {
+            order_key_size =
+                FixedSizeSerializer<PRIMARY_KEY>::size_in_bytes + FixedSizeSerializer<SECONDARY_KEY>::size_in_bytes
+        };
+
+        explicit SharedMemoryListenersFactory(const std::string& name)
+            : ring(std::make_shared<SharedMemoryRingReader>(name)) {
+        }
+
+        template <typename PROCESSOR> struct SharedMemoryListener {
+            typedef PROCESSOR T_PROCESSOR;
+            static_assert(!IsBatchProcessor<T_PROCESSOR>::value,
+                          "SharedMemoryListener: only the per-entry processors are supported.");
+
+            SharedMemoryListener(std::shared_ptr<const SharedMemoryRingReader> ring,
+                                 T_PROCESSOR& processor,
+                                 EntryAllocation entry_allocation)
+                : ring(ring),
+                  processor(processor),
+                  entry_allocation(entry_allocation),
+                  worker_thread(&SharedMemoryListener::ThreadFunction, this) {
+            }
+            ~SharedMemoryListener() {
+                terminating = true;
+                worker_thread.join();
+            }
+
+            // The number of entries processed, and of the ones overwritten before this listener got to them.
+            uint64_t EntriesProcessed() const {
+                return entries_processed;
+            }
+            uint64_t EntriesLost() const {
+                return entries_lost;
+            }
+
+          private:
+            void ThreadFunction() {
+                uint64_t position = ring->Begin();
+                uint64_t sequence;
+                uint64_t next_sequence = 0;
+                bool first = true;
+                std::string key;
+                std::string value;
+                T_ENTRY reusable_entry;
+                while (!terminating) {
+                    if (!ring->Read(position, sequence, key, value)) {
+                        ring->Wait(position, std::chrono::milliseconds(100));
+                        continue;
+                    }
+                    if (!first && sequence != next_sequence) {
+                        VLOG(2) << this << " SharedMemoryListener: lost " << sequence - next_sequence << " entries.";
+                        entries_lost += sequence - next_sequence;
+                    }
+                    first = false;
+                    next_sequence = sequence + 1;
+                    if (key.length() != order_key_size) {
+                        VLOG(3) << "throw MalformedStorageHeadException();";
+                        throw MalformedStorageHeadException();
+                    }
+                    const T_PRIMARY_KEY primary = FixedSizeSerializer<PRIMARY_KEY>::UnpackFromChars(key.data());
+                    MemoryInputStream is(value.data(), value.data() + value.size());
+                    if (entry_allocation == EntryAllocation::ReuseEntry) {
+                        T_ENTRY::DeSerializeAndProcessEntry(is, primary, processor, reusable_entry);
+                    } else {
+                        T_ENTRY::DeSerializeAndProcessEntry(is, primary, processor);
+                    }
+                    ++entries_processed;
+                }
+            }
+
+            std::shared_ptr<const SharedMemoryRingReader> ring;
+            T_PROCESSOR& processor;
+            const EntryAllocation entry_allocation;
+            std::atomic<bool> terminating{false};
+            std::atomic<uint64_t> entries_processed{0};
+            std::atomic<uint64_t> entries_lost{0};
+            std::thread worker_thread;
+
+            SharedMemoryListener() = delete;
+            SharedMemoryListener(const SharedMemoryListener&) = delete;
+            void operator=(const SharedMemoryListener&) = delete;
+        };
+
+        template <typename PROCESSOR>
+        std::unique_ptr<SharedMemoryListener<PROCESSOR>> operator()(
+            PROCESSOR& processor,
+            EntryAllocation entry_allocation = EntryAllocation::FreshEntry) {
+            return std::unique_ptr<SharedMemoryListener<PROCESSOR>>(
+                new SharedMemoryListener<PROCESSOR>(ring, processor, entry_allocation));
+        }
+
+        // The number of bytes the ring holds.
+        uint64_t Capacity() const {
+            return ring->Capacity();
+        }
+
+      private:
+        std::shared_ptr<const SharedMemoryRingReader> ring;
+    };
+};
+
+#endif  // TAILPRODUCE_SHARED_MEMORY_STREAM_H
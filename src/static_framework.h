@@ -2,7 +2,10 @@
 #define STATIC_FRAMEWORK_H
 
 #include <algorithm>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -10,7 +13,11 @@
 
 #include "stream_manager_params.h"
 #include "config_values.h"
+#include "http.h"
+#include "latency.h"
+#include "stats.h"
 #include "tcp_server_singleton.h"
+#include "tracing.h"
 
 namespace TailProduce {
     inline void EnsureThereAreNoStreamsWithoutPublishers(const std::set<std::string>& streams_declared,
@@ -33,19 +40,159 @@ namespace TailProduce {
 
     struct StreamManagerBase {};
 
-    template <typename STORAGE> struct StreamManager : StreamManagerBase {
+    // TRACER is called on the hot paths of the framework, see tracing.h.
+    template <typename STORAGE, typename TRACER = NoOpTracer> struct StreamManager : StreamManagerBase {
         typedef STORAGE T_STORAGE;
+        typedef TRACER T_TRACER;
         T_STORAGE storage;
     };
 
+    // An HTTP endpoint of the framework. Takes over the connection: it is up to the exporter to respond and
+    // to close it. Called from the io_service threads of the TCP server, so it should not block.
     struct StreamExporter {
-        virtual void ListenAndStreamData(std::unique_ptr<boost::asio::ip::tcp::socket>&& socket) = 0;
+        virtual ~StreamExporter() {
+        }
+        virtual void ListenAndStreamData(std::shared_ptr<::TailProduce::TCPServer::Connection> connection,
+                                         const ::TailProduce::HTTPRequest& request) = 0;
+        // Whether the exporter responds to the request before ListenAndStreamData() returns, leaving the
+        // connection to be read for the next request, rather than taking it over.
+        virtual bool RespondsInFull() const {
+            return false;
+        }
+    };
+
+    // The exporters of a framework by their paths. Shared with the connections being served,
+    // so that a keep-alive connection outliving the framework does not touch it.
+    struct StreamExporters {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::map<std::string, ::TailProduce::StreamExporter*> by_path;
+        size_t exporters_being_called = 0;
+    };
+
+    // Serves the latency histograms of the listeners as JSON, see latency.h.
+    struct LatencyExporter : StreamExporter {
+        explicit LatencyExporter(const LatencyHistograms& histograms) : histograms(histograms) {
+        }
+        virtual void ListenAndStreamData(std::shared_ptr<::TailProduce::TCPServer::Connection> connection,
+                                         const ::TailProduce::HTTPRequest& request) override {
+            connection->AsyncWrite(
+                ::TailProduce::FormatHTTPResponse(request, 200, histograms.FormatJSON(), "application/json"));
+        }
+        virtual bool RespondsInFull() const override {
+            return true;
+        }
+        const LatencyHistograms& histograms;
+    };
+
+    // Serves the counters of the framework as JSON, see stats.h.
+    struct StatsExporter : StreamExporter {
+        explicit StatsExporter(FrameworkStats& stats) : stats(stats) {
+        }
+        virtual void ListenAndStreamData(std::shared_ptr<::TailProduce::TCPServer::Connection> connection,
+                                         const ::TailProduce::HTTPRequest& request) override {
+            connection->AsyncWrite(
+                ::TailProduce::FormatHTTPResponse(request, 200, stats.FormatJSON(), "application/json"));
+        }
+        virtual bool RespondsInFull() const override {
+            return true;
+        }
+        FrameworkStats& stats;
+    };
+
+    // The streams of the framework by their names, for the replication, see replication.h.
+    struct ReplicatedStream;
+    typedef std::map<std::string, ReplicatedStream*> ReplicatedStreams;
+
+    // Reads the requests off the connection, asynchronously, until one of them is for an exporter.
+    struct HTTPRequestsDispatcher : std::enable_shared_from_this<HTTPRequestsDispatcher> {
+        HTTPRequestsDispatcher(std::shared_ptr<::TailProduce::TCPServer::Connection> connection,
+                               std::shared_ptr<StreamExporters> exporters)
+            : connection(connection), exporters(exporters), buffer(::TailProduce::HTTPRequest::kMaxHeadSize) {
+        }
+
+        void ReadNextRequest() {
+            auto self = shared_from_this();
+            ::TailProduce::AsyncReadHTTPRequest(connection,
+                                                buffer,
+                                                request,
+                                                [self](::TailProduce::HTTPReadResult result) {
+                                                    self->OnRequest(result);
+                                                });
+        }
+
+        void OnRequest(::TailProduce::HTTPReadResult result) {
+            if (result == ::TailProduce::HTTPReadResult::Closed) {
+                return;
+            }
+            if (result == ::TailProduce::HTTPReadResult::Malformed) {
+                request.keep_alive = false;
+                connection->AsyncWrite(::TailProduce::FormatHTTPResponse(request, 400, "Bad request.\n"));
+                connection->CloseAfterWrites();
+                return;
+            }
+
+            VLOG(2) << "HTTPRequestsDispatcher::OnRequest(\"" << request.path << "\")";
+            ::TailProduce::StreamExporter* exporter = nullptr;
+            std::string response;
+            {
+                std::lock_guard<std::mutex> guard(exporters->mutex);
+                auto cit = exporters->by_path.find(request.path);
+                if (cit != exporters->by_path.end()) {
+                    exporter = cit->second;
+                    ++exporters->exporters_being_called;
+                } else {
+                    response = "Not found: " + request.path + "\n";
+                    for (auto cit : exporters->by_path) {
+                        response += cit.first + '\n';
+                    }
+                    response += "That's it.\n";
+                }
+            }
+            if (exporter) {
+                // Called outside the mutex, so that a slow exporter does not hold the others back.
+                // RemoveExporter() waits for the calls in progress to return.
+                bool responded_in_full;
+                {
+                    ExporterCallScope scope(*exporters);
+                    exporter->ListenAndStreamData(connection, request);
+                    responded_in_full = exporter->RespondsInFull();
+                }
+                if (!responded_in_full) {
+                    return;
+                }
+            } else {
+                connection->AsyncWrite(::TailProduce::FormatHTTPResponse(request, 404, response));
+            }
+            if (request.keep_alive) {
+                ReadNextRequest();
+            } else {
+                connection->CloseAfterWrites();
+            }
+        }
+
+        struct ExporterCallScope {
+            StreamExporters& exporters;
+            explicit ExporterCallScope(StreamExporters& exporters) : exporters(exporters) {
+            }
+            ~ExporterCallScope() {
+                std::lock_guard<std::mutex> guard(exporters.mutex);
+                --exporters.exporters_being_called;
+                exporters.condition.notify_all();
+            }
+        };
+
+        std::shared_ptr<::TailProduce::TCPServer::Connection> connection;
+        std::shared_ptr<StreamExporters> exporters;
+        boost::asio::streambuf buffer;
+        ::TailProduce::HTTPRequest request;
     };
 
     template <typename BASE> class StaticFramework {
       public:
         typedef BASE T_BASE;
         typedef typename T_BASE::T_STORAGE T_STORAGE;
+        typedef typename T_BASE::T_TRACER T_TRACER;
 
         ::TailProduce::ConfigValues cv;
 
@@ -53,72 +200,80 @@ namespace TailProduce {
 
         std::set<std::string> streams_declared_;
         std::set<std::string> stream_publishers_declared_;
+        ::TailProduce::ReplicatedStreams replicated_streams_;
 
-        std::map<std::string, ::TailProduce::StreamExporter*> exporters_;
-
-        void HandleRequestSync(std::unique_ptr<boost::asio::ip::tcp::socket>&& socket) {
-            std::string query;
-            char c;
-            while (true) {
-                boost::asio::read(*socket, boost::asio::buffer(&c, 1), boost::asio::transfer_all());
-                if (c == '\n' || c == '\r') {
-                    break;
-                }
-                query += c;
-            }
-
-            std::istringstream is(query);
-
-            std::string query_resource;
+        // For TAILPRODUCE_SHARED_MEMORY_STREAM(), see StreamManagerParams::SetSharedMemoryPrefix().
+        const std::string shared_memory_prefix_;
+        const size_t shared_memory_ring_size_;
 
-            is >> query_resource;
-            if (query_resource == "GET") {
-                is >> query_resource;
-            }
-
-            VLOG(2) << this << " StaticFramework::HandleRequestSync(\"" << query_resource << "\")";
-            VLOG(2) << this << " StaticFramework::HandleRequestSync(): " << exporters_.size() << " exporters.";
+        // For the listeners, see StreamManagerParams::SetLatencyTracking().
+        ::TailProduce::LatencyHistograms latency_histograms_;
+        ::TailProduce::LatencyExporter latency_exporter_{latency_histograms_};
 
-            auto cit = exporters_.find(query_resource);
-            if (cit != exporters_.end()) {
-                cit->second->ListenAndStreamData(std::move(socket));
-            } else {
-                std::string response = "Not found: " + query_resource + "\n";
-                for (auto cit : exporters_) {
-                    response += cit.first + '\n';
-                }
-                response += "That's it.\n";
+        // For the streams, the listeners and the storage calls, see StreamManagerParams::SetStats().
+        ::TailProduce::FrameworkStats stats_;
+        ::TailProduce::StatsExporter stats_exporter_{stats_};
 
-                std::ostringstream os;
-                os << "HTTP/1.1 200 OK\n";
-                os << "Content-type: text/html\n";
-                os << "Content-length: " << response.length() << "\n";
-                os << "\n";
-                os << response;
+        std::shared_ptr<::TailProduce::StreamExporters> exporters_ =
+            std::make_shared<::TailProduce::StreamExporters>();
 
-                const std::string message = os.str();
-                boost::asio::write(*socket, boost::asio::buffer(message), boost::asio::transfer_all());
-            }
+        void HandleConnection(std::shared_ptr<::TailProduce::TCPServer::Connection> connection) {
+            std::make_shared<::TailProduce::HTTPRequestsDispatcher>(connection, exporters_)->ReadNextRequest();
         }
         std::unique_ptr<::TailProduce::TCPServer::ScopedHandlerRegisterer> scoped_http_handler_registerer;
+        std::unique_ptr<::TailProduce::TCPServer::ScopedHandlerRegisterer> scoped_unix_socket_handler_registerer;
 
         void AddExporter(const std::string& endpoint, ::TailProduce::StreamExporter* handler) {
-            // TODO(dkorolev): Add more logic here. Add a scoped adder.
+            // TODO(dkorolev): Add a scoped adder.
             VLOG(2) << this << " StaticFramework::AddExporter(\"" << endpoint << "\")";
-            exporters_[endpoint] = handler;
+            std::lock_guard<std::mutex> guard(exporters_->mutex);
+            exporters_->by_path[endpoint] = handler;
         }
 
+        // Once RemoveExporter() returns, the exporter is not and will not be called.
         void RemoveExporter(const std::string& endpoint, ::TailProduce::StreamExporter* handler) {
             VLOG(2) << this << " StaticFramework::RemoveExporter(\"" << endpoint << "\")";
-            // TODO(dkorolev): Add more logic here.
+            std::unique_lock<std::mutex> lock(exporters_->mutex);
+            auto it = exporters_->by_path.find(endpoint);
+            if (it != exporters_->by_path.end() && it->second == handler) {
+                exporters_->by_path.erase(it);
+            }
+            exporters_->condition.wait(lock, [this]() { return exporters_->exporters_being_called == 0; });
         }
 
         StaticFramework(T_STORAGE& storage,
                         const ::TailProduce::StreamManagerParams& params =
                             ::TailProduce::StreamManagerParams::FromCommandLineFlags())
-            : cv("s", "d", ':'), storage(EnsureStreamsAreCreatedDuringInitialization(storage, cv, params)) {
+            : cv("s", "d", ':'),
+              storage(EnsureStreamsAreCreatedDuringInitialization(storage, cv, params)),
+              shared_memory_prefix_(params.SharedMemoryPrefix()),
+              shared_memory_ring_size_(params.SharedMemoryRingSize()),
+              latency_histograms_(params.LatencyTracking()),
+              stats_(params.Stats()) {
             ::TailProduce::EnsureThereAreNoStreamsWithoutPublishers(streams_declared_, stream_publishers_declared_);
-            scoped_http_handler_registerer.reset(new ::TailProduce::TCPServer::ScopedHandlerRegisterer(8080, *this));
+            if (latency_histograms_.Enabled()) {
+                AddExporter("/latency", &latency_exporter_);
+            }
+            if (stats_.Enabled()) {
+                AddExporter("/stats", &stats_exporter_);
+            }
+            if (params.HTTPPort()) {
+                scoped_http_handler_registerer.reset(
+                    new ::TailProduce::TCPServer::ScopedHandlerRegisterer(params.HTTPPort(), *this));
+            }
+            if (!params.HTTPUnixSocket().empty()) {
+                scoped_unix_socket_handler_registerer.reset(new ::TailProduce::TCPServer::ScopedHandlerRegisterer(
+                    ::TailProduce::TCPServer::Endpoint::UnixSocket(params.HTTPUnixSocket()), *this));
+            }
+        }
+
+        ~StaticFramework() {
+            if (latency_histograms_.Enabled()) {
+                RemoveExporter("/latency", &latency_exporter_);
+            }
+            if (stats_.Enabled()) {
+                RemoveExporter("/stats", &stats_exporter_);
+            }
         }
 
         static T_STORAGE& EnsureStreamsAreCreatedDuringInitialization(
@@ -0,0 +1,413 @@
+// The counters of a framework, enabled by StreamManagerParams::SetStats() and served as JSON at /stats.
+//
+// Per stream: the entries and bytes published, the HEAD, and the publish rate since the previous request.
+// Per listener: the cursor, the lag in entries, the entries processed and the time spent processing them.
+// Per storage: the reads, the writes and their bytes, and the iterators created, by the framework.
+//
+// The counters are bumped on the hot paths, so they should not become a contention point of their own.
+// StripedCounters gives each thread a cache line of its own to add to, and only reading them sums the lines up.
+// The counters of a listener have one writer, its thread. The cursor of a listener is copied under the stream
+// mutex, which the listener takes anyway, and the lag is only counted when requested, up to kMaxLagCounted.
+
+#ifndef TAILPRODUCE_STATS_H
+#define TAILPRODUCE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "latency.h"
+#include "storage.h"
+
+namespace TailProduce {
+    namespace StatsInternal {
+        enum { kCacheLineSize = 64, kStripes = 16 };
+
+        // The stripe of the calling thread. The threads take the stripes round-robin.
+        inline size_t ThreadStripe() {
+            static std::atomic<size_t> threads_seen{0};
+            thread_local size_t stripe = threads_seen++ % kStripes;
+            return stripe;
+        }
+
+        inline std::string QuoteJSON(const std::string& s) {
+            std::string result = "\"";
+            for (const char c : s) {
+                if (c == '"' || c == '\\') {
+                    result += '\\';
+                    result += c;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    result += escaped;
+                } else {
+                    result += c;
+                }
+            }
+            return result + '"';
+        }
+    };
+
+    // N counters added to by any thread. Each thread adds to its own stripe, a cache line apart from the others.
+    // The stripes are allocated, and aligned, separately, for the counters to be movable along with the streams.
+    template <size_t N> class StripedCounters {
+      public:
+        StripedCounters() : memory(new char[kStripeSize * StatsInternal::kStripes + StatsInternal::kCacheLineSize]) {
+            const uintptr_t address = reinterpret_cast<uintptr_t>(memory.get());
+            stripes = memory.get() + (StatsInternal::kCacheLineSize - address % StatsInternal::kCacheLineSize) %
+                                         StatsInternal::kCacheLineSize;
+            for (size_t i = 0; i < StatsInternal::kStripes; ++i) {
+                new (stripes + i * kStripeSize) Stripe();
+            }
+        }
+        StripedCounters(StripedCounters&&) = default;
+
+        void Add(size_t counter, uint64_t delta) {
+            StripeAt(StatsInternal::ThreadStripe()).values[counter].fetch_add(delta, std::memory_order_relaxed);
+        }
+        uint64_t Get(size_t counter) const {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < StatsInternal::kStripes; ++i) {
+                sum += StripeAt(i).values[counter].load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+      private:
+        struct Stripe {
+            std::atomic<uint64_t> values[N];
+        };
+        enum {
+            kStripeSize = (sizeof(Stripe) + StatsInternal::kCacheLineSize - 1) / StatsInternal::kCacheLineSize *
+                          StatsInternal::kCacheLineSize
+        };
+
+        Stripe& StripeAt(size_t i) const {
+            return *reinterpret_cast<Stripe*>(stripes + i * kStripeSize);
+        }
+
+        std::unique_ptr<char[]> memory;
+        char* stripes;
+
+        StripedCounters(const StripedCounters&) = delete;
+        void operator=(const StripedCounters&) = delete;
+    };
+
+    // The storage calls of the framework: publishers, listeners and replication. A disabled one counts nothing.
+    class StorageStats {
+      public:
+        explicit StorageStats(bool enabled) : enabled(enabled) {
+        }
+
+        void CountRead(size_t bytes) {
+            if (enabled) {
+                counters.Add(kReads, 1);
+                counters.Add(kBytesRead, bytes);
+            }
+        }
+        void CountWrite(size_t bytes) {
+            if (enabled) {
+                counters.Add(kWrites, 1);
+                counters.Add(kBytesWritten, bytes);
+            }
+        }
+        void CountWrites(const ::TailProduce::Storage::WriteBatch& batch) {
+            if (enabled) {
+                size_t bytes = 0;
+                for (const auto& write : batch.writes) {
+                    bytes += write.value.size();
+                }
+                counters.Add(kWrites, batch.Size());
+                counters.Add(kBytesWritten, bytes);
+            }
+        }
+        void CountIteratorCreated() {
+            if (enabled) {
+                counters.Add(kIteratorsCreated, 1);
+            }
+        }
+
+        uint64_t Reads() const {
+            return counters.Get(kReads);
+        }
+        uint64_t BytesRead() const {
+            return counters.Get(kBytesRead);
+        }
+        uint64_t Writes() const {
+            return counters.Get(kWrites);
+        }
+        uint64_t BytesWritten() const {
+            return counters.Get(kBytesWritten);
+        }
+        uint64_t IteratorsCreated() const {
+            return counters.Get(kIteratorsCreated);
+        }
+
+      private:
+        enum { kReads, kBytesRead, kWrites, kBytesWritten, kIteratorsCreated, kCounters };
+        const bool enabled;
+        StripedCounters<kCounters> counters;
+    };
+
+    // What the publisher of a stream has published. Kept in the stream, see TAILPRODUCE_STREAM().
+    class StreamStats {
+      public:
+        explicit StreamStats(bool enabled) : enabled(enabled) {
+        }
+
+        void CountPublished(uint64_t entries, uint64_t bytes) {
+            if (enabled) {
+                counters.Add(kEntries, entries);
+                counters.Add(kBytes, bytes);
+            }
+        }
+
+        uint64_t EntriesPublished() const {
+            return counters.Get(kEntries);
+        }
+        uint64_t BytesPublished() const {
+            return counters.Get(kBytes);
+        }
+
+      private:
+        enum { kEntries, kBytes, kCounters };
+        const bool enabled;
+        StripedCounters<kCounters> counters;
+    };
+
+    // The progress of a listener.
+    class ListenerStats {
+      public:
+        // From the listener thread only.
+        void CountProcessed(uint64_t entries, uint64_t nanoseconds) {
+            entries_processed.store(entries_processed.load(std::memory_order_relaxed) + entries,
+                                    std::memory_order_relaxed);
+            processor_nanoseconds.store(processor_nanoseconds.load(std::memory_order_relaxed) + nanoseconds,
+                                        std::memory_order_relaxed);
+        }
+
+        uint64_t EntriesProcessed() const {
+            return entries_processed.load(std::memory_order_relaxed);
+        }
+        uint64_t ProcessorNanoseconds() const {
+            return processor_nanoseconds.load(std::memory_order_relaxed);
+        }
+
+        // The storage key of the listener, and whether the entry at it has been processed. Guarded by the mutex
+        // of the stream.
+        ::TailProduce::Storage::STORAGE_KEY_TYPE cursor;
+        bool cursor_processed = false;
+
+      private:
+        alignas(StatsInternal::kCacheLineSize) std::atomic<uint64_t> entries_processed{0};
+        std::atomic<uint64_t> processor_nanoseconds{0};
+    };
+
+    // A stream as seen by the stats, with the types erased. TAILPRODUCE_STREAM registers one for each stream.
+    struct StreamStatsSource {
+        virtual ~StreamStatsSource() {
+        }
+        virtual const StreamStats& Published() const = 0;
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadDataKey() const = 0;
+        // The number of entries past the cursor of the listener, up to `max_entries`. Also copies the cursor.
+        virtual uint64_t CountEntriesAhead(const ListenerStats& listener,
+                                           uint64_t max_entries,
+                                           ::TailProduce::Storage::STORAGE_KEY_TYPE& cursor) const = 0;
+    };
+
+    // The stats of a framework: its storage counters, and the streams and the listeners by their names.
+    class FrameworkStats {
+      public:
+        enum { kMaxLagCounted = 100000 };
+
+        explicit FrameworkStats(bool enabled) : enabled(enabled), storage(enabled) {
+        }
+
+        bool Enabled() const {
+            return enabled;
+        }
+
+      private:
+        const bool enabled;
+
+      public:
+        StorageStats storage;
+
+        // Keeps the stream listed while in scope.
+        void AddStream(const std::string& name, const StreamStatsSource* source) {
+            std::lock_guard<std::mutex> guard(streams_mutex);
+            streams[name] = StreamSample{source, 0, LatencyInternal::NowInNanoseconds()};
+        }
+        void RemoveStream(const std::string& name) {
+            std::lock_guard<std::mutex> guard(streams_mutex);
+            streams.erase(name);
+        }
+
+        // Keeps the listener listed while in scope.
+        struct ListenerRegistration {
+            ListenerRegistration(FrameworkStats& registry, const std::string& stream_name, const std::string& name)
+                : registry(registry),
+                  stream_name(stream_name),
+                  name(name),
+                  listener(std::make_shared<ListenerStats>()) {
+            }
+            ~ListenerRegistration() {
+                std::lock_guard<std::mutex> guard(registry.listeners_mutex);
+                registry.listeners.erase(name);
+            }
+
+            FrameworkStats& registry;
+            const std::string stream_name;
+            const std::string name;
+            const std::shared_ptr<ListenerStats> listener;
+
+            ListenerRegistration() = delete;
+            ListenerRegistration(const ListenerRegistration&) = delete;
+            void operator=(const ListenerRegistration&) = delete;
+        };
+
+        // Lists a new listener of the stream as `<stream>/<number>`. Returns null if the stats are not collected.
+        // Called with the stream mutex locked, thus `listeners_mutex` is never held while locking a stream.
+        std::unique_ptr<ListenerRegistration> RegisterListener(const std::string& stream_name) {
+            if (!enabled) {
+                return nullptr;
+            }
+            std::lock_guard<std::mutex> guard(listeners_mutex);
+            std::unique_ptr<ListenerRegistration> registration(new ListenerRegistration(
+                *this, stream_name, stream_name + '/' + std::to_string(++listeners_registered)));
+            listeners[registration->name] = ListenerEntry{stream_name, registration->listener};
+            return registration;
+        }
+
+        // {"storage": {...}, "streams": {"<stream>": {...}, ...}, "listeners": {"<stream>/<number>": {...}, ...}}
+        // The publish rate of each stream is over the time since the previous call.
+        std::string FormatJSON() {
+            std::map<std::string, ListenerEntry> listeners_snapshot;
+            {
+                std::lock_guard<std::mutex> guard(listeners_mutex);
+                listeners_snapshot = listeners;
+            }
+
+            std::ostringstream os;
+            os << "{\n  \"storage\": {\"reads\": " << storage.Reads() << ", \"bytes_read\": " << storage.BytesRead()
+               << ", \"writes\": " << storage.Writes() << ", \"bytes_written\": " << storage.BytesWritten()
+               << ", \"iterators_created\": " << storage.IteratorsCreated() << "},\n  \"streams\": {";
+            std::lock_guard<std::mutex> guard(streams_mutex);
+            const uint64_t now = LatencyInternal::NowInNanoseconds();
+            bool first = true;
+            for (auto& it : streams) {
+                StreamSample& sample = it.second;
+                const StreamStats& published = sample.source->Published();
+                const uint64_t entries = published.EntriesPublished();
+                const double seconds = (now - sample.nanoseconds) * 1e-9;
+                os << (first ? "" : ",") << "\n    " << StatsInternal::QuoteJSON(it.first)
+                   << ": {\"entries_published\": " << entries << ", \"bytes_published\": "
+                   << published.BytesPublished() << ", \"head\": "
+                   << StatsInternal::QuoteJSON(sample.source->HeadDataKey()) << ", \"entries_per_second\": "
+                   << (seconds > 0 ? (entries - sample.entries) / seconds : 0.0) << '}';
+                sample.entries = entries;
+                sample.nanoseconds = now;
+                first = false;
+            }
+            os << (first ? "},\n  \"listeners\": {" : "\n  },\n  \"listeners\": {");
+            first = true;
+            for (const auto& cit : listeners_snapshot) {
+                const ListenerStats& listener = *cit.second.listener;
+                const auto stream = streams.find(cit.second.stream_name);
+                ::TailProduce::Storage::STORAGE_KEY_TYPE cursor;
+                const uint64_t lag = stream != streams.end()
+                                         ? stream->second.source->CountEntriesAhead(listener, kMaxLagCounted, cursor)
+                                         : 0;
+                os << (first ? "" : ",") << "\n    " << StatsInternal::QuoteJSON(cit.first) << ": {\"cursor\": "
+                   << StatsInternal::QuoteJSON(cursor) << ", \"lag_entries\": " << lag
+                   << ", \"entries_processed\": " << listener.EntriesProcessed()
+                   << ", \"processor_ns\": " << listener.ProcessorNanoseconds() << '}';
+                first = false;
+            }
+            os << (first ? "}\n}\n" : "\n  }\n}\n");
+            return os.str();
+        }
+
+      private:
+        struct StreamSample {
+            const StreamStatsSource* source;
+            // The entries published and the time as of the previous FormatJSON(), for the rate.
+            uint64_t entries;
+            uint64_t nanoseconds;
+        };
+        struct ListenerEntry {
+            std::string stream_name;
+            std::shared_ptr<const ListenerStats> listener;
+        };
+
+        std::mutex streams_mutex;
+        std::map<std::string, StreamSample> streams;
+        std::mutex listeners_mutex;
+        std::map<std::string, ListenerEntry> listeners;
+        size_t listeners_registered = 0;
+
+        FrameworkStats() = delete;
+        FrameworkStats(const FrameworkStats&) = delete;
+        void operator=(const FrameworkStats&) = delete;
+    };
+
+    template <typename STREAM> struct StreamStatsImpl : StreamStatsSource {
+        typedef STREAM T_STREAM;
+
+        StreamStatsImpl(FrameworkStats& registry, const T_STREAM& stream) : registry(registry), stream(stream) {
+            if (registry.Enabled()) {
+                registry.AddStream(stream.name, this);
+            }
+        }
+        virtual ~StreamStatsImpl() {
+            if (registry.Enabled()) {
+                registry.RemoveStream(stream.name);
+            }
+        }
+
+        virtual const StreamStats& Published() const override {
+            return stream.publish_stats_;
+        }
+        virtual ::TailProduce::Storage::STORAGE_KEY_TYPE HeadDataKey() const override {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            return stream.head.ComposeStorageKey(stream, stream.config_values());
+        }
+        virtual uint64_t CountEntriesAhead(const ListenerStats& listener,
+                                           uint64_t max_entries,
+                                           ::TailProduce::Storage::STORAGE_KEY_TYPE& cursor) const override {
+            std::lock_guard<std::mutex> guard(stream.lock_mutex());
+            cursor = listener.cursor;
+            const ::TailProduce::Storage::STORAGE_KEY_TYPE head =
+                stream.head.ComposeStorageKey(stream, stream.config_values());
+            if (cursor.empty() || head < cursor) {
+                return 0;
+            }
+            auto iterator = stream.manager_->storage.CreateStorageIterator(cursor, head + '\0');
+            if (listener.cursor_processed && !iterator->Done() && iterator->Key() == cursor) {
+                iterator->Next();
+            }
+            uint64_t entries = 0;
+            while (!iterator->Done() && entries < max_entries) {
+                ++entries;
+                iterator->Next();
+            }
+            return entries;
+        }
+
+      private:
+        FrameworkStats& registry;
+        const T_STREAM& stream;
+
+        StreamStatsImpl() = delete;
+        StreamStatsImpl(const StreamStatsImpl&) = delete;
+        void operator=(const StreamStatsImpl&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_STATS_H
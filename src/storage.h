@@ -26,6 +26,33 @@ namespace TailProduce {
             return bytes(key);
         }
 
+        // WriteBatch collects the writes for ApplyBatch(). A storage applies the batch atomically:
+        // either all of its writes take place, or, if any of them is not allowed, none of them do.
+        struct WriteBatch {
+            struct Write {
+                STORAGE_KEY_TYPE key;
+                STORAGE_VALUE_TYPE value;
+                bool allow_overwrite;
+            };
+            std::vector<Write> writes;
+
+            void Set(const STORAGE_KEY_TYPE& key, const STORAGE_VALUE_TYPE& value) {
+                writes.push_back(Write{key, value, false});
+            }
+            void SetAllowingOverwrite(const STORAGE_KEY_TYPE& key, const STORAGE_VALUE_TYPE& value) {
+                writes.push_back(Write{key, value, true});
+            }
+            size_t Size() const {
+                return writes.size();
+            }
+            bool Empty() const {
+                return writes.empty();
+            }
+            void Clear() {
+                writes.clear();
+            }
+        };
+
         // TailProduce::Storage::Internal::Interface is used to static_assert the inheritance
         // at the moment of attemping to use the storage as part of the static framework.
         namespace Internal {
@@ -45,6 +72,12 @@ namespace TailProduce {
                 storage.SetAllowingOverwrite(STORAGE_KEY_TYPE("key"), STORAGE_VALUE_TYPE(bytes("value")));
                 STORAGE_VALUE_TYPE v = storage.Get("key");
                 bool b = storage.Has(STORAGE_KEY_TYPE("key"));
+                // ApplyBatch().
+                {
+                    WriteBatch batch;
+                    batch.Set(STORAGE_KEY_TYPE("batch"), STORAGE_VALUE_TYPE(bytes("value")));
+                    storage.ApplyBatch(batch);
+                }
                 // Get() and Has() should be const.
                 {
                     const T& const_storage = storage;
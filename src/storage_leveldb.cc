@@ -2,6 +2,7 @@
 #include <exception>
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 #include "storage_leveldb.h"
 #include "tp_exceptions.h"
@@ -70,6 +71,34 @@ void TailProduce::StorageLevelDB::InternalSet(::TailProduce::Storage::STORAGE_KE
     if (!s.ok()) throw std::domain_error(s.ToString());
 }
 
+void TailProduce::StorageLevelDB::ApplyBatch(::TailProduce::Storage::WriteBatch const& batch) {
+    // All the writes are checked before any of them is applied.
+    for (const auto& write : batch.writes) {
+        if (write.key.empty()) {
+            VLOG(3) << "Attempted to ApplyBatch() with an empty key.";
+            VLOG(3) << "throw ::TailProduce::StorageEmptyKeyException();";
+            throw ::TailProduce::StorageEmptyKeyException();
+        }
+        if (write.value.empty()) {
+            VLOG(3) << "Attempted to ApplyBatch() with an empty value.";
+            VLOG(3) << "throw ::TailProduce::StorageEmptyValueException();";
+            throw ::TailProduce::StorageEmptyValueException();
+        }
+        if (!write.allow_overwrite && Has(write.key)) {
+            VLOG(3) << "'" << write.key << "', that is attempted to be set in a batch, has already been set.";
+            VLOG(3) << "throw ::TailProduce::StorageOverwriteNotAllowedException();";
+            throw ::TailProduce::StorageOverwriteNotAllowedException();
+        }
+    }
+    leveldb::WriteBatch leveldb_batch;
+    for (const auto& write : batch.writes) {
+        leveldb_batch.Put(write.key,
+                          leveldb::Slice(reinterpret_cast<const char*>(write.value.data()), write.value.size()));
+    }
+    leveldb::Status s = db_->Write(leveldb::WriteOptions(), &leveldb_batch);
+    if (!s.ok()) throw std::domain_error(s.ToString());
+}
+
 void TailProduce::StorageLevelDB::UNUSED_Delete(::TailProduce::Storage::STORAGE_KEY_TYPE const& key) {
     leveldb::Status s = db_->Delete(leveldb::WriteOptions(), key);
     if (!s.ok()) throw std::domain_error(s.ToString());
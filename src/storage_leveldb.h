@@ -52,6 +52,8 @@ namespace TailProduce {
             InternalSet(key, value, true);
         }
         bool Has(STORAGE_KEY_TYPE const& key) const;
+        // Applies all the writes of the batch in one leveldb::WriteBatch.
+        void ApplyBatch(::TailProduce::Storage::WriteBatch const& batch);
 
         // TODO(dkorolev): If needed, add Delete() to the interface and add a test for it. So far, removed it.
         void UNUSED_Delete(STORAGE_KEY_TYPE const& key);
@@ -0,0 +1,641 @@
+// StreamExporterImpl streams the entries of a stream to HTTP clients, see TAILPRODUCE_EXPORT_STREAM.
+//
+// Each client gets an export session: a thread running a listener over the stream. The entries are formatted
+// into a buffer and the buffer goes out as one chunk of a chunked HTTP response once it is large enough
+// or once there are no more entries available right now.
+//
+// The session only reads the stream as fast as the client takes the data: with `kMaxBytesInFlight` bytes
+// written but not yet sent, it waits for the socket instead of reading further. With no new entries it waits
+// for the publisher to poke it. The session ends, and its thread exits, once the client disconnects,
+// the requested range is exported, or the exporter is destroyed.
+//
+// The query parameters, all optional:
+//   from=P or from=P:S  The order key to start from, inclusive. Defaults to the beginning of the stream.
+//   to=P or to=P:S      The order key to stop at, exclusive. Defaults to no end.
+//   limit=N             Export at most N entries.
+//   follow=0|1          With `follow=0`, end the response once the entries available right now are exported.
+//                       Defaults to 1: wait for new entries until the end of the range, if any, is reached.
+//   format=json         One `{"key":<primary key>,"entry":{...}}` line per entry. The default.
+//   format=tsv          One `<primary key>\t<secondary key>\t{...}` line per entry.
+//   format=binary       The entries as stored, with no deserialization: for each entry, the big-endian 32-bit
+//                       length and the bytes of the order key part of its storage key, then the big-endian
+//                       32-bit length and the bytes of its serialized value.
+//
+// With `Accept-Encoding: snappy`, each chunk of the response is compressed, see wire_compression.h.
+//
+// To resume an interrupted export, request `from=P:S` with the secondary key one greater than the last one
+// received, or start from the next primary key if the secondary keys are not of interest.
+
+#ifndef TAILPRODUCE_STREAM_EXPORTER_H
+#define TAILPRODUCE_STREAM_EXPORTER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "cereal/archives/json.hpp"
+
+#include "event_subscriber.h"
+#include "http.h"
+#include "listeners.h"
+#include "static_framework.h"
+#include "tcp_server_singleton.h"
+#include "wire_compression.h"
+
+namespace TailProduce {
+    enum class StreamExportFormat { JSON, TSV, Binary };
+
+    namespace StreamExporterInternal {
+        // Parses a non-negative decimal integer that fits into `T`, with nothing else around it.
+        template <typename T> inline bool ParseUnsigned(const std::string& s, T& output) {
+            if (s.empty()) {
+                return false;
+            }
+            T x = 0;
+            for (char c : s) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                const T digit = static_cast<T>(c - '0');
+                if (x > (std::numeric_limits<T>::max() - digit) / 10) {
+                    return false;
+                }
+                x = static_cast<T>(x * 10 + digit);
+            }
+            output = x;
+            return true;
+        }
+
+        // Parses "P" or "P:S" into the order key. The secondary key defaults to zero.
+        template <typename ORDER_KEY> inline bool ParseOrderKey(const std::string& s, ORDER_KEY& output) {
+            const size_t colon = s.find(':');
+            ORDER_KEY key = ORDER_KEY();
+            if (!ParseUnsigned(s.substr(0, colon), key.primary)) {
+                return false;
+            }
+            if (colon != std::string::npos && !ParseUnsigned(s.substr(colon + 1), key.secondary)) {
+                return false;
+            }
+            output = key;
+            return true;
+        }
+
+        template <typename ORDER_KEY> inline bool OrderKeyIsBefore(const ORDER_KEY& lhs, const ORDER_KEY& rhs) {
+            return lhs.primary < rhs.primary || (!(rhs.primary < lhs.primary) && lhs.secondary < rhs.secondary);
+        }
+
+        inline void AppendBigEndianUInt32(std::string& output, size_t value) {
+            output += static_cast<char>((value >> 24) & 0xff);
+            output += static_cast<char>((value >> 16) & 0xff);
+            output += static_cast<char>((value >> 8) & 0xff);
+            output += static_cast<char>(value & 0xff);
+        }
+    };
+
+    // The query parameters of an export request, see the top of this file.
+    template <typename ORDER_KEY> struct StreamExportParameters {
+        typedef ORDER_KEY T_ORDER_KEY;
+
+        StreamExportFormat format = StreamExportFormat::JSON;
+        T_ORDER_KEY from = T_ORDER_KEY();
+        bool has_to = false;
+        T_ORDER_KEY to = T_ORDER_KEY();
+        bool has_limit = false;
+        size_t limit = 0;
+        bool follow = true;
+
+        // Returns false and sets `error` if any of the parameters is malformed.
+        bool Parse(const HTTPRequest& request, std::string& error) {
+            using StreamExporterInternal::ParseOrderKey;
+            using StreamExporterInternal::ParseUnsigned;
+            if (request.HasParameter("from") && !ParseOrderKey(request.GetParameter("from"), from)) {
+                error = "Malformed `from`, expected `primary` or `primary:secondary`.";
+                return false;
+            }
+            if (request.HasParameter("to")) {
+                if (!ParseOrderKey(request.GetParameter("to"), to)) {
+                    error = "Malformed `to`, expected `primary` or `primary:secondary`.";
+                    return false;
+                }
+                has_to = true;
+            }
+            if (request.HasParameter("limit")) {
+                if (!ParseUnsigned(request.GetParameter("limit"), limit)) {
+                    error = "Malformed `limit`, expected a non-negative integer.";
+                    return false;
+                }
+                has_limit = true;
+            }
+            if (request.HasParameter("follow")) {
+                const std::string& value = request.GetParameter("follow");
+                if (value != "0" && value != "1") {
+                    error = "Malformed `follow`, expected `0` or `1`.";
+                    return false;
+                }
+                follow = (value == "1");
+            }
+            if (request.HasParameter("format")) {
+                const std::string& value = request.GetParameter("format");
+                if (value == "json") {
+                    format = StreamExportFormat::JSON;
+                } else if (value == "tsv") {
+                    format = StreamExportFormat::TSV;
+                } else if (value == "binary") {
+                    format = StreamExportFormat::Binary;
+                } else {
+                    error = "Malformed `format`, expected `json`, `tsv` or `binary`.";
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // Appends the JSON, pretty-printed by cereal, to `output` with the whitespace outside the strings removed.
+    inline void AppendCompactJSON(std::string& output, const std::string& json) {
+        bool in_string = false;
+        bool escaped = false;
+        for (char c : json) {
+            if (in_string) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    in_string = false;
+                }
+                output += c;
+            } else if (c == '"') {
+                in_string = true;
+                output += c;
+            } else if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                output += c;
+            }
+        }
+    }
+
+    // The export formatters append the next entry of the listener to `output`.
+
+    // Formats each entry as a line of `{"key":<primary key>,"entry":{...}}`.
+    template <typename STREAM> struct JSONLinesExportFormatter {
+        typedef typename STREAM::T_ORDER_KEY::T_PRIMARY_KEY T_PRIMARY_KEY;
+        static const char* ContentType() {
+            return "application/x-ndjson";
+        }
+        std::string& output;
+        std::ostringstream os;
+        JSONLinesExportFormatter(const STREAM&, std::string& output) : output(output) {
+        }
+        void AppendEntry(INTERNAL_UnsafeListener<STREAM>& listener) {
+            listener.ProcessEntrySync(*this);
+        }
+        template <typename ENTRY> void operator()(const ENTRY& entry) {
+            T_PRIMARY_KEY key;
+            entry.GetOrderKey(key);
+            os.str("");
+            {
+                cereal::JSONOutputArchive archive(os);
+                archive(cereal::make_nvp("key", key), cereal::make_nvp("entry", entry));
+            }
+            AppendCompactJSON(output, os.str());
+            output += '\n';
+        }
+    };
+
+    // Formats each entry as a line of `<primary key>\t<secondary key>\t{...}`.
+    template <typename STREAM> struct TSVExportFormatter {
+        typedef typename STREAM::T_ORDER_KEY T_ORDER_KEY;
+        static const char* ContentType() {
+            return "text/tab-separated-values";
+        }
+        const STREAM& stream;
+        std::string& output;
+        ::TailProduce::Storage::STORAGE_KEY_TYPE key;
+        T_ORDER_KEY order_key;
+        std::ostringstream os;
+        std::string json;
+        TSVExportFormatter(const STREAM& stream, std::string& output) : stream(stream), output(output) {
+        }
+        void AppendEntry(INTERNAL_UnsafeListener<STREAM>& listener) {
+            listener.PeekStorageKey(key);
+            order_key.DecomposeStorageKey(key, stream, stream.config_values());
+            output += std::to_string(order_key.primary);
+            output += '\t';
+            output += std::to_string(order_key.secondary);
+            output += '\t';
+            listener.ProcessEntrySync(*this);
+        }
+        template <typename ENTRY> void operator()(const ENTRY& entry) {
+            os.str("");
+            {
+                cereal::JSONOutputArchive archive(os);
+                archive(cereal::make_nvp("entry", entry));
+            }
+            json.clear();
+            AppendCompactJSON(json, os.str());
+            // Unwrap `{"entry":{...}}`.
+            const size_t prefix = sizeof("{\"entry\":") - 1;
+            output.append(json, prefix, json.length() - prefix - 1);
+            output += '\n';
+        }
+    };
+
+    // Copies each entry as stored, length-prefixed, see the top of this file.
+    template <typename STREAM> struct BinaryExportFormatter {
+        static const char* ContentType() {
+            return "application/octet-stream";
+        }
+        const size_t prefix_length;
+        std::string& output;
+        ::TailProduce::Storage::STORAGE_KEY_TYPE key;
+        ::TailProduce::Storage::STORAGE_VALUE_TYPE value;
+        BinaryExportFormatter(const STREAM& stream, std::string& output)
+            : prefix_length(stream.storage_key_data_prefix.length()), output(output) {
+        }
+        void AppendEntry(INTERNAL_UnsafeListener<STREAM>& listener) {
+            listener.PeekStorageEntry(key, value);
+            if (key.length() < prefix_length) {
+                VLOG(3) << "throw ::TailProduce::MalformedStorageHeadException();";
+                throw ::TailProduce::MalformedStorageHeadException();
+            }
+            StreamExporterInternal::AppendBigEndianUInt32(output, key.length() - prefix_length);
+            output.append(key, prefix_length, std::string::npos);
+            StreamExporterInternal::AppendBigEndianUInt32(output, value.size());
+            output.append(value.begin(), value.end());
+        }
+    };
+
+    // ExportSession is the connection side of an export: a thread per client, the writes with backpressure,
+    // the wakeups on pokes and noticing the client going away. The derived class implements Run():
+    //
+    // SendHead(content_type);
+    // while (Continue()) {
+    //     ... append the data available right now to `buffer`, up to `kChunkSize` bytes ...
+    //     if (!SendChunk(buffer)) break;
+    //     if (there was no more data) WaitForPoke();
+    // }
+    // EndResponse();
+    struct ExportSession : ::TailProduce::Subscriber, std::enable_shared_from_this<ExportSession> {
+        enum { kChunkSize = 64 * 1024, kMaxBytesInFlight = 256 * 1024 };
+
+        explicit ExportSession(std::shared_ptr<TCPServer::Connection> connection) : connection(connection) {
+        }
+        virtual ~ExportSession() {
+        }
+
+        virtual void Run() = 0;
+
+        // To be called before Start(), as negotiated with the client.
+        void SetCompression(WireCompression value) {
+            compression = value;
+        }
+
+        void Start() {
+            WatchForDisconnect(this->shared_from_this());
+            thread = std::thread(&ExportSession::RunAndRelease, this);
+        }
+
+        // Returns false once the session should end. Otherwise, a poke from now on means there may be more data.
+        bool Continue() {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (stopping || disconnected) {
+                return false;
+            }
+            poked = false;
+            return true;
+        }
+
+        void WaitForPoke() {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait_for(lock, std::chrono::seconds(1), [this]() {
+                return poked || stopping || disconnected;
+            });
+        }
+
+        bool SendHead(const std::string& content_type) {
+            return Send(
+                FormatHTTPChunkedResponseHead(200, content_type, WireCompressionContentEncoding(compression)));
+        }
+
+        // Sends the buffer, if not empty, as the next chunk of the response and clears it.
+        bool SendChunk(std::string& buffer) {
+            if (buffer.empty()) {
+                return true;
+            }
+            std::string chunk;
+            if (compression != WireCompression::None) {
+                CompressWireChunk(compression, buffer, compressed);
+                chunk.reserve(compressed.size() + 16);
+                AppendHTTPChunk(chunk, compressed.data(), compressed.size());
+            } else {
+                chunk.reserve(buffer.size() + 16);
+                AppendHTTPChunk(chunk, buffer.data(), buffer.size());
+            }
+            buffer.clear();
+            return Send(std::move(chunk));
+        }
+
+        // Waits until there is room for `data` among the bytes in flight. Returns false if the session ends.
+        bool Send(std::string data) {
+            const size_t size = data.size();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() {
+                    return bytes_in_flight < kMaxBytesInFlight || stopping || disconnected;
+                });
+                if (stopping || disconnected) {
+                    return false;
+                }
+                bytes_in_flight += size;
+            }
+            auto self = this->shared_from_this();
+            connection->AsyncWrite(std::move(data), [self, size](const boost::system::error_code& ec) {
+                std::lock_guard<std::mutex> guard(self->mutex);
+                self->bytes_in_flight -= size;
+                self->bytes_sent += ec ? 0 : size;
+                if (ec) {
+                    self->disconnected = true;
+                }
+                self->condition.notify_all();
+            });
+            return true;
+        }
+
+        // Ends the chunked response, unless the client is gone already.
+        void EndResponse() {
+            bool client_is_gone;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                client_is_gone = disconnected;
+            }
+            if (!client_is_gone) {
+                connection->AsyncWrite(kLastHTTPChunk);
+                connection->CloseAfterWrites();
+            }
+        }
+
+        // The client is not expected to send anything: any completed read, EOF included, ends the session.
+        static void WatchForDisconnect(std::shared_ptr<ExportSession> self) {
+            std::shared_ptr<TCPServer::Connection> connection = self->connection;
+            connection->socket.async_read_some(
+                boost::asio::buffer(self->read_buffer),
+                connection->strand.wrap([self](const boost::system::error_code& ec, size_t) {
+                    VLOG(2) << self.get() << " ExportSession: client disconnected.";
+                    std::lock_guard<std::mutex> guard(self->mutex);
+                    self->disconnected = true;
+                    self->condition.notify_all();
+                }));
+        }
+
+        virtual void Poke() override {
+            std::lock_guard<std::mutex> guard(mutex);
+            poked = true;
+            condition.notify_all();
+        }
+
+        void Stop() {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+            condition.notify_all();
+        }
+
+        void Join() {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        size_t BytesSent() {
+            std::lock_guard<std::mutex> guard(mutex);
+            return bytes_sent;
+        }
+
+        std::shared_ptr<TCPServer::Connection> connection;
+        std::atomic<bool> done{false};
+
+      private:
+        void RunAndRelease() {
+            Run();
+            VLOG(2) << this << " ExportSession done.";
+            connection.reset();
+            done = true;
+        }
+
+        WireCompression compression = WireCompression::None;
+        std::string compressed;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool poked = false;
+        bool stopping = false;
+        bool disconnected = false;
+        size_t bytes_in_flight = 0;
+        size_t bytes_sent = 0;
+        std::array<char, 256> read_buffer;
+
+        ExportSession() = delete;
+        ExportSession(const ExportSession&) = delete;
+        void operator=(const ExportSession&) = delete;
+    };
+
+    // The sessions of one exporter. The finished ones are dropped as new ones are added,
+    // the remaining ones are stopped and joined on destruction.
+    struct ExportSessions {
+        ExportSessions() = default;
+
+        ~ExportSessions() {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& session : sessions) {
+                session->Stop();
+            }
+            for (auto& session : sessions) {
+                session->Join();
+            }
+        }
+
+        void Start(std::shared_ptr<ExportSession> session) {
+            std::lock_guard<std::mutex> guard(mutex);
+            ReapFinishedSessionsUnguarded();
+            session->Start();
+            sessions.push_back(session);
+        }
+
+        size_t Active() {
+            std::lock_guard<std::mutex> guard(mutex);
+            ReapFinishedSessionsUnguarded();
+            return sessions.size();
+        }
+
+        size_t BytesSent() {
+            std::lock_guard<std::mutex> guard(mutex);
+            size_t total = 0;
+            for (auto& session : sessions) {
+                total += session->BytesSent();
+            }
+            return total;
+        }
+
+      private:
+        void ReapFinishedSessionsUnguarded() {
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                if ((*it)->done) {
+                    (*it)->Join();
+                    it = sessions.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ExportSession>> sessions;
+
+        ExportSessions(const ExportSessions&) = delete;
+        void operator=(const ExportSessions&) = delete;
+    };
+
+    // Responds with the error and closes the connection, for the requests that do not start a session.
+    inline void RespondWithErrorAndClose(std::shared_ptr<TCPServer::Connection> connection,
+                                         const HTTPRequest& request,
+                                         int code,
+                                         const std::string& message) {
+        HTTPRequest response_to = request;
+        response_to.keep_alive = false;
+        connection->AsyncWrite(FormatHTTPResponse(response_to, code, message + '\n'));
+        connection->CloseAfterWrites();
+    }
+
+    template <typename STREAM> struct StreamExporterImpl : StreamExporter {
+        typedef STREAM T_STREAM;
+        typedef StreamExportParameters<typename T_STREAM::T_ORDER_KEY> T_PARAMETERS;
+
+        struct Session : ExportSession {
+            Session(const T_STREAM& stream,
+                    std::shared_ptr<TCPServer::Connection> connection,
+                    const T_PARAMETERS& parameters)
+                : ExportSession(connection), stream(stream), parameters(parameters) {
+            }
+
+            virtual void Run() override {
+                switch (parameters.format) {
+                    case StreamExportFormat::JSON:
+                        Export<JSONLinesExportFormatter<T_STREAM>>();
+                        break;
+                    case StreamExportFormat::TSV:
+                        Export<TSVExportFormatter<T_STREAM>>();
+                        break;
+                    case StreamExportFormat::Binary:
+                        Export<BinaryExportFormatter<T_STREAM>>();
+                        break;
+                }
+                VLOG(2) << this << " StreamExporter('" << stream.name << "'): " << entries_exported << " entries.";
+            }
+
+            template <typename FORMATTER> void Export() {
+                ::TailProduce::SubscribeWhileInScope<::TailProduce::SubscriptionsManager> subscribe(
+                    this, stream.subscriptions_);
+                std::unique_ptr<INTERNAL_UnsafeListener<T_STREAM>> listener(
+                    parameters.has_to
+                        ? new INTERNAL_UnsafeListener<T_STREAM>(stream, parameters.from, parameters.to)
+                        : new INTERNAL_UnsafeListener<T_STREAM>(stream, parameters.from));
+                listener->SetEntryAllocation(EntryAllocation::ReuseEntry);
+                std::string buffer;
+                FORMATTER formatter(stream, buffer);
+                SendHead(FORMATTER::ContentType());
+
+                while (Continue()) {
+                    bool has_data = !LimitReached() && listener->HasData();
+                    while (has_data && buffer.size() < kChunkSize) {
+                        formatter.AppendEntry(*listener);
+                        listener->AdvanceToNextEntry();
+                        ++entries_exported;
+                        has_data = !LimitReached() && listener->HasData();
+                    }
+                    if (!SendChunk(buffer)) {
+                        break;
+                    }
+                    if (!has_data) {
+                        if (ExportIsComplete(*listener)) {
+                            break;
+                        }
+                        WaitForPoke();
+                    }
+                }
+                EndResponse();
+            }
+
+            bool LimitReached() const {
+                return parameters.has_limit && entries_exported >= parameters.limit;
+            }
+
+            // Called with no data available: whether no more entries are to be exported.
+            bool ExportIsComplete(INTERNAL_UnsafeListener<T_STREAM>& listener) {
+                if (LimitReached() || listener.ReachedEnd() || !parameters.follow) {
+                    return true;
+                }
+                if (parameters.has_to) {
+                    // New entries come after the HEAD. Once it is at or beyond `to`, the entries up to the HEAD
+                    // are all there is to export. The HEAD is read first, so that these entries are seen.
+                    typename T_STREAM::T_ORDER_KEY head;
+                    {
+                        std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                        head = stream.head;
+                    }
+                    if (!StreamExporterInternal::OrderKeyIsBefore(head, parameters.to)) {
+                        return !listener.HasData();
+                    }
+                }
+                return false;
+            }
+
+            const T_STREAM& stream;
+            const T_PARAMETERS parameters;
+            size_t entries_exported = 0;
+        };
+
+        explicit StreamExporterImpl(const T_STREAM& stream) : stream(stream) {
+        }
+
+        virtual void ListenAndStreamData(std::shared_ptr<TCPServer::Connection> connection,
+                                         const HTTPRequest& request) override {
+            VLOG(2) << this << " StreamExporter('" << stream.name << "'): " << request.target;
+            T_PARAMETERS parameters;
+            std::string error;
+            if (!parameters.Parse(request, error)) {
+                RespondWithErrorAndClose(connection, request, 400, error);
+                return;
+            }
+            auto session = std::make_shared<Session>(stream, connection, parameters);
+            session->SetCompression(NegotiateWireCompression(request));
+            sessions.Start(session);
+        }
+
+        size_t ActiveSessions() {
+            return sessions.Active();
+        }
+
+        size_t BytesSent() {
+            return sessions.BytesSent();
+        }
+
+      private:
+        const T_STREAM& stream;
+        ExportSessions sessions;
+
+        StreamExporterImpl() = delete;
+        StreamExporterImpl(const StreamExporterImpl&) = delete;
+        void operator=(const StreamExporterImpl&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_STREAM_EXPORTER_H
@@ -0,0 +1,222 @@
+// StreamIngesterImpl publishes the entries POST-ed over HTTP into a stream, see TAILPRODUCE_INGEST_STREAM.
+//
+// The body of the request is a batch of entries in one of the formats of the export, see stream_exporter.h,
+// so that what is exported from one stream can be ingested into another one as is:
+//   format=json    One `{"key":<primary key>,"entry":{...}}` line per entry. The default.
+//   format=binary  For each entry, the big-endian 32-bit length and the bytes of the order key part
+//                  of its storage key, then the big-endian 32-bit length and the bytes of the entry
+//                  as serialized by the stream's serializer.
+// Only the primary keys are taken from the request, the secondary keys are assigned by the publisher.
+//
+// The whole body is parsed before anything is published: a malformed request gets a 400 and publishes nothing.
+// The entries are then published in batches of up to `max_batch_entries`, each batch as one storage write
+// together with the new HEAD of the stream. The response is sent once all the batches are committed:
+//   {"entries":<number of entries published>,"head":"<primary key>:<secondary key>"}
+// If a batch fails, for instance with its keys going backwards, the response is a 400 that tells how many
+// entries of the request, from its beginning, have been published.
+//
+// The requests are handled on the threads of the TCP server, the connection is kept alive if the client
+// asks for it.
+
+#ifndef TAILPRODUCE_STREAM_INGESTER_H
+#define TAILPRODUCE_STREAM_INGESTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "cereal/archives/json.hpp"
+
+#include "fixed_size_serializer.h"
+#include "http.h"
+#include "memory_istream.h"
+#include "publishers.h"
+#include "static_framework.h"
+#include "tcp_server_singleton.h"
+#include "tp_exceptions.h"
+
+namespace TailProduce {
+    namespace StreamIngesterInternal {
+        inline bool ReadBigEndianUInt32(const std::string& input, size_t& offset, size_t& value) {
+            if (input.length() - offset < 4) {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < 4; ++i) {
+                value = (value << 8) | static_cast<uint8_t>(input[offset + i]);
+            }
+            offset += 4;
+            return true;
+        }
+    };
+
+    template <typename STREAM> struct StreamIngesterImpl : StreamExporter {
+        typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_ENTRY T_ENTRY;
+        typedef typename T_STREAM::T_ORDER_KEY T_ORDER_KEY;
+        typedef typename T_ORDER_KEY::T_PRIMARY_KEY T_PRIMARY_KEY;
+        typedef typename T_ORDER_KEY::T_SECONDARY_KEY T_SECONDARY_KEY;
+
+        enum { kDefaultMaxBatchEntries = 10000 };
+
+        explicit StreamIngesterImpl(::TailProduce::Publisher<T_STREAM>& publisher) : publisher(publisher) {
+        }
+
+        // The most entries to publish as one storage write.
+        StreamIngesterImpl& SetMaxBatchEntries(size_t value) {
+            max_batch_entries = value ? value : 1;
+            return *this;
+        }
+
+        // The largest request body to accept, the larger ones get a 413.
+        StreamIngesterImpl& SetMaxRequestBytes(size_t value) {
+            max_request_bytes = value;
+            return *this;
+        }
+
+        virtual void ListenAndStreamData(std::shared_ptr<TCPServer::Connection> connection,
+                                         const HTTPRequest& request) override {
+            VLOG(2) << this << " StreamIngester('" << publisher.impl.stream.name << "'): " << request.target << ", "
+                    << request.body.length() << " bytes.";
+            int code;
+            const std::string response = Ingest(request, code);
+            connection->AsyncWrite(
+                FormatHTTPResponse(request, code, response, code == 200 ? "application/json" : "text/plain"));
+        }
+
+        virtual bool RespondsInFull() const override {
+            return true;
+        }
+
+        size_t EntriesIngested() const {
+            return entries_ingested;
+        }
+
+      private:
+        // Returns the body of the response and sets the HTTP response code.
+        std::string Ingest(const HTTPRequest& request, int& code) {
+            code = 400;
+            if (request.method != "POST") {
+                code = 405;
+                return "Expected a POST.\n";
+            }
+            if (request.body.length() > max_request_bytes) {
+                code = 413;
+                return "The request is larger than " + std::to_string(max_request_bytes.load()) + " bytes.\n";
+            }
+            const std::string& format = request.GetParameter("format", "json");
+            std::vector<T_ENTRY> entries;
+            std::string error;
+            if (format == "json") {
+                ParseJSONLines(request.body, entries, error);
+            } else if (format == "binary") {
+                ParseBinary(request.body, entries, error);
+            } else {
+                error = "Malformed `format`, expected `json` or `binary`.";
+            }
+            if (!error.empty()) {
+                return error + '\n';
+            }
+
+            size_t published = 0;
+            try {
+                while (published < entries.size()) {
+                    const size_t batch_end = std::min(entries.size(), published + max_batch_entries.load());
+                    publisher.PushMany(entries.begin() + published, entries.begin() + batch_end);
+                    entries_ingested += batch_end - published;
+                    published = batch_end;
+                }
+            } catch (const ::TailProduce::OrderKeysGoBackwardsException&) {
+                return "Order keys go backwards, published " + std::to_string(published) + " entries.\n";
+            } catch (const ::TailProduce::StorageException&) {
+                code = 500;
+                return "Storage error, published " + std::to_string(published) + " entries.\n";
+            }
+
+            const T_ORDER_KEY head = publisher.GetHeadPrimaryAndSecondary();
+            code = 200;
+            return "{\"entries\":" + std::to_string(published) + ",\"head\":\"" + std::to_string(head.primary) +
+                   ':' + std::to_string(head.secondary) + "\"}\n";
+        }
+
+        void ParseJSONLines(const std::string& body, std::vector<T_ENTRY>& entries, std::string& error) {
+            size_t begin = 0;
+            size_t line_number = 0;
+            while (begin < body.length()) {
+                size_t end = body.find('\n', begin);
+                if (end == std::string::npos) {
+                    end = body.length();
+                }
+                ++line_number;
+                if (body.find_first_not_of(" \t\r", begin) < end) {
+                    MemoryInputStream is(body.data() + begin, body.data() + end);
+                    T_PRIMARY_KEY key;
+                    entries.emplace_back();
+                    try {
+                        cereal::JSONInputArchive archive(is);
+                        archive(cereal::make_nvp("key", key), cereal::make_nvp("entry", entries.back()));
+                    } catch (const cereal::Exception&) {
+                        error = "Malformed JSON on line " + std::to_string(line_number) + '.';
+                        return;
+                    }
+                    entries.back().SetOrderKey(key);
+                }
+                begin = end + 1;
+            }
+        }
+
+        void ParseBinary(const std::string& body, std::vector<T_ENTRY>& entries, std::string& error) {
+            const size_t primary_length = FixedSizeSerializer<T_PRIMARY_KEY>::size_in_bytes;
+            const size_t key_length = primary_length + FixedSizeSerializer<T_SECONDARY_KEY>::size_in_bytes;
+            size_t offset = 0;
+            while (offset < body.length()) {
+                const std::string where = " of entry " + std::to_string(entries.size() + 1) + '.';
+                size_t length;
+                if (!StreamIngesterInternal::ReadBigEndianUInt32(body, offset, length) || length != key_length ||
+                    body.length() - offset < length ||
+                    body.find_first_not_of("0123456789", offset) < offset + length) {
+                    error = "Malformed key" + where;
+                    return;
+                }
+                T_PRIMARY_KEY key;
+                FixedSizeSerialization::UnpackFromString(body.substr(offset, primary_length), key);
+                offset += length;
+                if (!StreamIngesterInternal::ReadBigEndianUInt32(body, offset, length) ||
+                    body.length() - offset < length) {
+                    error = "Malformed value" + where;
+                    return;
+                }
+                MemoryInputStream is(body.data() + offset, body.data() + offset + length);
+                offset += length;
+                entries.emplace_back();
+                try {
+                    DeserializedInPlace processor;
+                    T_ENTRY::DeSerializeAndProcessEntry(is, key, processor, entries.back());
+                } catch (const ::TailProduce::CerealException&) {
+                    error = "Malformed value" + where;
+                    return;
+                }
+            }
+        }
+
+        // The entries are deserialized in place, there is nothing else to do with them.
+        struct DeserializedInPlace {
+            void operator()(const T_ENTRY&) {
+            }
+        };
+
+        ::TailProduce::Publisher<T_STREAM>& publisher;
+        std::atomic<size_t> max_batch_entries{kDefaultMaxBatchEntries};
+        std::atomic<size_t> max_request_bytes{HTTPRequest::kMaxBodySize};
+        std::atomic<size_t> entries_ingested{0};
+
+        StreamIngesterImpl() = delete;
+        StreamIngesterImpl(const StreamIngesterImpl&) = delete;
+        void operator=(const StreamIngesterImpl&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_STREAM_INGESTER_H
@@ -92,8 +92,67 @@ namespace TailProduce {
             }
         }
 
+        // The port StaticFramework serves its exporters on. Zero for no HTTP server, as for a replication follower
+        // running next to its leader.
+        StreamManagerParams& SetHTTPPort(size_t port) {
+            http_port = port;
+            return *this;
+        }
+        size_t HTTPPort() const {
+            return http_port;
+        }
+
+        // The Unix domain socket StaticFramework also serves its exporters on, for the clients on the same host.
+        // A path starting with '@' is in the abstract namespace. Empty, the default, for none.
+        StreamManagerParams& SetHTTPUnixSocket(const std::string& path) {
+            http_unix_socket = path;
+            return *this;
+        }
+        const std::string& HTTPUnixSocket() const {
+            return http_unix_socket;
+        }
+
+        // The streams declared with TAILPRODUCE_SHARED_MEMORY_STREAM() are published into the shared memory rings
+        // named `prefix + stream name`, of `ring_size` bytes each. The prefix is to start with a slash, as in
+        // "/tailproduce.". An empty prefix, the default, publishes none.
+        StreamManagerParams& SetSharedMemoryPrefix(const std::string& prefix, size_t ring_size = 64 * 1024 * 1024) {
+            shared_memory_prefix = prefix;
+            shared_memory_ring_size = ring_size;
+            return *this;
+        }
+        const std::string& SharedMemoryPrefix() const {
+            return shared_memory_prefix;
+        }
+        size_t SharedMemoryRingSize() const {
+            return shared_memory_ring_size;
+        }
+
+        // Whether to measure the delay from publishing each entry to each listener reading it, see latency.h.
+        StreamManagerParams& SetLatencyTracking(bool enabled = true) {
+            latency_tracking = enabled;
+            return *this;
+        }
+        bool LatencyTracking() const {
+            return latency_tracking;
+        }
+
+        // Whether to count what the streams, the listeners and the storage do, and serve it at /stats, see stats.h.
+        StreamManagerParams& SetStats(bool enabled = true) {
+            stats = enabled;
+            return *this;
+        }
+        bool Stats() const {
+            return stats;
+        }
+
       private:
         std::map<std::string, std::shared_ptr<HeadInitializer>> streams_to_create;
+        size_t http_port = 8080;
+        std::string http_unix_socket;
+        std::string shared_memory_prefix;
+        size_t shared_memory_ring_size = 0;
+        bool latency_tracking = false;
+        bool stats = false;
     };
 };
 
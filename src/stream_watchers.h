@@ -0,0 +1,491 @@
+// The server-sent events and the long-poll modes of the stream exporter, see StreamExporterWithWatchers.
+//
+// Unlike the streaming export, these modes do not take a thread per client. A watcher is a Subscriber of its
+// stream, the same way the listeners are: the publisher's poke schedules reading the new entries on the strand
+// of the watcher's connection. An idle watcher is its position in the stream, its connection and, for a long
+// poll, a timer, so thousands of them cost next to nothing. Mind TCPServerOptions::max_connections though.
+//
+// mode=sse, or no `mode` and `Accept: text/event-stream`:
+//   A `text/event-stream` response with an event per entry: `id: <primary key>:<secondary key>` and
+//   `data: {"key":<primary key>,"entry":{...}}`. Lasts until the client disconnects or `limit` entries are sent.
+// mode=poll:
+//   Waits until the HEAD of the stream moves past `after`, or until `timeout_ms` passes, and responds with
+//   `{"entries":[{"key":<primary key>,"entry":{...}},...],"next":"<primary key>:<secondary key>"}`, with at most
+//   `limit` entries. Pass `next` as `after` to the next request. The connection is kept alive if asked for.
+//
+// The query parameters, all optional:
+//   after=P:S     Start after this order key. Defaults to the HEAD of the stream, to only get the new entries.
+//                 With SSE, the `Last-Event-ID` header of a reconnecting event source takes precedence.
+//   limit=N       SSE: end the response after N entries. Long poll: the most entries to return, 1000 by default.
+//   timeout_ms=N  Long poll: how long to wait, 30000 by default. Times out with no entries and `next` = `after`.
+
+#ifndef TAILPRODUCE_STREAM_WATCHERS_H
+#define TAILPRODUCE_STREAM_WATCHERS_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+
+#include <glog/logging.h>
+
+#include <boost/asio.hpp>
+
+#include "event_subscriber.h"
+#include "http.h"
+#include "listeners.h"
+#include "static_framework.h"
+#include "stream_exporter.h"
+#include "tcp_server_singleton.h"
+
+namespace TailProduce {
+    enum class StreamWatchMode { SSE, LongPoll };
+
+    // The query parameters of an SSE or a long-poll request, see the top of this file.
+    template <typename ORDER_KEY> struct StreamWatchParameters {
+        typedef ORDER_KEY T_ORDER_KEY;
+        enum { kDefaultLongPollLimit = 1000, kDefaultTimeoutMs = 30000 };
+
+        StreamWatchMode mode = StreamWatchMode::SSE;
+        bool has_after = false;
+        T_ORDER_KEY after = T_ORDER_KEY();
+        size_t limit = 0;
+        size_t timeout_ms = kDefaultTimeoutMs;
+
+        // Returns false and sets `error` if any of the parameters is malformed.
+        bool Parse(StreamWatchMode watch_mode, const HTTPRequest& request, std::string& error) {
+            using StreamExporterInternal::ParseOrderKey;
+            using StreamExporterInternal::ParseUnsigned;
+            mode = watch_mode;
+            limit = (mode == StreamWatchMode::LongPoll) ? kDefaultLongPollLimit : 0;
+            const std::string& last_event_id = request.GetHeader("last-event-id");
+            if (mode == StreamWatchMode::SSE && !last_event_id.empty()) {
+                if (!ParseOrderKey(last_event_id, after)) {
+                    error = "Malformed `Last-Event-ID`, expected `primary:secondary`.";
+                    return false;
+                }
+                has_after = true;
+            } else if (request.HasParameter("after")) {
+                if (!ParseOrderKey(request.GetParameter("after"), after)) {
+                    error = "Malformed `after`, expected `primary` or `primary:secondary`.";
+                    return false;
+                }
+                has_after = true;
+            }
+            if (request.HasParameter("limit") && !ParseUnsigned(request.GetParameter("limit"), limit)) {
+                error = "Malformed `limit`, expected a non-negative integer.";
+                return false;
+            }
+            if (mode == StreamWatchMode::LongPoll && !limit) {
+                error = "Malformed `limit`, expected a positive integer.";
+                return false;
+            }
+            if (request.HasParameter("timeout_ms") &&
+                !ParseUnsigned(request.GetParameter("timeout_ms"), timeout_ms)) {
+                error = "Malformed `timeout_ms`, expected a non-negative integer.";
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // A client waiting for the entries of the stream, over SSE or a long poll. Runs on the strand of its connection.
+    template <typename STREAM>
+    struct StreamWatcher : ::TailProduce::Subscriber, std::enable_shared_from_this<StreamWatcher<STREAM>> {
+        typedef STREAM T_STREAM;
+        typedef typename T_STREAM::T_ORDER_KEY T_ORDER_KEY;
+        typedef StreamWatchParameters<T_ORDER_KEY> T_PARAMETERS;
+        typedef TCPServer::Connection::T_WRITE_CALLBACK T_WRITE_CALLBACK;
+        enum { kChunkSize = 64 * 1024, kMaxBytesInFlight = 256 * 1024 };
+
+        // The watchers of one exporter. The watchers hold it too, to tell whether the exporter is gone.
+        struct State {
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool stopped = false;
+            size_t reading = 0;
+            std::set<std::shared_ptr<StreamWatcher>> watchers;
+        };
+
+        StreamWatcher(const T_STREAM& stream,
+                      std::shared_ptr<State> state,
+                      std::shared_ptr<TCPServer::Connection> connection,
+                      std::shared_ptr<StreamExporters> exporters,
+                      const HTTPRequest& request,
+                      const T_PARAMETERS& parameters)
+            : stream(stream),
+              state(state),
+              connection(connection),
+              exporters(exporters),
+              request(request),
+              parameters(parameters),
+              timer(connection->state->io_service) {
+            this->request.body.clear();
+            this->request.keep_alive =
+                request.keep_alive && exporters && parameters.mode == StreamWatchMode::LongPoll;
+        }
+
+        // Registers the watcher and starts waiting for the entries.
+        // Returns false if the exporter is being torn down.
+        bool Start() {
+            {
+                std::lock_guard<std::mutex> guard(state->mutex);
+                if (state->stopped) {
+                    return false;
+                }
+                {
+                    std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                    if (!parameters.has_after) {
+                        parameters.after = stream.head;
+                    }
+                }
+                position = parameters.after;
+                listener.reset(new INTERNAL_UnsafeListener<T_STREAM>(stream, Successor(parameters.after)));
+                listener->SetEntryAllocation(EntryAllocation::ReuseEntry);
+                state->watchers.insert(this->shared_from_this());
+                stream.subscriptions_.RegisterSubscriber(this);
+                subscribed = true;
+            }
+            auto self = this->shared_from_this();
+            connection->strand.dispatch([self]() { self->OnStart(); });
+            return true;
+        }
+
+        // Called by the publisher, under the mutex of the subscriptions: only schedules reading the stream.
+        virtual void Poke() override {
+            if (!scheduled.exchange(true)) {
+                auto self = this->shared_from_this();
+                connection->strand.post([self]() { self->Pump(); });
+            }
+        }
+
+        // Unsubscribes the watchers and closes their connections, for the exporter being destroyed.
+        static void StopAll(State& state) {
+            std::set<std::shared_ptr<StreamWatcher>> watchers;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.stopped = true;
+                state.condition.wait(lock, [&state]() { return state.reading == 0; });
+                for (auto& watcher : state.watchers) {
+                    watcher->UnsubscribeUnguarded();
+                }
+                watchers.swap(state.watchers);
+            }
+            for (auto& watcher : watchers) {
+                watcher->connection->CloseAfterWrites();
+            }
+        }
+
+      private:
+        static T_ORDER_KEY Successor(const T_ORDER_KEY& key) {
+            if (key.secondary == std::numeric_limits<typename T_ORDER_KEY::T_SECONDARY_KEY>::max()) {
+                return T_ORDER_KEY(key.primary + 1, 0);
+            }
+            return T_ORDER_KEY(key.primary, key.secondary + 1);
+        }
+
+        void OnStart() {
+            if (parameters.mode == StreamWatchMode::SSE) {
+                connection->AsyncWrite(
+                    "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                    "Connection: close\r\n\r\n");
+            } else {
+                timer.expires_from_now(boost::posix_time::milliseconds(parameters.timeout_ms));
+                auto self = this->shared_from_this();
+                timer.async_wait(connection->strand.wrap([self](const boost::system::error_code& ec) {
+                    if (!ec && !self->finished) {
+                        self->RespondToLongPoll("", self->parameters.after);
+                    }
+                }));
+            }
+            WatchForDisconnect();
+            Pump();
+        }
+
+        // The client is not expected to send anything while it waits, other than its next request once a long poll
+        // is answered. That is passed on to a new HTTPRequestsDispatcher, along with the connection, once the
+        // response is written. Anything else, EOF included, means the client is gone.
+        void WatchForDisconnect() {
+            auto self = this->shared_from_this();
+            connection->socket.async_read_some(
+                boost::asio::buffer(read_buffer),
+                connection->strand.wrap([self](const boost::system::error_code& ec, size_t size) {
+                    self->OnRead(ec, size);
+                }));
+        }
+
+        void OnRead(const boost::system::error_code& ec, size_t size) {
+            if (!ec && request.keep_alive && pending_request.size() + size <= HTTPRequest::kMaxHeadSize) {
+                pending_request.append(read_buffer.data(), size);
+                if (hand_over_connection) {
+                    HandOverConnection();
+                } else {
+                    WatchForDisconnect();
+                }
+            } else if (ec == boost::asio::error::operation_aborted && hand_over_connection) {
+                HandOverConnection();
+            } else {
+                VLOG(2) << this << " StreamWatcher: client disconnected.";
+                Finish();
+                connection->Close();
+            }
+        }
+
+        void HandOverConnection() {
+            auto dispatcher = std::make_shared<HTTPRequestsDispatcher>(connection, exporters);
+            std::ostream(&dispatcher->buffer).write(pending_request.data(), pending_request.size());
+            dispatcher->ReadNextRequest();
+        }
+
+        // Reads the entries available after `position`, and sends them or, for a long poll, responds
+        // if there are any.
+        void Pump() {
+            scheduled = false;
+            if (finished || bytes_in_flight >= kMaxBytesInFlight) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(state->mutex);
+                if (state->stopped) {
+                    return;
+                }
+                ++state->reading;
+            }
+            ReadingScope scope(*state);
+
+            T_ORDER_KEY head;
+            {
+                std::lock_guard<std::mutex> guard(stream.lock_mutex());
+                head = stream.head;
+            }
+            const size_t max_size = (parameters.mode == StreamWatchMode::SSE) ? kChunkSize : ~size_t(0);
+            std::string buffer;
+            size_t entries = 0;
+            JSONLinesExportFormatter<T_STREAM> formatter(stream, json);
+            while (buffer.size() < max_size && !LimitReached(entries) && listener->HasData()) {
+                listener->PeekStorageKey(key);
+                position.DecomposeStorageKey(key, stream, stream.config_values());
+                json.clear();
+                formatter.AppendEntry(*listener);
+                listener->AdvanceToNextEntry();
+                json.resize(json.size() - 1);  // The newline.
+                if (parameters.mode == StreamWatchMode::SSE) {
+                    buffer += "id: " + std::to_string(position.primary) + ':' +
+                              std::to_string(position.secondary) + "\ndata: " + json + "\n\n";
+                } else {
+                    buffer += (entries ? "," : "") + json;
+                }
+                ++entries;
+            }
+            entries_sent += entries;
+
+            if (parameters.mode == StreamWatchMode::SSE) {
+                const bool chunk_is_full = buffer.size() >= max_size;
+                if (!buffer.empty()) {
+                    const size_t size = buffer.size();
+                    bytes_in_flight += size;
+                    connection->AsyncWrite(std::move(buffer), OnWritten(size));
+                }
+                if (parameters.limit && entries_sent >= parameters.limit) {
+                    Finish();
+                    connection->CloseAfterWrites();
+                } else if (chunk_is_full && !scheduled.exchange(true)) {
+                    // There may be more.
+                    auto self = this->shared_from_this();
+                    connection->strand.post([self]() { self->Pump(); });
+                }
+            } else if (entries || StreamExporterInternal::OrderKeyIsBefore(parameters.after, head)) {
+                // Up to `head`, all the entries are read, unless the limit is reached.
+                const bool up_to_head =
+                    !LimitReached(entries) && StreamExporterInternal::OrderKeyIsBefore(position, head);
+                RespondToLongPoll(buffer, up_to_head ? head : position);
+            }
+        }
+
+        bool LimitReached(size_t entries) const {
+            return parameters.limit && entries_sent + entries >= parameters.limit;
+        }
+
+        void RespondToLongPoll(const std::string& entries, const T_ORDER_KEY& next) {
+            Finish();
+            boost::system::error_code ignored;
+            timer.cancel(ignored);
+            const std::string body = "{\"entries\":[" + entries + "],\"next\":\"" + std::to_string(next.primary) +
+                                     ':' + std::to_string(next.secondary) + "\"}\n";
+            if (request.keep_alive) {
+                // Cancelling the read cancels the writes too: only cancel it once the response is written.
+                auto self = this->shared_from_this();
+                connection->AsyncWrite(FormatHTTPResponse(request, 200, body, "application/json"),
+                                       [self](const boost::system::error_code& ec) {
+                    if (!ec) {
+                        boost::system::error_code ignored;
+                        self->hand_over_connection = true;
+                        self->connection->socket.cancel(ignored);
+                    }
+                });
+            } else {
+                connection->AsyncWrite(FormatHTTPResponse(request, 200, body, "application/json"));
+                connection->CloseAfterWrites();
+            }
+        }
+
+        T_WRITE_CALLBACK OnWritten(size_t size) {
+            auto self = this->shared_from_this();
+            return [self, size](const boost::system::error_code& ec) {
+                const bool was_blocked = self->bytes_in_flight >= kMaxBytesInFlight;
+                self->bytes_in_flight -= size;
+                if (ec) {
+                    self->Finish();
+                } else if (was_blocked && self->bytes_in_flight < kMaxBytesInFlight) {
+                    self->Pump();
+                }
+            };
+        }
+
+        // Stops watching the stream. The connection is up to the caller.
+        void Finish() {
+            if (finished) {
+                return;
+            }
+            finished = true;
+            std::lock_guard<std::mutex> guard(state->mutex);
+            UnsubscribeUnguarded();
+            state->watchers.erase(this->shared_from_this());
+        }
+
+        void UnsubscribeUnguarded() {
+            if (subscribed) {
+                subscribed = false;
+                stream.subscriptions_.UnregisterSubscriber(this);
+            }
+        }
+
+        struct ReadingScope {
+            State& state;
+            explicit ReadingScope(State& state) : state(state) {
+            }
+            ~ReadingScope() {
+                std::lock_guard<std::mutex> guard(state.mutex);
+                --state.reading;
+                state.condition.notify_all();
+            }
+        };
+
+        const T_STREAM& stream;
+        std::shared_ptr<State> state;
+        std::shared_ptr<TCPServer::Connection> connection;
+        std::shared_ptr<StreamExporters> exporters;
+        HTTPRequest request;
+        T_PARAMETERS parameters;
+        boost::asio::deadline_timer timer;
+
+        // Guarded by the mutex of `state`.
+        bool subscribed = false;
+
+        std::atomic<bool> scheduled{false};
+
+        // Accessed on the strand only.
+        std::unique_ptr<INTERNAL_UnsafeListener<T_STREAM>> listener;
+        T_ORDER_KEY position;
+        ::TailProduce::Storage::STORAGE_KEY_TYPE key;
+        std::string json;
+        size_t entries_sent = 0;
+        size_t bytes_in_flight = 0;
+        bool finished = false;
+        bool hand_over_connection = false;
+        std::string pending_request;
+        std::array<char, 256> read_buffer;
+
+        StreamWatcher() = delete;
+        StreamWatcher(const StreamWatcher&) = delete;
+        void operator=(const StreamWatcher&) = delete;
+    };
+
+    // The SSE and long-poll clients of an exporter.
+    template <typename STREAM> struct StreamWatchers {
+        typedef STREAM T_STREAM;
+        typedef StreamWatcher<T_STREAM> T_WATCHER;
+        typedef typename T_WATCHER::T_PARAMETERS T_PARAMETERS;
+
+        // With no `exporters`, the long-poll connections are closed after the response instead of kept alive.
+        StreamWatchers(const T_STREAM& stream, std::shared_ptr<StreamExporters> exporters)
+            : stream(stream), exporters(exporters), state(std::make_shared<typename T_WATCHER::State>()) {
+        }
+
+        ~StreamWatchers() {
+            T_WATCHER::StopAll(*state);
+        }
+
+        void Start(StreamWatchMode mode,
+                   std::shared_ptr<TCPServer::Connection> connection,
+                   const HTTPRequest& request) {
+            T_PARAMETERS parameters;
+            std::string error;
+            if (!parameters.Parse(mode, request, error)) {
+                RespondWithErrorAndClose(connection, request, 400, error);
+                return;
+            }
+            auto watcher = std::make_shared<T_WATCHER>(stream, state, connection, exporters, request, parameters);
+            if (!watcher->Start()) {
+                RespondWithErrorAndClose(connection, request, 503, "The stream is going away.");
+            }
+        }
+
+        size_t Active() {
+            std::lock_guard<std::mutex> guard(state->mutex);
+            return state->watchers.size();
+        }
+
+      private:
+        const T_STREAM& stream;
+        std::shared_ptr<StreamExporters> exporters;
+        std::shared_ptr<typename T_WATCHER::State> state;
+
+        StreamWatchers() = delete;
+        StreamWatchers(const StreamWatchers&) = delete;
+        void operator=(const StreamWatchers&) = delete;
+    };
+
+    // The stream exporter of TAILPRODUCE_EXPORT_STREAM: StreamExporterImpl, plus `mode=sse` and `mode=poll`.
+    template <typename STREAM> struct StreamExporterWithWatchers : StreamExporterImpl<STREAM> {
+        typedef STREAM T_STREAM;
+
+        StreamExporterWithWatchers(const T_STREAM& stream, std::shared_ptr<StreamExporters> exporters = nullptr)
+            : StreamExporterImpl<T_STREAM>(stream), watchers(stream, exporters) {
+        }
+
+        virtual void ListenAndStreamData(std::shared_ptr<TCPServer::Connection> connection,
+                                         const HTTPRequest& request) override {
+            const std::string& mode = request.GetParameter("mode");
+            if (mode == "sse" || (mode.empty() && request.GetHeader("accept").find("text/event-stream") !=
+                                                      std::string::npos)) {
+                watchers.Start(StreamWatchMode::SSE, connection, request);
+            } else if (mode == "poll") {
+                watchers.Start(StreamWatchMode::LongPoll, connection, request);
+            } else if (mode.empty() || mode == "stream") {
+                StreamExporterImpl<T_STREAM>::ListenAndStreamData(connection, request);
+            } else {
+                RespondWithErrorAndClose(
+                    connection, request, 400, "Unknown `mode`, expected `stream`, `sse` or `poll`.");
+            }
+        }
+
+        size_t ActiveWatchers() {
+            return watchers.Active();
+        }
+
+      private:
+        StreamWatchers<T_STREAM> watchers;
+
+        StreamExporterWithWatchers() = delete;
+        StreamExporterWithWatchers(const StreamExporterWithWatchers&) = delete;
+        void operator=(const StreamExporterWithWatchers&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_STREAM_WATCHERS_H
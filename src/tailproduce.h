@@ -8,14 +8,27 @@
 
 #include "config_values.h"
 #include "event_subscriber.h"
+#include "latency.h"
 #include "listeners.h"
+#include "merged_listener.h"
+#include "operators.h"
 #include "publishers.h"
+#include "replay.h"
+#include "replication.h"
 #include "serialize.h"
+#include "shared_memory_stream.h"
+#include "stats.h"
 #include "static_framework.h"
 #include "storage.h"
 #include "stream.h"
+#include "stream_exporter.h"
+#include "stream_ingester.h"
+#include "stream_watchers.h"
 #include "stream_manager_params.h"
 #include "tp_exceptions.h"
+#include "tp_logging.h"
+#include "tracing.h"
+#include "wire_compression.h"
 
 #include "tailproduce.macros"
 
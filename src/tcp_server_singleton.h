@@ -1,22 +1,39 @@
-// TODO(dkorolev): Add mutex guards for registration / deregistration of TCP handlers.
-
 // NOTE: This header requires g++ on my machine, clang++ can't compile it. -- D.K.
 //
 // Uses boost::asio.
 //
-// Maintains a multithreaded TCP server. Runs requests asynchoronously and is asynchronous itself.
+// Maintains a multithreaded TCP server. Each port has its own io_service, run by a fixed pool of threads.
+// Besides the TCP ports, the server listens on Unix domain sockets, for the clients on the same host to skip
+// the TCP loopback stack. The handlers are the same, only the endpoint they are registered for differs.
+// Connections are accepted asynchronously, and handlers that implement HandleConnection() read and write
+// asynchronously as well, so the number of threads does not grow with the number of connections.
+//
+// The number of open connections per port is capped: once the cap is reached, the server stops accepting until
+// one of the open connections is closed. The pending connections wait in the kernel backlog meanwhile.
+//
 // Implemented as a singleton to avoid server tear down issues. Friendly with TailProduce unit tests using this.
-// Once certain port has been open for listening, listening on it never stops. Handlers may change though.
+// Once certain port has been open for listening, it keeps listening until the end of the program.
+// Handlers may change though. Standalone PerPortConnectionAccepter-s, e.g. on port 0, can be stopped with Stop().
 //
 // Usage:
 //
-// struct MyHandler {
+// struct MyAsyncHandler {
+//     // Called from the io_service threads, should not block. The connection stays open
+//     // while there are references to it, normally the ones captured by the pending async calls.
+//     void HandleConnection(std::shared_ptr<TCPServer::Connection> connection) {
+//         connection->AsyncWrite("Hello, World!\n");
+//         connection->CloseAfterWrites();
+//     }
+// };
+//
+// struct MySyncHandler {
+//     // Called from a dedicated thread, may block. Each call counts as an open connection until it returns.
 //     void HandleRequestSync(std::unique_ptr<boost::asio::ip::tcp::socket>&& socket) {
 //         // ...
 //     }
 // };
 //
-// MyHandler handler;
+// MyAsyncHandler handler;
 //
 // // Manual case.
 // TCPServer::Instance()[8080].RegisterHandler(handler);
@@ -35,13 +52,36 @@
 //     ::TailProduce::TCPServer::ScopedHandlerRegisterer scope(8080, handler);
 //     std::this_thread::sleep_for(std::chrono::seconds(30));
 // }
+//
+// // The same on a Unix domain socket; a name starting with '@' is in the abstract namespace, with no file.
+// TCPServer::ScopedHandlerRegisterer scope(TCPServer::Endpoint::UnixSocket("/tmp/my.socket"), handler);
+//
+// // Non-default options have to be set before the port is first used.
+// TCPServer::Options options;
+// options.max_connections = 10000;
+// TCPServer::Instance().Configure(8081, options);
 
 #ifndef TCP_SERVER_H
 #define TCP_SERVER_H
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <glog/logging.h>
 
@@ -50,57 +90,356 @@
 #include "tp_exceptions.h"
 
 namespace TailProduce {
+    struct TCPServerOptions {
+        // The number of threads running the io_service of the port.
+        size_t threads = std::max(2u, std::thread::hardware_concurrency());
+        // The number of open connections beyond which the server stops accepting new ones.
+        size_t max_connections = 1024;
+        // How long Stop() waits for the open connections to be closed by their handlers
+        // before closing them, and then again before giving up on them.
+        std::chrono::milliseconds shutdown_grace = std::chrono::milliseconds(1000);
+    };
+
+    // What the server listens on: a TCP port, or a Unix domain socket path. The port converts implicitly.
+    struct TCPServerEndpoint {
+        size_t port = 0;
+        std::string unix_socket_path;
+
+        TCPServerEndpoint(size_t port) : port(port) {
+        }
+
+        // A path starting with '@' is a name in the abstract namespace, which has no file behind it.
+        static TCPServerEndpoint UnixSocket(const std::string& path) {
+            if (path.empty() || path == "@") {
+                VLOG(3) << "throw TCPServerLogicErrorException();";
+                throw ::TailProduce::TCPServerLogicErrorException("Empty Unix domain socket path.");
+            }
+            TCPServerEndpoint endpoint(0);
+            endpoint.unix_socket_path = path;
+            return endpoint;
+        }
+
+        bool IsUnixSocket() const {
+            return !unix_socket_path.empty();
+        }
+
+        bool IsAbstractUnixSocket() const {
+            return IsUnixSocket() && unix_socket_path[0] == '@';
+        }
+
+        boost::asio::generic::stream_protocol::endpoint AsioEndpoint() const {
+            if (!IsUnixSocket()) {
+                return boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port);
+            } else if (IsAbstractUnixSocket()) {
+                return boost::asio::local::stream_protocol::endpoint('\0' + unix_socket_path.substr(1));
+            } else {
+                return boost::asio::local::stream_protocol::endpoint(unix_socket_path);
+            }
+        }
+
+        std::string ToString() const {
+            return IsUnixSocket() ? "unix socket " + unix_socket_path : "port " + std::to_string(port);
+        }
+
+        bool operator<(const TCPServerEndpoint& rhs) const {
+            if (unix_socket_path != rhs.unix_socket_path) {
+                return unix_socket_path < rhs.unix_socket_path;
+            }
+            return port < rhs.port;
+        }
+    };
+
     struct TCPServer {
         using tcp = boost::asio::ip::tcp;
+        using stream_protocol = boost::asio::generic::stream_protocol;
+
+        typedef TCPServerOptions Options;
+        typedef TCPServerEndpoint Endpoint;
+
+        struct Connection;
+
+        // The state shared between the accepter of a port and its connections. Connections that outlive
+        // the accepter, e.g. the ones held by blocking handlers that do not return, keep it alive.
+        struct ConnectionsState {
+            boost::asio::io_service io_service;
+            std::mutex mutex;
+            std::condition_variable released;
+            size_t open = 0;
+            std::map<Connection*, std::weak_ptr<Connection>> connections;
+            // Resumes accepting once a connection is closed. Reset by Stop().
+            std::function<void()> on_released;
+        };
+
+        // An accepted connection, over TCP or a Unix domain socket. Its own async operations run on its strand,
+        // so a handler that wraps its completion handlers with `strand.wrap()` needs no locking.
+        struct Connection : std::enable_shared_from_this<Connection> {
+            typedef std::function<void(const boost::system::error_code&)> T_WRITE_CALLBACK;
+
+            explicit Connection(std::shared_ptr<ConnectionsState> state)
+                : state(state), socket(state->io_service), strand(state->io_service) {
+            }
+
+            ~Connection() {
+                if (accepted) {
+                    std::lock_guard<std::mutex> guard(state->mutex);
+                    state->connections.erase(this);
+                    --state->open;
+                    state->released.notify_all();
+                    if (state->on_released) {
+                        state->on_released();
+                    }
+                }
+            }
+
+            // Writes `data` after all the previously queued data. Can be called from any thread.
+            // `done`, if set, is called on the strand once the data is written or the write has failed.
+            void AsyncWrite(std::string data, T_WRITE_CALLBACK done = nullptr) {
+                auto self = shared_from_this();
+                std::shared_ptr<std::string> moved(new std::string(std::move(data)));
+                strand.dispatch([self, moved, done]() {
+                    self->write_queue.emplace_back(std::move(*moved), done);
+                    if (self->write_queue.size() == 1) {
+                        self->WriteFront();
+                    }
+                });
+            }
+
+            // Closes the connection once all the queued data is written.
+            void CloseAfterWrites() {
+                auto self = shared_from_this();
+                strand.dispatch([self]() {
+                    self->close_after_writes = true;
+                    if (self->write_queue.empty()) {
+                        self->CloseOnStrand();
+                    }
+                });
+            }
+
+            // Closes the connection right away. The pending async operations complete with an error.
+            void Close() {
+                auto self = shared_from_this();
+                strand.dispatch([self]() { self->CloseOnStrand(); });
+            }
+
+            std::shared_ptr<ConnectionsState> state;
+            stream_protocol::socket socket;
+            boost::asio::io_service::strand strand;
+            bool accepted = false;
+
+          private:
+            void WriteFront() {
+                auto self = shared_from_this();
+                boost::asio::async_write(
+                    socket,
+                    boost::asio::buffer(write_queue.front().first),
+                    strand.wrap([self](const boost::system::error_code& ec, size_t) {
+                        T_WRITE_CALLBACK done = std::move(self->write_queue.front().second);
+                        self->write_queue.pop_front();
+                        if (ec) {
+                            VLOG(3) << "TCPServer::Connection write error: " << ec.message();
+                            for (auto& pending : self->write_queue) {
+                                if (pending.second) {
+                                    pending.second(ec);
+                                }
+                            }
+                            self->write_queue.clear();
+                        }
+                        if (done) {
+                            done(ec);
+                        }
+                        if (!self->write_queue.empty()) {
+                            self->WriteFront();
+                        } else if (self->close_after_writes || ec) {
+                            self->CloseOnStrand();
+                        }
+                    }));
+            }
+
+            void CloseOnStrand() {
+                boost::system::error_code ignored;
+                socket.shutdown(stream_protocol::socket::shutdown_both, ignored);
+                socket.close(ignored);
+            }
+
+            std::deque<std::pair<std::string, T_WRITE_CALLBACK>> write_queue;
+            bool close_after_writes = false;
+
+            Connection() = delete;
+            Connection(const Connection&) = delete;
+            void operator=(const Connection&) = delete;
+        };
 
         struct PerPortConnectionAccepter {
             struct Handler {
-                virtual void HandleRequest(std::unique_ptr<tcp::socket>&& socket) = 0;
+                virtual ~Handler() {
+                }
+                virtual void HandleConnection(std::shared_ptr<Connection> connection) = 0;
+            };
+
+            // Handlers implementing HandleConnection() are called on the io_service threads.
+            // Handlers implementing only HandleRequestSync() are called on a dedicated thread per connection,
+            // and are served over TCP only.
+            template <typename HANDLER> struct HasHandleConnection {
+                template <typename T>
+                static auto Check(T* t)
+                    -> decltype(t->HandleConnection(std::shared_ptr<Connection>()), std::true_type());
+                template <typename T> static std::false_type Check(...);
+                enum { value = decltype(Check<HANDLER>(nullptr))::value };
             };
+
             template <typename HANDLER> struct UserHandlerWrapper : Handler {
                 HANDLER& user_handler;
                 explicit UserHandlerWrapper(HANDLER& user_handler) : user_handler(user_handler) {
                 }
-                virtual void HandleRequest(std::unique_ptr<tcp::socket>&& socket) {
-                    user_handler.HandleRequestSync(std::move(socket));
+                virtual void HandleConnection(std::shared_ptr<Connection> connection) {
+                    Call(connection, std::integral_constant<bool, HasHandleConnection<HANDLER>::value>());
+                }
+                void Call(std::shared_ptr<Connection> connection, std::true_type) {
+                    user_handler.HandleConnection(connection);
+                }
+                void Call(std::shared_ptr<Connection> connection, std::false_type) {
+                    HANDLER& handler = user_handler;
+                    std::thread([&handler, connection]() {
+                        try {
+                            std::unique_ptr<tcp::socket> socket(new tcp::socket(connection->state->io_service));
+                            socket->assign(tcp::v4(), connection->socket.release());
+                            handler.HandleRequestSync(std::move(socket));
+                        } catch (std::exception& e) {
+                            LOG(WARNING) << "TCPServer: HandleRequestSync() has thrown: " << e.what();
+                        }
+                    }).detach();
                 }
                 UserHandlerWrapper() = delete;
                 UserHandlerWrapper(const UserHandlerWrapper&) = delete;
                 void operator=(const UserHandlerWrapper&) = delete;
             };
 
-            boost::asio::io_service io_service_;
-            tcp::acceptor acceptor_;
+            const Endpoint endpoint_;
+            const Options options_;
+            std::shared_ptr<ConnectionsState> state_;
+            boost::asio::basic_socket_acceptor<stream_protocol> acceptor_;
+            boost::asio::io_service::strand accept_strand_;
+            boost::asio::deadline_timer accept_retry_timer_;
+            std::unique_ptr<boost::asio::io_service::work> work_;
+            std::vector<std::thread> threads_;
+            bool accepting_ = false;  // Guarded by `accept_strand_`.
+            bool stopping_ = false;   // Guarded by `accept_strand_`.
+            bool stopped_ = false;
             std::unique_ptr<Handler> handler_;
             std::mutex handler_mutex_;
 
-            PerPortConnectionAccepter(size_t port)
-                : io_service_(), acceptor_(io_service_, tcp::endpoint(tcp::v4(), port)) {
-                std::thread(&PerPortConnectionAccepter::ServingThread, this).detach();
+            explicit PerPortConnectionAccepter(const Endpoint& endpoint, const Options& options = Options())
+                : endpoint_(endpoint),
+                  options_(options),
+                  state_(new ConnectionsState()),
+                  acceptor_(state_->io_service, BindableAsioEndpoint(endpoint)),
+                  accept_strand_(state_->io_service),
+                  accept_retry_timer_(state_->io_service),
+                  work_(new boost::asio::io_service::work(state_->io_service)) {
+                {
+                    std::lock_guard<std::mutex> guard(state_->mutex);
+                    state_->on_released = [this]() { accept_strand_.post([this]() { StartAccept(); }); };
+                }
+                accept_strand_.post([this]() { StartAccept(); });
+                for (size_t i = 0; i < std::max(size_t(1), options_.threads); ++i) {
+                    threads_.emplace_back(&PerPortConnectionAccepter::ServingThread, state_);
+                }
+            }
+
+            ~PerPortConnectionAccepter() {
+                Stop();
             }
-            void ServingThread() {
+
+            static void ServingThread(std::shared_ptr<ConnectionsState> state) {
                 for (;;) {
                     try {
-                        std::unique_ptr<tcp::socket> socket(new tcp::socket(io_service_));
-                        acceptor_.accept(*socket);
-                        {
-                            std::lock_guard<std::mutex> guard(handler_mutex_);
-                            if (handler_) {
-                                std::thread(&Handler::HandleRequest, handler_.get(), std::move(socket)).detach();
-                            } else {
-                                std::string message = "500\n";
-                                boost::asio::write(
-                                    *socket, boost::asio::buffer(message), boost::asio::transfer_all());
+                        state->io_service.run();
+                        return;
+                    } catch (std::exception& e) {
+                        LOG(ERROR) << "TCPServer: uncaught exception in a handler: " << e.what();
+                    }
+                }
+            }
+
+            // The port the server listens on, useful when it was created with port 0. Zero for a Unix socket.
+            size_t Port() const {
+                if (endpoint_.IsUnixSocket()) {
+                    return 0;
+                }
+                const stream_protocol::endpoint local = acceptor_.local_endpoint();
+                tcp::endpoint result;
+                memcpy(result.data(), local.data(), std::min(local.size(), result.capacity()));
+                return result.port();
+            }
+
+            size_t OpenConnections() const {
+                std::lock_guard<std::mutex> guard(state_->mutex);
+                return state_->open;
+            }
+
+            // Stops accepting, gives the open connections `shutdown_grace` to be closed by their handlers,
+            // closes the remaining ones, and joins the threads. Blocking handlers that do not return
+            // within another `shutdown_grace` are left behind and keep the state of the port alive.
+            void Stop() {
+                if (stopped_) {
+                    return;
+                }
+                stopped_ = true;
+                {
+                    std::lock_guard<std::mutex> guard(state_->mutex);
+                    state_->on_released = nullptr;
+                }
+                std::promise<void> acceptor_closed;
+                accept_strand_.post([this, &acceptor_closed]() {
+                    stopping_ = true;
+                    boost::system::error_code ignored;
+                    accept_retry_timer_.cancel(ignored);
+                    acceptor_.close(ignored);
+                    acceptor_closed.set_value();
+                });
+                acceptor_closed.get_future().wait();
+                if (endpoint_.IsUnixSocket() && !endpoint_.IsAbstractUnixSocket()) {
+                    unlink(endpoint_.unix_socket_path.c_str());
+                }
+
+                if (!WaitForConnectionsToClose()) {
+                    std::vector<std::shared_ptr<Connection>> remaining;
+                    {
+                        std::lock_guard<std::mutex> guard(state_->mutex);
+                        for (const auto& it : state_->connections) {
+                            auto connection = it.second.lock();
+                            if (connection) {
+                                remaining.push_back(connection);
                             }
                         }
-                    } catch (std::exception& e) {
-                        throw ::TailProduce::TCPServerRuntimeException(e.what());
+                    }
+                    VLOG(2) << "TCPServer: closing " << remaining.size() << " connections on shutdown.";
+                    for (auto& connection : remaining) {
+                        connection->Close();
+                    }
+                    remaining.clear();
+                    if (!WaitForConnectionsToClose()) {
+                        LOG(WARNING) << "TCPServer: " << OpenConnections() << " connections still open on shutdown.";
                     }
                 }
+
+                // With no connections left the threads return once the aborted accept is handled.
+                work_.reset();
+                if (OpenConnections()) {
+                    state_->io_service.stop();
+                }
+                for (auto& thread : threads_) {
+                    thread.join();
+                }
+                threads_.clear();
             }
 
             template <typename HANDLER> void RegisterHandler(HANDLER& handler) {
                 std::lock_guard<std::mutex> guard(handler_mutex_);
+                if (endpoint_.IsUnixSocket() && !HasHandleConnection<HANDLER>::value) {
+                    throw ::TailProduce::TCPServerLogicErrorException(
+                        "HandleRequestSync() handlers are served over TCP only.");
+                }
                 if (!handler_) {
                     handler_.reset(new UserHandlerWrapper<HANDLER>(handler));
                 } else {
@@ -117,25 +456,115 @@ namespace TailProduce {
                 }
             }
 
+          private:
+            // The socket file left behind by a previous run is removed, the file of a live server is not.
+            static stream_protocol::endpoint BindableAsioEndpoint(const Endpoint& endpoint) {
+                struct stat st;
+                if (endpoint.IsUnixSocket() && !endpoint.IsAbstractUnixSocket() &&
+                    stat(endpoint.unix_socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                    boost::asio::io_service io_service;
+                    boost::asio::local::stream_protocol::socket probe(io_service);
+                    boost::system::error_code ec;
+                    probe.connect(boost::asio::local::stream_protocol::endpoint(endpoint.unix_socket_path), ec);
+                    if (ec == boost::asio::error::connection_refused) {
+                        unlink(endpoint.unix_socket_path.c_str());
+                    }
+                }
+                return endpoint.AsioEndpoint();
+            }
+
+            // Runs on `accept_strand_`. At most one accept is pending at any time.
+            void StartAccept() {
+                if (accepting_ || stopping_) {
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> guard(state_->mutex);
+                    if (state_->open >= options_.max_connections) {
+                        VLOG(3) << "TCPServer: " << state_->open << " connections open, not accepting.";
+                        return;
+                    }
+                }
+                accepting_ = true;
+                std::shared_ptr<Connection> connection(new Connection(state_));
+                acceptor_.async_accept(
+                    connection->socket,
+                    accept_strand_.wrap([this, connection](const boost::system::error_code& ec) {
+                        OnAccept(connection, ec);
+                    }));
+            }
+
+            void OnAccept(std::shared_ptr<Connection> connection, const boost::system::error_code& ec) {
+                accepting_ = false;
+                if (stopping_ || ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (ec) {
+                    // Most likely out of file descriptors. Retry a bit later instead of spinning.
+                    LOG(WARNING) << "TCPServer: accept failed: " << ec.message();
+                    accept_retry_timer_.expires_from_now(boost::posix_time::milliseconds(10));
+                    accept_retry_timer_.async_wait(accept_strand_.wrap([this](const boost::system::error_code& ec) {
+                        if (!ec) {
+                            StartAccept();
+                        }
+                    }));
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> guard(state_->mutex);
+                    connection->accepted = true;
+                    ++state_->open;
+                    state_->connections[connection.get()] = connection;
+                }
+                state_->io_service.post([this, connection]() { Dispatch(connection); });
+                StartAccept();
+            }
+
+            void Dispatch(std::shared_ptr<Connection> connection) {
+                std::lock_guard<std::mutex> guard(handler_mutex_);
+                if (handler_) {
+                    handler_->HandleConnection(connection);
+                } else {
+                    connection->AsyncWrite("500\n");
+                    connection->CloseAfterWrites();
+                }
+            }
+
+            bool WaitForConnectionsToClose() {
+                std::unique_lock<std::mutex> lock(state_->mutex);
+                return state_->released.wait_for(
+                    lock, options_.shutdown_grace, [this]() { return state_->open == 0; });
+            }
+
             PerPortConnectionAccepter() = delete;
             PerPortConnectionAccepter(const PerPortConnectionAccepter&) = delete;
             void operator=(const PerPortConnectionAccepter&) = delete;
         };
 
-        std::map<size_t, std::unique_ptr<PerPortConnectionAccepter>> by_port_;
-        std::mutex by_port_mutex_;
+        std::map<Endpoint, std::unique_ptr<PerPortConnectionAccepter>> by_endpoint_;
+        std::mutex by_endpoint_mutex_;
+
+        PerPortConnectionAccepter& operator[](const Endpoint& endpoint) {
+            return Configure(endpoint, Options(), false);
+        }
 
-        PerPortConnectionAccepter& operator[](size_t port) {
-            std::lock_guard<std::mutex> guard(by_port_mutex_);
-            std::unique_ptr<PerPortConnectionAccepter>& ref = by_port_[port];
+        // Creates the server on `endpoint` with non-default options. Throws if the endpoint is already in use.
+        PerPortConnectionAccepter& Configure(const Endpoint& endpoint,
+                                             const Options& options,
+                                             bool must_be_new = true) {
+            std::lock_guard<std::mutex> guard(by_endpoint_mutex_);
+            std::unique_ptr<PerPortConnectionAccepter>& ref = by_endpoint_[endpoint];
             if (!ref) {
                 try {
-                    VLOG(2) << "Creating server on port " << port;
-                    ref.reset(new PerPortConnectionAccepter(port));
-                    VLOG(2) << "Creating server on port " << port << ": Done.";
+                    VLOG(2) << "Creating server on " << endpoint.ToString();
+                    ref.reset(new PerPortConnectionAccepter(endpoint, options));
+                    VLOG(2) << "Creating server on " << endpoint.ToString() << ": Done.";
                 } catch (std::exception& e) {
                     throw ::TailProduce::TCPServerSpawnException(e.what());
                 }
+            } else if (must_be_new) {
+                throw ::TailProduce::TCPServerLogicErrorException(
+                    "Configure() called for an endpoint already in use.");
             }
             return *ref;
         }
@@ -146,12 +575,14 @@ namespace TailProduce {
         }
 
         struct ScopedHandlerRegisterer {
-            size_t port;
-            template <typename HANDLER> ScopedHandlerRegisterer(size_t port, HANDLER& handler) : port(port) {
-                Instance()[port].RegisterHandler<HANDLER>(handler);
+            Endpoint endpoint;
+            template <typename HANDLER>
+            ScopedHandlerRegisterer(const Endpoint& endpoint, HANDLER& handler)
+                : endpoint(endpoint) {
+                Instance()[endpoint].RegisterHandler<HANDLER>(handler);
             }
             ~ScopedHandlerRegisterer() {
-                Instance()[port].UnregisterHandler();
+                Instance()[endpoint].UnregisterHandler();
             }
         };
     };
@@ -163,7 +594,7 @@ namespace TailProduce {
         }
         HTTPResponseHandler(const HTTPResponseHandler& rhs) : f_(rhs.f_) {
         }
-        void HandleRequestSync(std::unique_ptr<boost::asio::ip::tcp::socket>&& socket) {
+        void HandleConnection(std::shared_ptr<TCPServer::Connection> connection) {
             const std::string response = ([=]() {
                 std::lock_guard<std::mutex> guard(mutex);
                 return f_();
@@ -176,8 +607,8 @@ namespace TailProduce {
             os << "\n";
             os << response;
 
-            const std::string message = os.str();
-            boost::asio::write(*socket, boost::asio::buffer(message), boost::asio::transfer_all());
+            connection->AsyncWrite(os.str());
+            connection->CloseAfterWrites();
         }
         HTTPResponseHandler() = delete;
         void operator=(const HTTPResponseHandler&) = delete;
@@ -28,6 +28,7 @@ namespace TailProduce {
     struct OrderKeysGoBackwardsException : Exception {};
     struct ListenerHasNoDataToRead : Exception {};
     struct AttemptedToAdvanceListenerWithNoDataAvailable : Exception {};
+    struct InvalidKeyPredicateException : Exception {};
     struct StreamDoesNotExistException : Exception {};
     struct MalformedStorageHeadException : Exception {};
     struct StreamAlreadyListedForCreationException : Exception {};
@@ -57,8 +58,25 @@ namespace TailProduce {
             : NetworkException("TCPServerLogicErrorException: '" + name + "'.") {
         }
     };
+    struct HTTPRequestParseException : NetworkException {
+        explicit HTTPRequestParseException(const std::string& name)
+            : NetworkException("HTTPRequestParseException: '" + name + "'.") {
+        }
+    };
+    struct ReplicationProtocolException : NetworkException {
+        explicit ReplicationProtocolException(const std::string& name)
+            : NetworkException("ReplicationProtocolException: '" + name + "'.") {
+        }
+    };
+    struct SharedMemoryException : Exception {
+        explicit SharedMemoryException(const std::string& name)
+            : Exception("SharedMemoryException: '" + name + "'.") {
+        }
+    };
     struct AlreadyInTearDownModeException : Exception {};
     struct AttemptedToCreateScopedClientForNullParent : Exception {};
+    struct JobNameEmptyException : Exception {};
+    struct ConsumerNameEmptyException : Exception {};
 };
 
 #endif
@@ -0,0 +1,25 @@
+// The logging of the per-entry paths, removable at compile time.
+//
+// TP_VLOG(level) is VLOG(level) for the levels up to TAILPRODUCE_TRACING_LEVEL, and compiles to nothing above it,
+// along with the arguments streamed into it. Build with `make TRACING_LEVEL=0`, i.e.
+// -DTAILPRODUCE_TRACING_LEVEL=0, for the listeners and the storages not to spend a cycle on logging per entry.
+// Release builds, the ones with NDEBUG, default to 0, and the others keep all the levels.
+//
+// Whatever is only computed to be logged on these paths should be computed within TP_VLOG(), not ahead of it.
+
+#ifndef TP_LOGGING_H
+#define TP_LOGGING_H
+
+#include <glog/logging.h>
+
+#ifndef TAILPRODUCE_TRACING_LEVEL
+#ifdef NDEBUG
+#define TAILPRODUCE_TRACING_LEVEL 0
+#else
+#define TAILPRODUCE_TRACING_LEVEL 3
+#endif
+#endif
+
+#define TP_VLOG(level) VLOG_IF(level, (level) <= TAILPRODUCE_TRACING_LEVEL)
+
+#endif  // TP_LOGGING_H
@@ -0,0 +1,75 @@
+// The tracer policy of a framework: the hooks on its hot paths, for a profiler to be attached at compile time.
+//
+// The tracer is the second template parameter of StreamManager, `StreamManager<STORAGE, TRACER>`, NoOpTracer by
+// default. The framework calls `TRACER::Begin(event)` and `TRACER::End(event)` around each of the TraceEvent-s,
+// on the thread doing the work, through TraceScope. Both are static, so that NoOpTracer compiles to nothing.
+//
+// A tracer is any type with these two static functions. Perf markers, USDT probes and the like fit here.
+// RingTracer, in ring_tracer.h, is a sample one: it records the events and dumps them as a Chrome trace.
+
+#ifndef TAILPRODUCE_TRACING_H
+#define TAILPRODUCE_TRACING_H
+
+namespace TailProduce {
+    enum class TraceEvent {
+        // Storage Set(), SetAllowingOverwrite() or ApplyBatch(), by the publishers.
+        StorageSet,
+        // Reading the value of an entry off the storage iterator, by the listeners.
+        StorageGet,
+        // Creating the storage iterator from the cursor of a listener.
+        StorageSeek,
+        // Publishing an entry, or a PushMany() batch, in full, including the storage writes of the HEAD.
+        PublisherCommit,
+        // The listener thread going through the entries available since it has last run out of them,
+        // or through one batch of a batch processor, see columnar.h.
+        ListenerBatch,
+        // Serializing an entry to be published.
+        Serialize,
+        // Deserializing an entry and calling the processor with it.
+        DeserializeAndProcess
+    };
+
+    inline const char* TraceEventName(TraceEvent event) {
+        switch (event) {
+            case TraceEvent::StorageSet:
+                return "StorageSet";
+            case TraceEvent::StorageGet:
+                return "StorageGet";
+            case TraceEvent::StorageSeek:
+                return "StorageSeek";
+            case TraceEvent::PublisherCommit:
+                return "PublisherCommit";
+            case TraceEvent::ListenerBatch:
+                return "ListenerBatch";
+            case TraceEvent::Serialize:
+                return "Serialize";
+            case TraceEvent::DeserializeAndProcess:
+                return "DeserializeAndProcess";
+        }
+        return "Unknown";
+    }
+
+    struct NoOpTracer {
+        static void Begin(TraceEvent) {
+        }
+        static void End(TraceEvent) {
+        }
+    };
+
+    // Calls TRACER::Begin() and TRACER::End() for the lifetime of the scope.
+    template <typename TRACER> struct TraceScope {
+        explicit TraceScope(TraceEvent event) : event(event) {
+            TRACER::Begin(event);
+        }
+        ~TraceScope() {
+            TRACER::End(event);
+        }
+        const TraceEvent event;
+
+        TraceScope() = delete;
+        TraceScope(const TraceScope&) = delete;
+        void operator=(const TraceScope&) = delete;
+    };
+};
+
+#endif  // TAILPRODUCE_TRACING_H
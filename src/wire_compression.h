@@ -0,0 +1,66 @@
+// Optional compression of the chunked responses of the stream exporters and of the replication leader.
+//
+// The client asks for it per connection, with `Accept-Encoding: snappy` in its request. The response then comes
+// with `Content-Encoding: snappy`, and each of its chunks is one block compressed with snappy, in the raw snappy
+// format. A chunk is a coalesced batch of up to ExportSession::kChunkSize bytes of entries, so the field names
+// repeated across the entries of the batch are compressed away. Without the header, the data is sent as is.
+//
+// The client decompresses the chunks one by one, see ReplicationFollower.
+
+#ifndef TAILPRODUCE_WIRE_COMPRESSION_H
+#define TAILPRODUCE_WIRE_COMPRESSION_H
+
+#include <sstream>
+#include <string>
+
+#include <snappy.h>
+
+#include "http.h"
+
+namespace TailProduce {
+    enum class WireCompression { None, Snappy };
+
+    // The value of `Content-Encoding` for the compression, empty for none.
+    inline const char* WireCompressionContentEncoding(WireCompression compression) {
+        return compression == WireCompression::Snappy ? "snappy" : "";
+    }
+
+    // The compression the client accepts, as per the `Accept-Encoding` header of its request.
+    inline WireCompression NegotiateWireCompression(const HTTPRequest& request) {
+        std::istringstream is(HTTPInternal::ToLower(request.GetHeader("accept-encoding")));
+        std::string coding;
+        while (std::getline(is, coding, ',')) {
+            const size_t semicolon = coding.find(';');
+            if (HTTPInternal::Trim(coding.substr(0, semicolon)) == "snappy") {
+                // `snappy;q=0` declines it.
+                const std::string parameters = HTTPInternal::Trim(
+                    semicolon == std::string::npos ? std::string() : coding.substr(semicolon + 1));
+                if (parameters.compare(0, 2, "q=") || parameters.find_first_not_of("0.", 2) != std::string::npos) {
+                    return WireCompression::Snappy;
+                }
+            }
+        }
+        return WireCompression::None;
+    }
+
+    // Sets `output` to the chunk to send for the `input` batch.
+    inline void CompressWireChunk(WireCompression compression, const std::string& input, std::string& output) {
+        if (compression == WireCompression::Snappy) {
+            snappy::Compress(input.data(), input.size(), &output);
+        } else {
+            output = input;
+        }
+    }
+
+    // Sets `output` to the batch sent as the `input` chunk. Returns false if the chunk is malformed.
+    inline bool UncompressWireChunk(WireCompression compression, const std::string& input, std::string& output) {
+        if (compression == WireCompression::Snappy) {
+            return snappy::Uncompress(input.data(), input.size(), &output);
+        } else {
+            output = input;
+            return true;
+        }
+    }
+};
+
+#endif  // TAILPRODUCE_WIRE_COMPRESSION_H
@@ -0,0 +1,161 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+#include "../../src/columnar_kernels.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::ColumnarBatch;
+using ::TailProduce::Span;
+using ::TailProduce::StreamManagerParams;
+using ::TailProduce::ColumnarKernels::InstructionSet;
+
+static std::vector<InstructionSet> SupportedInstructionSets() {
+    std::vector<InstructionSet> result{InstructionSet::Reference};
+    const InstructionSet best = ::TailProduce::ColumnarKernels::BestSupportedInstructionSet();
+    if (best == InstructionSet::SSE || best == InstructionSet::AVX2) {
+        result.push_back(InstructionSet::SSE);
+    }
+    if (best == InstructionSet::AVX2) {
+        result.push_back(InstructionSet::AVX2);
+    }
+    return result;
+}
+
+TEST(ColumnarKernels, MatchReference) {
+    namespace K = ::TailProduce::ColumnarKernels;
+    std::mt19937 random(42);
+    for (size_t size : {0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 100, 10007}) {
+        std::vector<uint32_t> data(size);
+        for (auto& x : data) {
+            x = random();
+        }
+        if (size > 2) {
+            data[size / 2] = 0;
+            data[size - 1] = 0xffffffff;
+        }
+        const Span<uint32_t> column(data);
+        const uint64_t golden_sum = K::Reference::Sum(column);
+        const K::MinMax golden_min_max = K::Reference::MinMaxOf(column);
+        std::vector<uint64_t> golden_histogram(5);
+        K::Reference::Histogram(column, 30, golden_histogram);
+        for (InstructionSet set : SupportedInstructionSets()) {
+            EXPECT_EQ(golden_sum, K::Sum(column, set)) << size;
+            const K::MinMax min_max = K::MinMaxOf(column, set);
+            EXPECT_EQ(golden_min_max.min, min_max.min) << size;
+            EXPECT_EQ(golden_min_max.max, min_max.max) << size;
+            std::vector<uint64_t> histogram(5);
+            K::Histogram(column, 30, histogram, set);
+            EXPECT_EQ(golden_histogram, histogram) << size;
+        }
+        EXPECT_EQ(size, golden_histogram[0] + golden_histogram[1] + golden_histogram[2] + golden_histogram[3]);
+        EXPECT_EQ(0, golden_histogram[4]);
+    }
+}
+
+TEST(ColumnarKernels, HistogramClampsToLastBucket) {
+    namespace K = ::TailProduce::ColumnarKernels;
+    std::vector<uint32_t> data{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 100, 1000};
+    for (InstructionSet set : SupportedInstructionSets()) {
+        std::vector<uint64_t> histogram(4);
+        K::Histogram(Span<uint32_t>(data), 2, histogram, set);
+        EXPECT_EQ(std::vector<uint64_t>({4, 4, 4, 7}), histogram);
+    }
+}
+
+TEST(ColumnarBatch, AppendsClearsAndKeepsCapacity) {
+    ColumnarBatch<uint32_t, uint32_t, double> batch;
+    batch.Append(1, 10, 0.5);
+    batch.Append(2, 20, 1.5);
+    ASSERT_EQ(2, batch.Size());
+    EXPECT_EQ(2, batch.OrderKeys()[1]);
+    EXPECT_EQ(20, batch.Column<0>()[1]);
+    EXPECT_EQ(1.5, batch.Column<1>()[1]);
+    const uint32_t* data = batch.Column<0>().data;
+    batch.Clear();
+    EXPECT_EQ(0, batch.Size());
+    EXPECT_TRUE(batch.Column<1>().empty());
+    batch.Append(3, 30, 2.5);
+    EXPECT_EQ(data, batch.Column<0>().data);
+}
+
+// Sums the lengths of the `data` fields, one batch at a time.
+struct DataLengthBatchAggregator {
+    typedef ColumnarBatch<uint32_t, uint32_t> T_BATCH;
+    size_t batches = 0;
+    size_t entries = 0;
+    uint64_t keys_sum = 0;
+    uint64_t lengths_sum = 0;
+    void ExtractColumns(const SimpleEntry& entry, T_BATCH& batch) {
+        batch.Append(entry.ikey, entry.data.length());
+    }
+    void operator()(const T_BATCH& batch) {
+        ++batches;
+        entries += batch.Size();
+        keys_sum += ::TailProduce::ColumnarKernels::Sum(batch.OrderKeys());
+        lengths_sum += ::TailProduce::ColumnarKernels::Sum(batch.Column<0>());
+    }
+};
+
+template <typename STREAM_MANAGER_TYPE> struct ColumnarSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithASingleStream, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(test);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+};
+
+template <typename STREAM_MANAGER_TYPE> class ColumnarListenerTest : public ::testing::Test {};
+TYPED_TEST_CASE(ColumnarListenerTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(ColumnarListenerTest, ProcessesBatches) {
+    typedef ColumnarSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 10; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(i, std::string(i, '*')));
+    }
+
+    typename Setup::StreamManagerWithASingleStream::test_type::INTERNAL_unsafe_listener_type listener(
+        streams_manager.test, uint32_t(2), uint32_t(9));
+    DataLengthBatchAggregator aggregator;
+    typename DataLengthBatchAggregator::T_BATCH batch;
+    EXPECT_EQ(3, listener.ProcessBatchSync(aggregator, batch, 3));
+    EXPECT_EQ(std::vector<uint32_t>({2, 3, 4}),
+              std::vector<uint32_t>(batch.OrderKeys().begin(), batch.OrderKeys().end()));
+    EXPECT_EQ(3, listener.ProcessBatchSync(aggregator, batch, 3));
+    EXPECT_EQ(1, listener.ProcessBatchSync(aggregator, batch, 3));
+    EXPECT_EQ(0, listener.ProcessBatchSync(aggregator, batch, 3));
+    EXPECT_TRUE(listener.ReachedEnd());
+
+    EXPECT_EQ(3, aggregator.batches);
+    EXPECT_EQ(7, aggregator.entries);
+    EXPECT_EQ(2 + 3 + 4 + 5 + 6 + 7 + 8, aggregator.keys_sum);
+    EXPECT_EQ(2 + 3 + 4 + 5 + 6 + 7 + 8, aggregator.lengths_sum);
+}
+
+TYPED_TEST(ColumnarListenerTest, AsyncListenerUsesBatchesForBatchProcessors) {
+    typedef ColumnarSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 100; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(i, "x"));
+    }
+    DataLengthBatchAggregator aggregator;
+    auto scope = streams_manager.new_scoped_test_listener(aggregator);
+    scope->WaitUntilCurrent();
+    streams_manager.test_publisher.Push(SimpleEntry(101, "xyz"));
+    scope->WaitUntilCurrent();
+    EXPECT_EQ(101, aggregator.entries);
+    EXPECT_EQ(5151, aggregator.keys_sum);
+    EXPECT_EQ(103, aggregator.lengths_sum);
+    EXPECT_LT(aggregator.batches, aggregator.entries);
+}
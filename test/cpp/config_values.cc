@@ -15,6 +15,8 @@ TEST(ConfigValues, StandardSettings) {
     EXPECT_EQ("d:foo;", cv.EndDataStorageKey(stream_traits));
     EXPECT_EQ("s:foo:", cv.GetStreamMetaPrefix(stream_traits));
     EXPECT_EQ("d:foo:", cv.GetStreamDataPrefix(stream_traits));
+    EXPECT_EQ("s:foo:job:bar", cv.JobCursorStorageKey(stream_traits, "bar"));
+    EXPECT_EQ("s:foo:consumer:bar", cv.ConsumerCursorStorageKey(stream_traits, "bar"));
 }
 
 TEST(ConfigValues, NonStandardSettings) {
@@ -23,4 +25,5 @@ TEST(ConfigValues, NonStandardSettings) {
     EXPECT_EQ("Data.foo/", cv.EndDataStorageKey(stream_traits));
     EXPECT_EQ("Stream.foo.", cv.GetStreamMetaPrefix(stream_traits));
     EXPECT_EQ("Data.foo.", cv.GetStreamDataPrefix(stream_traits));
+    EXPECT_EQ("Stream.foo.consumer.bar", cv.ConsumerCursorStorageKey(stream_traits, "bar"));
 }
@@ -0,0 +1,112 @@
+// Tests for the named consumers, the listeners that resume after their committed cursors, see listeners.h.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(ConsumersFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// The keys of the entries consumed. The log is only to be read once the count is reached.
+struct ConsumedKeys {
+    std::atomic<size_t> entries{0};
+    std::string log;
+    void operator()(const SimpleEntry& entry) {
+        log += (log.empty() ? "" : ",") + std::to_string(entry.ikey);
+        ++entries;
+    }
+};
+
+static void PushKeys(ConsumersFramework& framework, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, std::to_string(i)));
+    }
+}
+
+// The storage key of the entry the committed cursor of the consumer points to, empty if there is none.
+static std::string CommittedKey(ConsumersFramework& framework, const std::string& consumer_name) {
+    std::lock_guard<std::mutex> guard(framework.test.lock_mutex());
+    const std::string key = framework.cv.ConsumerCursorStorageKey(framework.test, consumer_name);
+    if (!framework.storage.Has(key)) {
+        return "";
+    }
+    return ::TailProduce::Storage::ValueToKey(framework.storage.Get(key));
+}
+
+static std::string EntryKey(ConsumersFramework& framework, uint32_t key) {
+    return ConsumersFramework::test_type::T_ORDER_KEY(key)
+        .ComposeStorageKey(framework.test, framework.test.config_values());
+}
+
+TEST(ConsumerCursor, RestartedConsumerResumesAfterTheCommittedKey) {
+    InMemoryTestStorage storage;
+    {
+        ConsumersFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+        PushKeys(framework, 1, 11);
+        ConsumedKeys consumed;
+        auto consumer = framework.new_scoped_test_listener.Consumer("reporter", consumed);
+        ASSERT_TRUE(WaitUntil([&consumed]() { return consumed.entries == 10; }));
+        EXPECT_EQ("1,2,3,4,5,6,7,8,9,10", consumed.log);
+        consumer->CommitCursor();
+        EXPECT_EQ(EntryKey(framework, 10), CommittedKey(framework, "reporter"));
+    }
+
+    ConsumersFramework framework(storage, StreamManagerParams());
+    PushKeys(framework, 11, 16);
+    ConsumedKeys resumed;
+    auto consumer = framework.new_scoped_test_listener.Consumer("reporter", resumed);
+    ASSERT_TRUE(WaitUntil([&resumed]() { return resumed.entries == 5; }));
+    EXPECT_EQ("11,12,13,14,15", resumed.log);
+
+    // Another name is another consumer, starting from the beginning.
+    ConsumedKeys other;
+    auto other_consumer = framework.new_scoped_test_listener.Consumer("archiver", other);
+    ASSERT_TRUE(WaitUntil([&other]() { return other.entries == 15; }));
+    EXPECT_EQ("", CommittedKey(framework, "archiver"));
+}
+
+TEST(ConsumerCursor, CommittedPeriodicallyAndOnDemand) {
+    InMemoryTestStorage storage;
+    ConsumersFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    ConsumedKeys consumed;
+    auto consumer = framework.new_scoped_test_listener.Consumer(
+        "reporter", consumed, ::TailProduce::EntryAllocation::FreshEntry, 3);
+    PushKeys(framework, 1, 8);
+    ASSERT_TRUE(WaitUntil([&consumed]() { return consumed.entries == 7; }));
+    // Every third entry.
+    ASSERT_TRUE(WaitUntil([&framework]() { return CommittedKey(framework, "reporter") == EntryKey(framework, 6); }));
+    consumer->CommitCursor();
+    EXPECT_EQ(EntryKey(framework, 7), CommittedKey(framework, "reporter"));
+}
+
+TEST(ConsumerCursor, RequiresAName) {
+    InMemoryTestStorage storage;
+    ConsumersFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    ConsumedKeys consumed;
+    ASSERT_THROW(framework.new_scoped_test_listener.Consumer("", consumed),
+                 ::TailProduce::ConsumerNameEmptyException);
+}
@@ -0,0 +1,199 @@
+// Tests for the listener-side entry reuse, `::TailProduce::EntryAllocation::ReuseEntry`.
+// Counts heap allocations made by the current thread to confirm that deserializing fixed-shape entries
+// into a reused instance does not allocate once the instance has reached its steady-state capacity.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "cereal/types/string.hpp"
+#include "cereal/types/vector.hpp"
+
+#include "helpers/storages.h"
+
+using ::TailProduce::EntryAllocation;
+using ::TailProduce::MemoryInputStream;
+using ::TailProduce::StreamManagerParams;
+
+// Per-thread, so that the threads spawned by other tests do not affect the numbers.
+static thread_local size_t allocations_made_by_this_thread = 0;
+
+void* operator new(size_t size) {
+    ++allocations_made_by_this_thread;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+struct FixedShapeEntry : ::TailProduce::CerealBinarySerializable<FixedShapeEntry> {
+    FixedShapeEntry() = default;
+    FixedShapeEntry(uint32_t key, const std::string& name, const std::vector<uint32_t>& values)
+        : key(key), name(name), values(values) {
+    }
+
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+
+    uint32_t key;
+    std::string name;
+    std::vector<uint32_t> values;
+
+  private:
+    friend class cereal::access;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(name), CEREAL_NVP(values));
+    }
+};
+
+// Same shape, different content: a 40-character name and 16 values.
+static FixedShapeEntry MakeFixedShapeEntry(uint32_t key) {
+    std::vector<uint32_t> values(16);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = key * 100 + i;
+    }
+    return FixedShapeEntry(key, std::string(40, 'a' + key % 26), values);
+}
+
+struct ChecksumProcessor {
+    size_t count = 0;
+    uint64_t checksum = 0;
+    const FixedShapeEntry* last_instance = nullptr;
+    bool same_instance = true;
+    void operator()(const FixedShapeEntry& entry) {
+        if (count && &entry != last_instance) {
+            same_instance = false;
+        }
+        last_instance = &entry;
+        ++count;
+        checksum = checksum * 31 + entry.key + entry.name[0] + entry.values.back();
+    }
+};
+
+TEST(EntryReuse, DeSerializationIntoReusedEntryDoesNotAllocate) {
+    const size_t N = 100;
+    std::vector<std::string> serialized(N);
+    for (size_t i = 0; i < N; ++i) {
+        std::ostringstream os;
+        FixedShapeEntry::SerializeEntry(os, MakeFixedShapeEntry(i + 1));
+        serialized[i] = os.str();
+    }
+
+    ChecksumProcessor fresh_processor;
+    const size_t fresh_before = allocations_made_by_this_thread;
+    for (size_t i = 0; i < N; ++i) {
+        MemoryInputStream is(serialized[i].data(), serialized[i].data() + serialized[i].size());
+        FixedShapeEntry::DeSerializeAndProcessEntry(is, uint32_t(i + 1), fresh_processor);
+    }
+    const size_t fresh_allocations = allocations_made_by_this_thread - fresh_before;
+
+    ChecksumProcessor reuse_processor;
+    FixedShapeEntry reusable_entry;
+    {
+        // The first record brings the reused instance to its steady-state capacity.
+        MemoryInputStream is(serialized[0].data(), serialized[0].data() + serialized[0].size());
+        FixedShapeEntry::DeSerializeAndProcessEntry(is, uint32_t(1), reuse_processor, reusable_entry);
+    }
+    const size_t reuse_before = allocations_made_by_this_thread;
+    for (size_t i = 1; i < N; ++i) {
+        MemoryInputStream is(serialized[i].data(), serialized[i].data() + serialized[i].size());
+        FixedShapeEntry::DeSerializeAndProcessEntry(is, uint32_t(i + 1), reuse_processor, reusable_entry);
+    }
+    const size_t reuse_allocations = allocations_made_by_this_thread - reuse_before;
+
+    EXPECT_EQ(N, fresh_processor.count);
+    EXPECT_EQ(N, reuse_processor.count);
+    EXPECT_EQ(fresh_processor.checksum, reuse_processor.checksum);
+    EXPECT_TRUE(reuse_processor.same_instance);
+    EXPECT_GE(fresh_allocations, 2 * N);
+    EXPECT_EQ(0, reuse_allocations);
+}
+
+template <typename STREAM_MANAGER_TYPE> struct EntryReuseSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithFixedShapeStream, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(fixed, FixedShapeEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(fixed);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+};
+
+template <typename STREAM_MANAGER_TYPE> class EntryReuseTest : public ::testing::Test {};
+TYPED_TEST_CASE(EntryReuseTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(EntryReuseTest, ListenerReusesEntryInstance) {
+    typedef EntryReuseSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithFixedShapeStream streams_manager(
+        storage, StreamManagerParams().CreateStream("fixed", uint32_t(0), uint32_t(0)));
+
+    const size_t N = 100;
+    for (size_t i = 0; i < N; ++i) {
+        streams_manager.fixed_publisher.Push(MakeFixedShapeEntry(i + 1));
+    }
+
+    auto replay = [&streams_manager, N](EntryAllocation mode, ChecksumProcessor& processor) {
+        typename Setup::StreamManagerWithFixedShapeStream::fixed_type::INTERNAL_unsafe_listener_type listener(
+            streams_manager.fixed);
+        listener.SetEntryAllocation(mode);
+        // Warm up on the first record, then count the allocations of the steady-state replay.
+        listener.ProcessEntrySync(processor);
+        listener.AdvanceToNextEntry();
+        const size_t before = allocations_made_by_this_thread;
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(processor);
+            listener.AdvanceToNextEntry();
+        }
+        return allocations_made_by_this_thread - before;
+    };
+
+    ChecksumProcessor fresh_processor;
+    const size_t fresh_allocations = replay(EntryAllocation::FreshEntry, fresh_processor);
+    ChecksumProcessor reuse_processor;
+    const size_t reuse_allocations = replay(EntryAllocation::ReuseEntry, reuse_processor);
+
+    EXPECT_EQ(N, fresh_processor.count);
+    EXPECT_EQ(N, reuse_processor.count);
+    EXPECT_EQ(fresh_processor.checksum, reuse_processor.checksum);
+    EXPECT_TRUE(reuse_processor.same_instance);
+    // The entry members, the value buffer and the input stream buffer are no longer allocated per record.
+    EXPECT_GE(fresh_allocations, reuse_allocations + 3 * (N - 1));
+}
+
+TYPED_TEST(EntryReuseTest, AsyncListenerWithReusedEntry) {
+    typedef EntryReuseSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithFixedShapeStream streams_manager(
+        storage, StreamManagerParams().CreateStream("fixed", uint32_t(0), uint32_t(0)));
+
+    ChecksumProcessor processor;
+    auto scope = streams_manager.new_scoped_fixed_listener(processor, EntryAllocation::ReuseEntry);
+    ChecksumProcessor expected;
+    for (size_t i = 0; i < 10; ++i) {
+        const FixedShapeEntry entry = MakeFixedShapeEntry(i + 1);
+        expected(entry);
+        streams_manager.fixed_publisher.Push(entry);
+    }
+    scope->WaitUntilCurrent();
+    EXPECT_EQ(10, processor.count);
+    EXPECT_EQ(expected.checksum, processor.checksum);
+    EXPECT_TRUE(processor.same_instance);
+}
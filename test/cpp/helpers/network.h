@@ -0,0 +1,115 @@
+#ifndef TAILPRODUCE_TEST_HELPERS_NETWORK_H
+#define TAILPRODUCE_TEST_HELPERS_NETWORK_H
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+
+#include <boost/asio.hpp>
+
+// Blocking loopback clients for the tests of the network endpoints.
+
+inline std::unique_ptr<boost::asio::ip::tcp::socket> ConnectToLocalhost(boost::asio::io_service& io_service,
+                                                                        size_t port) {
+    std::unique_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(io_service));
+    socket->connect(
+        boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port));
+    return socket;
+}
+
+// The path of a Unix domain socket, a name in the abstract namespace if it starts with '@'.
+inline std::unique_ptr<boost::asio::local::stream_protocol::socket> ConnectToUnixSocket(
+    boost::asio::io_service& io_service,
+    const std::string& path) {
+    std::unique_ptr<boost::asio::local::stream_protocol::socket> socket(
+        new boost::asio::local::stream_protocol::socket(io_service));
+    socket->connect(boost::asio::local::stream_protocol::endpoint(path[0] == '@' ? '\0' + path.substr(1) : path));
+    return socket;
+}
+
+template <typename SOCKET> std::string ReadUntilClosed(SOCKET& socket) {
+    std::string result;
+    std::array<char, 4096> buffer;
+    boost::system::error_code ec;
+    while (!ec) {
+        result.append(buffer.data(), socket.read_some(boost::asio::buffer(buffer), ec));
+    }
+    return result;
+}
+
+// Reads one response with `Content-Length` off the connection, which may then be used for the next request.
+// Returns the head of the response, up to and including the empty line, and sets `body`.
+inline std::string ReadHTTPResponse(boost::asio::ip::tcp::socket& socket,
+                                    boost::asio::streambuf& buffer,
+                                    std::string& body) {
+    const size_t head_size = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+    const char* begin = boost::asio::buffer_cast<const char*>(buffer.data());
+    const std::string head(begin, begin + head_size);
+    buffer.consume(head_size);
+    const size_t header = head.find("Content-Length: ");
+    const size_t length = std::stoul(head.substr(header + sizeof("Content-Length: ") - 1));
+    if (buffer.size() < length) {
+        boost::asio::read(socket, buffer, boost::asio::transfer_exactly(length - buffer.size()));
+    }
+    begin = boost::asio::buffer_cast<const char*>(buffer.data());
+    body.assign(begin, begin + length);
+    buffer.consume(length);
+    return head;
+}
+
+// Reads a chunked HTTP response one chunk at a time.
+struct ChunkedResponseReader {
+    boost::asio::ip::tcp::socket& socket;
+    boost::asio::streambuf buffer;
+    std::string head;
+    size_t chunks = 0;
+
+    explicit ChunkedResponseReader(boost::asio::ip::tcp::socket& socket) : socket(socket) {
+        const size_t size = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+        head = Take(size);
+    }
+
+    // Appends the next chunk to `data`. Returns false once the last chunk, or the end of the connection, is reached.
+    bool ReadChunk(std::string& data) {
+        boost::system::error_code ec;
+        const size_t line = boost::asio::read_until(socket, buffer, "\r\n", ec);
+        if (ec) {
+            return false;
+        }
+        const size_t size = std::stoul(Take(line), nullptr, 16);
+        if (!size) {
+            return false;
+        }
+        if (buffer.size() < size + 2) {
+            boost::asio::read(socket, buffer, boost::asio::transfer_exactly(size + 2 - buffer.size()));
+        }
+        data += Take(size);
+        Take(2);
+        ++chunks;
+        return true;
+    }
+
+    // Reads until `data` has at least `lines` lines.
+    bool ReadLines(std::string& data, size_t lines) {
+        size_t count = std::count(data.begin(), data.end(), '\n');
+        while (count < lines) {
+            const size_t offset = data.length();
+            if (!ReadChunk(data)) {
+                return false;
+            }
+            count += std::count(data.begin() + offset, data.end(), '\n');
+        }
+        return true;
+    }
+
+  private:
+    std::string Take(size_t size) {
+        const char* begin = boost::asio::buffer_cast<const char*>(buffer.data());
+        std::string result(begin, begin + size);
+        buffer.consume(size);
+        return result;
+    }
+};
+
+#endif  // TAILPRODUCE_TEST_HELPERS_NETWORK_H
@@ -32,8 +32,8 @@ class InMemoryTestStorage : ::TailProduce::Storage::Impl<InMemoryTestStorage> {
     typedef std::map<STORAGE_KEY_TYPE, STORAGE_VALUE_TYPE> MAP_TYPE;
 
     void Set(const STORAGE_KEY_TYPE& key, const STORAGE_VALUE_TYPE& value, bool allow_overwrite = false) {
-        VLOG(3) << "InMemoryTestStorage::Set('" << key << "', '" << ::TailProduce::antibytes(value)
-                << (allow_overwrite ? "');" : "', allow_overwrite=true);");
+        TP_VLOG(3) << "InMemoryTestStorage::Set('" << key << "', '" << ::TailProduce::antibytes(value)
+                   << (allow_overwrite ? "', allow_overwrite=true);" : "');");
         if (key.empty()) {
             VLOG(3) << "Attempted to Set() an entry with an empty key.";
             VLOG(3) << "throw ::TailProduce::StorageEmptyKeyException();";
@@ -61,6 +61,27 @@ class InMemoryTestStorage : ::TailProduce::Storage::Impl<InMemoryTestStorage> {
         Set(key, value, true);
     }
 
+    // All the writes are checked before any of them is applied.
+    void ApplyBatch(const ::TailProduce::Storage::WriteBatch& batch) {
+        for (const auto& write : batch.writes) {
+            if (write.key.empty()) {
+                VLOG(3) << "throw ::TailProduce::StorageEmptyKeyException();";
+                throw ::TailProduce::StorageEmptyKeyException();
+            }
+            if (write.value.empty()) {
+                VLOG(3) << "throw ::TailProduce::StorageEmptyValueException();";
+                throw ::TailProduce::StorageEmptyValueException();
+            }
+            if (!write.allow_overwrite && Has(write.key)) {
+                VLOG(3) << "throw ::TailProduce::StorageOverwriteNotAllowedException();";
+                throw ::TailProduce::StorageOverwriteNotAllowedException();
+            }
+        }
+        for (const auto& write : batch.writes) {
+            data_[write.key] = write.value;
+        }
+    }
+
     bool Has(const STORAGE_KEY_TYPE& key) const {
         if (key.empty()) {
             VLOG(3) << "Attempted to Has() with an empty key.";
@@ -79,11 +100,11 @@ class InMemoryTestStorage : ::TailProduce::Storage::Impl<InMemoryTestStorage> {
         }
         const auto cit = data_.find(key);
         if (cit != data_.end()) {
-            VLOG(3) << "InMemoryTestStorage::Get('" << ::TailProduce::antibytes(key) << ") == '"
-                    << ::TailProduce::antibytes(cit->second) << "'.";
+            TP_VLOG(3) << "InMemoryTestStorage::Get('" << ::TailProduce::antibytes(key) << ") == '"
+                       << ::TailProduce::antibytes(cit->second) << "'.";
             return cit->second;
         } else {
-            VLOG(3) << "InMemoryTestStorage::Get('" << ::TailProduce::antibytes(key) << "): not found.";
+            TP_VLOG(3) << "InMemoryTestStorage::Get('" << ::TailProduce::antibytes(key) << "): not found.";
             VLOG(3) << "throw ::TailProduce::StorageNoDataException();";
             throw ::TailProduce::StorageNoDataException();
         }
@@ -0,0 +1,128 @@
+// Tests for the HTTP request parser, see http.h.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::HTTPRequest;
+using ::TailProduce::ParseHTTPRequestHead;
+using ::TailProduce::ReadHTTPRequest;
+using ::TailProduce::StreamManagerParams;
+using ::TailProduce::TCPServer;
+using boost::asio::ip::tcp;
+
+TEST(HTTP, ParsesRequestLineHeadersAndQuery) {
+    HTTPRequest request;
+    ParseHTTPRequestHead(
+        "GET /a%20b?from=10&to=20&name=two+words%21&flag HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "X-Custom-Header:   value with spaces  \r\n"
+        "\r\n",
+        request);
+    EXPECT_EQ("GET", request.method);
+    EXPECT_EQ("/a b", request.path);
+    EXPECT_EQ("HTTP/1.1", request.version);
+    EXPECT_EQ("localhost", request.GetHeader("host"));
+    EXPECT_EQ("value with spaces", request.GetHeader("x-custom-header"));
+    EXPECT_EQ("10", request.GetParameter("from"));
+    EXPECT_EQ("20", request.GetParameter("to"));
+    EXPECT_EQ("two words!", request.GetParameter("name"));
+    EXPECT_TRUE(request.HasParameter("flag"));
+    EXPECT_FALSE(request.HasParameter("limit"));
+    EXPECT_EQ("100", request.GetParameter("limit", "100"));
+    EXPECT_TRUE(request.keep_alive);
+}
+
+TEST(HTTP, KeepAliveDefaults) {
+    HTTPRequest request;
+    ParseHTTPRequestHead("GET / HTTP/1.1\r\nConnection: close\r\n\r\n", request);
+    EXPECT_FALSE(request.keep_alive);
+    ParseHTTPRequestHead("GET / HTTP/1.0\r\n\r\n", request);
+    EXPECT_FALSE(request.keep_alive);
+    ParseHTTPRequestHead("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", request);
+    EXPECT_TRUE(request.keep_alive);
+    // The legacy form, `echo /stream | nc`.
+    ParseHTTPRequestHead("/stream\n", request);
+    EXPECT_EQ("GET", request.method);
+    EXPECT_EQ("/stream", request.path);
+    EXPECT_FALSE(request.keep_alive);
+}
+
+TEST(HTTP, MalformedRequests) {
+    HTTPRequest request;
+    ASSERT_THROW(ParseHTTPRequestHead("", request), ::TailProduce::HTTPRequestParseException);
+    ASSERT_THROW(ParseHTTPRequestHead("GET\r\n\r\n", request), ::TailProduce::HTTPRequestParseException);
+    ASSERT_THROW(ParseHTTPRequestHead("GET / HTTP/1.1\r\nNo colon\r\n\r\n", request),
+                 ::TailProduce::HTTPRequestParseException);
+}
+
+// Echoes the path and the body of each request, keeping the connection alive.
+struct EchoHandler {
+    void HandleRequestSync(std::unique_ptr<tcp::socket>&& socket) {
+        boost::asio::streambuf buffer(HTTPRequest::kMaxHeadSize);
+        HTTPRequest request;
+        while (ReadHTTPRequest(*socket, buffer, request)) {
+            const std::string response =
+                ::TailProduce::FormatHTTPResponse(request, 200, request.path + ':' + request.body);
+            boost::asio::write(*socket, boost::asio::buffer(response), boost::asio::transfer_all());
+            if (!request.keep_alive) {
+                break;
+            }
+        }
+    }
+};
+
+TEST(HTTP, PipelinedKeepAliveRequestsWithBodies) {
+    TCPServer::PerPortConnectionAccepter server(0);
+    EchoHandler handler;
+    server.RegisterHandler(handler);
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, server.Port());
+    const std::string requests =
+        "POST /one HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+        "GET /two HTTP/1.1\r\n\r\n"
+        "POST /three HTTP/1.1\r\nContent-Length: 3\r\nConnection: close\r\n\r\nbye";
+    boost::asio::write(*socket, boost::asio::buffer(requests), boost::asio::transfer_all());
+    const std::string responses = ReadUntilClosed(*socket);
+    EXPECT_EQ(
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: keep-alive\r\n\r\n"
+        "/one:hello"
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\nConnection: keep-alive\r\n\r\n"
+        "/two:"
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\n"
+        "/three:bye",
+        responses);
+    server.UnregisterHandler();
+}
+
+TEST(HTTP, StaticFrameworkServesKeepAliveRequests) {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithASingleStream,
+                                       ::TailProduce::StreamManager<InMemoryTestStorage>);
+    TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(test);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    InMemoryTestStorage storage;
+    StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string requests =
+        "GET /foo HTTP/1.1\r\n\r\n"
+        "GET /bar HTTP/1.1\r\nConnection: close\r\n\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(requests), boost::asio::transfer_all());
+    const std::string responses = ReadUntilClosed(*socket);
+    EXPECT_NE(std::string::npos, responses.find("Not found: /foo\n"));
+    EXPECT_NE(std::string::npos, responses.find("Not found: /bar\n"));
+    EXPECT_EQ(0, responses.find("HTTP/1.1 404 Not Found\r\n"));
+}
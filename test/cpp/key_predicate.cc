@@ -0,0 +1,131 @@
+// Tests for the listener-side key predicates, see key_predicate.h.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::KeyPredicate;
+using ::TailProduce::KeyPredicateDecision;
+using ::TailProduce::PrimaryKeyRanges;
+using ::TailProduce::SecondaryKeySampling;
+using ::TailProduce::StreamManagerParams;
+
+template <typename STREAM_MANAGER_TYPE> struct KeyPredicateSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithASingleStream, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(test);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+    typedef typename StreamManagerWithASingleStream::test_type T_STREAM;
+    typedef typename T_STREAM::INTERNAL_unsafe_listener_type T_LISTENER;
+};
+
+// Counts the calls to the wrapped predicate, to confirm the gaps are seeked over and not scanned.
+template <typename STREAM> struct CountingPredicate : KeyPredicate<STREAM> {
+    CountingPredicate(KeyPredicate<STREAM>* predicate, size_t& calls) : predicate(predicate), calls(calls) {
+    }
+    virtual KeyPredicateDecision Evaluate(const ::TailProduce::Storage::STORAGE_KEY_TYPE& storage_key,
+                                          ::TailProduce::Storage::STORAGE_KEY_TYPE& seek_to) override {
+        ++calls;
+        return predicate->Evaluate(storage_key, seek_to);
+    }
+    std::unique_ptr<KeyPredicate<STREAM>> predicate;
+    size_t& calls;
+};
+
+struct CollectingProcessor {
+    std::vector<uint32_t> keys;
+    std::vector<std::string> data;
+    void operator()(const SimpleEntry& entry) {
+        keys.push_back(entry.ikey);
+        data.push_back(entry.data);
+    }
+};
+
+template <typename LISTENER> void ProcessAvailableEntries(LISTENER& listener, CollectingProcessor& processor) {
+    while (listener.HasData()) {
+        listener.ProcessEntrySync(processor);
+        listener.AdvanceToNextEntry();
+    }
+}
+
+template <typename STREAM_MANAGER_TYPE> class KeyPredicateTest : public ::testing::Test {};
+TYPED_TEST_CASE(KeyPredicateTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(KeyPredicateTest, PrimaryKeyRangesSeekOverGaps) {
+    typedef KeyPredicateSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 1000; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(i, "x"));
+    }
+
+    typename Setup::T_LISTENER listener(streams_manager.test);
+    size_t calls = 0;
+    listener.SetKeyPredicate(std::unique_ptr<KeyPredicate<typename Setup::T_STREAM>>(
+        new CountingPredicate<typename Setup::T_STREAM>(
+            new PrimaryKeyRanges<typename Setup::T_STREAM>(streams_manager.test,
+                                                           {{900, 903}, {10, 13}, {12, 15}, {500, 500}}),
+            calls)));
+    CollectingProcessor processor;
+    ProcessAvailableEntries(listener, processor);
+    EXPECT_EQ(std::vector<uint32_t>({10, 11, 12, 13, 14, 900, 901, 902}), processor.keys);
+    EXPECT_TRUE(listener.ReachedEnd());
+    // One call per accepted entry, one per gap and one for the first key beyond the last range.
+    EXPECT_EQ(processor.keys.size() + 3, calls);
+}
+
+TYPED_TEST(KeyPredicateTest, PrimaryKeyRangesFollowNewData) {
+    typedef KeyPredicateSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 5; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(i, "x"));
+    }
+
+    typename Setup::T_LISTENER listener(streams_manager.test);
+    listener.SetKeyPredicate(std::unique_ptr<KeyPredicate<typename Setup::T_STREAM>>(
+        new PrimaryKeyRanges<typename Setup::T_STREAM>(streams_manager.test, {{3, 4}, {7, 9}})));
+    CollectingProcessor processor;
+    ProcessAvailableEntries(listener, processor);
+    EXPECT_EQ(std::vector<uint32_t>({3}), processor.keys);
+    EXPECT_FALSE(listener.ReachedEnd());
+
+    for (uint32_t i = 6; i <= 10; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(i, "x"));
+    }
+    ProcessAvailableEntries(listener, processor);
+    EXPECT_EQ(std::vector<uint32_t>({3, 7, 8}), processor.keys);
+    EXPECT_TRUE(listener.ReachedEnd());
+}
+
+TYPED_TEST(KeyPredicateTest, SecondaryKeySampling) {
+    typedef KeyPredicateSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    // Entries with the same primary key get secondary keys 0, 1, 2, etc.
+    for (uint32_t i = 0; i < 12; ++i) {
+        streams_manager.test_publisher.Push(SimpleEntry(1, std::to_string(i)));
+    }
+
+    typename Setup::T_LISTENER listener(streams_manager.test, uint32_t(1), uint32_t(2));
+    listener.SetKeyPredicate(std::unique_ptr<KeyPredicate<typename Setup::T_STREAM>>(
+        new SecondaryKeySampling<typename Setup::T_STREAM>(streams_manager.test, 3, 1)));
+    CollectingProcessor processor;
+    ProcessAvailableEntries(listener, processor);
+    EXPECT_EQ(std::vector<std::string>({"1", "4", "7", "10"}), processor.data);
+
+    ASSERT_THROW(SecondaryKeySampling<typename Setup::T_STREAM>(streams_manager.test, 0, 0),
+                 ::TailProduce::InvalidKeyPredicateException);
+}
@@ -0,0 +1,139 @@
+// Tests for the publish-to-process latency histograms, see latency.h.
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::LatencyHistogram;
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(LatencyFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Returns the response code and sets `body`.
+static int Get(const std::string& target, std::string& body) {
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string request = "GET " + target + " HTTP/1.1\r\nConnection: close\r\n\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    boost::asio::streambuf buffer;
+    const std::string head = ReadHTTPResponse(*socket, buffer, body);
+    return std::stoi(head.substr(sizeof("HTTP/1.1 ") - 1, 3));
+}
+
+struct Counter {
+    std::atomic<size_t> entries{0};
+    void operator()(const SimpleEntry&) {
+        ++entries;
+    }
+};
+
+TEST(LatencyHistogram, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(0u, histogram.Count());
+    EXPECT_EQ(0u, histogram.Percentile(0.5));
+    for (uint64_t i = 1; i <= 100000; ++i) {
+        histogram.Record(i * 1000);
+    }
+    EXPECT_EQ(100000u, histogram.Count());
+    EXPECT_EQ(100000000u, histogram.Max());
+    // Within 1%.
+    EXPECT_NEAR(50000000.0, histogram.Percentile(0.5), 500000.0);
+    EXPECT_NEAR(99000000.0, histogram.Percentile(0.99), 990000.0);
+    EXPECT_NEAR(99900000.0, histogram.Percentile(0.999), 999000.0);
+    EXPECT_EQ(100000000u, histogram.Percentile(1.0));
+
+    // The small values are exact, the huge ones go into the last bucket.
+    LatencyHistogram small;
+    small.Record(3);
+    small.Record(5);
+    small.Record(200);
+    EXPECT_EQ(3u, small.Percentile(0.1));
+    EXPECT_EQ(5u, small.Percentile(0.5));
+    EXPECT_EQ(200u, small.Percentile(1.0));
+    small.Record(~uint64_t(0));
+    EXPECT_EQ(~uint64_t(0), small.Percentile(1.0));
+    EXPECT_EQ(LatencyHistogram::kBuckets - 1, LatencyHistogram::BucketIndex(~uint64_t(0)));
+    for (size_t i = 0; i + 1 < LatencyHistogram::kBuckets; ++i) {
+        ASSERT_EQ(i, LatencyHistogram::BucketIndex(LatencyHistogram::HighestValueInBucket(i)));
+        ASSERT_EQ(i + 1, LatencyHistogram::BucketIndex(LatencyHistogram::HighestValueInBucket(i) + 1));
+    }
+}
+
+TEST(Latency, RecordedPerListenerAndServedOverHTTP) {
+    InMemoryTestStorage storage;
+    {
+        LatencyFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+        framework.test_publisher.Push(SimpleEntry(1, "before"));
+    }
+
+    LatencyFramework framework(storage, StreamManagerParams().SetLatencyTracking());
+    Counter counter;
+    Counter another_counter;
+    auto listener = framework.new_scoped_test_listener(counter);
+    auto another_listener = framework.new_scoped_test_listener(another_counter);
+    ASSERT_TRUE(listener->Latency());
+    EXPECT_EQ("test/1", listener->LatencyHistogramName());
+    EXPECT_EQ("test/2", another_listener->LatencyHistogramName());
+
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+    framework.test_publisher.Push(SimpleEntry(2, "deux"));
+    std::vector<SimpleEntry> batch{SimpleEntry(3, "three"), SimpleEntry(4, "four")};
+    framework.test_publisher.PushMany(batch.begin(), batch.end());
+    ASSERT_TRUE(WaitUntil([&counter]() { return counter.entries == 5; }));
+    ASSERT_TRUE(WaitUntil([&another_counter]() { return another_counter.entries == 5; }));
+
+    // The entry from before the framework started has no stamp.
+    const LatencyHistogram& latency = *listener->Latency();
+    EXPECT_EQ(4u, latency.Count());
+    EXPECT_EQ(1u, latency.Unmatched());
+    EXPECT_LT(0u, latency.Max());
+    EXPECT_LE(latency.Percentile(0.5), latency.Max());
+    EXPECT_EQ(4u, another_listener->Latency()->Count());
+
+    std::string body;
+    ASSERT_EQ(200, Get("/latency", body));
+    EXPECT_NE(std::string::npos, body.find("\"test/1\": {\"count\": 4, \"unmatched\": 1, \"p50_ns\": ")) << body;
+    EXPECT_NE(std::string::npos, body.find("\"test/2\": {\"count\": 4, ")) << body;
+    EXPECT_NE(std::string::npos, body.find("\"p999_ns\": ")) << body;
+
+    // The histogram of a listener goes away with it.
+    another_listener.reset();
+    ASSERT_EQ(200, Get("/latency", body));
+    EXPECT_EQ(std::string::npos, body.find("\"test/2\"")) << body;
+}
+
+TEST(Latency, DisabledByDefault) {
+    InMemoryTestStorage storage;
+    LatencyFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    Counter counter;
+    auto listener = framework.new_scoped_test_listener(counter);
+    EXPECT_FALSE(listener->Latency());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    ASSERT_TRUE(WaitUntil([&counter]() { return counter.entries == 1; }));
+    std::string body;
+    EXPECT_EQ(404, Get("/latency", body));
+}
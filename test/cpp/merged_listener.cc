@@ -0,0 +1,133 @@
+// Tests for MergedListener, see merged_listener.h.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "cereal/types/string.hpp"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::EntryAllocation;
+using ::TailProduce::MergedListener;
+using ::TailProduce::StreamManagerParams;
+
+struct OtherEntry : ::TailProduce::CerealBinarySerializable<OtherEntry> {
+    OtherEntry() = default;
+    OtherEntry(uint32_t key, const std::string& text) : key(key), text(text) {
+    }
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+    uint32_t key;
+    std::string text;
+
+  private:
+    friend class cereal::access;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(text));
+    }
+};
+
+template <typename STREAM_MANAGER_TYPE> struct MergeSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithTwoStreams, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(foo, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_STREAM(bar, OtherEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(foo);
+    TAILPRODUCE_PUBLISHER(bar);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+    typedef typename StreamManagerWithTwoStreams::foo_type T_FOO;
+    typedef typename StreamManagerWithTwoStreams::bar_type T_BAR;
+    typedef MergedListener<T_FOO, T_BAR> T_MERGED_LISTENER;
+
+    static StreamManagerParams Params() {
+        return StreamManagerParams()
+            .CreateStream("foo", uint32_t(0), uint32_t(0))
+            .CreateStream("bar", uint32_t(0), uint32_t(0));
+    }
+};
+
+struct MergeProcessor {
+    std::vector<std::string> log;
+    void operator()(const SimpleEntry& entry) {
+        log.push_back("foo:" + std::to_string(entry.ikey) + ":" + entry.data);
+    }
+    void operator()(const OtherEntry& entry) {
+        log.push_back("bar:" + std::to_string(entry.key) + ":" + entry.text);
+    }
+};
+
+template <typename LISTENER> void ProcessAvailableEntries(LISTENER& listener, MergeProcessor& processor) {
+    while (listener.HasData()) {
+        listener.ProcessEntrySync(processor);
+        listener.AdvanceToNextEntry();
+    }
+}
+
+template <typename STREAM_MANAGER_TYPE> class MergedListenerTest : public ::testing::Test {};
+TYPED_TEST_CASE(MergedListenerTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(MergedListenerTest, MergesInPrimaryKeyOrderAndRespectsHeads) {
+    typedef MergeSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithTwoStreams streams_manager(storage, Setup::Params());
+    streams_manager.foo_publisher.Push(SimpleEntry(1, "a"));
+    streams_manager.foo_publisher.Push(SimpleEntry(4, "b"));
+    streams_manager.foo_publisher.Push(SimpleEntry(7, "c"));
+    streams_manager.bar_publisher.Push(OtherEntry(2, "x"));
+    streams_manager.bar_publisher.Push(OtherEntry(3, "y"));
+    streams_manager.bar_publisher.Push(OtherEntry(8, "z"));
+
+    typename Setup::T_MERGED_LISTENER merged(streams_manager.foo, streams_manager.bar);
+    merged.SetEntryAllocation(EntryAllocation::ReuseEntry);
+    MergeProcessor processor;
+    ProcessAvailableEntries(merged, processor);
+    // `bar:8` has to wait: `foo` could still get an entry with the primary key below 8.
+    EXPECT_EQ(std::vector<std::string>({"foo:1:a", "bar:2:x", "bar:3:y", "foo:4:b", "foo:7:c"}), processor.log);
+    EXPECT_FALSE(merged.HasData());
+    ASSERT_THROW(merged.AdvanceToNextEntry(), ::TailProduce::AttemptedToAdvanceListenerWithNoDataAvailable);
+
+    // Moving the HEAD of `foo` without publishing an entry is enough to release `bar:8`.
+    streams_manager.foo_publisher.PushHead(8);
+    ProcessAvailableEntries(merged, processor);
+    ASSERT_EQ(6, processor.log.size());
+    EXPECT_EQ("bar:8:z", processor.log.back());
+
+    // Equal primary keys available at the same time come in the order of the streams.
+    streams_manager.bar_publisher.Push(OtherEntry(9, "second"));
+    streams_manager.foo_publisher.Push(SimpleEntry(9, "first"));
+    streams_manager.foo_publisher.Push(SimpleEntry(10, "third"));
+    streams_manager.bar_publisher.PushHead(10);
+    ProcessAvailableEntries(merged, processor);
+    EXPECT_EQ(std::vector<std::string>({"foo:9:first", "bar:9:second", "foo:10:third"}),
+              std::vector<std::string>(processor.log.begin() + 6, processor.log.end()));
+}
+
+TYPED_TEST(MergedListenerTest, Bounded) {
+    typedef MergeSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithTwoStreams streams_manager(storage, Setup::Params());
+    for (uint32_t i = 1; i <= 10; ++i) {
+        if (i % 3) {
+            streams_manager.foo_publisher.Push(SimpleEntry(i, "f"));
+        } else {
+            streams_manager.bar_publisher.Push(OtherEntry(i, "b"));
+        }
+    }
+    // `bar` stops at 9, the HEAD of `foo` is at 10: everything up to and including 9 is safe to hand out.
+    typename Setup::T_MERGED_LISTENER merged(uint32_t(2), uint32_t(8), streams_manager.foo, streams_manager.bar);
+    MergeProcessor processor;
+    ProcessAvailableEntries(merged, processor);
+    EXPECT_EQ(std::vector<std::string>({"foo:2:f", "bar:3:b", "foo:4:f", "foo:5:f", "bar:6:b", "foo:7:f"}),
+              processor.log);
+    EXPECT_TRUE(merged.ReachedEnd());
+}
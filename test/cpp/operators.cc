@@ -0,0 +1,211 @@
+// Tests for the stream processing operators and OperatorStage, see operators.h.
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::Filter;
+using ::TailProduce::FlatMap;
+using ::TailProduce::Fuse;
+using ::TailProduce::KeyedAggregate;
+using ::TailProduce::Map;
+using ::TailProduce::RunJob;
+using ::TailProduce::RunOperatorStage;
+using ::TailProduce::StreamManagerParams;
+
+struct IsPrime {
+    bool operator()(const SimpleEntry& entry) const {
+        if (entry.ikey < 2) {
+            return false;
+        }
+        for (uint32_t i = 2; i * i <= entry.ikey; ++i) {
+            if (entry.ikey % i == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct Square {
+    SimpleEntry operator()(const SimpleEntry& entry) const {
+        return SimpleEntry(entry.ikey * entry.ikey, entry.data + "^2");
+    }
+};
+
+struct EmitTwice {
+    template <typename EMIT> void operator()(const SimpleEntry& entry, EMIT& emit) const {
+        emit(entry);
+        emit(SimpleEntry(entry.ikey, entry.data + "'"));
+    }
+};
+
+struct OutputLog {
+    std::string log;
+    void operator()(const SimpleEntry& entry) {
+        log += (log.empty() ? "" : ",") + std::to_string(entry.ikey) + '=' + entry.data;
+    }
+};
+
+struct Count {
+    uint32_t entries = 0;
+};
+
+// Counts the entries by their keys modulo three, in the windows of ten keys.
+static ::TailProduce::KeyedAggregateOperator<uint32_t,
+                                             Count,
+                                             uint32_t (*)(const SimpleEntry&),
+                                             uint64_t (*)(const SimpleEntry&),
+                                             void (*)(Count&, const SimpleEntry&),
+                                             SimpleEntry (*)(const uint32_t&, const Count&, uint64_t)>
+CountByResidue() {
+    return KeyedAggregate<uint32_t, Count>(
+        +[](const SimpleEntry& entry) { return entry.ikey % 3; },
+        +[](const SimpleEntry& entry) { return static_cast<uint64_t>(entry.ikey / 10); },
+        +[](Count& count, const SimpleEntry&) { ++count.entries; },
+        +[](const uint32_t& residue, const Count& count, uint64_t window) {
+            return SimpleEntry((window + 1) * 10, std::to_string(residue) + ':' + std::to_string(count.entries));
+        });
+}
+
+TEST(Operators, FuseRunsTheChainEntryByEntry) {
+    auto op = Fuse(Filter(IsPrime()), Map(Square()), FlatMap(EmitTwice()));
+    OutputLog output_log;
+    for (uint32_t i = 1; i <= 6; ++i) {
+        op(SimpleEntry(i, std::to_string(i)), output_log);
+    }
+    EXPECT_EQ("4=2^2,4=2^2',9=3^2,9=3^2',25=5^2,25=5^2'", output_log.log);
+}
+
+TEST(Operators, KeyedAggregateEmitsOnceTheWindowEnds) {
+    auto op = CountByResidue();
+    OutputLog output_log;
+    for (uint32_t i = 1; i <= 9; ++i) {
+        op(SimpleEntry(i, ""), output_log);
+    }
+    EXPECT_EQ("", output_log.log);
+    for (uint32_t i = 10; i <= 25; ++i) {
+        op(SimpleEntry(i, ""), output_log);
+    }
+    // The window of keys 20 and up is not over yet.
+    EXPECT_EQ("10=0:3,10=1:3,10=2:3,20=0:3,20=1:4,20=2:3", output_log.log);
+}
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(OperatorsFramework, ::TailProduce::StreamManager<LevelDBTestStorage>);
+TAILPRODUCE_STREAM(numbers, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(numbers);
+TAILPRODUCE_STREAM(derived, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(derived);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static StreamManagerParams OperatorsFrameworkParams() {
+    return StreamManagerParams()
+        .CreateStream("numbers", uint32_t(0), uint32_t(0))
+        .CreateStream("derived", uint32_t(0), uint32_t(0));
+}
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+template <typename STREAM> static std::string ReadAll(const STREAM& stream) {
+    ::TailProduce::INTERNAL_UnsafeListener<STREAM> listener(stream);
+    OutputLog output_log;
+    while (listener.HasData()) {
+        listener.ProcessEntrySync(output_log);
+        listener.AdvanceToNextEntry();
+    }
+    return output_log.log;
+}
+
+TEST(OperatorStage, PublishesTheOutputInBatches) {
+    LevelDBTestStorage storage;
+    OperatorsFramework framework(storage, OperatorsFrameworkParams());
+    std::vector<SimpleEntry> entries;
+    for (uint32_t i = 1; i <= 100; ++i) {
+        entries.emplace_back(i, std::to_string(i));
+    }
+    framework.numbers_publisher.PushMany(entries.begin(), entries.end());
+
+    auto stage = RunOperatorStage(
+        framework.numbers, framework.derived_publisher, Fuse(Filter(IsPrime()), FlatMap(EmitTwice())), 10);
+    ASSERT_TRUE(WaitUntil([&stage]() { return stage->EntriesWritten() == 50; }));
+    EXPECT_EQ(100u, stage->EntriesRead());
+    // At most a batch per ten entries read.
+    EXPECT_LE(stage->BatchesWritten(), 10u);
+
+    // The stage is poked by the publisher of the input stream.
+    for (uint32_t i = 101; i <= 110; ++i) {
+        framework.numbers_publisher.Push(SimpleEntry(i, std::to_string(i)));
+    }
+    ASSERT_TRUE(WaitUntil([&stage]() { return stage->EntriesWritten() == 58; }));
+    const std::string output = ReadAll(framework.derived);
+    EXPECT_EQ(0u, output.find("2=2,2=2',3=3,3=3',5=5,5=5',7=7,7=7',11=11,11=11',")) << output;
+    const std::string last = ",107=107,107=107',109=109,109=109'";
+    EXPECT_EQ(last, output.substr(output.length() - last.length())) << output;
+}
+
+TEST(OperatorStage, AggregatesIntoAnotherStream) {
+    LevelDBTestStorage storage;
+    OperatorsFramework framework(storage, OperatorsFrameworkParams());
+    auto stage = RunOperatorStage(framework.numbers, framework.derived_publisher, CountByResidue());
+    for (uint32_t i = 1; i <= 30; ++i) {
+        framework.numbers_publisher.Push(SimpleEntry(i, std::to_string(i)));
+    }
+    ASSERT_TRUE(WaitUntil([&stage]() { return stage->EntriesWritten() == 9; }));
+    EXPECT_EQ("10=0:3,10=1:3,10=2:3,20=0:3,20=1:4,20=2:3,30=0:3,30=1:3,30=2:4", ReadAll(framework.derived));
+}
+
+static void PushNumbers(OperatorsFramework& framework, uint32_t begin, uint32_t end) {
+    std::vector<SimpleEntry> entries;
+    for (uint32_t i = begin; i < end; ++i) {
+        entries.emplace_back(i, std::to_string(i));
+    }
+    framework.numbers_publisher.PushMany(entries.begin(), entries.end());
+}
+
+TEST(OperatorStage, JobResumesAfterTheCommittedCursor) {
+    LevelDBTestStorage storage;
+    const std::string cursor_key = "s:derived:job:primes";
+    {
+        OperatorsFramework framework(storage, OperatorsFrameworkParams());
+        PushNumbers(framework, 1, 51);
+        auto job = RunJob("primes", framework.numbers, framework.derived_publisher, Filter(IsPrime()), 10);
+        // The last prime is in the last batch, so its cursor is committed along with it.
+        ASSERT_TRUE(WaitUntil([&job]() { return job->EntriesWritten() == 15; }));
+        EXPECT_EQ(50u, job->EntriesRead());
+    }
+    ASSERT_TRUE(storage.Has(cursor_key));
+
+    OperatorsFramework framework(storage, StreamManagerParams());
+    const std::string last_key = OperatorsFramework::numbers_type::T_ORDER_KEY(126)
+                                     .ComposeStorageKey(framework.numbers, framework.numbers.config_values());
+    PushNumbers(framework, 51, 101);
+    // No primes here: the cursor still moves on.
+    PushNumbers(framework, 114, 127);
+    auto job = RunJob("primes", framework.numbers, framework.derived_publisher, Filter(IsPrime()), 10);
+    ASSERT_TRUE(WaitUntil([&storage, &cursor_key, &last_key]() {
+        return ::TailProduce::Storage::ValueToKey(storage.Get(cursor_key)) == last_key;
+    }));
+    EXPECT_EQ(63u, job->EntriesRead());
+    EXPECT_EQ(10u, job->EntriesWritten());
+    EXPECT_EQ(
+        "2=2,3=3,5=5,7=7,11=11,13=13,17=17,19=19,23=23,29=29,31=31,37=37,41=41,43=43,47=47,"
+        "53=53,59=59,61=61,67=67,71=71,73=73,79=79,83=83,89=89,97=97",
+        ReadAll(framework.derived));
+}
@@ -0,0 +1,207 @@
+// Tests for the field projection, `::TailProduce::Projection<...>` and `::TailProduce::KeyOnly`.
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "cereal/types/map.hpp"
+#include "cereal/types/string.hpp"
+#include "cereal/types/vector.hpp"
+
+#include "helpers/storages.h"
+
+using ::TailProduce::bytes;
+using ::TailProduce::EntryAllocation;
+using ::TailProduce::KeyOnly;
+using ::TailProduce::Projection;
+using ::TailProduce::StreamManagerParams;
+
+template <typename SERIALIZABLE> struct WideEntryImpl : SERIALIZABLE {
+    void SetOrderKey(uint32_t input) {
+        key = input;
+    }
+    void GetOrderKey(uint32_t& output) const {
+        output = key;
+    }
+
+    uint32_t key = 0;
+    uint32_t a = 0;                        // Field 0.
+    std::string payload;                   // Field 1.
+    std::vector<uint64_t> samples;         // Field 2.
+    std::map<std::string, uint32_t> tags;  // Field 3.
+    uint64_t b = 0;                        // Field 4.
+
+  private:
+    friend class cereal::access;
+    template <class A> void serialize(A& ar) {
+        ar(CEREAL_NVP(a), CEREAL_NVP(payload), CEREAL_NVP(samples), CEREAL_NVP(tags), CEREAL_NVP(b));
+    }
+};
+
+struct WideBinaryEntry : WideEntryImpl<::TailProduce::CerealBinarySerializable<WideBinaryEntry>> {};
+struct WideJSONEntry : WideEntryImpl<::TailProduce::CerealJSONSerializable<WideJSONEntry>> {};
+
+template <typename ENTRY> ENTRY MakeWideEntry(uint32_t key) {
+    ENTRY entry;
+    entry.key = key;
+    entry.a = key * 10;
+    entry.payload = std::string(100 + key, 'x');
+    entry.samples = std::vector<uint64_t>(key, key);
+    entry.tags["key"] = key;
+    entry.b = key * 1000000000000ull;
+    return entry;
+}
+
+template <typename ENTRY> struct Capture {
+    std::vector<ENTRY> entries;
+    void operator()(const ENTRY& entry) {
+        entries.push_back(entry);
+    }
+};
+
+template <typename ENTRY> void RunProjectionOfFieldsZeroAndFour() {
+    std::ostringstream os;
+    ENTRY::SerializeEntry(os, MakeWideEntry<ENTRY>(7));
+    std::istringstream is(os.str());
+    Capture<ENTRY> capture;
+    ENTRY entry;
+    ENTRY::template DeSerializeProjectedAndProcessEntry<Projection<0, 4>>(is, uint32_t(7), capture, entry);
+    ASSERT_EQ(1, capture.entries.size());
+    EXPECT_EQ(7, capture.entries[0].key);
+    EXPECT_EQ(70, capture.entries[0].a);
+    EXPECT_EQ(7000000000000ull, capture.entries[0].b);
+    EXPECT_TRUE(capture.entries[0].payload.empty());
+    EXPECT_TRUE(capture.entries[0].samples.empty());
+    EXPECT_TRUE(capture.entries[0].tags.empty());
+}
+
+TEST(Projection, BinarySkipsUnprojectedFields) {
+    RunProjectionOfFieldsZeroAndFour<WideBinaryEntry>();
+}
+
+TEST(Projection, JSONSkipsUnprojectedFields) {
+    RunProjectionOfFieldsZeroAndFour<WideJSONEntry>();
+}
+
+TEST(Projection, BinaryProjectionOfFieldsAfterSkippedOnes) {
+    std::ostringstream os;
+    WideBinaryEntry::SerializeEntry(os, MakeWideEntry<WideBinaryEntry>(5));
+    std::istringstream is(os.str());
+    Capture<WideBinaryEntry> capture;
+    WideBinaryEntry entry;
+    WideBinaryEntry::DeSerializeProjectedAndProcessEntry<Projection<3>>(is, uint32_t(5), capture, entry);
+    ASSERT_EQ(1, capture.entries.size());
+    EXPECT_EQ(0, capture.entries[0].a);
+    EXPECT_EQ(5, capture.entries[0].tags["key"]);
+    EXPECT_EQ(0, capture.entries[0].b);
+}
+
+struct SmallProcessor {
+    typedef Projection<0, 4> T_PROJECTION;
+    std::vector<WideBinaryEntry> entries;
+    void operator()(const WideBinaryEntry& entry) {
+        entries.push_back(entry);
+    }
+};
+
+struct KeyOnlyProcessor {
+    typedef KeyOnly T_PROJECTION;
+    std::vector<uint32_t> keys;
+    void operator()(const WideBinaryEntry& entry) {
+        EXPECT_EQ(0, entry.a);
+        EXPECT_TRUE(entry.payload.empty());
+        keys.push_back(entry.key);
+    }
+};
+
+struct AllFieldsProcessor {
+    std::vector<WideBinaryEntry> entries;
+    void operator()(const WideBinaryEntry& entry) {
+        entries.push_back(entry);
+    }
+};
+
+template <typename STREAM_MANAGER_TYPE> struct ProjectionSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StreamManagerWithASingleStream, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(test, WideBinaryEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(test);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+    typedef typename StreamManagerWithASingleStream::test_type::INTERNAL_unsafe_listener_type T_LISTENER;
+};
+
+template <typename STREAM_MANAGER_TYPE> class ProjectionTest : public ::testing::Test {};
+TYPED_TEST_CASE(ProjectionTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(ProjectionTest, ListenerDecodesOnlyProjectedFields) {
+    typedef ProjectionSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 5; ++i) {
+        streams_manager.test_publisher.Push(MakeWideEntry<WideBinaryEntry>(i));
+    }
+
+    for (EntryAllocation mode : {EntryAllocation::FreshEntry, EntryAllocation::ReuseEntry}) {
+        typename Setup::T_LISTENER listener(streams_manager.test, uint32_t(1), uint32_t(6));
+        listener.SetEntryAllocation(mode);
+        SmallProcessor processor;
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(processor);
+            listener.AdvanceToNextEntry();
+        }
+        ASSERT_EQ(5, processor.entries.size());
+        for (uint32_t i = 1; i <= 5; ++i) {
+            const WideBinaryEntry& entry = processor.entries[i - 1];
+            EXPECT_EQ(i, entry.key);
+            EXPECT_EQ(i * 10, entry.a);
+            EXPECT_EQ(i * 1000000000000ull, entry.b);
+            EXPECT_TRUE(entry.payload.empty());
+            EXPECT_TRUE(entry.samples.empty());
+            EXPECT_TRUE(entry.tags.empty());
+        }
+    }
+}
+
+TYPED_TEST(ProjectionTest, KeyOnlyListenerDoesNotReadValues) {
+    typedef ProjectionSetup<TypeParam> Setup;
+    typename Setup::T_STORAGE storage;
+    typename Setup::StreamManagerWithASingleStream streams_manager(
+        storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    for (uint32_t i = 1; i <= 5; ++i) {
+        streams_manager.test_publisher.Push(MakeWideEntry<WideBinaryEntry>(i));
+    }
+
+    // Corrupt the stored values: a processor that needs them can no longer be run, a key-only one still can.
+    std::vector<::TailProduce::Storage::STORAGE_KEY_TYPE> keys;
+    for (auto it = storage.CreateStorageIterator("d:test:", "d:test;"); !it->Done(); it->Next()) {
+        keys.push_back(it->Key());
+    }
+    ASSERT_EQ(5, keys.size());
+    for (const auto& key : keys) {
+        storage.SetAllowingOverwrite(key, bytes("Not a valid entry."));
+    }
+
+    {
+        typename Setup::T_LISTENER listener(streams_manager.test, uint32_t(1), uint32_t(6));
+        AllFieldsProcessor processor;
+        ASSERT_ANY_THROW(listener.ProcessEntrySync(processor));
+    }
+
+    for (EntryAllocation mode : {EntryAllocation::FreshEntry, EntryAllocation::ReuseEntry}) {
+        typename Setup::T_LISTENER listener(streams_manager.test, uint32_t(1), uint32_t(6));
+        listener.SetEntryAllocation(mode);
+        KeyOnlyProcessor processor;
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(processor);
+            listener.AdvanceToNextEntry();
+        }
+        EXPECT_EQ(std::vector<uint32_t>({1, 2, 3, 4, 5}), processor.keys);
+    }
+}
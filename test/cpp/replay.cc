@@ -0,0 +1,105 @@
+// Tests for the parallel replay of historical ranges, see replay.h.
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::ParallelReplay;
+using ::TailProduce::ReplayPartitions;
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(ReplayFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+typedef ReplayFramework::test_type::T_ORDER_KEY T_KEY;
+
+static void PushKeys(ReplayFramework& framework, uint32_t begin, uint32_t end) {
+    std::vector<SimpleEntry> entries;
+    for (uint32_t i = begin; i < end; ++i) {
+        entries.emplace_back(i, std::to_string(i));
+    }
+    framework.test_publisher.PushMany(entries.begin(), entries.end());
+}
+
+// The keys of a sub-range, in order.
+struct KeysReplayed {
+    std::vector<uint32_t> keys;
+    void operator()(const SimpleEntry& entry) {
+        keys.push_back(entry.ikey);
+    }
+};
+
+TEST(Replay, PartitionsHoldAboutAsManyEntriesEach) {
+    InMemoryTestStorage storage;
+    ReplayFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    PushKeys(framework, 1, 1001);
+    const std::vector<T_KEY> boundaries = ReplayPartitions(framework.test, T_KEY(1), T_KEY(1001), 4);
+    ASSERT_EQ(5u, boundaries.size());
+    EXPECT_EQ(1u, boundaries.front().primary);
+    EXPECT_EQ(1001u, boundaries.back().primary);
+    for (uint32_t i = 1; i < 4; ++i) {
+        EXPECT_NEAR(i * 250 + 1, boundaries[i].primary, 10) << i;
+    }
+
+    // Fewer entries than partitions.
+    EXPECT_EQ(4u, ReplayPartitions(framework.test, T_KEY(1), T_KEY(4), 8).size());
+    EXPECT_EQ(2u, ReplayPartitions(framework.test, T_KEY(2000), T_KEY(3000), 8).size());
+}
+
+TEST(Replay, ReducesThePartitionsInOrder) {
+    InMemoryTestStorage storage;
+    ReplayFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    PushKeys(framework, 1, 1001);
+    // Called by the worker threads.
+    std::atomic<size_t> processors_made{0};
+    auto make_processor = [&processors_made](size_t) {
+        ++processors_made;
+        return KeysReplayed();
+    };
+    std::vector<uint32_t> keys;
+    auto reduce = [&keys](const KeysReplayed& partition) {
+        EXPECT_FALSE(partition.keys.empty());
+        keys.insert(keys.end(), partition.keys.begin(), partition.keys.end());
+    };
+    const uint64_t entries = ParallelReplay(framework.test, T_KEY(101), T_KEY(901), 8, make_processor, reduce, 4);
+    EXPECT_EQ(800u, entries);
+    EXPECT_EQ(8u, processors_made);
+    ASSERT_EQ(800u, keys.size());
+    for (uint32_t i = 0; i < 800; ++i) {
+        ASSERT_EQ(i + 101, keys[i]);
+    }
+}
+
+struct ThrowsOnKey {
+    void operator()(const SimpleEntry& entry) {
+        if (entry.ikey == 42) {
+            throw std::runtime_error("42");
+        }
+    }
+};
+
+TEST(Replay, RethrowsTheExceptionOfAProcessor) {
+    InMemoryTestStorage storage;
+    ReplayFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    PushKeys(framework, 1, 101);
+    size_t reduced = 0;
+    ASSERT_THROW(ParallelReplay(framework.test,
+                                T_KEY(1),
+                                T_KEY(101),
+                                4,
+                                [](size_t) { return ThrowsOnKey(); },
+                                [&reduced](const ThrowsOnKey&) { ++reduced; }),
+                 std::runtime_error);
+    EXPECT_EQ(0u, reduced);
+}
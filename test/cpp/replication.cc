@@ -0,0 +1,227 @@
+// Tests for the replication of a framework into another one, see replication.h.
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::INTERNAL_UnsafeListener;
+using ::TailProduce::ReplicationFollower;
+using ::TailProduce::ReplicationLag;
+using ::TailProduce::ReplicationLeader;
+using ::TailProduce::StreamManagerParams;
+
+template <typename STREAM_MANAGER_TYPE> struct ReplicationSetup {
+    TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(Framework, STREAM_MANAGER_TYPE);
+    TAILPRODUCE_STREAM(foo, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_STREAM(bar, SimpleEntry, uint32_t, uint32_t);
+    TAILPRODUCE_PUBLISHER(foo);
+    TAILPRODUCE_PUBLISHER(bar);
+    TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+    typedef typename STREAM_MANAGER_TYPE::T_STORAGE T_STORAGE;
+
+    static StreamManagerParams Params() {
+        return StreamManagerParams()
+            .CreateStream("foo", uint32_t(0), uint32_t(0))
+            .CreateStream("bar", uint32_t(0), uint32_t(0));
+    }
+};
+
+struct EntriesCollector {
+    std::vector<std::string> entries;
+    void operator()(const SimpleEntry& entry) {
+        entries.push_back(std::to_string(entry.ikey) + ':' + entry.data);
+    }
+};
+
+template <typename STREAM> std::vector<std::string> Entries(const STREAM& stream) {
+    INTERNAL_UnsafeListener<STREAM> listener(stream);
+    EntriesCollector collector;
+    while (listener.HasData()) {
+        listener.ProcessEntrySync(collector);
+        listener.AdvanceToNextEntry();
+    }
+    return collector.entries;
+}
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+template <typename STREAM_MANAGER_TYPE> class ReplicationTest : public ::testing::Test {};
+TYPED_TEST_CASE(ReplicationTest, TestStreamManagerImplementationsTypeList);
+
+TYPED_TEST(ReplicationTest, CatchesUpAndFollows) {
+    typedef ReplicationSetup<TypeParam> Setup;
+    typedef typename Setup::Framework Framework;
+    typename Setup::T_STORAGE leader_storage;
+    typename Setup::T_STORAGE follower_storage;
+    Framework leader(leader_storage, Setup::Params());
+    Framework follower(follower_storage, Setup::Params().SetHTTPPort(0));
+    leader.foo_publisher.Push(SimpleEntry(1, "a"));
+    leader.foo_publisher.Push(SimpleEntry(1, "b"));
+    leader.foo_publisher.Push(SimpleEntry(2, "c"));
+    leader.bar_publisher.Push(SimpleEntry(5, "x"));
+
+    ReplicationLeader<Framework> replication_leader(leader);
+    ReplicationFollower<Framework> replication(follower, "localhost", 8080);
+    ASSERT_TRUE(WaitUntil([&follower]() {
+        return follower.foo_publisher.GetHead() == 2 && follower.bar_publisher.GetHead() == 5;
+    }));
+    EXPECT_EQ(std::vector<std::string>({"1:a", "1:b", "2:c"}), Entries(follower.foo));
+    EXPECT_EQ(std::vector<std::string>({"5:x"}), Entries(follower.bar));
+    EXPECT_EQ(leader_storage.Get("d:foo:00000000010000000001"), follower_storage.Get("d:foo:00000000010000000001"));
+
+    // New entries, as well as HEAD-s moved with no entries, are replicated as they come.
+    leader.foo_publisher.Push(SimpleEntry(3, "d"));
+    leader.bar_publisher.PushHead(7);
+    ASSERT_TRUE(WaitUntil([&follower]() {
+        return follower.foo_publisher.GetHead() == 3 && follower.bar_publisher.GetHead() == 7;
+    }));
+    EXPECT_EQ(Entries(leader.foo), Entries(follower.foo));
+    EXPECT_EQ(Entries(leader.bar), Entries(follower.bar));
+    EXPECT_EQ(leader_storage.Get("s:foo"), follower_storage.Get("s:foo"));
+    EXPECT_EQ(leader_storage.Get("s:bar"), follower_storage.Get("s:bar"));
+
+    EXPECT_TRUE(WaitUntil([&replication]() { return replication.Lag().entries == 0; }));
+    EXPECT_EQ(0, replication.Lag().bytes);
+    EXPECT_EQ(5, replication.Applied().entries);
+    EXPECT_TRUE(replication.Connected());
+}
+
+TYPED_TEST(ReplicationTest, ResumesFromItsHead) {
+    typedef ReplicationSetup<TypeParam> Setup;
+    typedef typename Setup::Framework Framework;
+    typename Setup::T_STORAGE leader_storage;
+    typename Setup::T_STORAGE follower_storage;
+    Framework leader(leader_storage, Setup::Params());
+    Framework follower(follower_storage, Setup::Params().SetHTTPPort(0));
+    ReplicationLeader<Framework> replication_leader(leader);
+
+    leader.foo_publisher.Push(SimpleEntry(1, "a"));
+    {
+        ReplicationFollower<Framework> replication(follower, "localhost", 8080);
+        ASSERT_TRUE(WaitUntil([&follower]() { return follower.foo_publisher.GetHead() == 1; }));
+    }
+    EXPECT_TRUE(WaitUntil([&replication_leader]() { return replication_leader.ActiveSessions() == 0; }));
+
+    leader.foo_publisher.Push(SimpleEntry(2, "b"));
+    leader.foo_publisher.Push(SimpleEntry(3, "c"));
+    // Only the entries after the HEAD of the follower are sent, the ones it has would fail to be overwritten.
+    ReplicationFollower<Framework> replication(follower, "localhost", 8080);
+    ASSERT_TRUE(WaitUntil([&follower]() { return follower.foo_publisher.GetHead() == 3; }));
+    EXPECT_EQ(std::vector<std::string>({"1:a", "2:b", "3:c"}), Entries(follower.foo));
+    EXPECT_EQ(2, replication.Applied().entries);
+}
+
+TYPED_TEST(ReplicationTest, CompressedOnRequest) {
+    typedef ReplicationSetup<TypeParam> Setup;
+    typedef typename Setup::Framework Framework;
+    typename Setup::T_STORAGE leader_storage;
+    typename Setup::T_STORAGE follower_storage;
+    Framework leader(leader_storage, Setup::Params());
+    Framework follower(follower_storage, Setup::Params().SetHTTPPort(0));
+    ReplicationLeader<Framework> replication_leader(leader);
+    for (uint32_t i = 1; i <= 1000; ++i) {
+        leader.foo_publisher.Push(SimpleEntry(i, "entry " + std::to_string(i % 10)));
+    }
+
+    ReplicationFollower<Framework> replication(
+        follower, "localhost", 8080, "/replicate", ::TailProduce::WireCompression::Snappy);
+    ASSERT_TRUE(WaitUntil([&follower]() { return follower.foo_publisher.GetHead() == 1000; }));
+    leader.bar_publisher.Push(SimpleEntry(1, "x"));
+    ASSERT_TRUE(WaitUntil([&follower]() { return follower.bar_publisher.GetHead() == 1; }));
+    EXPECT_EQ(Entries(leader.foo), Entries(follower.foo));
+    EXPECT_EQ(leader_storage.Get("s:foo"), follower_storage.Get("s:foo"));
+    EXPECT_EQ(1001, replication.Applied().entries);
+}
+
+// The first chunk, with the client not reading further, tells how much the leader has left to send.
+TYPED_TEST(ReplicationTest, ReportsLag) {
+    typedef ReplicationSetup<TypeParam> Setup;
+    typedef typename Setup::Framework Framework;
+    typename Setup::T_STORAGE leader_storage;
+    Framework leader(leader_storage, Setup::Params());
+    ReplicationLeader<Framework> replication_leader(leader);
+    const size_t n = 1000;
+    for (uint32_t i = 1; i <= n; ++i) {
+        leader.foo_publisher.Push(SimpleEntry(i, std::string(1000, 'x')));
+    }
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string request =
+        "GET /replicate?foo=00000000000000000000&bar=00000000000000000000 HTTP/1.1\r\n\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    ChunkedResponseReader reader(*socket);
+    EXPECT_EQ(0, reader.head.find("HTTP/1.1 200 OK\r\n"));
+    std::string chunk;
+    ASSERT_TRUE(reader.ReadChunk(chunk));
+
+    size_t entries = 0;
+    size_t record_size = 0;
+    std::string head;
+    ReplicationLag lag;
+    bool has_status = false;
+    ::TailProduce::ReplicationInternal::RecordParser parser;
+    parser.Feed(chunk, [&](const std::string& key, const char* value, size_t size) {
+        if (key.empty()) {
+            ASSERT_EQ(16, size);
+            lag.entries = ::TailProduce::ReplicationInternal::ParseBigEndian(value, 8);
+            lag.bytes = ::TailProduce::ReplicationInternal::ParseBigEndian(value + 8, 8);
+            has_status = true;
+        } else if (key == "s:foo") {
+            head.assign(value, size);
+        } else {
+            EXPECT_EQ(0, key.find("d:foo:"));
+            ++entries;
+            record_size = 8 + key.length() + size;
+        }
+    });
+    EXPECT_TRUE(parser.pending.empty());
+    ASSERT_GT(entries, 0);
+    ASSERT_LT(entries, n);
+    // The HEAD moves as far as the entries sent.
+    EXPECT_EQ("d:foo:" + ::TailProduce::FixedSizeSerialization::PackToString(uint32_t(entries)) + "0000000000",
+              head);
+    ASSERT_TRUE(has_status);
+    EXPECT_EQ(n - entries, lag.entries);
+    EXPECT_EQ((n - entries) * record_size, lag.bytes);
+}
+
+TYPED_TEST(ReplicationTest, RejectsMalformedRequests) {
+    typedef ReplicationSetup<TypeParam> Setup;
+    typedef typename Setup::Framework Framework;
+    typename Setup::T_STORAGE leader_storage;
+    Framework leader(leader_storage, Setup::Params());
+    ReplicationLeader<Framework> replication_leader(leader);
+    leader.foo_publisher.Push(SimpleEntry(1, "a"));
+
+    boost::asio::io_service io_service;
+    for (const std::string target : {"/replicate?baz=00000000000000000000",
+                                     "/replicate?foo=0",
+                                     "/replicate?foo=0000000000000000000x",
+                                     "/replicate?foo=00000000020000000000"}) {
+        auto socket = ConnectToLocalhost(io_service, 8080);
+        const std::string request = "GET " + target + " HTTP/1.1\r\n\r\n";
+        boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+        EXPECT_EQ(0, ReadUntilClosed(*socket).find("HTTP/1.1 400 ")) << target;
+    }
+    EXPECT_EQ(0, replication_leader.ActiveSessions());
+}
@@ -0,0 +1,226 @@
+// Tests for the streams published into shared memory, see shared_memory_ring.h and shared_memory_stream.h.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::SharedMemoryRingReader;
+using ::TailProduce::SharedMemoryRingWriter;
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(SharedFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_SHARED_MEMORY_STREAM(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+// The names are per process, for the tests not to step on each other's rings.
+static std::string RingName(const std::string& name) {
+    return "/tailproduce-test-" + std::to_string(getpid()) + '-' + name;
+}
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void Append(SharedMemoryRingWriter& writer, const std::string& key, const std::string& value) {
+    ASSERT_TRUE(writer.Append(key.data(), key.size(), value.data(), value.size()));
+}
+
+TEST(SharedMemoryRing, WrapsAroundAndSkipsTheOverwrittenRecords) {
+    SharedMemoryRingWriter writer(RingName("ring"), 4096);
+    SharedMemoryRingReader reader(RingName("ring"));
+    EXPECT_EQ(4096u, reader.Capacity());
+
+    uint64_t position = reader.Begin();
+    uint64_t sequence;
+    std::string key;
+    std::string value;
+    EXPECT_FALSE(reader.Read(position, sequence, key, value));
+    Append(writer, "k0", "first");
+    EXPECT_FALSE(reader.Read(position, sequence, key, value));
+    writer.Commit();
+    ASSERT_TRUE(reader.Read(position, sequence, key, value));
+    EXPECT_EQ(0u, sequence);
+    EXPECT_EQ("k0", key);
+    EXPECT_EQ("first", value);
+    EXPECT_FALSE(reader.Read(position, sequence, key, value));
+
+    // Records of 112 bytes: the ring holds 36 of them, and the 37th goes to the beginning of the buffer.
+    for (int i = 1; i <= 100; ++i) {
+        Append(writer, "k" + std::to_string(i), std::string(90, 'a' + i % 26));
+    }
+    // Too large a record is not written.
+    const std::string large(3000, 'x');
+    EXPECT_FALSE(writer.Append("k", 1, large.data(), large.size()));
+    writer.Commit();
+
+    ASSERT_TRUE(reader.Read(position, sequence, key, value));
+    EXPECT_EQ(65u, sequence);
+    EXPECT_EQ("k65", key);
+    EXPECT_EQ(std::string(90, 'a' + 65 % 26), value);
+    for (int i = 66; i <= 100; ++i) {
+        ASSERT_TRUE(reader.Read(position, sequence, key, value));
+        EXPECT_EQ(static_cast<uint64_t>(i), sequence);
+        EXPECT_EQ("k" + std::to_string(i), key);
+    }
+    EXPECT_FALSE(reader.Read(position, sequence, key, value));
+    EXPECT_EQ(reader.End(), position);
+}
+
+TEST(SharedMemoryRing, NoSuchRing) {
+    ASSERT_THROW(SharedMemoryRingReader(RingName("nonexistent")), ::TailProduce::SharedMemoryException);
+    {
+        SharedMemoryRingWriter writer(RingName("gone"), 4096);
+    }
+    ASSERT_THROW(SharedMemoryRingReader(RingName("gone")), ::TailProduce::SharedMemoryException);
+}
+
+TEST(SharedMemoryRing, ReadByAnotherProcess) {
+    const size_t kRecords = 10000;
+    const std::string name = RingName("process");
+    SharedMemoryRingWriter writer(name, 1024 * 1024);
+    const pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (!pid) {
+        // The child maps the ring read-only and waits for the records on the futex.
+        std::unique_ptr<SharedMemoryRingReader> mapped;
+        try {
+            mapped.reset(new SharedMemoryRingReader(name));
+        } catch (const ::TailProduce::SharedMemoryException&) {
+            _exit(3);
+        }
+        const SharedMemoryRingReader& reader = *mapped;
+        uint64_t position = reader.Begin();
+        uint64_t sequence;
+        std::string key;
+        std::string value;
+        for (size_t i = 0; i < kRecords; ++i) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+            while (!reader.Read(position, sequence, key, value)) {
+                if (std::chrono::steady_clock::now() > deadline) {
+                    _exit(1);
+                }
+                reader.Wait(position, std::chrono::milliseconds(100));
+            }
+            if (sequence != i || key != std::to_string(i) || value != "value " + std::to_string(i)) {
+                _exit(2);
+            }
+        }
+        _exit(0);
+    }
+    for (size_t i = 0; i < kRecords; ++i) {
+        Append(writer, std::to_string(i), "value " + std::to_string(i));
+        if (i % 10 == 9) {
+            writer.Commit();
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+        }
+    }
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+struct Collector {
+    std::mutex mutex;
+    std::vector<std::string> entries;
+    void operator()(const SimpleEntry& entry) {
+        std::lock_guard<std::mutex> guard(mutex);
+        entries.push_back(std::to_string(entry.ikey) + ':' + entry.data);
+    }
+    std::string Joined() {
+        std::lock_guard<std::mutex> guard(mutex);
+        std::string result;
+        for (const std::string& entry : entries) {
+            result += (result.empty() ? "" : ",") + entry;
+        }
+        return result;
+    }
+};
+
+// Holds the first entry until opened.
+struct GatedCollector : Collector {
+    std::atomic<bool> open{false};
+    void operator()(const SimpleEntry& entry) {
+        while (!open) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        Collector::operator()(entry);
+    }
+};
+
+TEST(SharedMemoryStream, PublishesTheNewEntries) {
+    InMemoryTestStorage storage;
+    StreamManagerParams params;
+    params.CreateStream("test", uint32_t(0), uint32_t(0));
+    {
+        SharedFramework framework(storage, params);
+        framework.test_publisher.Push(SimpleEntry(1, "before"));
+    }
+
+    SharedFramework framework(storage, StreamManagerParams().SetSharedMemoryPrefix(RingName(""), 64 * 1024));
+    ::TailProduce::SharedMemoryListenersFactory<SimpleEntry, uint32_t, uint32_t> factory(RingName("test"));
+    EXPECT_EQ(64u * 1024, factory.Capacity());
+    Collector collector;
+    Collector reusing_collector;
+    auto listener = factory(collector);
+    auto reusing_listener = factory(reusing_collector, ::TailProduce::EntryAllocation::ReuseEntry);
+
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+    framework.test_publisher.Push(SimpleEntry(2, "deux"));
+    framework.test_publisher.Push(SimpleEntry(3, "three"));
+    ASSERT_TRUE(WaitUntil([&listener]() { return listener->EntriesProcessed() == 3; }));
+    EXPECT_EQ("2:two,2:deux,3:three", collector.Joined());
+    ASSERT_TRUE(WaitUntil([&reusing_listener]() { return reusing_listener->EntriesProcessed() == 3; }));
+    EXPECT_EQ("2:two,2:deux,3:three", reusing_collector.Joined());
+    EXPECT_EQ(3u, framework.test_shared_memory.EntriesWritten());
+    EXPECT_EQ(0u, listener->EntriesLost());
+
+    // A listener that falls behind by more than the ring holds loses the oldest entries, and knows it.
+    GatedCollector gated_collector;
+    auto gated_listener = factory(gated_collector);
+    const std::string data(1000, 'x');
+    for (uint32_t i = 4; i < 204; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, data));
+    }
+    ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_shared_memory.EntriesWritten() == 203; }));
+    gated_collector.open = true;
+    framework.test_publisher.Push(SimpleEntry(204, "last"));
+    ASSERT_TRUE(WaitUntil([&gated_listener]() {
+        return gated_listener->EntriesProcessed() + gated_listener->EntriesLost() == 204;
+    }));
+    EXPECT_LT(100u, gated_listener->EntriesLost());
+    EXPECT_EQ("204:last", gated_collector.entries.back());
+    ASSERT_TRUE(WaitUntil([&listener]() { return listener->EntriesProcessed() + listener->EntriesLost() == 204; }));
+}
+
+TEST(SharedMemoryStream, DisabledByDefault) {
+    InMemoryTestStorage storage;
+    SharedFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    EXPECT_EQ(0u, framework.test_shared_memory.EntriesWritten());
+    typedef ::TailProduce::SharedMemoryListenersFactory<SimpleEntry, uint32_t, uint32_t> T_FACTORY;
+    ASSERT_THROW(T_FACTORY(RingName("test")), ::TailProduce::SharedMemoryException);
+}
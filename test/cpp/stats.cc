@@ -0,0 +1,157 @@
+// Tests for the counters of the streams, the listeners and the storage, see stats.h.
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::StreamManagerParams;
+using ::TailProduce::StripedCounters;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(StatsFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Returns the response code and sets `body`.
+static int Get(const std::string& target, std::string& body) {
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string request = "GET " + target + " HTTP/1.1\r\nConnection: close\r\n\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    boost::asio::streambuf buffer;
+    const std::string head = ReadHTTPResponse(*socket, buffer, body);
+    return std::stoi(head.substr(sizeof("HTTP/1.1 ") - 1, 3));
+}
+
+struct Counter {
+    std::atomic<size_t> entries{0};
+    void operator()(const SimpleEntry&) {
+        ++entries;
+    }
+};
+
+// Holds the first entry until opened.
+struct GatedCounter : Counter {
+    std::atomic<bool> entered{false};
+    std::atomic<bool> open{false};
+    void operator()(const SimpleEntry& entry) {
+        entered = true;
+        while (!open) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        Counter::operator()(entry);
+    }
+};
+
+TEST(StripedCounters, SumUpTheThreads) {
+    StripedCounters<2> counters;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 20; ++i) {
+        threads.emplace_back([&counters]() {
+            for (int j = 0; j < 10000; ++j) {
+                counters.Add(0, 1);
+                counters.Add(1, 3);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(200000u, counters.Get(0));
+    EXPECT_EQ(600000u, counters.Get(1));
+}
+
+TEST(Stats, CountedAndServedOverHTTP) {
+    InMemoryTestStorage storage;
+    StatsFramework framework(storage,
+                             StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)).SetStats());
+    Counter counter;
+    auto listener = framework.new_scoped_test_listener(counter);
+    EXPECT_EQ("test/1", listener->StatsName());
+    ASSERT_TRUE(listener->Stats());
+
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+    std::vector<SimpleEntry> batch{SimpleEntry(3, "three"), SimpleEntry(3, "trois"), SimpleEntry(4, "four")};
+    framework.test_publisher.PushMany(batch.begin(), batch.end());
+    ASSERT_TRUE(WaitUntil([&listener]() { return listener->Stats()->EntriesProcessed() == 5; }));
+    EXPECT_EQ(5u, counter.entries);
+    EXPECT_LT(0u, listener->Stats()->ProcessorNanoseconds());
+
+    EXPECT_EQ(5u, framework.test.publish_stats_.EntriesPublished());
+    EXPECT_LT(0u, framework.test.publish_stats_.BytesPublished());
+    // Each Push() writes the entry and the HEAD, and PushMany() writes them in one batch.
+    const ::TailProduce::StorageStats& storage_stats = framework.stats_.storage;
+    EXPECT_EQ(8u, storage_stats.Writes());
+    EXPECT_LT(framework.test.publish_stats_.BytesPublished(), storage_stats.BytesWritten());
+    EXPECT_EQ(5u, storage_stats.Reads());
+    EXPECT_EQ(framework.test.publish_stats_.BytesPublished(), storage_stats.BytesRead());
+    EXPECT_LE(1u, storage_stats.IteratorsCreated());
+
+    // A listener stuck in its processor on the first entry lags behind by all of them.
+    GatedCounter gated_counter;
+    auto gated_listener = framework.new_scoped_test_listener(gated_counter);
+    ASSERT_TRUE(WaitUntil([&gated_counter]() { return gated_counter.entered.load(); }));
+
+    const std::string head = framework.test.head.ComposeStorageKey(framework.test, framework.test.config_values());
+    std::string body;
+    ASSERT_EQ(200, Get("/stats", body));
+    EXPECT_NE(std::string::npos, body.find("\"storage\": {\"reads\": ")) << body;
+    EXPECT_NE(std::string::npos,
+              body.find("\"test\": {\"entries_published\": 5, \"bytes_published\": " +
+                        std::to_string(framework.test.publish_stats_.BytesPublished()) + ", \"head\": \"" + head +
+                        "\", \"entries_per_second\": ")) << body;
+    EXPECT_NE(std::string::npos,
+              body.find("\"test/1\": {\"cursor\": \"" + head + "\", \"lag_entries\": 0, \"entries_processed\": 5, "))
+        << body;
+    EXPECT_NE(std::string::npos, body.find("\"test/2\": {\"cursor\": \"")) << body;
+    EXPECT_NE(std::string::npos, body.find("\"lag_entries\": 5, \"entries_processed\": 0, ")) << body;
+
+    gated_counter.open = true;
+    ASSERT_TRUE(WaitUntil([&gated_listener]() { return gated_listener->Stats()->EntriesProcessed() == 5; }));
+    ASSERT_EQ(200, Get("/stats", body));
+    EXPECT_NE(std::string::npos, body.find("\"lag_entries\": 0, \"entries_processed\": 5, \"processor_ns\": "))
+        << body;
+    EXPECT_EQ(std::string::npos, body.find("\"lag_entries\": 5")) << body;
+
+    // The listener goes away from the stats with it.
+    gated_listener.reset();
+    ASSERT_EQ(200, Get("/stats", body));
+    EXPECT_EQ(std::string::npos, body.find("\"test/2\"")) << body;
+}
+
+TEST(Stats, DisabledByDefault) {
+    InMemoryTestStorage storage;
+    StatsFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    Counter counter;
+    auto listener = framework.new_scoped_test_listener(counter);
+    EXPECT_FALSE(listener->Stats());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    ASSERT_TRUE(WaitUntil([&counter]() { return counter.entries == 1; }));
+    EXPECT_EQ(0u, framework.test.publish_stats_.EntriesPublished());
+    EXPECT_EQ(0u, framework.stats_.storage.Writes());
+    EXPECT_EQ(0u, framework.stats_.storage.Reads());
+    std::string body;
+    EXPECT_EQ(404, Get("/stats", body));
+}
@@ -40,6 +40,29 @@ TYPED_TEST(DataStorageTest, SetsOverwritesAndGets) {
     EXPECT_EQ(bytes("second"), storage.Get("key"));
 }
 
+TYPED_TEST(DataStorageTest, AppliesBatchesAtomically) {
+    TypeParam storage;
+    storage.Set("head", bytes("0"));
+    ::TailProduce::Storage::WriteBatch batch;
+    batch.Set("a", bytes("one"));
+    batch.Set("b", bytes("two"));
+    batch.SetAllowingOverwrite("head", bytes("2"));
+    storage.ApplyBatch(batch);
+    EXPECT_EQ(bytes("one"), storage.Get("a"));
+    EXPECT_EQ(bytes("two"), storage.Get("b"));
+    EXPECT_EQ(bytes("2"), storage.Get("head"));
+
+    // A write that is not allowed fails the whole batch.
+    batch.Clear();
+    batch.Set("c", bytes("three"));
+    batch.SetAllowingOverwrite("head", bytes("3"));
+    batch.Set("a", bytes("again"));
+    ASSERT_THROW(storage.ApplyBatch(batch), ::TailProduce::StorageOverwriteNotAllowedException);
+    EXPECT_FALSE(storage.Has("c"));
+    EXPECT_EQ(bytes("2"), storage.Get("head"));
+    EXPECT_EQ(bytes("one"), storage.Get("a"));
+}
+
 TYPED_TEST(DataStorageTest, BasicExceptions) {
     TypeParam storage;
     ASSERT_THROW(storage.Set("", bytes("foo")), ::TailProduce::StorageEmptyKeyException);
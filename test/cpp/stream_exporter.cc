@@ -0,0 +1,259 @@
+// Tests for the HTTP stream exporter, see stream_exporter.h and TAILPRODUCE_EXPORT_STREAM.
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(ExportingFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_EXPORT_STREAM(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static StreamManagerParams ExportingFrameworkParams() {
+    return StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0));
+}
+
+static std::unique_ptr<boost::asio::ip::tcp::socket> RequestStream(boost::asio::io_service& io_service,
+                                                                   const std::string& target = "/test") {
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string request = "GET " + target + " HTTP/1.1\r\n\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    return socket;
+}
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(StreamExporter, StreamsExistingAndNewEntries) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+
+    boost::asio::io_service io_service;
+    auto socket = RequestStream(io_service);
+    ChunkedResponseReader reader(*socket);
+    EXPECT_EQ(0, reader.head.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, reader.head.find("Transfer-Encoding: chunked\r\n"));
+
+    std::string data;
+    ASSERT_TRUE(reader.ReadLines(data, 2));
+    EXPECT_EQ("{\"key\":1,\"entry\":{\"data\":\"one\"}}\n{\"key\":2,\"entry\":{\"data\":\"two\"}}\n", data);
+
+    // New entries wake the session up.
+    framework.test_publisher.Push(SimpleEntry(3, "three\n\"quoted\""));
+    ASSERT_TRUE(reader.ReadLines(data, 3));
+    EXPECT_EQ("{\"key\":3,\"entry\":{\"data\":\"three\\n\\\"quoted\\\"\"}}\n", data.substr(data.find("{\"key\":3")));
+
+    // A disconnected client ends its session.
+    EXPECT_EQ(1, framework.test_exporter.ActiveSessions());
+    socket.reset();
+    EXPECT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveSessions() == 0; }));
+}
+
+TEST(StreamExporter, CoalescesEntriesIntoLargeChunks) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    const size_t n = 10000;
+    for (uint32_t i = 1; i <= n; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, "x"));
+    }
+
+    boost::asio::io_service io_service;
+    auto socket = RequestStream(io_service);
+    ChunkedResponseReader reader(*socket);
+    std::string data;
+    ASSERT_TRUE(reader.ReadLines(data, n));
+    EXPECT_EQ(n, std::count(data.begin(), data.end(), '\n'));
+    EXPECT_LT(reader.chunks, n / 100);
+}
+
+TEST(StreamExporter, SlowClientHoldsTheListenerBack) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    const size_t n = 8000;
+    const std::string payload(4000, 'x');
+    for (uint32_t i = 1; i <= n; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, payload));
+    }
+    const size_t total_bytes = n * payload.length();
+
+    boost::asio::io_service io_service;
+    auto socket = RequestStream(io_service);
+    // The client reads nothing: the session stops once the socket buffers are full.
+    size_t bytes_sent_while_stalled = 0;
+    ASSERT_TRUE(WaitUntil([&framework, &bytes_sent_while_stalled]() {
+        bytes_sent_while_stalled = framework.test_exporter.BytesSent();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        return bytes_sent_while_stalled && bytes_sent_while_stalled == framework.test_exporter.BytesSent();
+    }));
+    EXPECT_LT(bytes_sent_while_stalled, total_bytes / 2);
+
+    ChunkedResponseReader reader(*socket);
+    std::string data;
+    ASSERT_TRUE(reader.ReadLines(data, n));
+    EXPECT_EQ(n, std::count(data.begin(), data.end(), '\n'));
+}
+
+TEST(StreamExporter, EndsTheResponseOnTearDown) {
+    InMemoryTestStorage storage;
+    boost::asio::io_service io_service;
+    std::unique_ptr<boost::asio::ip::tcp::socket> socket;
+    std::string data;
+    {
+        ExportingFramework framework(storage, ExportingFrameworkParams());
+        framework.test_publisher.Push(SimpleEntry(1, "one"));
+        socket = RequestStream(io_service);
+        ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.BytesSent() > 0; }));
+    }
+    ChunkedResponseReader reader(*socket);
+    EXPECT_FALSE(reader.ReadChunk(data) && reader.ReadChunk(data));
+    EXPECT_EQ("{\"key\":1,\"entry\":{\"data\":\"one\"}}\n", data);
+    EXPECT_EQ("", ReadUntilClosed(*socket));
+}
+
+// Reads the whole response, which is expected to end on its own.
+static std::string ReadCompleteExport(boost::asio::io_service& io_service, const std::string& target) {
+    auto socket = RequestStream(io_service, target);
+    ChunkedResponseReader reader(*socket);
+    std::string data;
+    while (reader.ReadChunk(data)) {
+    }
+    return data;
+}
+
+static std::string JSONLine(uint32_t key, const std::string& data) {
+    return "{\"key\":" + std::to_string(key) + ",\"entry\":{\"data\":\"" + data + "\"}}\n";
+}
+
+TEST(StreamExporter, RangeLimitAndFollow) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    for (uint32_t i = 1; i <= 5; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, "x" + std::to_string(i)));
+    }
+    boost::asio::io_service io_service;
+
+    // The HEAD is beyond `to`, no more entries can come before it: the response ends.
+    EXPECT_EQ(JSONLine(2, "x2") + JSONLine(3, "x3"), ReadCompleteExport(io_service, "/test?from=2&to=4"));
+    EXPECT_EQ(JSONLine(1, "x1") + JSONLine(2, "x2"), ReadCompleteExport(io_service, "/test?limit=2"));
+    EXPECT_EQ(JSONLine(4, "x4") + JSONLine(5, "x5"), ReadCompleteExport(io_service, "/test?from=4&follow=0"));
+    EXPECT_EQ("", ReadCompleteExport(io_service, "/test?from=6&follow=0"));
+
+    // With `follow=1`, the default, the response waits for the entries up to `to`.
+    auto socket = RequestStream(io_service, "/test?from=5&to=8");
+    ChunkedResponseReader reader(*socket);
+    std::string data;
+    ASSERT_TRUE(reader.ReadLines(data, 1));
+    EXPECT_EQ(JSONLine(5, "x5"), data);
+    framework.test_publisher.Push(SimpleEntry(6, "x6"));
+    ASSERT_TRUE(reader.ReadLines(data, 2));
+    EXPECT_EQ(JSONLine(5, "x5") + JSONLine(6, "x6"), data);
+    // Moving the HEAD to `to` ends the response, with no entry beyond the range published.
+    framework.test_publisher.PushHead(8);
+    EXPECT_FALSE(reader.ReadChunk(data));
+    EXPECT_EQ(JSONLine(5, "x5") + JSONLine(6, "x6"), data);
+    EXPECT_EQ("", ReadUntilClosed(*socket));
+}
+
+TEST(StreamExporter, TSVAndSecondaryKeys) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "a"));
+    framework.test_publisher.Push(SimpleEntry(1, "b"));
+    framework.test_publisher.Push(SimpleEntry(2, "c\td"));
+    boost::asio::io_service io_service;
+    EXPECT_EQ("1\t0\t{\"data\":\"a\"}\n1\t1\t{\"data\":\"b\"}\n2\t0\t{\"data\":\"c\\td\"}\n",
+              ReadCompleteExport(io_service, "/test?format=tsv&follow=0"));
+    // Resuming after `1:0` skips the entry already received, not the whole primary key.
+    EXPECT_EQ("1\t1\t{\"data\":\"b\"}\n", ReadCompleteExport(io_service, "/test?format=tsv&from=1:1&to=2"));
+}
+
+TEST(StreamExporter, Binary) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+    boost::asio::io_service io_service;
+    const std::string data = ReadCompleteExport(io_service, "/test?format=binary&follow=0");
+
+    std::vector<std::string> fields;
+    size_t offset = 0;
+    while (offset + 4 <= data.length()) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data() + offset);
+        const size_t length = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+        ASSERT_LE(offset + 4 + length, data.length());
+        fields.push_back(data.substr(offset + 4, length));
+        offset += 4 + length;
+    }
+    EXPECT_EQ(data.length(), offset);
+    ASSERT_EQ(4, fields.size());
+    EXPECT_EQ("00000000010000000000", fields[0]);
+    EXPECT_EQ("00000000020000000000", fields[2]);
+    // The values are exported as stored.
+    for (size_t i = 0; i < 4; i += 2) {
+        const std::string key = framework.test.storage_key_data_prefix + fields[i];
+        EXPECT_EQ(::TailProduce::antibytes(storage.Get(key)), fields[i + 1]);
+    }
+}
+
+TEST(StreamExporter, MalformedParameters) {
+    InMemoryTestStorage storage;
+    ExportingFramework framework(storage, ExportingFrameworkParams());
+    boost::asio::io_service io_service;
+    for (const std::string target : {"/test?from=x",
+                                     "/test?from=1:",
+                                     "/test?to=-1",
+                                     "/test?to=99999999999",
+                                     "/test?limit=1.5",
+                                     "/test?follow=yes",
+                                     "/test?format=xml"}) {
+        auto socket = RequestStream(io_service, target);
+        const std::string response = ReadUntilClosed(*socket);
+        EXPECT_EQ(0, response.find("HTTP/1.1 400 ")) << target;
+    }
+    EXPECT_EQ(0, framework.test_exporter.ActiveSessions());
+}
+
+TEST(StreamExporter, OverUnixDomainSocket) {
+    InMemoryTestStorage storage;
+    const std::string path = "@tailproduce-test-exporter-" + std::to_string(getpid());
+    ExportingFramework framework(storage, ExportingFrameworkParams().SetHTTPUnixSocket(path));
+    for (uint32_t i = 1; i <= 1000; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, "entry " + std::to_string(i)));
+    }
+
+    // The same response as over TCP.
+    const std::string request = "GET /test?follow=0&format=tsv HTTP/1.1\r\n\r\n";
+    boost::asio::io_service io_service;
+    auto tcp_socket = ConnectToLocalhost(io_service, 8080);
+    boost::asio::write(*tcp_socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    const std::string tcp_response = ReadUntilClosed(*tcp_socket);
+    auto unix_socket = ConnectToUnixSocket(io_service, path);
+    boost::asio::write(*unix_socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    EXPECT_EQ(tcp_response, ReadUntilClosed(*unix_socket));
+    EXPECT_NE(std::string::npos, tcp_response.find("1000\t0\t{\"data\":\"entry 1000\"}\n"));
+}
@@ -0,0 +1,165 @@
+// Tests for the HTTP stream ingester, see stream_ingester.h and TAILPRODUCE_INGEST_STREAM.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::INTERNAL_UnsafeListener;
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(IngestingFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_STREAM(copy, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_PUBLISHER(copy);
+TAILPRODUCE_EXPORT_STREAM(test);
+TAILPRODUCE_INGEST_STREAM(test);
+TAILPRODUCE_INGEST_STREAM(copy);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static StreamManagerParams IngestingFrameworkParams() {
+    return StreamManagerParams()
+        .CreateStream("test", uint32_t(0), uint32_t(0))
+        .CreateStream("copy", uint32_t(0), uint32_t(0));
+}
+
+static void SendRequest(boost::asio::ip::tcp::socket& socket,
+                        const std::string& method,
+                        const std::string& target,
+                        const std::string& body,
+                        bool keep_alive = false) {
+    const std::string request = method + ' ' + target + " HTTP/1.1\r\nContent-Length: " +
+                                std::to_string(body.length()) + "\r\nConnection: " +
+                                (keep_alive ? "keep-alive" : "close") + "\r\n\r\n" + body;
+    boost::asio::write(socket, boost::asio::buffer(request), boost::asio::transfer_all());
+}
+
+// Sends the request on a new connection, returns the response code and sets `body` to the response body.
+static int Post(const std::string& target, const std::string& request_body, std::string& body) {
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    SendRequest(*socket, "POST", target, request_body);
+    boost::asio::streambuf buffer;
+    const std::string head = ReadHTTPResponse(*socket, buffer, body);
+    return std::stoi(head.substr(sizeof("HTTP/1.1 ") - 1, 3));
+}
+
+struct EntriesCollector {
+    std::vector<std::string> entries;
+    void operator()(const SimpleEntry& entry) {
+        entries.push_back(std::to_string(entry.ikey) + ':' + entry.data);
+    }
+};
+
+template <typename STREAM> std::vector<std::string> Entries(const STREAM& stream) {
+    INTERNAL_UnsafeListener<STREAM> listener(stream);
+    EntriesCollector collector;
+    while (listener.HasData()) {
+        listener.ProcessEntrySync(collector);
+        listener.AdvanceToNextEntry();
+    }
+    return collector.entries;
+}
+
+static std::string JSONLine(uint32_t key, const std::string& data) {
+    return "{\"key\":" + std::to_string(key) + ",\"entry\":{\"data\":\"" + data + "\"}}\n";
+}
+
+TEST(StreamIngester, IngestsJSONLinesOverKeepAliveConnection) {
+    InMemoryTestStorage storage;
+    IngestingFramework framework(storage, IngestingFrameworkParams());
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    boost::asio::streambuf buffer;
+    std::string body;
+    const std::string lines = JSONLine(1, "a") + JSONLine(1, "b") + "\n" + JSONLine(2, "c");
+    SendRequest(*socket, "POST", "/test/ingest", lines, true);
+    std::string head = ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, head.find("Content-Type: application/json\r\n"));
+    EXPECT_EQ("{\"entries\":3,\"head\":\"2:0\"}\n", body);
+    // The entries are committed by the time the response is sent.
+    EXPECT_EQ(std::vector<std::string>({"1:a", "1:b", "2:c"}), Entries(framework.test));
+
+    // The same connection takes the next request, with no trailing newline after its last line.
+    SendRequest(*socket, "POST", "/test/ingest?format=json", "{\"key\":3,\"entry\":{\"data\":\"d\\n\"}}");
+    head = ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_EQ("{\"entries\":1,\"head\":\"3:0\"}\n", body);
+    EXPECT_EQ("", ReadUntilClosed(*socket));
+    EXPECT_EQ(std::vector<std::string>({"1:a", "1:b", "2:c", "3:d\n"}), Entries(framework.test));
+    EXPECT_EQ(4, framework.test_ingester.EntriesIngested());
+}
+
+TEST(StreamIngester, IngestsTheBinaryExport) {
+    InMemoryTestStorage storage;
+    IngestingFramework framework(storage, IngestingFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(1, "uno"));
+    framework.test_publisher.Push(SimpleEntry(2, std::string("two\0zwei", 8)));
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    SendRequest(*socket, "GET", "/test?format=binary&follow=0", "");
+    ChunkedResponseReader reader(*socket);
+    std::string exported;
+    while (reader.ReadChunk(exported)) {
+    }
+
+    std::string body;
+    EXPECT_EQ(200, Post("/copy/ingest?format=binary", exported, body));
+    EXPECT_EQ("{\"entries\":3,\"head\":\"2:0\"}\n", body);
+    EXPECT_EQ(Entries(framework.test), Entries(framework.copy));
+    EXPECT_EQ(storage.Get("d:test:00000000010000000001"), storage.Get("d:copy:00000000010000000001"));
+}
+
+TEST(StreamIngester, CommitsEachBatchAtomically) {
+    InMemoryTestStorage storage;
+    IngestingFramework framework(storage, IngestingFrameworkParams());
+    framework.test_ingester.SetMaxBatchEntries(2);
+
+    std::string body;
+    EXPECT_EQ(200, Post("/test/ingest", JSONLine(1, "a") + JSONLine(2, "b") + JSONLine(3, "c"), body));
+    EXPECT_EQ("{\"entries\":3,\"head\":\"3:0\"}\n", body);
+
+    // The second batch, {5, 2}, goes backwards: the first batch, {4, 4}, is published, none of the second one is.
+    EXPECT_EQ(400, Post("/test/ingest", JSONLine(4, "d") + JSONLine(4, "e") + JSONLine(5, "f") + JSONLine(2, "x"),
+                        body));
+    EXPECT_EQ("Order keys go backwards, published 2 entries.\n", body);
+    EXPECT_EQ(std::vector<std::string>({"1:a", "2:b", "3:c", "4:d", "4:e"}), Entries(framework.test));
+    EXPECT_EQ(4, framework.test_publisher.GetHead());
+    EXPECT_EQ(1, framework.test_publisher.GetHeadPrimaryAndSecondary().secondary);
+    EXPECT_EQ(5, framework.test_ingester.EntriesIngested());
+}
+
+TEST(StreamIngester, RejectsMalformedRequests) {
+    InMemoryTestStorage storage;
+    IngestingFramework framework(storage, IngestingFrameworkParams());
+    framework.test_ingester.SetMaxRequestBytes(1000);
+
+    std::string body;
+    EXPECT_EQ(400, Post("/test/ingest", JSONLine(1, "a") + "{\"key\":2,\"entry\":\n", body));
+    EXPECT_EQ("Malformed JSON on line 2.\n", body);
+    EXPECT_EQ(400, Post("/test/ingest", JSONLine(1, "a") + "{\"key\":2}\n", body));
+    EXPECT_EQ(400, Post("/test/ingest", "not json\n", body));
+    EXPECT_EQ(400, Post("/test/ingest?format=binary", std::string("\0\0\0\x14", 4) + "0000000001", body));
+    EXPECT_EQ("Malformed key of entry 1.\n", body);
+    EXPECT_EQ(400, Post("/test/ingest?format=binary", std::string("\0\0\0\x14", 4) + "0000000001000000000x", body));
+    EXPECT_EQ(400, Post("/test/ingest?format=xml", JSONLine(1, "a"), body));
+    EXPECT_EQ(413, Post("/test/ingest", std::string(1001, '\n'), body));
+    EXPECT_TRUE(Entries(framework.test).empty());
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    SendRequest(*socket, "GET", "/test/ingest", "");
+    EXPECT_EQ(0, ReadUntilClosed(*socket).find("HTTP/1.1 405 Method Not Allowed\r\n"));
+    EXPECT_EQ(0, framework.test_ingester.EntriesIngested());
+}
@@ -517,20 +517,28 @@ TYPED_TEST(StreamManagerTest, ExpandedMacroSyntaxCompiles) {
             typedef SimpleEntry T_ENTRY;
             typedef typename test_type_params::T_ORDER_KEY T_ORDER_KEY;
             typedef typename T_THIS_FRAMEWORK_INSTANCE::T_STORAGE T_STORAGE;
+            typedef typename T_THIS_FRAMEWORK_INSTANCE::T_TRACER T_TRACER;
             typedef ::TailProduce::INTERNAL_UnsafeListener<test_type> INTERNAL_unsafe_listener_type;
             T_THIS_FRAMEWORK_INSTANCE* manager_;
             mutable ::TailProduce::SubscriptionsManager subscriptions_;
+            ::TailProduce::PublishTimestamps publish_timestamps_;
+            ::TailProduce::StreamStats publish_stats_;
             test_type(T_THIS_FRAMEWORK_INSTANCE* manager,
                       const char* stream_name,
                       const char* entry_type_name,
                       const char* entry_order_key_name)
-                : T_STREAM_INSTANCE(manager->cv, manager->storage), manager_(manager) {
+                : T_STREAM_INSTANCE(manager->cv, manager->storage),
+                  manager_(manager),
+                  publish_timestamps_(manager->latency_histograms_.Enabled()),
+                  publish_stats_(manager->stats_.Enabled()) {
                 manager_->streams_declared_.insert("test");
             }
         };
         test_type test = test_type(this, "test", "uint32_t", "uint32_t");
         ::TailProduce::AsyncListenersFactory<test_type> new_scoped_test_listener =
             ::TailProduce::AsyncListenersFactory<test_type>(test);
+        ::TailProduce::ReplicatedStreamImpl<test_type> test_replicated{this->replicated_streams_, test};
+        ::TailProduce::StreamStatsImpl<test_type> test_stats{this->stats_, test};
 
         // TAILPRODUCE_PUBLISHER(test);
         struct test_publisher_type : ::TailProduce::Publisher<test_type> {
@@ -542,29 +550,17 @@ TYPED_TEST(StreamManagerTest, ExpandedMacroSyntaxCompiles) {
         test_publisher_type test_publisher = test_publisher_type(this);
 
         // TAILPRODUCE_EXPORT_STREAM(test);
-        struct test_exporter_type : ::TailProduce::StreamExporter {
+        struct test_exporter_type : ::TailProduce::StreamExporterImpl<test_type> {
             T_THIS_FRAMEWORK_INSTANCE* manager_;
-            explicit test_exporter_type(T_THIS_FRAMEWORK_INSTANCE* manager) : manager_(manager) {
+            explicit test_exporter_type(T_THIS_FRAMEWORK_INSTANCE* manager)
+                : ::TailProduce::StreamExporterImpl<test_type>(manager->test), manager_(manager) {
                 manager_->AddExporter("/test", this);
             }
             ~test_exporter_type() {
                 manager_->RemoveExporter("/test", this);
             }
-            void ListenAndStreamData(std::unique_ptr<boost::asio::ip::tcp::socket>&& socket) {
-                // TODO(dkorolev): Handle shutdown correctly.
-                auto lambda = [&socket](const SimpleEntry& entry) {
-                    std::ostringstream os;
-                    os << entry.ikey << ' ' << entry.data << '\n';
-                    std::string message = os.str();
-                    boost::asio::write(*socket, boost::asio::buffer(message), boost::asio::transfer_all());
-                };
-                auto scope = manager_->new_scoped_test_listener(lambda);
-                // TODO(dkorolev): Join threads or do something else clever.
-                while (true) {
-                }
-            }
         };
-        test_exporter_type test_exporter = test_exporter_type(this);
+        test_exporter_type test_exporter{this};
 
         // TAILPRODUCE_STATIC_FRAMEWORK_END();
     };
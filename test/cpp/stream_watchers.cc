@@ -0,0 +1,197 @@
+// Tests for the SSE and long-poll modes of the HTTP stream exporter, see stream_watchers.h.
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::StreamManagerParams;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(WatchedFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_EXPORT_STREAM(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static StreamManagerParams WatchedFrameworkParams() {
+    return StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0));
+}
+
+static void SendGet(boost::asio::ip::tcp::socket& socket,
+                    const std::string& target,
+                    const std::string& headers = "") {
+    const std::string request = "GET " + target + " HTTP/1.1\r\n" + headers + "\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request), boost::asio::transfer_all());
+}
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static std::string Entry(uint32_t key, const std::string& data) {
+    return "{\"key\":" + std::to_string(key) + ",\"entry\":{\"data\":\"" + data + "\"}}";
+}
+
+TEST(StreamWatchers, LongPollReturnsOnceTheHeadMoves) {
+    InMemoryTestStorage storage;
+    WatchedFramework framework(storage, WatchedFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    boost::asio::streambuf buffer;
+    std::string body;
+
+    // The entries after `after` are there already.
+    SendGet(*socket, "/test?mode=poll&after=0");
+    std::string head = ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ(0, head.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, head.find("Content-Type: application/json\r\n"));
+    EXPECT_EQ("{\"entries\":[" + Entry(1, "one") + "],\"next\":\"1:0\"}\n", body);
+
+    // Over the same connection, wait for the next entries.
+    SendGet(*socket, "/test?mode=poll&after=1:0");
+    ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 1; }));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+    ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ("{\"entries\":[" + Entry(2, "two") + "],\"next\":\"2:0\"}\n", body);
+
+    // Moving the HEAD with no entries completes the poll too.
+    SendGet(*socket, "/test?mode=poll&after=2:0");
+    ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 1; }));
+    framework.test_publisher.PushHead(5);
+    ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ("{\"entries\":[],\"next\":\"5:0\"}\n", body);
+    EXPECT_EQ(0, framework.test_exporter.ActiveWatchers());
+}
+
+TEST(StreamWatchers, LongPollLimitAndTimeout) {
+    InMemoryTestStorage storage;
+    WatchedFramework framework(storage, WatchedFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(1, "uno"));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    boost::asio::streambuf buffer;
+    std::string body;
+    SendGet(*socket, "/test?mode=poll&after=0&limit=2");
+    ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ("{\"entries\":[" + Entry(1, "one") + ',' + Entry(1, "uno") + "],\"next\":\"1:1\"}\n", body);
+    SendGet(*socket, "/test?mode=poll&after=1:1&limit=2");
+    ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ("{\"entries\":[" + Entry(2, "two") + "],\"next\":\"2:0\"}\n", body);
+
+    // With nothing new, the poll times out with no entries, and the connection is closed if asked to.
+    SendGet(*socket, "/test?mode=poll&timeout_ms=50", "Connection: close\r\n");
+    ReadHTTPResponse(*socket, buffer, body);
+    EXPECT_EQ("{\"entries\":[],\"next\":\"2:0\"}\n", body);
+    EXPECT_EQ("", ReadUntilClosed(*socket));
+    EXPECT_EQ(0, framework.test_exporter.ActiveWatchers());
+}
+
+TEST(StreamWatchers, ServerSentEvents) {
+    InMemoryTestStorage storage;
+    WatchedFramework framework(storage, WatchedFrameworkParams());
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    framework.test_publisher.Push(SimpleEntry(2, "two"));
+
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    // A reconnecting event source: the events after its last one, up to the limit.
+    SendGet(*socket, "/test?limit=2", "Accept: text/event-stream\r\nLast-Event-ID: 1:0\r\n");
+    ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 1; }));
+    framework.test_publisher.Push(SimpleEntry(3, "three"));
+    const std::string response = ReadUntilClosed(*socket);
+    EXPECT_EQ(0, response.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, response.find("Content-Type: text/event-stream\r\n"));
+    EXPECT_EQ("id: 2:0\ndata: " + Entry(2, "two") + "\n\nid: 3:0\ndata: " + Entry(3, "three") + "\n\n",
+              response.substr(response.find("\r\n\r\n") + 4));
+    EXPECT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 0; }));
+}
+
+TEST(StreamWatchers, DisconnectedClientsAreForgotten) {
+    InMemoryTestStorage storage;
+    WatchedFramework framework(storage, WatchedFrameworkParams());
+
+    boost::asio::io_service io_service;
+    {
+        auto socket = ConnectToLocalhost(io_service, 8080);
+        SendGet(*socket, "/test?mode=sse");
+        auto another_socket = ConnectToLocalhost(io_service, 8080);
+        SendGet(*another_socket, "/test?mode=poll");
+        ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 2; }));
+    }
+    EXPECT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == 0; }));
+}
+
+TEST(StreamWatchers, ManyIdleWatchersTakeNoThreads) {
+    const size_t kWatchers = 500;
+    boost::asio::io_service io_service;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> sockets;
+    {
+        InMemoryTestStorage storage;
+        WatchedFramework framework(storage, WatchedFrameworkParams());
+        for (size_t i = 0; i < kWatchers; ++i) {
+            sockets.push_back(ConnectToLocalhost(io_service, 8080));
+            SendGet(*sockets.back(), i % 2 ? "/test?mode=sse" : "/test?mode=poll", "Connection: close\r\n");
+        }
+        ASSERT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == kWatchers; }));
+        EXPECT_EQ(0, framework.test_exporter.ActiveSessions());
+
+        // One entry completes every long poll.
+        framework.test_publisher.Push(SimpleEntry(1, "one"));
+        for (size_t i = 0; i < kWatchers; i += 2) {
+            const std::string response = ReadUntilClosed(*sockets[i]);
+            EXPECT_EQ("{\"entries\":[" + Entry(1, "one") + "],\"next\":\"1:0\"}\n",
+                      response.substr(response.find("\r\n\r\n") + 4));
+        }
+        for (size_t i = 1; i < kWatchers; i += 2) {
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(*sockets[i], buffer, "\n\n");
+            const std::string response(boost::asio::buffer_cast<const char*>(buffer.data()), buffer.size());
+            EXPECT_NE(std::string::npos, response.find("\r\n\r\nid: 1:0\ndata: " + Entry(1, "one") + "\n\n"));
+        }
+        EXPECT_TRUE(WaitUntil([&framework]() { return framework.test_exporter.ActiveWatchers() == kWatchers / 2; }));
+    }
+    // Tearing down the framework closes the remaining ones.
+    for (size_t i = 1; i < kWatchers; i += 2) {
+        EXPECT_EQ("", ReadUntilClosed(*sockets[i]));
+    }
+}
+
+TEST(StreamWatchers, MalformedParameters) {
+    InMemoryTestStorage storage;
+    WatchedFramework framework(storage, WatchedFrameworkParams());
+    for (const char* target : {"/test?mode=poll&after=x",
+                               "/test?mode=poll&limit=0",
+                               "/test?mode=poll&timeout_ms=-1",
+                               "/test?mode=sse&limit=many",
+                               "/test?mode=push"}) {
+        boost::asio::io_service io_service;
+        auto socket = ConnectToLocalhost(io_service, 8080);
+        SendGet(*socket, target);
+        EXPECT_EQ(0, ReadUntilClosed(*socket).find("HTTP/1.1 400 Bad Request\r\n")) << target;
+    }
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    SendGet(*socket, "/test", "Accept: text/event-stream\r\nLast-Event-ID: yesterday\r\n");
+    EXPECT_EQ(0, ReadUntilClosed(*socket).find("HTTP/1.1 400 Bad Request\r\n"));
+}
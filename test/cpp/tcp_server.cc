@@ -0,0 +1,221 @@
+// Tests for the TCP server, see tcp_server_singleton.h.
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tcp_server_singleton.h"
+
+#include "helpers/network.h"
+
+using ::TailProduce::TCPServer;
+using boost::asio::ip::tcp;
+
+// Replies "pong\n" to "ping\n", then keeps the connection open until the client closes it.
+struct PingPongHandler {
+    void HandleConnection(std::shared_ptr<TCPServer::Connection> connection) {
+        std::shared_ptr<std::array<char, 5>> buffer(new std::array<char, 5>());
+        boost::asio::async_read(connection->socket,
+                                boost::asio::buffer(*buffer),
+                                connection->strand.wrap([connection, buffer](const boost::system::error_code& ec,
+                                                                             size_t) {
+                                    if (!ec && std::string(buffer->data(), 5) == "ping\n") {
+                                        connection->AsyncWrite("pong\n");
+                                        WaitForClose(connection, buffer);
+                                    }
+                                }));
+    }
+    static void WaitForClose(std::shared_ptr<TCPServer::Connection> connection,
+                             std::shared_ptr<std::array<char, 5>> buffer) {
+        connection->socket.async_read_some(
+            boost::asio::buffer(*buffer),
+            connection->strand.wrap([connection, buffer](const boost::system::error_code& ec, size_t) {
+                if (!ec) {
+                    WaitForClose(connection, buffer);
+                }
+            }));
+    }
+};
+
+struct SyncHandler {
+    void HandleRequestSync(std::unique_ptr<tcp::socket>&& socket) {
+        boost::asio::write(*socket, boost::asio::buffer(std::string("sync\n")), boost::asio::transfer_all());
+    }
+};
+
+template <typename SOCKET> void Ping(SOCKET& socket) {
+    boost::asio::write(socket, boost::asio::buffer(std::string("ping\n")), boost::asio::transfer_all());
+}
+
+template <typename SOCKET> std::string ReadFive(SOCKET& socket) {
+    std::array<char, 5> buffer;
+    boost::asio::read(socket, boost::asio::buffer(buffer), boost::asio::transfer_all());
+    return std::string(buffer.data(), buffer.size());
+}
+
+template <typename PREDICATE> bool WaitFor(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(TCPServer, TenThousandConcurrentConnections) {
+    // Both ends of each connection live in this process, two file descriptors per connection.
+    size_t n = 10000;
+    struct rlimit limit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, 2 * n + 256);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &limit));
+    if (limit.rlim_cur < 2 * n + 256) {
+        n = (limit.rlim_cur - 256) / 2;
+        LOG(WARNING) << "Not enough file descriptors, testing with " << n << " connections.";
+    }
+
+    TCPServer::Options options;
+    options.threads = 4;
+    options.max_connections = n;
+    TCPServer::PerPortConnectionAccepter server(0, options);
+    PingPongHandler handler;
+    server.RegisterHandler(handler);
+
+    boost::asio::io_service io_service;
+    std::vector<std::unique_ptr<tcp::socket>> clients;
+    for (size_t i = 0; i < n; ++i) {
+        clients.push_back(ConnectToLocalhost(io_service, server.Port()));
+        Ping(*clients.back());
+    }
+    for (auto& client : clients) {
+        ASSERT_EQ("pong\n", ReadFive(*client));
+    }
+    EXPECT_EQ(n, server.OpenConnections());
+
+    clients.clear();
+    EXPECT_TRUE(WaitFor([&server]() { return server.OpenConnections() == 0; }));
+    server.UnregisterHandler();
+}
+
+TEST(TCPServer, StopsAcceptingAtConnectionLimit) {
+    TCPServer::Options options;
+    options.max_connections = 2;
+    TCPServer::PerPortConnectionAccepter server(0, options);
+    PingPongHandler handler;
+    server.RegisterHandler(handler);
+
+    boost::asio::io_service io_service;
+    auto a = ConnectToLocalhost(io_service, server.Port());
+    auto b = ConnectToLocalhost(io_service, server.Port());
+    Ping(*a);
+    Ping(*b);
+    EXPECT_EQ("pong\n", ReadFive(*a));
+    EXPECT_EQ("pong\n", ReadFive(*b));
+
+    // The third connection waits in the backlog.
+    auto c = ConnectToLocalhost(io_service, server.Port());
+    Ping(*c);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(0, c->available());
+    EXPECT_EQ(2, server.OpenConnections());
+
+    a.reset();
+    EXPECT_EQ("pong\n", ReadFive(*c));
+    EXPECT_EQ(2, server.OpenConnections());
+    server.UnregisterHandler();
+}
+
+TEST(TCPServer, GracefulShutdownClosesOpenConnections) {
+    TCPServer::Options options;
+    options.shutdown_grace = std::chrono::milliseconds(50);
+    TCPServer::PerPortConnectionAccepter server(0, options);
+    PingPongHandler handler;
+    server.RegisterHandler(handler);
+
+    const size_t port = server.Port();
+    boost::asio::io_service io_service;
+    auto client = ConnectToLocalhost(io_service, port);
+    Ping(*client);
+    EXPECT_EQ("pong\n", ReadFive(*client));
+    EXPECT_EQ(1, server.OpenConnections());
+
+    server.Stop();
+    EXPECT_EQ(0, server.OpenConnections());
+    EXPECT_EQ("", ReadUntilClosed(*client));
+    EXPECT_ANY_THROW(ConnectToLocalhost(io_service, port));
+}
+
+TEST(TCPServer, SyncHandlersAndNoHandler) {
+    TCPServer::PerPortConnectionAccepter server(0);
+    boost::asio::io_service io_service;
+    {
+        auto client = ConnectToLocalhost(io_service, server.Port());
+        EXPECT_EQ("500\n", ReadUntilClosed(*client));
+    }
+    SyncHandler handler;
+    server.RegisterHandler(handler);
+    {
+        auto client = ConnectToLocalhost(io_service, server.Port());
+        EXPECT_EQ("sync\n", ReadUntilClosed(*client));
+    }
+    EXPECT_TRUE(WaitFor([&server]() { return server.OpenConnections() == 0; }));
+    server.UnregisterHandler();
+}
+
+TEST(TCPServer, UnixDomainSockets) {
+    const std::string path = "/tmp/tailproduce-test-" + std::to_string(getpid()) + ".socket";
+    for (const std::string& name : {path, "@tailproduce-test-" + std::to_string(getpid())}) {
+        TCPServer::PerPortConnectionAccepter server(TCPServer::Endpoint::UnixSocket(name));
+        EXPECT_EQ(0, server.Port());
+        PingPongHandler handler;
+        server.RegisterHandler(handler);
+        boost::asio::io_service io_service;
+        auto client = ConnectToUnixSocket(io_service, name);
+        Ping(*client);
+        EXPECT_EQ("pong\n", ReadFive(*client));
+        EXPECT_EQ(1, server.OpenConnections());
+        client.reset();
+        EXPECT_TRUE(WaitFor([&server]() { return server.OpenConnections() == 0; }));
+        server.UnregisterHandler();
+        // The sync handlers are called with a TCP socket.
+        SyncHandler sync_handler;
+        ASSERT_THROW(server.RegisterHandler(sync_handler), ::TailProduce::TCPServerLogicErrorException);
+    }
+    // The socket file is removed once the server is stopped.
+    struct stat st;
+    EXPECT_NE(0, stat(path.c_str(), &st));
+}
+
+TEST(TCPServer, ReplacesAStaleUnixSocketFile) {
+    const std::string path = "/tmp/tailproduce-test-stale-" + std::to_string(getpid()) + ".socket";
+    boost::asio::io_service io_service;
+    {
+        // The socket file of a server gone without cleaning up.
+        boost::asio::local::stream_protocol::acceptor gone(io_service,
+                                                           boost::asio::local::stream_protocol::endpoint(path));
+    }
+    struct stat st;
+    ASSERT_EQ(0, stat(path.c_str(), &st));
+    TCPServer::PerPortConnectionAccepter server(TCPServer::Endpoint::UnixSocket(path));
+    PingPongHandler handler;
+    server.RegisterHandler(handler);
+    auto client = ConnectToUnixSocket(io_service, path);
+    Ping(*client);
+    EXPECT_EQ("pong\n", ReadFive(*client));
+    client.reset();
+    // Another live server on the same path is not.
+    ASSERT_THROW(TCPServer::PerPortConnectionAccepter(TCPServer::Endpoint::UnixSocket(path)), std::exception);
+    server.UnregisterHandler();
+}
@@ -0,0 +1,159 @@
+// Tests for the tracer policy of the framework, see tracing.h and ring_tracer.h.
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+#include "../../src/ring_tracer.h"
+
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::RingTracer;
+using ::TailProduce::StreamManagerParams;
+using ::TailProduce::TraceEvent;
+
+// Counts the calls by event.
+struct CountingTracer {
+    enum { kEvents = static_cast<int>(TraceEvent::DeserializeAndProcess) + 1 };
+    static std::atomic<size_t> begins[kEvents];
+    static std::atomic<size_t> ends[kEvents];
+    static void Begin(TraceEvent event) {
+        ++begins[static_cast<int>(event)];
+    }
+    static void End(TraceEvent event) {
+        ++ends[static_cast<int>(event)];
+    }
+    static size_t Begins(TraceEvent event) {
+        return begins[static_cast<int>(event)];
+    }
+    static size_t Ends(TraceEvent event) {
+        return ends[static_cast<int>(event)];
+    }
+};
+std::atomic<size_t> CountingTracer::begins[CountingTracer::kEvents];
+std::atomic<size_t> CountingTracer::ends[CountingTracer::kEvents];
+
+typedef ::TailProduce::StreamManager<InMemoryTestStorage, CountingTracer> CountingStreamManager;
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(CountingFramework, CountingStreamManager);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+typedef ::TailProduce::StreamManager<InMemoryTestStorage, RingTracer<1024>> RingStreamManager;
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(RingFramework, RingStreamManager);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+template <typename PREDICATE> static bool WaitUntil(PREDICATE predicate) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+struct Counter {
+    std::atomic<size_t> entries{0};
+    void operator()(const SimpleEntry&) {
+        ++entries;
+    }
+};
+
+TEST(Tracing, CalledOnTheHotPaths) {
+    InMemoryTestStorage storage;
+    CountingFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    std::vector<SimpleEntry> batch{SimpleEntry(2, "two"), SimpleEntry(3, "three")};
+    framework.test_publisher.PushMany(batch.begin(), batch.end());
+    EXPECT_EQ(2u, CountingTracer::Begins(TraceEvent::PublisherCommit));
+    EXPECT_EQ(3u, CountingTracer::Begins(TraceEvent::Serialize));
+    // The entry and the HEAD of Push(), and the batch of PushMany().
+    EXPECT_EQ(3u, CountingTracer::Begins(TraceEvent::StorageSet));
+
+    {
+        Counter counter;
+        auto listener = framework.new_scoped_test_listener(counter);
+        ASSERT_TRUE(WaitUntil([&counter]() { return counter.entries == 3; }));
+    }
+    EXPECT_EQ(3u, CountingTracer::Begins(TraceEvent::StorageGet));
+    EXPECT_EQ(3u, CountingTracer::Begins(TraceEvent::DeserializeAndProcess));
+    EXPECT_LE(1u, CountingTracer::Begins(TraceEvent::StorageSeek));
+    EXPECT_LE(1u, CountingTracer::Begins(TraceEvent::ListenerBatch));
+    for (int i = 0; i < CountingTracer::kEvents; ++i) {
+        EXPECT_EQ(CountingTracer::Begins(TraceEvent(i)), CountingTracer::Ends(TraceEvent(i)))
+            << ::TailProduce::TraceEventName(TraceEvent(i));
+    }
+}
+
+TEST(Tracing, RingTracerDumpsChromeTrace) {
+    InMemoryTestStorage storage;
+    RingFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    framework.test_publisher.Push(SimpleEntry(1, "one"));
+    // An AsyncListener would keep seeking while idle, so the entry is read synchronously, by another thread.
+    Counter counter;
+    std::thread([&framework, &counter]() {
+        RingFramework::test_type::INTERNAL_unsafe_listener_type listener(framework.test);
+        while (listener.HasData()) {
+            listener.ProcessEntrySync(counter);
+            listener.AdvanceToNextEntry();
+        }
+    }).join();
+    EXPECT_EQ(1u, counter.entries);
+
+    const std::string file_name = "/tmp/tailproduce-test-trace-" + std::to_string(getpid()) + ".json";
+    ASSERT_TRUE(RingTracer<1024>::Dump(file_name));
+    std::ifstream file(file_name);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    unlink(file_name.c_str());
+    const std::string trace = contents.str();
+    EXPECT_EQ(0u, trace.find("{\"traceEvents\": [\n{\"name\": ")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("{\"name\": \"PublisherCommit\", \"ph\": \"B\", \"ts\": ")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("{\"name\": \"PublisherCommit\", \"ph\": \"E\", \"ts\": ")) << trace;
+    EXPECT_NE(std::string::npos, trace.find("{\"name\": \"DeserializeAndProcess\", \"ph\": \"B\"")) << trace;
+    // The publisher and the listener are different threads.
+    EXPECT_NE(std::string::npos, trace.find("\"tid\": 2}")) << trace;
+    EXPECT_EQ("\n]}\n", trace.substr(trace.length() - 4));
+}
+
+TEST(Tracing, RingTracerKeepsTheLatestEvents) {
+    typedef RingTracer<4> T_TRACER;
+    std::thread([]() {
+        for (int i = 0; i < 5; ++i) {
+            T_TRACER::Begin(TraceEvent::StorageGet);
+            T_TRACER::End(TraceEvent::StorageGet);
+        }
+        T_TRACER::Begin(TraceEvent::StorageSet);
+        T_TRACER::End(TraceEvent::StorageSet);
+    }).join();
+    EXPECT_EQ(12u, T_TRACER::EventsRecorded());
+    EXPECT_EQ(
+        "{\"traceEvents\": [\n"
+        "{\"name\": \"StorageGet\", \"ph\": \"B\", \"ts\": X, \"pid\": 1, \"tid\": 1},\n"
+        "{\"name\": \"StorageGet\", \"ph\": \"E\", \"ts\": X, \"pid\": 1, \"tid\": 1},\n"
+        "{\"name\": \"StorageSet\", \"ph\": \"B\", \"ts\": X, \"pid\": 1, \"tid\": 1},\n"
+        "{\"name\": \"StorageSet\", \"ph\": \"E\", \"ts\": X, \"pid\": 1, \"tid\": 1}\n"
+        "]}\n",
+        [](std::string trace) {
+            // The timestamps differ from run to run.
+            for (size_t i = trace.find("\"ts\": "); i != std::string::npos; i = trace.find("\"ts\": ", i + 1)) {
+                const size_t end = trace.find(',', i);
+                trace.replace(i + 6, end - i - 6, "X");
+            }
+            return trace;
+        }(T_TRACER::FormatJSON()));
+}
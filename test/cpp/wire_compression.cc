@@ -0,0 +1,82 @@
+// Tests for the compression of the exported streams, see wire_compression.h.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "../../src/tailproduce.h"
+
+#include "helpers/network.h"
+#include "helpers/storages.h"
+#include "helpers/test_client.h"
+
+using ::TailProduce::HTTPRequest;
+using ::TailProduce::NegotiateWireCompression;
+using ::TailProduce::StreamManagerParams;
+using ::TailProduce::WireCompression;
+
+TAILPRODUCE_STATIC_FRAMEWORK_BEGIN(CompressingFramework, ::TailProduce::StreamManager<InMemoryTestStorage>);
+TAILPRODUCE_STREAM(test, SimpleEntry, uint32_t, uint32_t);
+TAILPRODUCE_PUBLISHER(test);
+TAILPRODUCE_EXPORT_STREAM(test);
+TAILPRODUCE_STATIC_FRAMEWORK_END();
+
+static WireCompression Negotiate(const std::string& accept_encoding) {
+    HTTPRequest request;
+    request.headers["accept-encoding"] = accept_encoding;
+    return NegotiateWireCompression(request);
+}
+
+TEST(WireCompression, Negotiation) {
+    EXPECT_TRUE(WireCompression::None == NegotiateWireCompression(HTTPRequest()));
+    EXPECT_TRUE(WireCompression::None == Negotiate("gzip, deflate"));
+    EXPECT_TRUE(WireCompression::Snappy == Negotiate("snappy"));
+    EXPECT_TRUE(WireCompression::Snappy == Negotiate("gzip, Snappy;q=0.5"));
+    EXPECT_TRUE(WireCompression::None == Negotiate("snappy;q=0, gzip"));
+    EXPECT_TRUE(WireCompression::None == Negotiate("x-snappy-framed"));
+}
+
+// Exports the stream with the headers given, returns the head of the response and sets `chunks`.
+static std::string Export(const std::string& headers, std::vector<std::string>& chunks) {
+    boost::asio::io_service io_service;
+    auto socket = ConnectToLocalhost(io_service, 8080);
+    const std::string request = "GET /test?follow=0 HTTP/1.1\r\n" + headers + "\r\n";
+    boost::asio::write(*socket, boost::asio::buffer(request), boost::asio::transfer_all());
+    ChunkedResponseReader reader(*socket);
+    std::string chunk;
+    while (reader.ReadChunk(chunk)) {
+        chunks.push_back(chunk);
+        chunk.clear();
+    }
+    return reader.head;
+}
+
+TEST(WireCompression, CompressesEachChunkOfTheExport) {
+    InMemoryTestStorage storage;
+    CompressingFramework framework(storage, StreamManagerParams().CreateStream("test", uint32_t(0), uint32_t(0)));
+    // Several chunks worth of entries.
+    for (uint32_t i = 1; i <= 5000; ++i) {
+        framework.test_publisher.Push(SimpleEntry(i, "entry number " + std::to_string(i)));
+    }
+
+    std::vector<std::string> plain;
+    std::string head = Export("", plain);
+    EXPECT_EQ(std::string::npos, head.find("Content-Encoding"));
+    ASSERT_LT(1u, plain.size());
+
+    std::vector<std::string> compressed;
+    head = Export("Accept-Encoding: gzip, snappy\r\n", compressed);
+    EXPECT_NE(std::string::npos, head.find("Content-Encoding: snappy\r\n"));
+    ASSERT_EQ(plain.size(), compressed.size());
+    size_t plain_bytes = 0;
+    size_t compressed_bytes = 0;
+    for (size_t i = 0; i < plain.size(); ++i) {
+        std::string uncompressed;
+        ASSERT_TRUE(::TailProduce::UncompressWireChunk(WireCompression::Snappy, compressed[i], uncompressed));
+        EXPECT_EQ(plain[i], uncompressed);
+        plain_bytes += plain[i].size();
+        compressed_bytes += compressed[i].size();
+    }
+    EXPECT_LT(compressed_bytes * 2, plain_bytes);
+}